@@ -0,0 +1,147 @@
+//
+//  AFCBORSerializationTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLRequestSerialization.h"
+#import "AFURLResponseSerialization.h"
+
+//十六进制字符串 -> NSData、测试向量取自RFC 8949 Appendix A
+static NSData * AFTestDataFromHexString(NSString *hexString) {
+    NSMutableData *data = [NSMutableData dataWithCapacity:hexString.length / 2];
+    for (NSUInteger idx = 0; idx + 1 < hexString.length; idx += 2) {
+        unsigned int byte = 0;
+        [[NSScanner scannerWithString:[hexString substringWithRange:NSMakeRange(idx, 2)]] scanHexInt:&byte];
+        uint8_t value = (uint8_t)byte;
+        [data appendBytes:&value length:1];
+    }
+
+    return data;
+}
+
+@interface AFCBORSerializationTests : XCTestCase
+@end
+
+@implementation AFCBORSerializationTests
+
+- (NSData *)encodedObject:(id)object {
+    NSError *error = nil;
+    NSURLRequest *request = [[AFCBORRequestSerializer serializer] requestWithMethod:@"POST" URLString:@"https://example.com/cbor" parameters:object error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Content-Type"], @"application/cbor");
+
+    return request.HTTPBody;
+}
+
+- (id)decodedObjectWithData:(NSData *)data zeroCopy:(BOOL)zeroCopy error:(NSError *__autoreleasing *)error {
+    AFCBORResponseSerializer *serializer = [AFCBORResponseSerializer serializer];
+    serializer.usesZeroCopyViews = zeroCopy;
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"https://example.com/cbor"] statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Content-Type": @"application/cbor"}];
+
+    return [serializer responseObjectForResponse:response data:data error:error];
+}
+
+- (void)testEncodingMatchesSpecificationVectors {
+    NSDictionary <NSString *, id> *vectors = @{
+        @"00": @0,
+        @"17": @23,
+        @"1818": @24,
+        @"1903e8": @1000,
+        @"1a000f4240": @1000000,
+        @"1b000000e8d4a51000": @1000000000000,
+        @"1bffffffffffffffff": @(ULLONG_MAX),
+        @"20": @(-1),
+        @"3903e7": @(-1000),
+        @"fb3ff199999999999a": @1.1,
+        @"fa47c35000": @100000.0,
+        @"fa7f7fffff": @3.4028234663852886e+38,
+        @"fb7e37e43c8800759c": @1.0e+300,
+        @"f4": @NO,
+        @"f5": @YES,
+        @"f6": [NSNull null],
+        @"4401020304": AFTestDataFromHexString(@"01020304"),
+        @"6449455446": @"IETF",
+        @"62c3bc": @"ü",
+        @"8301820203820405": @[@1, @[@2, @3], @[@4, @5]],
+        @"a10102": @{@1: @2},
+    };
+
+    [vectors enumerateKeysAndObjectsUsingBlock:^(NSString *hexString, id object, BOOL *stop) {
+        //包一层只有一个元素的数组、去掉数组头部0x81后就是元素本身的编码
+        NSData *encoded = [self encodedObject:@[object]];
+        XCTAssertEqualObjects([encoded subdataWithRange:NSMakeRange(1, encoded.length - 1)], AFTestDataFromHexString(hexString), @"%@", object);
+    }];
+}
+
+- (void)testDecodingSpecificationVectors {
+    NSDictionary <NSString *, id> *vectors = @{
+        @"f90000": @0.0,
+        @"f93c00": @1.0,
+        @"f97bff": @65504.0,
+        @"f9fc00": @(-INFINITY),
+        @"f7": [NSNull null],
+        @"5f42010243030405ff": AFTestDataFromHexString(@"0102030405"),
+        @"7f657374726561646d696e67ff": @"streaming",
+        @"9fff": @[],
+        @"bf61610161629f0203ffff": @{@"a": @1, @"b": @[@2, @3]},
+        @"c074323031332d30332d32315432303a30343a30305a": @"2013-03-21T20:04:00Z",
+        @"c11a514b67b0": [NSDate dateWithTimeIntervalSince1970:1363896240],
+        @"c1fb41d452d9ec200000": [NSDate dateWithTimeIntervalSince1970:1363896240.5],
+    };
+
+    [vectors enumerateKeysAndObjectsUsingBlock:^(NSString *hexString, id object, BOOL *stop) {
+        NSError *error = nil;
+        XCTAssertEqualObjects([self decodedObjectWithData:AFTestDataFromHexString(hexString) zeroCopy:NO error:&error], object, @"%@", hexString);
+        XCTAssertNil(error);
+    }];
+}
+
+- (void)testRoundTripPreservesFoundationObjects {
+    NSMutableString *longString = [NSMutableString string];
+    for (NSUInteger idx = 0; idx < 100; idx++) {
+        [longString appendString:@"中文 text "];
+    }
+
+    NSDictionary *object = @{
+        @"integers": @[@0, @23, @24, @255, @256, @65535, @65536, @(UINT32_MAX), @((unsigned long long)UINT32_MAX + 1), @(LLONG_MAX), @(ULLONG_MAX), @(-1), @(-24), @(-25), @(-256), @(-257), @(LLONG_MIN)],
+        @"floats": @[@0.5, @(-2.75), @0.1, @(DBL_MAX), @(FLT_MIN)],
+        @"booleans": @[@YES, @NO],
+        @"null": [NSNull null],
+        @"string": @"hello",
+        @"emptyString": @"",
+        @"longString": longString,
+        @"data": [longString dataUsingEncoding:NSUTF8StringEncoding],
+        @"date": [NSDate dateWithTimeIntervalSince1970:1500000000.25],
+        @"nested": @{@"array": @[@{@"deep": @[@[@[]]]}], @"map": @{}},
+    };
+
+    NSData *encoded = [self encodedObject:object];
+    for (NSNumber *zeroCopy in @[@NO, @YES]) {
+        NSError *error = nil;
+        id decoded = [self decodedObjectWithData:encoded zeroCopy:[zeroCopy boolValue] error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(decoded, object);
+
+        //布尔值需要还原成CFBoolean、而不是0/1
+        for (NSNumber *boolean in decoded[@"booleans"]) {
+            XCTAssertEqual(CFGetTypeID((__bridge CFTypeRef)boolean), CFBooleanGetTypeID());
+        }
+    }
+}
+
+- (void)testMalformedDataIsRejected {
+    NSData *encoded = [self encodedObject:@{@"key": @[@1, @2, @"three"]}];
+
+    NSError *error = nil;
+    XCTAssertNil([self decodedObjectWithData:[encoded subdataWithRange:NSMakeRange(0, encoded.length - 1)] zeroCopy:NO error:&error]);
+    XCTAssertNotNil(error);
+
+    NSMutableData *trailingData = [encoded mutableCopy];
+    [trailingData appendBytes:"\x00" length:1];
+    error = nil;
+    XCTAssertNil([self decodedObjectWithData:trailingData zeroCopy:NO error:&error]);
+    XCTAssertNotNil(error);
+}
+
+@end
@@ -0,0 +1,321 @@
+//
+//  AFChunkedUploadTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import <CommonCrypto/CommonDigest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFChunkedUploadTestHost = @"upload.test";
+
+static NSData * AFTestSHA256(NSData *data) {
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256([data bytes], (CC_LONG)[data length], digest);
+
+    return [NSData dataWithBytes:digest length:sizeof(digest)];
+}
+
+static NSString * AFTestHexString(NSData *data) {
+    const uint8_t *bytes = [data bytes];
+    NSMutableString *string = [NSMutableString stringWithCapacity:[data length] * 2];
+    for (NSUInteger idx = 0; idx < [data length]; idx++) {
+        [string appendFormat:@"%02x", bytes[idx]];
+    }
+
+    return string;
+}
+
+//按头文件中的分块协议实现的服务器、块按摘要保存、提交时按清单拼接
+@interface AFChunkedUploadTestServer : NSObject
+@property (nonatomic, strong) NSLock *lock;
+@property (nonatomic, strong) NSMutableDictionary <NSString *, NSData *> *chunksByDigest;
+@property (nonatomic, strong) NSMutableArray <NSNumber *> *receivedChunkIndexes;
+@property (nonatomic, strong) NSData *committedFile;
+@property (nonatomic, assign) NSUInteger queryCount;
+@property (nonatomic, assign) NSTimeInterval chunkDelay;
+@property (nonatomic, assign) NSInteger commitStatusCode;
+//第几个块请求(从1开始)不回应、直到客户端取消、到达时调用stallHandler
+@property (nonatomic, assign) NSUInteger stalledChunkNumber;
+@property (nonatomic, copy) dispatch_block_t stallHandler;
+@end
+
+@implementation AFChunkedUploadTestServer
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.lock = [[NSLock alloc] init];
+    self.chunksByDigest = [NSMutableDictionary dictionary];
+    self.receivedChunkIndexes = [NSMutableArray array];
+    self.commitStatusCode = 200;
+
+    return self;
+}
+
+- (void)respondTo:(AFTestURLProtocol *)connection statusCode:(NSInteger)statusCode JSONObject:(id)JSONObject {
+    NSData *data = [NSJSONSerialization dataWithJSONObject:JSONObject options:0 error:nil];
+    [connection respondWithStatusCode:statusCode headerFields:@{@"Content-Type": @"application/json"} data:data];
+}
+
+- (void)handleConnection:(AFTestURLProtocol *)connection {
+    NSURLRequest *request = connection.request;
+    NSData *body = connection.HTTPBody;
+
+    if ([request valueForHTTPHeaderField:@"Upload-Chunk-Query"]) {
+        NSArray *digests = [NSJSONSerialization JSONObjectWithData:body options:0 error:nil][@"sha256"];
+        NSMutableArray *missingDigests = [NSMutableArray array];
+        [self.lock lock];
+        self.queryCount++;
+        for (NSString *digest in digests) {
+            if (!self.chunksByDigest[digest]) {
+                [missingDigests addObject:digest];
+            }
+        }
+        [self.lock unlock];
+        [self respondTo:connection statusCode:200 JSONObject:@{@"missing": missingDigests}];
+        return;
+    }
+
+    if ([request valueForHTTPHeaderField:@"Upload-Complete"]) {
+        NSDictionary *commit = [NSJSONSerialization JSONObjectWithData:body options:0 error:nil];
+        NSMutableData *file = [NSMutableData data];
+        [self.lock lock];
+        for (NSDictionary *chunkInfo in commit[@"chunks"]) {
+            NSData *chunkData = self.chunksByDigest[chunkInfo[@"sha256"]];
+            if (!chunkData || [chunkInfo[@"offset"] unsignedIntegerValue] != [file length]) {
+                [self.lock unlock];
+                [self respondTo:connection statusCode:400 JSONObject:@{@"error": @"missing chunk"}];
+                return;
+            }
+            [file appendData:chunkData];
+        }
+        NSInteger statusCode = self.commitStatusCode;
+        if (statusCode == 200) {
+            self.committedFile = file;
+        }
+        [self.lock unlock];
+        [self respondTo:connection statusCode:statusCode JSONObject:@{@"length": @([file length])}];
+        return;
+    }
+
+    //摘要不对的块拒绝保存
+    NSString *digestHeader = [request valueForHTTPHeaderField:@"Digest"];
+    NSData *digest = AFTestSHA256(body ?: [NSData data]);
+    if (![digestHeader isEqualToString:[@"sha-256=" stringByAppendingString:[digest base64EncodedStringWithOptions:0]]]) {
+        [self respondTo:connection statusCode:400 JSONObject:@{@"error": @"digest mismatch"}];
+        return;
+    }
+
+    [self.lock lock];
+    [self.receivedChunkIndexes addObject:@([[request valueForHTTPHeaderField:@"Upload-Chunk-Index"] integerValue])];
+    BOOL stalls = [self.receivedChunkIndexes count] == self.stalledChunkNumber;
+    dispatch_block_t stallHandler = self.stallHandler;
+    [self.lock unlock];
+
+    if (stalls) {
+        if (stallHandler) {
+            stallHandler();
+        }
+        while (!connection.stopped) {
+            [NSThread sleepForTimeInterval:0.01];
+        }
+        return;
+    }
+    if (self.chunkDelay > 0) {
+        [NSThread sleepForTimeInterval:self.chunkDelay];
+    }
+
+    [self.lock lock];
+    self.chunksByDigest[AFTestHexString(digest)] = body;
+    [self.lock unlock];
+    [connection respondWithStatusCode:201 headerFields:@{@"Content-Length": @"0"} data:nil];
+}
+
+- (NSArray <NSNumber *> *)takeReceivedChunkIndexes {
+    [self.lock lock];
+    NSArray *indexes = [self.receivedChunkIndexes copy];
+    [self.receivedChunkIndexes removeAllObjects];
+    self.stalledChunkNumber = 0;
+    [self.lock unlock];
+
+    return indexes;
+}
+
+@end
+
+@interface AFChunkedUploadTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@property (nonatomic, strong) AFChunkedUploadTestServer *server;
+@property (nonatomic, strong) NSURL *fileURL;
+@property (nonatomic, strong) NSURL *manifestURL;
+@property (nonatomic, strong) NSData *file;
+@end
+
+@implementation AFChunkedUploadTests
+
+- (void)setUp {
+    [super setUp];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+
+    AFChunkedUploadTestServer *server = [[AFChunkedUploadTestServer alloc] init];
+    self.server = server;
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        [server handleConnection:connection];
+    } forHost:AFChunkedUploadTestHost];
+
+    //1MB、64KB一块共16块
+    NSMutableData *file = [NSMutableData dataWithLength:1024 * 1024];
+    uint8_t *bytes = [file mutableBytes];
+    for (NSUInteger idx = 0; idx < [file length]; idx++) {
+        bytes[idx] = (uint8_t)((idx * 2654435761u) >> 11);
+    }
+    self.file = file;
+    NSString *directory = NSTemporaryDirectory();
+    NSString *name = [[NSUUID UUID] UUIDString];
+    self.fileURL = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"bin"]]];
+    self.manifestURL = [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:[name stringByAppendingPathExtension:@"plist"]]];
+    [file writeToURL:self.fileURL atomically:YES];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFChunkedUploadTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [[NSFileManager defaultManager] removeItemAtURL:self.fileURL error:nil];
+    [[NSFileManager defaultManager] removeItemAtURL:self.manifestURL error:nil];
+    [super tearDown];
+}
+
+- (AFURLSessionChunkedUpload *)uploadWithDeduplication:(BOOL)deduplicatesChunks completionHandler:(void (^)(NSError *error))completionHandler {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/files/backup", AFChunkedUploadTestHost]]];
+    request.HTTPMethod = @"PUT";
+    AFURLSessionChunkedUpload *upload = [self.manager chunkedUploadTaskWithRequest:request fromFile:self.fileURL manifestURL:self.manifestURL progress:nil completionHandler:^(__unused NSURLResponse *response, __unused id responseObject, NSError *error) {
+        completionHandler(error);
+    }];
+    upload.chunkSize = 64 * 1024;
+    upload.deduplicatesChunks = deduplicatesChunks;
+
+    return upload;
+}
+
+- (NSError *)runUploadWithDeduplication:(BOOL)deduplicatesChunks {
+    __block NSError *uploadError = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"upload"];
+    [[self uploadWithDeduplication:deduplicatesChunks completionHandler:^(NSError *error) {
+        uploadError = error;
+        [expectation fulfill];
+    }] resume];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    return uploadError;
+}
+
+//清单在串行队列上异步写入、取消后稍等一下再继续
+- (void)waitForManifest {
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+}
+
+- (void)testResumeSendsOnlyChunksNotYetAcknowledged {
+    //一次只传一块、第5块卡住时取消、前4块已经被确认并写入清单
+    XCTestExpectation *stalledExpectation = [self expectationWithDescription:@"stalled"];
+    self.server.stalledChunkNumber = 5;
+    self.server.stallHandler = ^{
+        [stalledExpectation fulfill];
+    };
+    XCTestExpectation *cancelledExpectation = [self expectationWithDescription:@"cancelled"];
+    AFURLSessionChunkedUpload *upload = [self uploadWithDeduplication:NO completionHandler:^(NSError *error) {
+        XCTAssertEqual(error.code, NSURLErrorCancelled);
+        [cancelledExpectation fulfill];
+    }];
+    upload.maximumConcurrentChunkCount = 1;
+    [upload resume];
+    [self waitForExpectations:@[stalledExpectation] timeout:30];
+    [upload cancel];
+    [self waitForExpectations:@[cancelledExpectation] timeout:30];
+    [self waitForManifest];
+
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:self.manifestURL.path]);
+    XCTAssertEqualObjects([self.server takeReceivedChunkIndexes], (@[@0, @1, @2, @3, @4]));
+
+    //重新创建、从清单继续
+    XCTAssertNil([self runUploadWithDeduplication:NO]);
+    NSArray *resumedIndexes = [[self.server takeReceivedChunkIndexes] sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqualObjects(resumedIndexes, (@[@4, @5, @6, @7, @8, @9, @10, @11, @12, @13, @14, @15]));
+    XCTAssertEqualObjects(self.server.committedFile, self.file);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:self.manifestURL.path]);
+}
+
+- (void)testServerQueryReconcilesChunksTheServerAlreadyHas {
+    //服务器已经有前半部分文件的块
+    for (NSUInteger offset = 0; offset < [self.file length] / 2; offset += 64 * 1024) {
+        NSData *chunkData = [self.file subdataWithRange:NSMakeRange(offset, 64 * 1024)];
+        self.server.chunksByDigest[AFTestHexString(AFTestSHA256(chunkData))] = chunkData;
+    }
+
+    XCTAssertNil([self runUploadWithDeduplication:YES]);
+
+    NSArray *sentIndexes = [[self.server takeReceivedChunkIndexes] sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqualObjects(sentIndexes, (@[@8, @9, @10, @11, @12, @13, @14, @15]));
+    XCTAssertEqual(self.server.queryCount, (NSUInteger)1);
+    XCTAssertEqualObjects(self.server.committedFile, self.file);
+}
+
+- (void)testManifestFromDeduplicatedUploadIsRebuiltWithoutDeduplication {
+    //服务器已有所有块、去重的上传不发送任何块、提交失败时清单保留、所有块都标记为已上传
+    AFChunkedUploadTestServer *server = self.server;
+    for (NSUInteger offset = 0; offset < [self.file length]; offset += 64 * 1024) {
+        NSData *chunkData = [self.file subdataWithRange:NSMakeRange(offset, 64 * 1024)];
+        server.chunksByDigest[AFTestHexString(AFTestSHA256(chunkData))] = chunkData;
+    }
+    server.commitStatusCode = 500;
+    XCTAssertNotNil([self runUploadWithDeduplication:YES]);
+    XCTAssertEqual([[server takeReceivedChunkIndexes] count], (NSUInteger)0);
+    [self waitForManifest];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:self.manifestURL.path]);
+
+    //换到一个没有这些块的服务器、不去重的上传不能沿用清单中的标记
+    [server.chunksByDigest removeAllObjects];
+    server.commitStatusCode = 200;
+    XCTAssertNil([self runUploadWithDeduplication:NO]);
+    XCTAssertEqual([[server takeReceivedChunkIndexes] count], (NSUInteger)16);
+    XCTAssertEqualObjects(server.committedFile, self.file);
+}
+
+- (void)testUploadInterruptedAtRandomPointsCompletes {
+    self.server.chunkDelay = 0.005;
+    srand48(7);
+
+    //模拟进程在任意时刻被杀掉、已经确认的块之后不再需要发送
+    NSUInteger sentChunkCount = 0;
+    for (NSUInteger attempt = 0; attempt < 8; attempt++) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"interrupted"];
+        AFURLSessionChunkedUpload *upload = [self uploadWithDeduplication:NO completionHandler:^(__unused NSError *error) {
+            [expectation fulfill];
+        }];
+        [upload resume];
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(drand48() * 0.03 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            [upload cancel];
+        });
+        [self waitForExpectationsWithTimeout:30 handler:nil];
+        [self waitForManifest];
+        sentChunkCount += [[self.server takeReceivedChunkIndexes] count];
+        //偶尔在完成之前就已经全部传完
+        if (self.server.committedFile) {
+            break;
+        }
+    }
+
+    if (!self.server.committedFile) {
+        XCTAssertNil([self runUploadWithDeduplication:NO]);
+        sentChunkCount += [[self.server takeReceivedChunkIndexes] count];
+    }
+    XCTAssertEqualObjects(self.server.committedFile, self.file);
+    //每次中断最多重发正在进行中的块
+    XCTAssertLessThanOrEqual(sentChunkCount, (NSUInteger)16 + 8 * 4);
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  AFCompressingRequestSerializerTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLRequestSerialization.h"
+
+@interface AFTestUnknownRequestSerializer : NSObject <AFURLRequestSerialization>
+@end
+
+@implementation AFTestUnknownRequestSerializer
+
+- (NSURLRequest *)requestBySerializingRequest:(NSURLRequest *)request withParameters:(id)parameters error:(NSError *__autoreleasing *)error {
+    return request;
+}
+
++ (BOOL)supportsSecureCoding {
+    return YES;
+}
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    return [self init];
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+}
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    return [[[self class] allocWithZone:zone] init];
+}
+
+@end
+
+@interface AFCompressingRequestSerializerTests : XCTestCase
+@end
+
+@implementation AFCompressingRequestSerializerTests
+
+- (NSData *)bodyOfStream:(NSInputStream *)stream {
+    NSMutableData *body = [NSMutableData data];
+    uint8_t buffer[1024];
+    [stream open];
+    //最多读这么多次、避免压缩数据流不结束时卡住
+    for (NSUInteger idx = 0; idx < 100000 && [stream streamStatus] == NSStreamStatusOpen; idx++) {
+        NSInteger numberOfBytesRead = [stream read:buffer maxLength:sizeof(buffer)];
+        if (numberOfBytesRead < 0) {
+            break;
+        }
+        [body appendBytes:buffer length:(NSUInteger)numberOfBytesRead];
+    }
+    XCTAssertEqual([stream streamStatus], NSStreamStatusAtEnd);
+    [stream close];
+
+    return body;
+}
+
+- (void)testMultipartBodyStreamIsCompressedUntilEnd {
+    AFCompressingRequestSerializer *serializer = [AFCompressingRequestSerializer serializerWithRequestSerializer:[AFHTTPRequestSerializer serializer]];
+    NSMutableData *fileData = [NSMutableData dataWithLength:64 * 1024];
+    NSURLRequest *request = [serializer multipartFormRequestWithMethod:@"POST" URLString:@"https://example.com/upload" parameters:@{@"name": @"value"} constructingBodyWithBlock:^(id <AFMultipartFormData> formData) {
+        [formData appendPartWithFileData:fileData name:@"file" fileName:@"zeros.bin" mimeType:@"application/octet-stream"];
+    } error:nil];
+
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Content-Encoding"], @"gzip");
+    XCTAssertNil([request valueForHTTPHeaderField:@"Content-Length"]);
+
+    NSData *body = [self bodyOfStream:request.HTTPBodyStream];
+    XCTAssertGreaterThan(body.length, (NSUInteger)2);
+    XCTAssertLessThan(body.length, fileData.length);
+    const uint8_t *bytes = body.bytes;
+    XCTAssertEqual(bytes[0], 0x1f);
+    XCTAssertEqual(bytes[1], 0x8b);
+}
+
+- (void)testSecureCodingRestoresWrappedSerializer {
+    if (@available(iOS 11.0, *)) {
+        AFCompressingRequestSerializer *serializer = [AFCompressingRequestSerializer serializerWithRequestSerializer:[AFJSONRequestSerializer serializer]];
+        serializer.compressionLevel = 9;
+
+        NSData *archive = [NSKeyedArchiver archivedDataWithRootObject:serializer requiringSecureCoding:YES error:nil];
+        AFCompressingRequestSerializer *decodedSerializer = [NSKeyedUnarchiver unarchivedObjectOfClass:[AFCompressingRequestSerializer class] fromData:archive error:nil];
+
+        XCTAssertTrue([decodedSerializer.requestSerializer isKindOfClass:[AFJSONRequestSerializer class]]);
+        XCTAssertEqual(decodedSerializer.compressionLevel, 9);
+    }
+}
+
+- (void)testSecureCodingRejectsUnknownSerializerClasses {
+    if (@available(iOS 11.0, *)) {
+        AFCompressingRequestSerializer *serializer = [AFCompressingRequestSerializer serializerWithRequestSerializer:[[AFTestUnknownRequestSerializer alloc] init]];
+
+        NSData *archive = [NSKeyedArchiver archivedDataWithRootObject:serializer requiringSecureCoding:YES error:nil];
+        NSError *error = nil;
+        AFCompressingRequestSerializer *decodedSerializer = [NSKeyedUnarchiver unarchivedObjectOfClass:[AFCompressingRequestSerializer class] fromData:archive error:&error];
+
+        XCTAssertFalse([decodedSerializer.requestSerializer isKindOfClass:[AFTestUnknownRequestSerializer class]]);
+    }
+}
+
+@end
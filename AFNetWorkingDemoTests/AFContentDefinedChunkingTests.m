@@ -0,0 +1,158 @@
+//
+//  AFContentDefinedChunkingTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import <CommonCrypto/CommonDigest.h>
+#import "AFURLSessionManager.h"
+
+@interface AFURLSessionChunkedUpload (Testing)
+- (void)setFileData:(NSData *)fileData;
+- (NSArray *)chunksByReadingFile;
+@end
+
+@interface AFContentDefinedChunkingTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@end
+
+@implementation AFContentDefinedChunkingTests
+
+- (void)setUp {
+    [super setUp];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[NSURLSessionConfiguration ephemeralSessionConfiguration]];
+}
+
+- (void)tearDown {
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+//固定种子的xorshift、每次运行内容相同
+- (NSMutableData *)randomDataWithLength:(NSUInteger)length {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = [data mutableBytes];
+    uint64_t state = 0x5DEECE66DULL;
+    for (NSUInteger idx = 0; idx < length; idx++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        bytes[idx] = (uint8_t)(state >> 56);
+    }
+
+    return data;
+}
+
+- (NSArray *)chunksOfData:(NSData *)data chunking:(AFURLSessionUploadChunking)chunking chunkSize:(NSUInteger)chunkSize {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/upload"]];
+    request.HTTPMethod = @"PUT";
+    AFURLSessionChunkedUpload *upload = [self.manager chunkedUploadTaskWithRequest:request fromFile:[NSURL fileURLWithPath:@"/dev/null"] manifestURL:[NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]] progress:nil completionHandler:nil];
+    upload.chunking = chunking;
+    upload.chunkSize = chunkSize;
+    [upload setFileData:data];
+
+    return [upload chunksByReadingFile];
+}
+
+//每块的结束位置
+- (NSArray <NSNumber *> *)chunkEndsOfData:(NSData *)data chunkSize:(NSUInteger)chunkSize {
+    NSMutableArray *ends = [NSMutableArray array];
+    for (id chunk in [self chunksOfData:data chunking:AFURLSessionUploadChunkingContentDefined chunkSize:chunkSize]) {
+        [ends addObject:@([[chunk valueForKey:@"offset"] longLongValue] + [[chunk valueForKey:@"length"] longLongValue])];
+    }
+
+    return ends;
+}
+
+- (void)testContentDefinedChunksCoverDataWithinLengthBounds {
+    NSUInteger chunkSize = 8192;
+    NSData *data = [self randomDataWithLength:2 * 1024 * 1024];
+    NSArray *chunks = [self chunksOfData:data chunking:AFURLSessionUploadChunkingContentDefined chunkSize:chunkSize];
+
+    XCTAssertGreaterThan([chunks count], (NSUInteger)100);
+    int64_t offset = 0;
+    for (NSUInteger idx = 0; idx < [chunks count]; idx++) {
+        id chunk = chunks[idx];
+        int64_t length = [[chunk valueForKey:@"length"] longLongValue];
+        XCTAssertEqual([[chunk valueForKey:@"offset"] longLongValue], offset);
+        XCTAssertLessThanOrEqual(length, (int64_t)chunkSize * 8);
+        if (idx + 1 < [chunks count]) {
+            XCTAssertGreaterThan(length, (int64_t)chunkSize / 4);
+        }
+
+        uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+        CC_SHA256((const uint8_t *)[data bytes] + offset, (CC_LONG)length, digest);
+        XCTAssertEqualObjects([chunk valueForKey:@"digest"], [NSData dataWithBytes:digest length:sizeof(digest)]);
+        offset += length;
+    }
+    XCTAssertEqual(offset, (int64_t)[data length]);
+
+    //同样的内容在不同设备、不同次运行中切出同样的块
+    XCTAssertEqualObjects([self chunkEndsOfData:data chunkSize:chunkSize], [self chunkEndsOfData:data chunkSize:chunkSize]);
+}
+
+- (void)testContentDefinedBoundariesResynchronizeAfterInsertion {
+    NSUInteger chunkSize = 8192;
+    NSMutableData *data = [self randomDataWithLength:2 * 1024 * 1024];
+    NSArray <NSNumber *> *ends = [self chunkEndsOfData:data chunkSize:chunkSize];
+
+    NSUInteger insertionOffset = [data length] / 2;
+    uint8_t insertedByte = 0xA5;
+    [data replaceBytesInRange:NSMakeRange(insertionOffset, 0) withBytes:&insertedByte length:1];
+    NSSet <NSNumber *> *insertedEnds = [NSSet setWithArray:[self chunkEndsOfData:data chunkSize:chunkSize]];
+
+    //插入位置之前的边界不变、最大块长度之后的边界整体后移一个字节
+    NSUInteger boundaryCountAfterInsertion = 0;
+    NSUInteger shiftedBoundaryCount = 0;
+    for (NSNumber *end in ends) {
+        long long value = [end longLongValue];
+        if (value <= (long long)insertionOffset) {
+            XCTAssertTrue([insertedEnds containsObject:end], @"boundary %lld moved", value);
+        } else if (value > (long long)(insertionOffset + chunkSize * 8)) {
+            boundaryCountAfterInsertion++;
+            if ([insertedEnds containsObject:@(value + 1)]) {
+                shiftedBoundaryCount++;
+            }
+        }
+    }
+    XCTAssertGreaterThan(boundaryCountAfterInsertion, (NSUInteger)50);
+    XCTAssertGreaterThanOrEqual(shiftedBoundaryCount * 10, boundaryCountAfterInsertion * 9);
+}
+
+- (void)testRepeatedContentProducesRepeatedDigests {
+    NSUInteger chunkSize = 8192;
+    NSMutableData *data = [self randomDataWithLength:1024 * 1024];
+    [data appendData:[data copy]];
+    NSArray *chunks = [self chunksOfData:data chunking:AFURLSessionUploadChunkingContentDefined chunkSize:chunkSize];
+
+    NSMutableSet *firstHalfDigests = [NSMutableSet set];
+    NSUInteger secondHalfChunkCount = 0;
+    NSUInteger repeatedChunkCount = 0;
+    for (id chunk in chunks) {
+        int64_t offset = [[chunk valueForKey:@"offset"] longLongValue];
+        int64_t length = [[chunk valueForKey:@"length"] longLongValue];
+        if (offset + length <= (int64_t)[data length] / 2) {
+            [firstHalfDigests addObject:[chunk valueForKey:@"digest"]];
+        } else if (offset >= (int64_t)[data length] / 2) {
+            secondHalfChunkCount++;
+            if ([firstHalfDigests containsObject:[chunk valueForKey:@"digest"]]) {
+                repeatedChunkCount++;
+            }
+        }
+    }
+    XCTAssertGreaterThan(secondHalfChunkCount, (NSUInteger)50);
+    XCTAssertGreaterThanOrEqual(repeatedChunkCount * 10, secondHalfChunkCount * 9);
+}
+
+- (void)testFixedSizeChunks {
+    NSData *data = [self randomDataWithLength:100000];
+    NSArray *chunks = [self chunksOfData:data chunking:AFURLSessionUploadChunkingFixedSize chunkSize:4096];
+
+    XCTAssertEqual([chunks count], (NSUInteger)25);
+    for (NSUInteger idx = 0; idx < [chunks count]; idx++) {
+        XCTAssertEqual([[chunks[idx] valueForKey:@"offset"] longLongValue], (long long)idx * 4096);
+        XCTAssertEqual([[chunks[idx] valueForKey:@"length"] longLongValue], idx + 1 < [chunks count] ? 4096 : 100000 - 24 * 4096);
+    }
+}
+
+@end
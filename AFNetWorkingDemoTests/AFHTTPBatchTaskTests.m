@@ -0,0 +1,204 @@
+//
+//  AFHTTPBatchTaskTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFHTTPSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFBatchTestHost = @"batch.test";
+
+@interface AFHTTPBatchTaskTests : XCTestCase
+@property (nonatomic, strong) AFHTTPSessionManager *manager;
+@property (nonatomic, strong) NSLock *lock;
+@property (nonatomic, assign) NSUInteger inFlightCount;
+@property (nonatomic, assign) NSUInteger maximumInFlightCount;
+@property (atomic, assign) BOOL stallsRequests;
+@property (atomic, copy) NSTimeInterval (^delayForIndex)(NSUInteger index);
+@end
+
+@implementation AFHTTPBatchTaskTests
+
+- (void)setUp {
+    [super setUp];
+    self.lock = [[NSLock alloc] init];
+    self.manager = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/", AFBatchTestHost]] sessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.delayForIndex = ^NSTimeInterval(__unused NSUInteger index) {
+        return 0.02;
+    };
+
+    //路径的最后一段是请求的序号、服务器记录同时处理的请求数
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        NSUInteger index = (NSUInteger)[[connection.request.URL lastPathComponent] integerValue];
+        [self.lock lock];
+        self.inFlightCount++;
+        self.maximumInFlightCount = MAX(self.maximumInFlightCount, self.inFlightCount);
+        [self.lock unlock];
+
+        if (self.stallsRequests) {
+            for (NSUInteger idx = 0; idx < 500 && !connection.stopped; idx++) {
+                [NSThread sleepForTimeInterval:0.01];
+            }
+        } else {
+            [NSThread sleepForTimeInterval:self.delayForIndex(index)];
+        }
+
+        [self.lock lock];
+        self.inFlightCount--;
+        [self.lock unlock];
+        NSData *data = [NSJSONSerialization dataWithJSONObject:@{@"index": @(index)} options:0 error:nil];
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/json"} data:data];
+    } forHost:AFBatchTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFBatchTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+- (NSArray <AFHTTPBatchRequest *> *)requestsWithCount:(NSUInteger)count {
+    NSMutableArray *requests = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger idx = 0; idx < count; idx++) {
+        [requests addObject:[AFHTTPBatchRequest requestWithMethod:@"GET" URLString:[NSString stringWithFormat:@"items/%lu", (unsigned long)idx] parameters:nil]];
+    }
+
+    return requests;
+}
+
+- (NSArray <AFHTTPBatchResult *> *)resultsOfBatchWithRequestCount:(NSUInteger)count
+                                    maximumConcurrentRequestCount:(NSUInteger)maximumConcurrentRequestCount
+                                                      resultOrder:(AFHTTPBatchResultOrder)resultOrder
+{
+    __block NSArray *batchResults = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"batch"];
+    [self.manager batchTaskWithRequests:[self requestsWithCount:count] maximumConcurrentRequestCount:maximumConcurrentRequestCount resultOrder:resultOrder queue:nil chunkSize:0 resultsHandler:nil completionHandler:^(NSArray <AFHTTPBatchResult *> *results) {
+        batchResults = results;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    return batchResults;
+}
+
+- (void)testWindowLimitsRequestsInFlight {
+    NSArray <AFHTTPBatchResult *> *results = [self resultsOfBatchWithRequestCount:20 maximumConcurrentRequestCount:3 resultOrder:AFHTTPBatchResultOrderSubmission];
+
+    XCTAssertEqual([results count], (NSUInteger)20);
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFBatchTestHost] count], (NSUInteger)20);
+    [self.lock lock];
+    XCTAssertEqual(self.maximumInFlightCount, (NSUInteger)3);
+    [self.lock unlock];
+    for (AFHTTPBatchResult *result in results) {
+        XCTAssertNil(result.error);
+        XCTAssertEqualObjects(result.responseObject[@"index"], @(result.index));
+    }
+}
+
+- (void)testResultsAreDeliveredInSubmissionOrderInChunks {
+    //后提交的请求先完成
+    self.delayForIndex = ^NSTimeInterval(NSUInteger index) {
+        return 0.01 * (12 - index);
+    };
+
+    NSMutableArray *chunkCounts = [NSMutableArray array];
+    NSMutableArray *indexes = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"batch"];
+    AFHTTPBatchTask *batchTask = [self.manager batchTaskWithRequests:[self requestsWithCount:12] maximumConcurrentRequestCount:12 resultOrder:AFHTTPBatchResultOrderSubmission queue:nil chunkSize:4 resultsHandler:^(NSArray <AFHTTPBatchResult *> *results) {
+        XCTAssertTrue([NSThread isMainThread]);
+        [chunkCounts addObject:@([results count])];
+        [indexes addObjectsFromArray:[results valueForKey:@"index"]];
+    } completionHandler:^(NSArray <AFHTTPBatchResult *> *results) {
+        //已经分批交付、不再保留
+        XCTAssertNil(results);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    XCTAssertEqualObjects(chunkCounts, (@[@4, @4, @4]));
+    XCTAssertEqualObjects(indexes, (@[@0, @1, @2, @3, @4, @5, @6, @7, @8, @9, @10, @11]));
+    XCTAssertEqual(batchTask.completedRequestCount, (NSUInteger)12);
+}
+
+- (void)testResultsAreDeliveredInCompletionOrder {
+    self.delayForIndex = ^NSTimeInterval(NSUInteger index) {
+        return 0.02 * (8 - index);
+    };
+
+    NSArray <AFHTTPBatchResult *> *results = [self resultsOfBatchWithRequestCount:8 maximumConcurrentRequestCount:8 resultOrder:AFHTTPBatchResultOrderCompletion];
+    NSArray *indexes = [results valueForKey:@"index"];
+
+    XCTAssertEqual([indexes count], (NSUInteger)8);
+    XCTAssertEqualObjects([NSSet setWithArray:indexes], ([NSSet setWithArray:@[@0, @1, @2, @3, @4, @5, @6, @7]]));
+    //延迟最短的最后一个请求先完成
+    XCTAssertEqualObjects([indexes firstObject], @7);
+    XCTAssertEqualObjects([indexes lastObject], @0);
+}
+
+- (void)testCancelEndsRunningAndPendingRequests {
+    self.stallsRequests = YES;
+
+    __block NSArray <AFHTTPBatchResult *> *batchResults = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"batch"];
+    AFHTTPBatchTask *batchTask = [self.manager batchTaskWithRequests:[self requestsWithCount:10] maximumConcurrentRequestCount:2 resultOrder:AFHTTPBatchResultOrderSubmission queue:nil chunkSize:0 resultsHandler:nil completionHandler:^(NSArray <AFHTTPBatchResult *> *results) {
+        batchResults = results;
+        [expectation fulfill];
+    }];
+
+    //等两个请求到达服务器后取消
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ([[AFTestURLProtocol requestsForHost:AFBatchTestHost] count] < 2 && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    [batchTask cancel];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqual([batchResults count], (NSUInteger)10);
+    for (AFHTTPBatchResult *result in batchResults) {
+        XCTAssertEqual(result.error.code, NSURLErrorCancelled);
+    }
+    XCTAssertEqual(batchTask.completedRequestCount, (NSUInteger)10);
+    //取消后没有再发出新的请求
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFBatchTestHost] count], (NSUInteger)2);
+    XCTAssertEqual([AFTestURLProtocol stoppedRequestCountForHost:AFBatchTestHost], (NSUInteger)2);
+}
+
+- (void)testBatchTasksAreLimitedByConcurrencyLimiter {
+    AFURLSessionConcurrencyLimiter *limiter = [[AFURLSessionConcurrencyLimiter alloc] init];
+    limiter.initialLimit = 1;
+    limiter.minimumLimit = 1;
+    limiter.maximumLimit = 1;
+    self.manager.concurrencyLimiter = limiter;
+
+    NSArray <AFHTTPBatchResult *> *results = [self resultsOfBatchWithRequestCount:6 maximumConcurrentRequestCount:4 resultOrder:AFHTTPBatchResultOrderSubmission];
+
+    XCTAssertEqual([results count], (NSUInteger)6);
+    [self.lock lock];
+    XCTAssertEqual(self.maximumInFlightCount, (NSUInteger)1);
+    [self.lock unlock];
+}
+
+- (void)testBatchTasksAreTimed {
+    AFURLSessionTaskTimingRecorder *recorder = [[AFURLSessionTaskTimingRecorder alloc] init];
+    self.manager.taskTimingRecorder = recorder;
+
+    [self resultsOfBatchWithRequestCount:5 maximumConcurrentRequestCount:2 resultOrder:AFHTTPBatchResultOrderSubmission];
+
+    //任务的记录在回调执行完后写入
+    __block NSUInteger recordCount = 0;
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:2];
+    while (recordCount < 5 && [deadline timeIntervalSinceNow] > 0) {
+        [recorder drainRecordsUsingBlock:^(const AFURLSessionTaskTimingRecord *record) {
+            XCTAssertNotEqual(record->taskIdentifier, (NSUInteger)0);
+            XCTAssertEqual(record->statusCode, 200);
+            XCTAssertNotEqual(record->timestamps[AFURLSessionTaskTimingPhaseRequestSerializationStart], (uint64_t)0);
+            XCTAssertNotEqual(record->timestamps[AFURLSessionTaskTimingPhaseSerializerEnd], (uint64_t)0);
+            recordCount++;
+        }];
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertEqual(recordCount, (NSUInteger)5);
+}
+
+@end
@@ -0,0 +1,152 @@
+//
+//  AFHTTPRequestCoalescingTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFHTTPSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFCoalescingTestHost = @"coalescing.test";
+
+@interface AFHTTPRequestCoalescingTests : XCTestCase
+@property (nonatomic, strong) AFHTTPSessionManager *manager;
+@end
+
+@implementation AFHTTPRequestCoalescingTests
+
+- (void)setUp {
+    [super setUp];
+    self.manager = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/", AFCoalescingTestHost]] sessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.manager.coalescesIdempotentRequests = YES;
+
+    //延迟返回、保证之后的请求发出时第一个还在进行中、响应体分段发送以便观察进度
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        NSMutableArray *items = [NSMutableArray array];
+        for (NSUInteger idx = 0; idx < 2000; idx++) {
+            [items addObject:@(idx)];
+        }
+        NSString *language = [connection.request valueForHTTPHeaderField:@"Accept-Language"] ?: @"";
+        NSData *data = [NSJSONSerialization dataWithJSONObject:@{@"language": language, @"items": items} options:0 error:nil];
+        [NSThread sleepForTimeInterval:0.2];
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/json", @"Content-Length": [NSString stringWithFormat:@"%lu", (unsigned long)[data length]]}];
+        [connection sendData:data chunkLength:1024 interval:0.001];
+        [connection finish];
+    } forHost:AFCoalescingTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFCoalescingTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+- (void)testConcurrentIdenticalRequestsShareOneTask {
+    NSMutableSet *tasks = [NSMutableSet set];
+    NSMutableArray *responseObjects = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"GET"];
+    expectation.expectedFulfillmentCount = 5;
+    for (NSUInteger idx = 0; idx < 5; idx++) {
+        NSURLSessionDataTask *task = [self.manager GET:@"items" parameters:nil receiptID:[NSUUID UUID] progress:nil success:^(__unused NSURLSessionDataTask *task, id responseObject) {
+            [responseObjects addObject:responseObject];
+            [expectation fulfill];
+        } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+            XCTFail(@"%@", error);
+            [expectation fulfill];
+        }];
+        [tasks addObject:task];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqual([tasks count], (NSUInteger)1);
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFCoalescingTestHost] count], (NSUInteger)1);
+    //每个调用方拿到各自的对象
+    XCTAssertEqual([responseObjects count], (NSUInteger)5);
+    for (NSUInteger idx = 1; idx < [responseObjects count]; idx++) {
+        XCTAssertEqualObjects(responseObjects[idx], responseObjects[0]);
+        XCTAssertNotEqual(responseObjects[idx], responseObjects[0]);
+    }
+}
+
+- (void)testDifferentCoalescingHeadersUseSeparateTasks {
+    NSMutableSet *tasks = [NSMutableSet set];
+    NSMutableDictionary *languages = [NSMutableDictionary dictionary];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"GET"];
+    expectation.expectedFulfillmentCount = 2;
+    for (NSString *language in @[@"en", @"fr"]) {
+        [self.manager.requestSerializer setValue:language forHTTPHeaderField:@"Accept-Language"];
+        NSURLSessionDataTask *task = [self.manager GET:@"items" parameters:nil receiptID:[NSUUID UUID] progress:nil success:^(__unused NSURLSessionDataTask *task, id responseObject) {
+            languages[language] = responseObject[@"language"];
+            [expectation fulfill];
+        } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+            XCTFail(@"%@", error);
+            [expectation fulfill];
+        }];
+        [tasks addObject:task];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqual([tasks count], (NSUInteger)2);
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFCoalescingTestHost] count], (NSUInteger)2);
+    XCTAssertEqualObjects(languages, (@{@"en": @"en", @"fr": @"fr"}));
+}
+
+- (void)testCancelledWaiterLeavesOthersIntact {
+    NSUUID *cancelledReceiptID = [NSUUID UUID];
+    __block NSUInteger successCount = 0;
+    __block NSError *cancellationError = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"GET"];
+    expectation.expectedFulfillmentCount = 3;
+    NSURLSessionDataTask *task = nil;
+    for (NSUUID *receiptID in @[[NSUUID UUID], cancelledReceiptID, [NSUUID UUID]]) {
+        task = [self.manager GET:@"items" parameters:nil receiptID:receiptID progress:nil success:^(__unused NSURLSessionDataTask *task, id responseObject) {
+            XCTAssertNotEqual(receiptID, cancelledReceiptID);
+            XCTAssertEqual([responseObject[@"items"] count], (NSUInteger)2000);
+            successCount++;
+            [expectation fulfill];
+        } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+            XCTAssertEqual(receiptID, cancelledReceiptID);
+            cancellationError = error;
+            [expectation fulfill];
+        }];
+    }
+    [self.manager cancelCoalescedTask:task receiptID:cancelledReceiptID];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqual(successCount, (NSUInteger)2);
+    XCTAssertEqual(cancellationError.code, NSURLErrorCancelled);
+    XCTAssertEqual([AFTestURLProtocol stoppedRequestCountForHost:AFCoalescingTestHost], (NSUInteger)0);
+}
+
+- (void)testProgressIsDeliveredToEveryWaiter {
+    __block NSUInteger firstProgressCount = 0;
+    __block NSUInteger secondProgressCount = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"GET"];
+    expectation.expectedFulfillmentCount = 2;
+    void (^failure)(NSURLSessionDataTask *, NSError *) = ^(__unused NSURLSessionDataTask *task, NSError *error) {
+        XCTFail(@"%@", error);
+        [expectation fulfill];
+    };
+    [self.manager GET:@"items" parameters:nil receiptID:[NSUUID UUID] progress:^(__unused NSProgress *downloadProgress) {
+        @synchronized (self) {
+            firstProgressCount++;
+        }
+    } success:^(__unused NSURLSessionDataTask *task, __unused id responseObject) {
+        [expectation fulfill];
+    } failure:failure];
+    [self.manager GET:@"items" parameters:nil receiptID:[NSUUID UUID] progress:^(__unused NSProgress *downloadProgress) {
+        @synchronized (self) {
+            secondProgressCount++;
+        }
+    } success:^(__unused NSURLSessionDataTask *task, __unused id responseObject) {
+        [expectation fulfill];
+    } failure:failure];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    @synchronized (self) {
+        XCTAssertGreaterThan(firstProgressCount, (NSUInteger)0);
+        XCTAssertEqual(secondProgressCount, firstProgressCount);
+    }
+}
+
+@end
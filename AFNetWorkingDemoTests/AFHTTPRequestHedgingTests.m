@@ -0,0 +1,128 @@
+//
+//  AFHTTPRequestHedgingTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFHTTPSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFHedgingTestHost = @"hedge.test";
+
+@interface AFHTTPRequestHedgingTests : XCTestCase
+@property (nonatomic, strong) AFHTTPSessionManager *manager;
+@property (nonatomic, strong) AFHTTPRequestHedgingPolicy *hedgingPolicy;
+@property (nonatomic, strong) NSLock *lock;
+@property (nonatomic, assign) BOOL stallsFirstRequest;
+@property (nonatomic, assign) NSUInteger requestCount;
+@end
+
+@implementation AFHTTPRequestHedgingTests
+
+- (void)setUp {
+    [super setUp];
+    self.lock = [[NSLock alloc] init];
+    self.hedgingPolicy = [[AFHTTPRequestHedgingPolicy alloc] init];
+    self.manager = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/", AFHedgingTestHost]] sessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.manager.hedgingPolicy = self.hedgingPolicy;
+
+    //平时20毫秒返回、stallsFirstRequest时第一个请求卡住直到被取消(最多1秒)、之后的请求立即返回
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        [self.lock lock];
+        BOOL stalls = self.stallsFirstRequest && self.requestCount == 0;
+        NSUInteger index = self.requestCount++;
+        [self.lock unlock];
+
+        if (stalls) {
+            for (NSUInteger idx = 0; idx < 100 && !connection.stopped; idx++) {
+                [NSThread sleepForTimeInterval:0.01];
+            }
+        } else if (!self.stallsFirstRequest) {
+            [NSThread sleepForTimeInterval:0.02];
+        }
+        NSData *data = [NSJSONSerialization dataWithJSONObject:@{@"index": @(index)} options:0 error:nil];
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/json"} data:data];
+    } forHost:AFHedgingTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFHedgingTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+- (void)stallFirstRequest {
+    [self.lock lock];
+    self.stallsFirstRequest = YES;
+    self.requestCount = 0;
+    [self.lock unlock];
+}
+
+//样本足够后路由才开始对冲
+- (void)warmUp {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"warm up"];
+    expectation.expectedFulfillmentCount = self.hedgingPolicy.minimumSampleCount;
+    for (NSUInteger idx = 0; idx < self.hedgingPolicy.minimumSampleCount; idx++) {
+        [self.manager GET:@"items/1" parameters:nil progress:nil success:^(__unused NSURLSessionDataTask *task, __unused id responseObject) {
+            [expectation fulfill];
+        } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+            XCTFail(@"%@", error);
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/items/2", AFHedgingTestHost]]];
+    XCTAssertGreaterThan([self.hedgingPolicy hedgeDelayForRequest:request], 0);
+}
+
+//返回收到响应的请求是第几个到达服务器的
+- (NSNumber *)GETIndex {
+    __block NSNumber *index = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"GET"];
+    [self.manager GET:@"items/2" parameters:nil progress:nil success:^(__unused NSURLSessionDataTask *task, id responseObject) {
+        index = responseObject[@"index"];
+        [expectation fulfill];
+    } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+        XCTFail(@"%@", error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    return index;
+}
+
+- (void)testSlowRequestIsHedgedAndLoserCancelled {
+    self.hedgingPolicy.budgetRatio = 1;
+    [self warmUp];
+
+    [self stallFirstRequest];
+    XCTAssertEqualObjects([self GETIndex], @1);
+    XCTAssertEqual(self.hedgingPolicy.hedgedRequestCount, (NSUInteger)1);
+    XCTAssertEqual(self.hedgingPolicy.hedgeWinCount, (NSUInteger)1);
+
+    //卡住的原请求被取消、服务器看到stopLoading
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:2];
+    while ([AFTestURLProtocol stoppedRequestCountForHost:AFHedgingTestHost] == 0 && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertEqual([AFTestURLProtocol stoppedRequestCountForHost:AFHedgingTestHost], (NSUInteger)1);
+}
+
+- (void)testHedgingStopsWhenBudgetIsExhausted {
+    //20个预热请求之后、5%的预算只够一次对冲
+    self.hedgingPolicy.budgetRatio = 0.05;
+    [self warmUp];
+
+    [self stallFirstRequest];
+    XCTAssertEqualObjects([self GETIndex], @1);
+    XCTAssertEqual(self.hedgingPolicy.hedgedRequestCount, (NSUInteger)1);
+
+    //预算用完、只能等卡住的原请求
+    [self stallFirstRequest];
+    XCTAssertEqualObjects([self GETIndex], @0);
+    XCTAssertEqual(self.hedgingPolicy.hedgedRequestCount, (NSUInteger)1);
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFHedgingTestHost] count], self.hedgingPolicy.minimumSampleCount + 3);
+}
+
+@end
@@ -0,0 +1,118 @@
+//
+//  AFHTTPRequestSerializerTemplateTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLRequestSerialization.h"
+
+@interface AFHTTPRequestSerializerTemplateTests : XCTestCase
+@end
+
+@implementation AFHTTPRequestSerializerTemplateTests
+
+//不经过模板、逐项设置请求属性和请求头生成的请求
+- (NSURLRequest *)untemplatedRequestWithSerializer:(AFHTTPRequestSerializer *)serializer method:(NSString *)method URLString:(NSString *)URLString parameters:(id)parameters {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:URLString]];
+    request.HTTPMethod = method;
+    request.timeoutInterval = serializer.timeoutInterval;
+    request.cachePolicy = serializer.cachePolicy;
+    request.allowsCellularAccess = serializer.allowsCellularAccess;
+    request.HTTPShouldHandleCookies = serializer.HTTPShouldHandleCookies;
+
+    return [serializer requestBySerializingRequest:request withParameters:parameters error:nil];
+}
+
+- (void)assertRequest:(NSURLRequest *)request isEquivalentToRequest:(NSURLRequest *)expectedRequest {
+    XCTAssertEqualObjects(request.URL, expectedRequest.URL);
+    XCTAssertEqualObjects(request.HTTPMethod, expectedRequest.HTTPMethod);
+    XCTAssertEqualObjects(request.allHTTPHeaderFields, expectedRequest.allHTTPHeaderFields);
+    XCTAssertEqualObjects(request.HTTPBody, expectedRequest.HTTPBody);
+    XCTAssertEqual(request.timeoutInterval, expectedRequest.timeoutInterval);
+    XCTAssertEqual(request.cachePolicy, expectedRequest.cachePolicy);
+    XCTAssertEqual(request.allowsCellularAccess, expectedRequest.allowsCellularAccess);
+    XCTAssertEqual(request.HTTPShouldHandleCookies, expectedRequest.HTTPShouldHandleCookies);
+}
+
+- (void)configureSerializer:(AFHTTPRequestSerializer *)serializer {
+    serializer.timeoutInterval = 15;
+    serializer.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    serializer.allowsCellularAccess = NO;
+    serializer.HTTPShouldHandleCookies = NO;
+    [serializer setValue:@"token" forHTTPHeaderField:@"X-Token"];
+    [serializer setAuthorizationHeaderFieldWithUsername:@"user" password:@"password"];
+}
+
+- (void)testTemplatedRequestsMatchUntemplatedRequests {
+    NSDictionary *parameters = @{@"name": @"value", @"list": @[@1, @2], @"nested": @{@"key": @"a b&c"}};
+    for (AFHTTPRequestSerializer *serializer in @[[AFHTTPRequestSerializer serializer], [AFJSONRequestSerializer serializer], [AFPropertyListRequestSerializer serializer]]) {
+        [self configureSerializer:serializer];
+        for (NSString *method in @[@"GET", @"HEAD", @"DELETE", @"POST", @"PUT", @"PATCH"]) {
+            NSURLRequest *request = [serializer requestWithMethod:method URLString:@"https://example.com/items?sort=asc" parameters:parameters error:nil];
+            NSURLRequest *expectedRequest = [self untemplatedRequestWithSerializer:serializer method:method URLString:@"https://example.com/items?sort=asc" parameters:parameters];
+            [self assertRequest:request isEquivalentToRequest:expectedRequest];
+        }
+    }
+}
+
+- (void)testChangesAfterFirstRequestAreApplied {
+    AFHTTPRequestSerializer *serializer = [AFHTTPRequestSerializer serializer];
+    [self configureSerializer:serializer];
+    NSURLRequest *firstRequest = [serializer requestWithMethod:@"GET" URLString:@"https://example.com/items" parameters:nil error:nil];
+    XCTAssertEqualObjects([firstRequest valueForHTTPHeaderField:@"X-Token"], @"token");
+
+    //模板在修改后重新编译
+    [serializer setValue:@"other" forHTTPHeaderField:@"X-Token"];
+    [serializer clearAuthorizationHeader];
+    serializer.timeoutInterval = 30;
+    NSURLRequest *request = [serializer requestWithMethod:@"GET" URLString:@"https://example.com/items" parameters:nil error:nil];
+    [self assertRequest:request isEquivalentToRequest:[self untemplatedRequestWithSerializer:serializer method:@"GET" URLString:@"https://example.com/items" parameters:nil]];
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"X-Token"], @"other");
+    XCTAssertNil([request valueForHTTPHeaderField:@"Authorization"]);
+    XCTAssertEqual(request.timeoutInterval, 30);
+
+    //之前生成的请求不受影响
+    XCTAssertEqualObjects([firstRequest valueForHTTPHeaderField:@"X-Token"], @"token");
+    XCTAssertEqual(firstRequest.timeoutInterval, 15);
+}
+
+- (void)testCopiedSerializerProducesEquivalentRequests {
+    AFHTTPRequestSerializer *serializer = [AFJSONRequestSerializer serializer];
+    [self configureSerializer:serializer];
+    AFHTTPRequestSerializer *copiedSerializer = [serializer copy];
+
+    NSURLRequest *request = [serializer requestWithMethod:@"POST" URLString:@"https://example.com/items" parameters:@{@"name": @"value"} error:nil];
+    NSURLRequest *copiedRequest = [copiedSerializer requestWithMethod:@"POST" URLString:@"https://example.com/items" parameters:@{@"name": @"value"} error:nil];
+    XCTAssertEqualObjects(copiedRequest.allHTTPHeaderFields, request.allHTTPHeaderFields);
+    XCTAssertEqualObjects(copiedRequest.HTTPBody, request.HTTPBody);
+}
+
+- (void)testHeaderAccessorsAreSafeWhileRequestsAreBuilt {
+    AFHTTPRequestSerializer *serializer = [AFHTTPRequestSerializer serializer];
+
+    //修改请求头、读取请求头和生成请求同时进行
+    dispatch_apply(2000, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t iteration) {
+        NSString *field = [NSString stringWithFormat:@"X-Field-%zu", iteration % 16];
+        switch (iteration % 3) {
+            case 0:
+                [serializer setValue:[NSString stringWithFormat:@"%zu", iteration] forHTTPHeaderField:field];
+                break;
+            case 1:
+                [serializer valueForHTTPHeaderField:field];
+                break;
+            default: {
+                NSURLRequest *request = [serializer requestWithMethod:@"GET" URLString:@"https://example.com/items" parameters:@{@"page": @(iteration)} error:nil];
+                XCTAssertNotNil(request);
+                break;
+            }
+        }
+    });
+
+    NSURLRequest *request = [serializer requestWithMethod:@"GET" URLString:@"https://example.com/items" parameters:nil error:nil];
+    for (NSUInteger idx = 0; idx < 16; idx++) {
+        NSString *field = [NSString stringWithFormat:@"X-Field-%lu", (unsigned long)idx];
+        XCTAssertEqualObjects([request valueForHTTPHeaderField:field], [serializer valueForHTTPHeaderField:field]);
+    }
+}
+
+@end
@@ -0,0 +1,154 @@
+//
+//  AFHTTPResponseCacheTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFHTTPSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFHTTPResponseCacheTestHost = @"cache.test";
+
+@interface AFHTTPResponseCache (Testing)
+- (void)storeResponseObject:(id)responseObject
+                   response:(NSHTTPURLResponse *)response
+                  byteCount:(int64_t)byteCount
+                 forRequest:(NSURLRequest *)request;
+@end
+
+@interface AFHTTPResponseCacheTests : XCTestCase
+@property (nonatomic, strong) AFHTTPResponseCache *cache;
+@end
+
+@implementation AFHTTPResponseCacheTests
+
+- (void)setUp {
+    [super setUp];
+    self.cache = [[AFHTTPResponseCache alloc] init];
+    self.cache.defaultFreshnessLifetime = 60;
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFHTTPResponseCacheTestHost];
+    [super tearDown];
+}
+
+- (NSMutableURLRequest *)requestWithLanguage:(NSString *)language {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/users"]];
+    [request setValue:language forHTTPHeaderField:@"Accept-Language"];
+    [request setValue:@"1" forHTTPHeaderField:@"X-Client-Version"];
+
+    return request;
+}
+
+- (NSHTTPURLResponse *)responseWithHeaderFields:(NSDictionary *)headerFields {
+    return [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"https://example.com/users"] statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:headerFields];
+}
+
+- (void)testVaryHeaderMustMatchRequest {
+    //X-Client-Version不在varyHTTPHeaderFields中、两个请求的缓存key相同、由响应的Vary区分
+    NSMutableURLRequest *request = [self requestWithLanguage:@"en"];
+    [self.cache storeResponseObject:@{@"name": @"value"} response:[self responseWithHeaderFields:@{@"Vary": @"x-client-version"}] byteCount:10 forRequest:request];
+
+    XCTAssertEqualObjects([self.cache cachedResponseObjectForRequest:request], @{@"name": @"value"});
+
+    [request setValue:@"2" forHTTPHeaderField:@"X-Client-Version"];
+    XCTAssertNil([self.cache cachedResponseObjectForRequest:request]);
+
+    [request setValue:nil forHTTPHeaderField:@"X-Client-Version"];
+    XCTAssertNil([self.cache cachedResponseObjectForRequest:request]);
+}
+
+- (void)testVaryAsteriskIsNotCached {
+    NSURLRequest *request = [self requestWithLanguage:@"en"];
+    [self.cache storeResponseObject:@{@"name": @"value"} response:[self responseWithHeaderFields:@{@"Vary": @"Accept, *"}] byteCount:10 forRequest:request];
+
+    XCTAssertNil([self.cache cachedResponseObjectForRequest:request]);
+}
+
+- (void)testCachedResponseObjectIsIsolatedFromCallers {
+    NSURLRequest *request = [self requestWithLanguage:@"en"];
+    NSMutableDictionary *responseObject = [@{@"items": [@[@1, @2] mutableCopy]} mutableCopy];
+    [self.cache storeResponseObject:responseObject response:[self responseWithHeaderFields:@{}] byteCount:10 forRequest:request];
+
+    //原来的调用方修改自己拿到的对象
+    [responseObject[@"items"] addObject:@3];
+    responseObject[@"extra"] = @YES;
+
+    NSMutableDictionary *cachedObject = [self.cache cachedResponseObjectForRequest:request];
+    XCTAssertEqualObjects(cachedObject, (@{@"items": @[@1, @2]}));
+    XCTAssertTrue([cachedObject isKindOfClass:[NSMutableDictionary class]]);
+
+    //命中的调用方修改自己的拷贝
+    [cachedObject[@"items"] removeAllObjects];
+    XCTAssertEqualObjects([self.cache cachedResponseObjectForRequest:request], (@{@"items": @[@1, @2]}));
+}
+
+- (void)testResponseHeaderNamesAreCaseInsensitive {
+    NSMutableURLRequest *request = [self requestWithLanguage:@"en"];
+    [self.cache storeResponseObject:@{@"name": @"value"} response:[self responseWithHeaderFields:@{@"cache-control": @"no-store"}] byteCount:10 forRequest:request];
+    XCTAssertNil([self.cache cachedResponseObjectForRequest:request]);
+
+    [self.cache storeResponseObject:@{@"name": @"value"} response:[self responseWithHeaderFields:@{@"vary": @"X-CLIENT-VERSION"}] byteCount:10 forRequest:request];
+    XCTAssertEqualObjects([self.cache cachedResponseObjectForRequest:request], @{@"name": @"value"});
+    [request setValue:@"2" forHTTPHeaderField:@"X-Client-Version"];
+    XCTAssertNil([self.cache cachedResponseObjectForRequest:request]);
+}
+
+- (void)testCoalescedRevalidationIsNotSharedAcrossVaryHeaders {
+    //带着If-None-Match的请求延迟返回304、保证两个请求同时在进行中、其他请求返回与X-Client-Version对应的内容
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        NSURLRequest *request = connection.request;
+        if ([[request valueForHTTPHeaderField:@"If-None-Match"] isEqualToString:@"\"v1\""]) {
+            [NSThread sleepForTimeInterval:0.3];
+            [connection respondWithStatusCode:304 headerFields:@{@"ETag": @"\"v1\"", @"Vary": @"X-Client-Version"} data:nil];
+            return;
+        }
+
+        NSString *clientVersion = [request valueForHTTPHeaderField:@"X-Client-Version"] ?: @"";
+        NSData *data = [NSJSONSerialization dataWithJSONObject:@{@"client": clientVersion} options:0 error:nil];
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/json", @"ETag": @"\"v1\"", @"Vary": @"X-Client-Version"} data:data];
+    } forHost:AFHTTPResponseCacheTestHost];
+
+    AFHTTPSessionManager *manager = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/", AFHTTPResponseCacheTestHost]] sessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    manager.coalescesIdempotentRequests = YES;
+    //立即过期、也不先返回过期的缓存、每次都要等验证结果
+    manager.responseCache = [[AFHTTPResponseCache alloc] init];
+    manager.responseCache.defaultFreshnessLifetime = 0;
+    manager.responseCache.staleWhileRevalidateLifetime = 0;
+
+    XCTestExpectation *storedExpectation = [self expectationWithDescription:@"stored"];
+    [manager.requestSerializer setValue:@"1" forHTTPHeaderField:@"X-Client-Version"];
+    [manager GET:@"users" parameters:nil receiptID:[NSUUID UUID] progress:nil success:^(__unused NSURLSessionDataTask *task, id responseObject) {
+        XCTAssertEqualObjects(responseObject, @{@"client": @"1"});
+        [storedExpectation fulfill];
+    } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+        XCTFail(@"%@", error);
+        [storedExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    //版本1的请求带着验证条件、版本2没有对应的缓存、不能挂到版本1的验证上收到304
+    NSMutableDictionary *responseObjects = [NSMutableDictionary dictionary];
+    for (NSString *clientVersion in @[@"1", @"2"]) {
+        XCTestExpectation *expectation = [self expectationWithDescription:clientVersion];
+        [manager.requestSerializer setValue:clientVersion forHTTPHeaderField:@"X-Client-Version"];
+        [manager GET:@"users" parameters:nil receiptID:[NSUUID UUID] progress:nil success:^(__unused NSURLSessionDataTask *task, id responseObject) {
+            responseObjects[clientVersion] = responseObject;
+            [expectation fulfill];
+        } failure:^(__unused NSURLSessionDataTask *task, NSError *error) {
+            XCTFail(@"client %@: %@", clientVersion, error);
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects(responseObjects[@"1"], @{@"client": @"1"});
+    XCTAssertEqualObjects(responseObjects[@"2"], @{@"client": @"2"});
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFHTTPResponseCacheTestHost] count], (NSUInteger)3);
+    XCTAssertEqual(manager.responseCache.notModifiedCount, (NSUInteger)1);
+
+    [manager invalidateSessionCancelingTasks:YES];
+}
+
+@end
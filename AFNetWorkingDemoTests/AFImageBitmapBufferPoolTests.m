@@ -0,0 +1,72 @@
+//
+//  AFImageBitmapBufferPoolTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLResponseSerialization.h"
+
+@interface AFImageBitmapBufferPool (Testing)
+- (NSMutableData *)checkoutBufferWithLength:(size_t)length reused:(BOOL *)reused;
+- (void)checkinBuffer:(NSMutableData *)buffer;
+@end
+
+@interface AFImageBitmapBufferPoolTests : XCTestCase
+@property (nonatomic, strong) AFImageBitmapBufferPool *pool;
+@end
+
+@implementation AFImageBitmapBufferPoolTests
+
+- (void)setUp {
+    [super setUp];
+    self.pool = [[AFImageBitmapBufferPool alloc] init];
+}
+
+- (size_t)sizeClassForLength:(size_t)length {
+    return [self.pool checkoutBufferWithLength:length reused:NULL].length;
+}
+
+- (void)testSmallLengthsMapToMinimumSizeClass {
+    XCTAssertEqual([self sizeClassForLength:1], (size_t)16 * 1024);
+    XCTAssertEqual([self sizeClassForLength:16 * 1024], (size_t)16 * 1024);
+}
+
+- (void)testLengthsRoundUpToQuarterOfPowerOfTwo {
+    XCTAssertEqual([self sizeClassForLength:16 * 1024 + 1], (size_t)20 * 1024);
+    XCTAssertEqual([self sizeClassForLength:20000], (size_t)20 * 1024);
+    XCTAssertEqual([self sizeClassForLength:32 * 1024], (size_t)32 * 1024);
+    XCTAssertEqual([self sizeClassForLength:32 * 1024 + 1], (size_t)40 * 1024);
+    XCTAssertEqual([self sizeClassForLength:600000], (size_t)640 * 1024);
+    XCTAssertEqual([self sizeClassForLength:1000000], (size_t)1024 * 1024);
+    XCTAssertEqual([self sizeClassForLength:1024 * 1024 + 1], (size_t)1280 * 1024);
+}
+
+- (void)testSizeClassWastesAtMostAQuarter {
+    for (size_t length = 16 * 1024 + 1; length < 8 * 1024 * 1024; length = length * 5 / 4 + 7) {
+        size_t sizeClass = [self sizeClassForLength:length];
+        XCTAssertGreaterThanOrEqual(sizeClass, length);
+        XCTAssertLessThanOrEqual(sizeClass - length, length / 4);
+    }
+}
+
+- (void)testBuffersAreReusedWithinTheSameSizeClass {
+    BOOL reused = YES;
+    NSMutableData *buffer = [self.pool checkoutBufferWithLength:20000 reused:&reused];
+    XCTAssertFalse(reused);
+
+    [self.pool checkinBuffer:buffer];
+    XCTAssertEqual(self.pool.pooledBytes, buffer.length);
+
+    NSMutableData *reusedBuffer = [self.pool checkoutBufferWithLength:18000 reused:&reused];
+    XCTAssertTrue(reused);
+    XCTAssertEqual(reusedBuffer, buffer);
+    XCTAssertEqual(self.pool.pooledBytes, (NSUInteger)0);
+}
+
+- (void)testBuffersBeyondMaximumPooledBytesAreReleased {
+    self.pool.maximumPooledBytes = 16 * 1024;
+    [self.pool checkinBuffer:[self.pool checkoutBufferWithLength:20000 reused:NULL]];
+    XCTAssertEqual(self.pool.pooledBytes, (NSUInteger)0);
+}
+
+@end
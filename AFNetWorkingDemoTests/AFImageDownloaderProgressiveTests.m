@@ -0,0 +1,133 @@
+//
+//  AFImageDownloaderProgressiveTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFImageDownloader.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFImageDownloaderTestHost = @"images.test";
+
+//记录验证响应的次数、渐进解码的图片只应该被验证一次
+@interface AFCountingImageResponseSerializer : AFImageResponseSerializer
+@property (atomic, assign) NSUInteger validationCount;
+@end
+
+@implementation AFCountingImageResponseSerializer
+
+- (BOOL)validateResponse:(NSHTTPURLResponse *)response data:(NSData *)data error:(NSError * __autoreleasing *)error {
+    self.validationCount++;
+    return [super validateResponse:response data:data error:error];
+}
+
+@end
+
+@interface AFImageDownloaderProgressiveTests : XCTestCase
+@property (nonatomic, strong) AFCountingImageResponseSerializer *responseSerializer;
+@property (nonatomic, strong) AFImageDownloader *downloader;
+@property (nonatomic, strong) NSData *imageData;
+@end
+
+@implementation AFImageDownloaderProgressiveTests
+
+- (void)setUp {
+    [super setUp];
+    AFHTTPSessionManager *sessionManager = [[AFHTTPSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.responseSerializer = [AFCountingImageResponseSerializer serializer];
+    sessionManager.responseSerializer = self.responseSerializer;
+    self.downloader = [[AFImageDownloader alloc] initWithSessionManager:sessionManager downloadPrioritization:AFImageDownloadPrioritizationFIFO maximumActiveDownloads:4 imageCache:[[AFAutoPurgingImageCache alloc] init]];
+    self.downloader.progressiveDecodingEnabled = YES;
+    self.downloader.progressiveDecodingInterval = 0;
+
+    //有噪点的图片压缩后足够大、能分成很多段
+    CGSize size = CGSizeMake(600, 600);
+    UIGraphicsBeginImageContextWithOptions(size, YES, 1);
+    srand48(42);
+    for (CGFloat y = 0; y < size.height; y += 4) {
+        for (CGFloat x = 0; x < size.width; x += 4) {
+            [[UIColor colorWithRed:drand48() green:drand48() blue:drand48() alpha:1] setFill];
+            UIRectFill(CGRectMake(x, y, 4, 4));
+        }
+    }
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    self.imageData = UIImageJPEGRepresentation(image, 0.9);
+
+    //限速的服务器、每5毫秒发送4KB
+    NSData *imageData = self.imageData;
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"image/jpeg", @"Content-Length": [NSString stringWithFormat:@"%lu", (unsigned long)[imageData length]]}];
+        [connection sendData:imageData chunkLength:4096 interval:0.005];
+        [connection finish];
+    } forHost:AFImageDownloaderTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFImageDownloaderTestHost];
+    [self.downloader.sessionManager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+- (NSURLRequest *)imageRequest {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/%@.jpg", AFImageDownloaderTestHost, [[NSUUID UUID] UUIDString]]]];
+    request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+
+    return request;
+}
+
+- (void)testPartialImagesArriveBeforeTheFinalImage {
+    XCTAssertGreaterThan([self.imageData length], (NSUInteger)40 * 1024);
+
+    __block NSUInteger partialImageCount = 0;
+    __block BOOL finished = NO;
+    __block BOOL partialImageAfterFinish = NO;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"image"];
+    [self.downloader downloadImageForURLRequest:[self imageRequest] withReceiptID:[NSUUID UUID] partialImage:^(__unused NSURLRequest *request, UIImage *partialImage) {
+        XCTAssertTrue([NSThread isMainThread]);
+        XCTAssertEqual(CGImageGetWidth(partialImage.CGImage), (size_t)600);
+        partialImageAfterFinish |= finished;
+        partialImageCount++;
+    } success:^(__unused NSURLRequest *request, __unused NSHTTPURLResponse *response, UIImage *responseObject) {
+        XCTAssertEqual(CGImageGetWidth(responseObject.CGImage), (size_t)600);
+        XCTAssertEqual(CGImageGetHeight(responseObject.CGImage), (size_t)600);
+        finished = YES;
+        [expectation fulfill];
+    } failure:^(__unused NSURLRequest *request, __unused NSHTTPURLResponse *response, NSError *error) {
+        XCTFail(@"%@", error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    //已经排到主队列上的部分图片也不能在最终结果之后出现
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertGreaterThan(partialImageCount, (NSUInteger)0);
+    XCTAssertFalse(partialImageAfterFinish);
+    //manager验证过一次、最终的图片只解码不再验证
+    XCTAssertEqual(self.responseSerializer.validationCount, (NSUInteger)1);
+}
+
+- (void)testCancelledHandlerReceivesNoMorePartialImages {
+    __block NSUInteger partialImageCount = 0;
+    __block NSUInteger partialImageCountAtCancel = 0;
+    __block AFImageDownloadReceipt *receipt = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"cancelled"];
+    receipt = [self.downloader downloadImageForURLRequest:[self imageRequest] withReceiptID:[NSUUID UUID] partialImage:^(__unused NSURLRequest *request, __unused UIImage *partialImage) {
+        if (++partialImageCount == 1) {
+            partialImageCountAtCancel = partialImageCount;
+            [self.downloader cancelTaskForImageDownloadReceipt:receipt];
+        }
+    } success:^(__unused NSURLRequest *request, __unused NSHTTPURLResponse *response, __unused UIImage *responseObject) {
+        XCTFail(@"cancelled handler received the final image");
+    } failure:^(__unused NSURLRequest *request, __unused NSHTTPURLResponse *response, NSError *error) {
+        XCTAssertEqual(error.code, NSURLErrorCancelled);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    //等到服务器发完、期间不再收到部分图片
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1]];
+    XCTAssertEqual(partialImageCount, partialImageCountAtCancel);
+}
+
+@end
@@ -0,0 +1,158 @@
+//
+//  AFJSONModelResponseSerializerTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLResponseSerialization.h"
+
+@interface AFTestJSONNode : NSObject
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, assign) NSInteger count;
+@property (nonatomic, assign) double ratio;
+@property (nonatomic, assign) BOOL enabled;
+@property (nonatomic, strong) NSNumber *score;
+@property (nonatomic, strong) id payload;
+@property (nonatomic, strong) AFTestJSONNode *parent;
+@property (nonatomic, copy) NSArray *children;
+@end
+
+@implementation AFTestJSONNode
+@end
+
+@interface AFJSONModelResponseSerializerTests : XCTestCase
+@end
+
+@implementation AFJSONModelResponseSerializerTests
+
+- (AFJSONModelSchema *)recursiveNodeSchema {
+    AFJSONModelSchema *schema = [AFJSONModelSchema schemaWithModelClass:[AFTestJSONNode class] keyMapping:nil];
+    [schema setSchema:schema forPropertyName:@"parent"];
+    [schema setSchema:schema forPropertyName:@"children"];
+
+    return schema;
+}
+
+- (id)responseObjectWithSchema:(AFJSONModelSchema *)schema JSONString:(NSString *)JSONString error:(NSError *__autoreleasing *)error {
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"https://example.com/model"] statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Content-Type": @"application/json"}];
+
+    return [[AFJSONModelResponseSerializer serializerWithSchema:schema] responseObjectForResponse:response data:[JSONString dataUsingEncoding:NSUTF8StringEncoding] error:error];
+}
+
+//与NSJSONSerialization的结果逐个字段比较
+- (void)assertNode:(AFTestJSONNode *)node matchesDictionary:(NSDictionary *)dictionary {
+    XCTAssertEqualObjects(node.name, dictionary[@"name"]);
+    XCTAssertEqual(node.count, [dictionary[@"count"] integerValue]);
+    XCTAssertEqual(node.ratio, [dictionary[@"ratio"] doubleValue]);
+    XCTAssertEqual(node.enabled, [dictionary[@"enabled"] boolValue]);
+    XCTAssertEqualObjects(node.score, dictionary[@"score"]);
+    XCTAssertEqualObjects(node.payload, dictionary[@"payload"]);
+
+    if (dictionary[@"parent"]) {
+        [self assertNode:node.parent matchesDictionary:dictionary[@"parent"]];
+    } else {
+        XCTAssertNil(node.parent);
+    }
+
+    NSArray *children = dictionary[@"children"];
+    XCTAssertEqual(node.children.count, children.count);
+    for (NSUInteger idx = 0; idx < MIN(node.children.count, children.count); idx++) {
+        [self assertNode:node.children[idx] matchesDictionary:children[idx]];
+    }
+}
+
+- (void)testRecursiveSchemaDoesNotRetainItself {
+    __weak AFJSONModelSchema *weakSchema = nil;
+    @autoreleasepool {
+        AFJSONModelSchema *schema = [self recursiveNodeSchema];
+        XCTAssertNotNil([self responseObjectWithSchema:schema JSONString:@"{\"children\": [{\"name\": \"child\"}]}" error:nil]);
+        weakSchema = schema;
+    }
+
+    XCTAssertNil(weakSchema);
+}
+
+- (void)testCopiedRecursiveSchemaNestsItsCopy {
+    AFJSONModelSchema *schema = [[self recursiveNodeSchema] copy];
+    AFTestJSONNode *node = [self responseObjectWithSchema:schema JSONString:@"{\"parent\": {\"parent\": {\"name\": \"root\"}}}" error:nil];
+
+    XCTAssertEqualObjects(node.parent.parent.name, @"root");
+}
+
+- (void)testModelMatchesJSONSerialization {
+    NSString *JSONString = @"{\"name\": \"root \\u4e2d\\u6587 \\ud83d\\ude00\", \"count\": 42, \"ratio\": 0.25, \"enabled\": true, \"score\": 1.5e3, \"unknown\": {\"ignored\": [1, 2, 3]},"
+                           @" \"payload\": {\"list\": [1, -2, 3.5, \"four\", null, false], \"nested\": {\"empty\": {}, \"array\": []}},"
+                           @" \"parent\": {\"name\": \"parent\", \"count\": -7},"
+                           @" \"children\": [{\"name\": \"a\", \"children\": [{\"name\": \"a.a\", \"score\": 2}]}, {\"name\": \"b\", \"enabled\": false, \"ratio\": -1e-3}]}";
+
+    NSError *error = nil;
+    AFTestJSONNode *node = [self responseObjectWithSchema:[self recursiveNodeSchema] JSONString:JSONString error:&error];
+    XCTAssertNil(error);
+
+    NSDictionary *dictionary = [NSJSONSerialization JSONObjectWithData:[JSONString dataUsingEncoding:NSUTF8StringEncoding] options:0 error:nil];
+    [self assertNode:node matchesDictionary:dictionary];
+}
+
+- (void)testPayloadMatchesJSONSerialization {
+    NSArray <NSString *> *documents = @[
+        @"null", @"true", @"false",
+        @"0", @"-0", @"-1", @"1.5", @"-1.25e-3", @"1E10", @"0.1", @"1e300",
+        @"9223372036854775807", @"-9223372036854775808", @"18446744073709551615",
+        @"\"\"", @"\"plain\"", @"\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t\"", @"\"\\u0041\\u00e9\\u4e2d\\ud83d\\ude00\"", @"\"中文 😀\"",
+        @"[]", @"{}", @" [ 1 , 2 ]\n", @"[1, [2, [3, [4]]], {\"a\": {\"b\": null}}]",
+        @"{\"key with spaces\": \"value\", \"\\u006bey\": [true, false, null]}",
+    ];
+
+    for (NSString *document in documents) {
+        NSString *JSONString = [NSString stringWithFormat:@"{\"payload\": %@}", document];
+        NSError *error = nil;
+        AFTestJSONNode *node = [self responseObjectWithSchema:[self recursiveNodeSchema] JSONString:JSONString error:&error];
+        XCTAssertNil(error, @"%@", document);
+
+        id expected = [NSJSONSerialization JSONObjectWithData:[document dataUsingEncoding:NSUTF8StringEncoding] options:NSJSONReadingAllowFragments error:nil];
+        XCTAssertEqualObjects(node.payload, expected, @"%@", document);
+    }
+}
+
+- (void)testMalformedDocumentsAreRejectedLikeJSONSerialization {
+    NSArray <NSString *> *documents = @[
+        @"{\"payload\": [1,]}", @"{\"payload\": {\"a\": 1,}}", @"{\"payload\": {\"a\":}}", @"{\"payload\": {\"a\" 1}}",
+        @"{\"payload\": [1 2]}", @"{\"payload\": [tru]}", @"{\"payload\": [nul]}", @"{\"payload\": [NaN]}",
+        @"{\"payload\": [1.]}", @"{\"payload\": [-]}", @"{\"payload\": {'a': 1}}", @"{\"payload\": \"unterminated}",
+        @"{\"payload\": [\"\\x\"]}", @"{\"payload\": [\"\\u12\"]}", @"{\"name\": 1 \"count\": 2}", @"{\"name\": \"a\"} trailing",
+        @"{\"children\": [{\"name\": }]}", @"{\"parent\": {\"name\": \"a\"}",
+    ];
+
+    for (NSString *document in documents) {
+        NSData *data = [document dataUsingEncoding:NSUTF8StringEncoding];
+        XCTAssertNil([NSJSONSerialization JSONObjectWithData:data options:0 error:nil], @"%@", document);
+
+        NSError *error = nil;
+        XCTAssertNil([self responseObjectWithSchema:[self recursiveNodeSchema] JSONString:document error:&error], @"%@", document);
+        XCTAssertNotNil(error, @"%@", document);
+    }
+}
+
+- (void)testKeyLookupDistinguishesSimilarKeys {
+    //同样长度、同样首字节的key很多、都只能命中自己
+    NSMutableDictionary *keyMapping = [NSMutableDictionary dictionary];
+    for (NSUInteger idx = 0; idx < 64; idx++) {
+        keyMapping[[NSString stringWithFormat:@"k%02lu", (unsigned long)idx]] = @"payload";
+    }
+    keyMapping[@"k37x"] = @"name";
+    keyMapping[@"k3"] = @"count";
+    AFJSONModelSchema *schema = [AFJSONModelSchema schemaWithModelClass:[AFTestJSONNode class] keyMapping:keyMapping];
+
+    AFTestJSONNode *node = [self responseObjectWithSchema:schema JSONString:@"{\"k37\": 37, \"k37x\": \"name\", \"k3\": 3, \"k370\": 370, \"j37\": 1, \"\": 0}" error:nil];
+    XCTAssertEqualObjects(node.payload, @37);
+    XCTAssertEqualObjects(node.name, @"name");
+    XCTAssertEqual(node.count, 3);
+}
+
+- (void)testEscapedKeysAreMatchedAfterUnescaping {
+    AFTestJSONNode *node = [self responseObjectWithSchema:[self recursiveNodeSchema] JSONString:@"{\"n\\u0061me\": \"escaped\"}" error:nil];
+
+    XCTAssertEqualObjects(node.name, @"escaped");
+}
+
+@end
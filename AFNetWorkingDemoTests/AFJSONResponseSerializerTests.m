@@ -0,0 +1,128 @@
+//
+//  AFJSONResponseSerializerTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import <malloc/malloc.h>
+#import "AFURLResponseSerialization.h"
+
+@interface AFJSONResponseSerializerTests : XCTestCase
+@end
+
+@implementation AFJSONResponseSerializerTests
+
+//大量重复的key和短字符串、每条记录里有一个null
+//字符串都超过tagged pointer能容纳的长度、否则相同内容本来就是同一个指针
+- (NSData *)recordsData {
+    NSMutableArray *records = [NSMutableArray array];
+    for (NSUInteger idx = 0; idx < 2000; idx++) {
+        [records addObject:@{@"accountStatus": @"active-subscription", @"membershipType": @"registered-member", @"groupIdentifier": @(idx % 10), @"displayName": [NSString stringWithFormat:@"registered-user-%lu", (unsigned long)(idx % 50)], @"internalNote": [NSNull null]}];
+    }
+
+    return [NSJSONSerialization dataWithJSONObject:records options:0 error:nil];
+}
+
+- (id)responseObjectWithSerializer:(AFJSONResponseSerializer *)serializer data:(NSData *)data {
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"https://example.com/records"] statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Content-Type": @"application/json"}];
+    NSError *error = nil;
+    id responseObject = [serializer responseObjectForResponse:response data:data error:&error];
+    XCTAssertNil(error);
+
+    return responseObject;
+}
+
+- (AFJSONResponseSerializer *)serializerWithBackend:(id <AFJSONParserBackend>)backend internsStrings:(BOOL)internsStrings {
+    AFJSONResponseSerializer *serializer = [AFJSONResponseSerializer serializer];
+    serializer.parserBackend = backend;
+    serializer.internsStrings = internsStrings;
+    serializer.removesKeysWithNullValues = YES;
+
+    return serializer;
+}
+
+- (AFStructuralIndexJSONParser *)lazyParser {
+    AFStructuralIndexJSONParser *parser = [AFStructuralIndexJSONParser parser];
+    parser.producesLazyObjects = YES;
+
+    return parser;
+}
+
+//遍历整棵树、统计不同的对象个数和它们占用的堆内存、tagged pointer不占堆内存
+- (void)collectObjectsInObject:(id)object objects:(NSHashTable *)objects {
+    [objects addObject:object];
+    if ([object isKindOfClass:[NSDictionary class]]) {
+        [(NSDictionary *)object enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            [objects addObject:key];
+            [self collectObjectsInObject:value objects:objects];
+        }];
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        for (id value in (NSArray *)object) {
+            [self collectObjectsInObject:value objects:objects];
+        }
+    }
+}
+
+- (NSHashTable *)objectsInObject:(id)object {
+    NSHashTable *objects = [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+    [self collectObjectsInObject:object objects:objects];
+
+    return objects;
+}
+
+- (size_t)footprintOfObjects:(NSHashTable *)objects {
+    size_t footprint = 0;
+    for (id object in objects) {
+        footprint += malloc_size((__bridge const void *)object);
+    }
+
+    return footprint;
+}
+
+- (void)testInterningReducesObjectCountAndFootprint {
+    NSData *data = [self recordsData];
+    NSArray *backends = @[[NSNull null], [AFStructuralIndexJSONParser parser]];
+
+    for (id backend in backends) {
+        id <AFJSONParserBackend> parserBackend = backend == [NSNull null] ? nil : backend;
+        NSHashTable *plainObjects = [self objectsInObject:[self responseObjectWithSerializer:[self serializerWithBackend:parserBackend internsStrings:NO] data:data]];
+        NSHashTable *internedObjects = [self objectsInObject:[self responseObjectWithSerializer:[self serializerWithBackend:parserBackend internsStrings:YES] data:data]];
+        size_t plainFootprint = [self footprintOfObjects:plainObjects];
+        size_t internedFootprint = [self footprintOfObjects:internedObjects];
+
+        NSLog(@"%@: %lu objects / %zu bytes without interning, %lu objects / %zu bytes with interning", parserBackend ? NSStringFromClass([parserBackend class]) : @"NSJSONSerialization", (unsigned long)plainObjects.count, plainFootprint, (unsigned long)internedObjects.count, internedFootprint);
+
+        //2000条记录的key和字符串值共享后只剩几十份
+        XCTAssertLessThan(internedObjects.count, plainObjects.count);
+        XCTAssertLessThan(internedFootprint, plainFootprint);
+    }
+}
+
+- (void)testStructuralParserInternsAndRemovesNullsWhileParsing {
+    NSData *data = [self recordsData];
+    NSArray *expected = [self responseObjectWithSerializer:[self serializerWithBackend:nil internsStrings:YES] data:data];
+    NSArray *records = [self responseObjectWithSerializer:[self serializerWithBackend:[AFStructuralIndexJSONParser parser] internsStrings:YES] data:data];
+
+    XCTAssertEqualObjects(records, expected);
+    XCTAssertNil(records[0][@"internalNote"]);
+    XCTAssertEqual([[records[0] allKeys] count], (NSUInteger)4);
+    XCTAssertEqual(records[0][@"accountStatus"], records[1][@"accountStatus"]);
+}
+
+- (void)testLazyResultsStayLazyWithInterningAndNullRemoval {
+    NSData *data = [self recordsData];
+    NSArray *records = [self responseObjectWithSerializer:[self serializerWithBackend:[self lazyParser] internsStrings:YES] data:data];
+
+    //没有被遍历重建成普通的数组
+    XCTAssertEqualObjects(NSStringFromClass([records class]), @"AFJSONLazyArray");
+    XCTAssertEqualObjects(NSStringFromClass([records[0] class]), @"AFJSONLazyDictionary");
+
+    XCTAssertNil(records[0][@"internalNote"]);
+    XCTAssertFalse([[records[0] allKeys] containsObject:@"internalNote"]);
+    XCTAssertEqual([[records[0] allKeys] count], (NSUInteger)4);
+    XCTAssertEqual(records[0][@"accountStatus"], records[1][@"accountStatus"]);
+    XCTAssertEqual([[records[0] allKeys] firstObject], [[records[1] allKeys] firstObject]);
+    XCTAssertEqualObjects(records, [self responseObjectWithSerializer:[self serializerWithBackend:nil internsStrings:NO] data:data]);
+}
+
+@end
@@ -0,0 +1,160 @@
+//
+//  AFSecurityPolicyTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFSecurityPolicy.h"
+
+//Fixtures下的证书由openssl生成、期望的指纹用头文件里给出的命令计算:
+//openssl x509 -in cert.cer -inform der -pubkey -noout | openssl pkey -pubin -outform der | openssl dgst -sha256 -binary | base64
+static NSString * const AFTestRSA2048Pin = @"ewZ1SfpzDyz8IgFw8+qT/xltEGU2dG8l8Z0GA901Ai0=";
+static NSString * const AFTestCAPin = @"8N2geBay95PieIWPvtQmG/8WX8TEJXgjIrx67lSPiK8=";
+
+@interface AFSecurityPolicy (Testing)
+- (NSArray *)pinnedCertificateRefs;
+- (NSSet <NSData *> *)pinnedPublicKeyHashes;
+- (BOOL)needsPinCompilation;
+- (void)compilePinsIfNeeded;
+@end
+
+@interface AFSecurityPolicyTests : XCTestCase
+@end
+
+@implementation AFSecurityPolicyTests
+
+- (NSData *)certificateDataNamed:(NSString *)name {
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:name ofType:@"cer"];
+    return [NSData dataWithContentsOfFile:path];
+}
+
+- (NSData *)pinWithBase64String:(NSString *)base64String {
+    return [[NSData alloc] initWithBase64EncodedString:base64String options:0];
+}
+
+//fixture的有效期从2026-10-19开始、固定校验时间避免受机器时钟影响
+- (SecTrustRef)copyServerTrustWithCertificatesNamed:(NSArray <NSString *> *)names verifyDate:(NSDate *)verifyDate {
+    NSMutableArray *certificates = [NSMutableArray array];
+    for (NSString *name in names) {
+        [certificates addObject:(__bridge_transfer id)SecCertificateCreateWithData(NULL, (__bridge CFDataRef)[self certificateDataNamed:name])];
+    }
+
+    SecPolicyRef policy = SecPolicyCreateBasicX509();
+    SecTrustRef trust = NULL;
+    SecTrustCreateWithCertificates((__bridge CFArrayRef)certificates, policy, &trust);
+    CFRelease(policy);
+    SecTrustSetVerifyDate(trust, (__bridge CFDateRef)verifyDate);
+
+    return trust;
+}
+
+- (NSDate *)dateWithinValidity {
+    return [NSDate dateWithTimeIntervalSince1970:1798761600]; // 2027-01-01
+}
+
+- (NSDate *)dateAfterExpiration {
+    return [NSDate dateWithTimeIntervalSince1970:7258118400]; // 2200-01-01
+}
+
+- (void)testPinsAreCompiledOnceUntilCertificatesChange {
+    NSData *certificate = [self certificateDataNamed:@"af-test-rsa2048"];
+    AFSecurityPolicy *policy = [AFSecurityPolicy policyWithPinningMode:AFSSLPinningModePublicKey withPinnedCertificates:[NSSet setWithObject:certificate]];
+
+    XCTAssertTrue([policy needsPinCompilation]);
+    XCTAssertNil([policy pinnedCertificateRefs]);
+
+    [policy compilePinsIfNeeded];
+    XCTAssertFalse([policy needsPinCompilation]);
+    XCTAssertEqual([policy pinnedCertificateRefs].count, (NSUInteger)1);
+    XCTAssertEqualObjects([policy pinnedPublicKeyHashes], [NSSet setWithObject:[self pinWithBase64String:AFTestRSA2048Pin]]);
+
+    NSArray *compiledCertificateRefs = [policy pinnedCertificateRefs];
+    [policy compilePinsIfNeeded];
+    XCTAssertEqual([policy pinnedCertificateRefs], compiledCertificateRefs);
+
+    policy.pinnedCertificates = [NSSet setWithObject:[self certificateDataNamed:@"af-test-ca"]];
+    XCTAssertTrue([policy needsPinCompilation]);
+
+    [policy compilePinsIfNeeded];
+    XCTAssertEqualObjects([policy pinnedPublicKeyHashes], [NSSet setWithObject:[self pinWithBase64String:AFTestCAPin]]);
+}
+
+- (void)testPinSetMatchesOpenSSLForEveryKeyType {
+    NSDictionary <NSString *, NSString *> *expectedPins = @{
+        @"af-test-rsa2048": AFTestRSA2048Pin,
+        @"af-test-rsa3072": @"IQg7vaozo8JJKIWH7SHBT2WkEHbEp/RqaS5DGwmPNkU=",
+        @"af-test-rsa4096": @"LrLtMi1vTVEmw9HytcIYqgqkwyW0fNDo48fX5NqMSNI=",
+        @"af-test-ecp256": @"TxaOcNy6gRQfitHCx/1MFN9dqpsexZpNh6t+jMyNDsk=",
+        @"af-test-ecp384": @"Kyt8JCSOMKTMDIK+ou9y9OLvFO7BYl4V9udldoM/HRI=",
+        @"af-test-ecp521": @"qNYOQAwIbyxoMskW5bPsatZuuD23NeqJeSbY/9pLPcw=",
+        @"af-test-ed25519": @"N9Og/l0gwRRucEUNZkrD2TlvTbK2hiHpv6uz4Per+Iw=",
+        //v1证书、没有version字段
+        @"af-test-leaf": @"N9uX3bOOytWSDxldDjRoEcx8cnmTXRybi2ODwf0Y83c=",
+    };
+
+    [expectedPins enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *expectedPin, BOOL *stop) {
+        NSData *pinSetData = [AFSecurityPolicy pinSetDataWithCertificates:[NSSet setWithObject:[self certificateDataNamed:name]]];
+        NSString *pinSet = [[NSString alloc] initWithData:pinSetData encoding:NSUTF8StringEncoding];
+        XCTAssertEqualObjects(pinSet, [expectedPin stringByAppendingString:@"\n"], @"%@", name);
+    }];
+}
+
+- (void)testMalformedCertificatesAreSkippedInPinSet {
+    NSData *certificate = [self certificateDataNamed:@"af-test-rsa2048"];
+    NSData *truncatedCertificate = [certificate subdataWithRange:NSMakeRange(0, 100)];
+
+    XCTAssertEqual([AFSecurityPolicy pinSetDataWithCertificates:[NSSet setWithObject:truncatedCertificate]].length, (NSUInteger)0);
+}
+
+- (void)testPinSetOnlyPolicyAcceptsMatchingChain {
+    NSString *pinSet = [NSString stringWithFormat:@"# test pins\n\n%@\n", AFTestCAPin];
+    NSURL *pinSetURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    XCTAssertTrue([[pinSet dataUsingEncoding:NSUTF8StringEncoding] writeToURL:pinSetURL atomically:YES]);
+
+    AFSecurityPolicy *policy = [AFSecurityPolicy policyWithPinSetContentsOfURL:pinSetURL];
+    policy.allowInvalidCertificates = YES;
+    policy.validatesDomainName = NO;
+
+    SecTrustRef pinnedChain = [self copyServerTrustWithCertificatesNamed:@[@"af-test-leaf", @"af-test-ca"] verifyDate:[self dateWithinValidity]];
+    XCTAssertTrue([policy evaluateServerTrust:pinnedChain forDomain:nil]);
+    CFRelease(pinnedChain);
+
+    SecTrustRef unpinnedChain = [self copyServerTrustWithCertificatesNamed:@[@"af-test-ecp384"] verifyDate:[self dateWithinValidity]];
+    XCTAssertFalse([policy evaluateServerTrust:unpinnedChain forDomain:nil]);
+    CFRelease(unpinnedChain);
+
+    [[NSFileManager defaultManager] removeItemAtURL:pinSetURL error:nil];
+}
+
+- (void)testCachedVerdictStillEvaluatesCertificateChain {
+    AFSecurityPolicy *policy = [AFSecurityPolicy policyWithPinningMode:AFSSLPinningModeCertificate withPinnedCertificates:[NSSet setWithObject:[self certificateDataNamed:@"af-test-rsa2048"]]];
+    policy.allowInvalidCertificates = YES;
+    policy.validatesDomainName = NO;
+    policy.trustEvaluationCacheTimeout = 60;
+
+    SecTrustRef trust = [self copyServerTrustWithCertificatesNamed:@[@"af-test-rsa2048"] verifyDate:[self dateWithinValidity]];
+    XCTAssertTrue([policy evaluateServerTrust:trust forDomain:nil]);
+
+    //同一条证书链已经有缓存、但证书过期后仍然不能通过
+    SecTrustSetVerifyDate(trust, (__bridge CFDateRef)[self dateAfterExpiration]);
+    XCTAssertFalse([policy evaluateServerTrust:trust forDomain:nil]);
+    CFRelease(trust);
+}
+
+- (void)testCachedVerdictIsKeyedOnWholeChain {
+    AFSecurityPolicy *policy = [AFSecurityPolicy policyWithPinningMode:AFSSLPinningModePublicKey withPinnedCertificates:[NSSet setWithObject:[self certificateDataNamed:@"af-test-ca"]]];
+    policy.allowInvalidCertificates = YES;
+    policy.validatesDomainName = NO;
+    policy.trustEvaluationCacheTimeout = 60;
+
+    SecTrustRef pinnedChain = [self copyServerTrustWithCertificatesNamed:@[@"af-test-leaf", @"af-test-ca"] verifyDate:[self dateWithinValidity]];
+    XCTAssertTrue([policy evaluateServerTrust:pinnedChain forDomain:@"leaf.af.test"]);
+    CFRelease(pinnedChain);
+
+    //同一张叶子证书换了一个没有固定的中间证书、不能命中上一次的缓存
+    SecTrustRef unpinnedChain = [self copyServerTrustWithCertificatesNamed:@[@"af-test-leaf", @"af-test-rsa2048"] verifyDate:[self dateWithinValidity]];
+    XCTAssertFalse([policy evaluateServerTrust:unpinnedChain forDomain:@"leaf.af.test"]);
+    CFRelease(unpinnedChain);
+}
+
+@end
@@ -0,0 +1,160 @@
+//
+//  AFSegmentedDownloadTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFSegmentedDownloadTestHost = @"segments.test";
+
+//返回文件的某个范围、ranges为NO时忽略Range、lengthKnown为NO时不返回Content-Length
+static void AFServeFile(AFTestURLProtocol *connection, NSData *file, NSString *ETag, BOOL ranges, BOOL lengthKnown) {
+    NSURLRequest *request = connection.request;
+    NSString *range = [request valueForHTTPHeaderField:@"Range"];
+    NSString *ifRange = [request valueForHTTPHeaderField:@"If-Range"];
+    NSMutableDictionary *headerFields = [NSMutableDictionary dictionaryWithObject:@"application/octet-stream" forKey:@"Content-Type"];
+    if (ETag) {
+        headerFields[@"ETag"] = ETag;
+    }
+
+    NSUInteger start = 0;
+    NSUInteger end = [file length];
+    BOOL partial = NO;
+    if (ranges && [range hasPrefix:@"bytes="] && (!ifRange || [ifRange isEqualToString:ETag])) {
+        NSArray *bounds = [[range substringFromIndex:6] componentsSeparatedByString:@"-"];
+        start = (NSUInteger)[bounds[0] longLongValue];
+        if ([bounds count] > 1 && [bounds[1] length] > 0) {
+            end = MIN(end, (NSUInteger)[bounds[1] longLongValue] + 1);
+        }
+        partial = YES;
+        headerFields[@"Accept-Ranges"] = @"bytes";
+        headerFields[@"Content-Range"] = [NSString stringWithFormat:@"bytes %lu-%lu/%lu", (unsigned long)start, (unsigned long)end - 1, (unsigned long)[file length]];
+    }
+    if (lengthKnown) {
+        headerFields[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)(end - start)];
+    }
+
+    [connection respondWithStatusCode:partial ? 206 : 200 headerFields:headerFields];
+    [connection sendData:[file subdataWithRange:NSMakeRange(start, end - start)] chunkLength:32 * 1024 interval:0.001];
+    [connection finish];
+}
+
+@interface AFSegmentedDownloadTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@property (nonatomic, strong) NSData *file;
+@end
+
+@implementation AFSegmentedDownloadTests
+
+- (void)setUp {
+    [super setUp];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+
+    NSMutableData *file = [NSMutableData dataWithLength:3 * 1024 * 1024 + 123];
+    uint8_t *bytes = [file mutableBytes];
+    for (NSUInteger idx = 0; idx < [file length]; idx++) {
+        bytes[idx] = (uint8_t)((idx * 2654435761u) >> 13);
+    }
+    self.file = file;
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFSegmentedDownloadTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+- (void)downloadWithCompletionHandler:(void (^)(NSURL *filePath, NSError *error))completionHandler {
+    NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/file.bin", AFSegmentedDownloadTestHost]]];
+    NSURL *destinationURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"download"];
+    AFURLSessionSegmentedDownload *download = [self.manager segmentedDownloadTaskWithRequest:request numberOfSegments:4 progress:nil destination:^NSURL *(__unused NSURL *targetPath, __unused NSURLResponse *response) {
+        return destinationURL;
+    } completionHandler:^(__unused NSURLResponse *response, NSURL *filePath, NSError *error) {
+        completionHandler(filePath, error);
+        if (filePath) {
+            [[NSFileManager defaultManager] removeItemAtURL:filePath error:nil];
+        }
+        [expectation fulfill];
+    }];
+    download.minimumSegmentLength = 256 * 1024;
+    [download resume];
+
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+- (void)testRangeCapableServerDownloadsInSegments {
+    NSData *file = self.file;
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        AFServeFile(connection, file, @"\"v1\"", YES, YES);
+    } forHost:AFSegmentedDownloadTestHost];
+
+    [self downloadWithCompletionHandler:^(NSURL *filePath, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects([NSData dataWithContentsOfURL:filePath], file);
+    }];
+
+    //探测请求之后的每一段都带着If-Range
+    NSArray <NSURLRequest *> *requests = [AFTestURLProtocol requestsForHost:AFSegmentedDownloadTestHost];
+    XCTAssertGreaterThanOrEqual([requests count], (NSUInteger)4);
+    XCTAssertEqualObjects([requests[0] valueForHTTPHeaderField:@"Range"], @"bytes=0-");
+    for (NSURLRequest *request in [requests subarrayWithRange:NSMakeRange(1, [requests count] - 1)]) {
+        XCTAssertEqualObjects([request valueForHTTPHeaderField:@"If-Range"], @"\"v1\"");
+    }
+}
+
+- (void)testServerWithoutRangeSupportUsesSingleStream {
+    NSData *file = self.file;
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        AFServeFile(connection, file, @"\"v1\"", NO, YES);
+    } forHost:AFSegmentedDownloadTestHost];
+
+    //二进制内容不能被manager默认的JSON序列化器判为失败
+    [self downloadWithCompletionHandler:^(NSURL *filePath, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects([NSData dataWithContentsOfURL:filePath], file);
+    }];
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFSegmentedDownloadTestHost] count], (NSUInteger)1);
+}
+
+- (void)testStreamOfUnknownLength {
+    NSData *file = self.file;
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        AFServeFile(connection, file, nil, NO, NO);
+    } forHost:AFSegmentedDownloadTestHost];
+
+    [self downloadWithCompletionHandler:^(NSURL *filePath, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects([NSData dataWithContentsOfURL:filePath], file);
+    }];
+    XCTAssertEqual([[AFTestURLProtocol requestsForHost:AFSegmentedDownloadTestHost] count], (NSUInteger)1);
+}
+
+- (void)testFileChangedBetweenRequestsFailsDownload {
+    NSData *file = self.file;
+    NSMutableData *changedFile = [file mutableCopy];
+    ((uint8_t *)[changedFile mutableBytes])[[changedFile length] - 1] ^= 0xFF;
+    __block NSUInteger requestCount = 0;
+    NSLock *lock = [[NSLock alloc] init];
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        [lock lock];
+        BOOL first = requestCount++ == 0;
+        [lock unlock];
+        //探测请求之后文件被替换、If-Range不再匹配时服务器返回完整的新文件
+        if (first) {
+            AFServeFile(connection, file, @"\"v1\"", YES, YES);
+        } else {
+            AFServeFile(connection, changedFile, @"\"v2\"", YES, YES);
+        }
+    } forHost:AFSegmentedDownloadTestHost];
+
+    [self downloadWithCompletionHandler:^(NSURL *filePath, NSError *error) {
+        XCTAssertNil(filePath);
+        XCTAssertEqualObjects(error.domain, NSURLErrorDomain);
+        XCTAssertEqual(error.code, NSURLErrorBadServerResponse);
+    }];
+}
+
+@end
@@ -0,0 +1,118 @@
+//
+//  AFStreamingRequestBodyTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLRequestSerialization.h"
+
+@interface AFStreamingRequestBodyTests : XCTestCase
+@end
+
+@implementation AFStreamingRequestBodyTests
+
+- (NSData *)bodyOfRequest:(NSURLRequest *)request {
+    if (request.HTTPBody) {
+        return request.HTTPBody;
+    }
+
+    NSMutableData *body = [NSMutableData data];
+    NSInputStream *stream = request.HTTPBodyStream;
+    uint8_t buffer[4096];
+    [stream open];
+    while (YES) {
+        NSInteger numberOfBytesRead = [stream read:buffer maxLength:sizeof(buffer)];
+        if (numberOfBytesRead <= 0) {
+            break;
+        }
+        [body appendBytes:buffer length:(NSUInteger)numberOfBytesRead];
+    }
+    [stream close];
+
+    return body;
+}
+
+//元素足够多、顶层字典和内部的数组、字典都会被拆开生成
+- (NSDictionary *)largeParameters {
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    for (NSUInteger idx = 0; idx < 300; idx++) {
+        parameters[[NSString stringWithFormat:@"%@key%lu", (idx % 2 ? @"K" : @"k"), (unsigned long)idx]] = [NSString stringWithFormat:@"value %lu & more", (unsigned long)idx];
+    }
+
+    NSMutableArray *items = [NSMutableArray array];
+    for (NSUInteger idx = 0; idx < 100; idx++) {
+        [items addObject:@{@"id": @(idx), @"name": [NSString stringWithFormat:@"item%lu", (unsigned long)idx], @"tags": @[@"a", @"b"]}];
+    }
+    parameters[@"items"] = items;
+
+    NSMutableDictionary *nested = [NSMutableDictionary dictionary];
+    for (NSUInteger idx = 0; idx < 80; idx++) {
+        nested[[NSString stringWithFormat:@"n%lu", (unsigned long)idx]] = @(idx * 1.5);
+    }
+    parameters[@"nested"] = nested;
+    parameters[@"set"] = [NSSet setWithObjects:@"z", @"y", @"x", nil];
+
+    return parameters;
+}
+
+- (NSURLRequest *)requestWithSerializer:(AFHTTPRequestSerializer *)serializer streams:(BOOL)streams parameters:(id)parameters {
+    serializer.streamsHTTPBody = streams;
+    NSError *error = nil;
+    NSURLRequest *request = [serializer requestWithMethod:@"POST" URLString:@"https://example.com/upload" parameters:parameters error:&error];
+    XCTAssertNil(error);
+
+    return request;
+}
+
+- (void)testStreamedFormBodyMatchesEncodedQueryString {
+    AFHTTPRequestSerializer *serializer = [AFHTTPRequestSerializer serializer];
+    NSDictionary *parameters = [self largeParameters];
+
+    NSData *expectedBody = [self bodyOfRequest:[self requestWithSerializer:serializer streams:NO parameters:parameters]];
+    NSURLRequest *request = [self requestWithSerializer:serializer streams:YES parameters:parameters];
+
+    XCTAssertNotNil(request.HTTPBodyStream);
+    XCTAssertEqualObjects([self bodyOfRequest:request], expectedBody);
+    //生成请求时不为了计算长度额外编码一遍
+    XCTAssertNil([request valueForHTTPHeaderField:@"Content-Length"]);
+}
+
+- (void)testStreamedJSONBodyMatchesJSONSerialization {
+    AFJSONRequestSerializer *serializer = [AFJSONRequestSerializer serializer];
+    NSMutableDictionary *parameters = [[self largeParameters] mutableCopy];
+    [parameters removeObjectForKey:@"set"];
+
+    NSURLRequest *request = [self requestWithSerializer:serializer streams:YES parameters:parameters];
+    NSData *body = [self bodyOfRequest:request];
+
+    XCTAssertNotNil(request.HTTPBodyStream);
+    XCTAssertEqualObjects([NSJSONSerialization JSONObjectWithData:body options:0 error:nil], parameters);
+    XCTAssertNil([request valueForHTTPHeaderField:@"Content-Length"]);
+}
+
+- (void)testStreamedJSONBodyKeepsSortedKeys {
+    if (@available(iOS 11.0, *)) {
+        AFJSONRequestSerializer *serializer = [AFJSONRequestSerializer serializerWithWritingOptions:NSJSONWritingSortedKeys];
+        NSMutableDictionary *parameters = [[self largeParameters] mutableCopy];
+        [parameters removeObjectForKey:@"set"];
+
+        NSData *expectedBody = [NSJSONSerialization dataWithJSONObject:parameters options:NSJSONWritingSortedKeys error:nil];
+        NSURLRequest *request = [self requestWithSerializer:serializer streams:YES parameters:parameters];
+
+        XCTAssertNotNil(request.HTTPBodyStream);
+        XCTAssertEqualObjects([self bodyOfRequest:request], expectedBody);
+    }
+}
+
+- (void)testStreamedBodyCanBeReadAgainFromCopy {
+    AFHTTPRequestSerializer *serializer = [AFHTTPRequestSerializer serializer];
+    NSURLRequest *request = [self requestWithSerializer:serializer streams:YES parameters:[self largeParameters]];
+
+    NSData *body = [self bodyOfRequest:request];
+    NSMutableURLRequest *copiedRequest = [request mutableCopy];
+    copiedRequest.HTTPBodyStream = [request.HTTPBodyStream copy];
+
+    XCTAssertEqualObjects([self bodyOfRequest:copiedRequest], body);
+}
+
+@end
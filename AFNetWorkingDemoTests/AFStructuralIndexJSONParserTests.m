@@ -0,0 +1,91 @@
+//
+//  AFStructuralIndexJSONParserTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLResponseSerialization.h"
+
+@interface AFStructuralIndexJSONParserTests : XCTestCase
+@end
+
+@implementation AFStructuralIndexJSONParserTests
+
+- (NSArray <NSString *> *)validDocuments {
+    NSMutableArray *documents = [NSMutableArray arrayWithArray:@[
+        @"[]", @"{}", @" [ 1 , 2 ]\n", @"[null, true, false]",
+        @"[0, -0, -1, 1.5, -1.25e-3, 1E10, 0.1, 1e300, 9223372036854775807, -9223372036854775808, 18446744073709551615]",
+        @"[\"\", \"plain\", \"\\\" \\\\ \\/ \\b \\f \\n \\r \\t\", \"\\u0041\\u00e9\\u4e2d\\ud83d\\ude00\", \"中文 😀\"]",
+        @"{\"a\": {\"b\": [1, [2, [3, [4]]]]}, \"\\u006bey\": \"value\", \"key with spaces\": {}}",
+        @"[\"\\\\\", \"\\\\\\\\\", \"\\\\\\\"\", \"a\\\\\", \"\\\"\\\"\"]",
+    ]];
+
+    //转义、引号和反斜杠分别落在64字节的block边界前后
+    for (NSUInteger padding = 55; padding < 70; padding++) {
+        NSString *prefix = [@"" stringByPaddingToLength:padding withString:@"x" startingAtIndex:0];
+        [documents addObject:[NSString stringWithFormat:@"[\"%@\\\"tail\", \"%@\\\\\", \"%@\\u00e9\"]", prefix, prefix, prefix]];
+        [documents addObject:[NSString stringWithFormat:@"{\"%@\": \"%@\\\\\\\\\\\"\"}", prefix, prefix]];
+    }
+
+    //很长的字符串、跨越多个block、长度是7的整数倍、不会在反斜杠处截断
+    NSString *longString = [@"" stringByPaddingToLength:994 withString:@"abc中文\\n" startingAtIndex:0];
+    [documents addObject:[NSString stringWithFormat:@"[\"%@\", \"%@\"]", longString, [longString stringByReplacingOccurrencesOfString:@"\\" withString:@"/"]]];
+
+    return documents;
+}
+
+- (NSArray <NSString *> *)malformedDocuments {
+    return @[
+        @"[1,]", @"{\"a\": 1,}", @"{\"a\":}", @"{\"a\" 1}", @"[1 2]", @"[tru]", @"[nul]", @"[NaN]", @"[1.]", @"[-]", @"{'a': 1}",
+        @"[\"unterminated]", @"[\"\\x\"]", @"[\"\\u12\"]", @"[\"\\u12g4\"]", @"[\"tab\tinside\"]", @"[\"newline\ninside\"]",
+        @"[\"escaped quote at end\\\"]", @"[\"a\"] trailing", @"[\"a\" \"b\"]", @"{\"a\"}", @"[\\\"a\"]",
+    ];
+}
+
+- (void)testValidDocumentsMatchJSONSerialization {
+    for (AFStructuralIndexJSONParser *parser in @[[AFStructuralIndexJSONParser parser], [self lazyParser], [self interningParser]]) {
+        for (NSString *document in [self validDocuments]) {
+            NSData *data = [document dataUsingEncoding:NSUTF8StringEncoding];
+            NSError *error = nil;
+            id expected = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+            XCTAssertNotNil(expected, @"%@", document);
+
+            XCTAssertEqualObjects([parser JSONObjectWithData:data options:0 error:&error], expected, @"%@", document);
+            XCTAssertNil(error, @"%@", document);
+        }
+    }
+}
+
+- (void)testMalformedDocumentsAreRejectedLikeJSONSerialization {
+    for (NSString *document in [self malformedDocuments]) {
+        NSData *data = [document dataUsingEncoding:NSUTF8StringEncoding];
+        XCTAssertNil([NSJSONSerialization JSONObjectWithData:data options:0 error:nil], @"%@", document);
+
+        NSError *error = nil;
+        XCTAssertNil([[AFStructuralIndexJSONParser parser] JSONObjectWithData:data options:0 error:&error], @"%@", document);
+        XCTAssertNotNil(error, @"%@", document);
+    }
+}
+
+- (void)testFragmentsRequireAllowFragments {
+    NSData *data = [@"\"fragment\"" dataUsingEncoding:NSUTF8StringEncoding];
+
+    XCTAssertNil([[AFStructuralIndexJSONParser parser] JSONObjectWithData:data options:0 error:nil]);
+    XCTAssertEqualObjects([[AFStructuralIndexJSONParser parser] JSONObjectWithData:data options:NSJSONReadingAllowFragments error:nil], @"fragment");
+}
+
+- (AFStructuralIndexJSONParser *)lazyParser {
+    AFStructuralIndexJSONParser *parser = [AFStructuralIndexJSONParser parser];
+    parser.producesLazyObjects = YES;
+
+    return parser;
+}
+
+- (AFStructuralIndexJSONParser *)interningParser {
+    AFStructuralIndexJSONParser *parser = [AFStructuralIndexJSONParser parser];
+    parser.internsStrings = YES;
+
+    return parser;
+}
+
+@end
@@ -0,0 +1,11 @@
+//
+//  AFTestMemory.h
+//  AFNetWorkingDemoTests
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ 当前进程占用的物理内存(phys_footprint)、和Xcode内存仪表显示的一致、取不到时返回0
+ */
+FOUNDATION_EXPORT uint64_t AFTestMemoryFootprint(void);
@@ -0,0 +1,17 @@
+//
+//  AFTestMemory.m
+//  AFNetWorkingDemoTests
+//
+
+#import "AFTestMemory.h"
+#import <mach/mach.h>
+
+uint64_t AFTestMemoryFootprint(void) {
+    task_vm_info_data_t info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+
+    return info.phys_footprint;
+}
@@ -0,0 +1,75 @@
+//
+//  AFTestURLProtocol.h
+//  AFNetWorkingDemoTests
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class AFTestURLProtocol;
+
+typedef void (^AFTestURLProtocolHandler)(AFTestURLProtocol *connection);
+
+/**
+ 测试用的替身服务器、通过`NSURLSessionConfiguration.protocolClasses`拦截注册过的host
+ 每个请求的handler在后台队列上执行、可以分段、延迟发送(模拟限速的服务器)、也可以不回应
+ */
+@interface AFTestURLProtocol : NSURLProtocol
+
+/**
+ 拦截请求的会话配置
+ */
++ (NSURLSessionConfiguration *)sessionConfiguration;
+
+/**
+ 注册一个host、之后发往这个host的请求交给handler处理
+ */
++ (void)registerHandler:(AFTestURLProtocolHandler)handler forHost:(NSString *)host;
+
+/**
+ 取消注册并清空这个host的请求记录
+ */
++ (void)unregisterHost:(NSString *)host;
+
+/**
+ 这个host按到达顺序收到的请求、请求体已经读出到`HTTPBody`
+ */
++ (NSArray <NSURLRequest *> *)requestsForHost:(NSString *)host;
+
+/**
+ 这个host在完成之前被客户端取消(stopLoading)的请求数
+ */
++ (NSUInteger)stoppedRequestCountForHost:(NSString *)host;
+
+/**
+ 请求体、上传任务和流式请求体也已经读出
+ */
+@property (readonly, nonatomic, strong, nullable) NSData *HTTPBody;
+
+/**
+ 客户端是否已经取消了这个请求
+ */
+@property (readonly, nonatomic, assign, getter=isStopped) BOOL stopped;
+
+- (void)respondWithStatusCode:(NSInteger)statusCode headerFields:(nullable NSDictionary <NSString *, NSString *> *)headerFields;
+
+- (void)sendData:(NSData *)data;
+
+- (void)finish;
+
+- (void)failWithError:(NSError *)error;
+
+/**
+ 返回完整的响应
+ */
+- (void)respondWithStatusCode:(NSInteger)statusCode headerFields:(nullable NSDictionary <NSString *, NSString *> *)headerFields data:(nullable NSData *)data;
+
+/**
+ 按固定的长度和间隔分段发送、客户端取消后停止
+ */
+- (void)sendData:(NSData *)data chunkLength:(NSUInteger)chunkLength interval:(NSTimeInterval)interval;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,244 @@
+//
+//  AFTestURLProtocol.m
+//  AFNetWorkingDemoTests
+//
+
+#import "AFTestURLProtocol.h"
+
+static NSMutableDictionary <NSString *, AFTestURLProtocolHandler> * AFTestURLProtocolHandlers() {
+    static NSMutableDictionary *_handlers = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _handlers = [NSMutableDictionary dictionary];
+    });
+
+    return _handlers;
+}
+
+static NSMutableDictionary <NSString *, NSMutableArray <NSURLRequest *> *> * AFTestURLProtocolRequests() {
+    static NSMutableDictionary *_requests = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _requests = [NSMutableDictionary dictionary];
+    });
+
+    return _requests;
+}
+
+static NSCountedSet <NSString *> * AFTestURLProtocolStoppedHosts() {
+    static NSCountedSet *_stoppedHosts = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _stoppedHosts = [NSCountedSet set];
+    });
+
+    return _stoppedHosts;
+}
+
+//上面三个容器都用这个锁保护
+static NSLock * AFTestURLProtocolLock() {
+    static NSLock *_lock = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _lock = [[NSLock alloc] init];
+    });
+
+    return _lock;
+}
+
+static NSData * AFTestURLProtocolReadBody(NSURLRequest *request) {
+    if (request.HTTPBody || !request.HTTPBodyStream) {
+        return request.HTTPBody;
+    }
+
+    NSMutableData *body = [NSMutableData data];
+    NSInputStream *stream = request.HTTPBodyStream;
+    uint8_t buffer[16384];
+    [stream open];
+    while (YES) {
+        NSInteger numberOfBytesRead = [stream read:buffer maxLength:sizeof(buffer)];
+        if (numberOfBytesRead <= 0) {
+            break;
+        }
+        [body appendBytes:buffer length:(NSUInteger)numberOfBytesRead];
+    }
+    [stream close];
+
+    return body;
+}
+
+@interface AFTestURLProtocol ()
+@property (readwrite, nonatomic, strong) NSData *HTTPBody;
+@property (readwrite, atomic, assign, getter=isStopped) BOOL stopped;
+@property (readwrite, atomic, assign, getter=isCompleted) BOOL completed;//已经把完成或者失败交给客户端
+@property (readwrite, nonatomic, strong) NSThread *clientThread;
+@property (readwrite, nonatomic, copy) NSArray <NSString *> *clientRunLoopModes;
+@end
+
+@implementation AFTestURLProtocol
+
++ (NSURLSessionConfiguration *)sessionConfiguration {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[AFTestURLProtocol class]];
+    configuration.HTTPMaximumConnectionsPerHost = 16;
+
+    return configuration;
+}
+
++ (void)registerHandler:(AFTestURLProtocolHandler)handler forHost:(NSString *)host {
+    [AFTestURLProtocolLock() lock];
+    AFTestURLProtocolHandlers()[[host lowercaseString]] = [handler copy];
+    AFTestURLProtocolRequests()[[host lowercaseString]] = [NSMutableArray array];
+    [AFTestURLProtocolLock() unlock];
+}
+
++ (void)unregisterHost:(NSString *)host {
+    [AFTestURLProtocolLock() lock];
+    [AFTestURLProtocolHandlers() removeObjectForKey:[host lowercaseString]];
+    [AFTestURLProtocolRequests() removeObjectForKey:[host lowercaseString]];
+    while ([AFTestURLProtocolStoppedHosts() countForObject:[host lowercaseString]] > 0) {
+        [AFTestURLProtocolStoppedHosts() removeObject:[host lowercaseString]];
+    }
+    [AFTestURLProtocolLock() unlock];
+}
+
++ (NSArray <NSURLRequest *> *)requestsForHost:(NSString *)host {
+    [AFTestURLProtocolLock() lock];
+    NSArray *requests = [AFTestURLProtocolRequests()[[host lowercaseString]] copy] ?: @[];
+    [AFTestURLProtocolLock() unlock];
+
+    return requests;
+}
+
++ (NSUInteger)stoppedRequestCountForHost:(NSString *)host {
+    [AFTestURLProtocolLock() lock];
+    NSUInteger count = [AFTestURLProtocolStoppedHosts() countForObject:[host lowercaseString]];
+    [AFTestURLProtocolLock() unlock];
+
+    return count;
+}
+
++ (AFTestURLProtocolHandler)handlerForRequest:(NSURLRequest *)request {
+    NSString *host = [request.URL.host lowercaseString];
+    if (!host) {
+        return nil;
+    }
+
+    [AFTestURLProtocolLock() lock];
+    AFTestURLProtocolHandler handler = AFTestURLProtocolHandlers()[host];
+    [AFTestURLProtocolLock() unlock];
+
+    return handler;
+}
+
+#pragma mark - NSURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+    return [self handlerForRequest:request] != nil;
+}
+
++ (BOOL)canInitWithTask:(NSURLSessionTask *)task {
+    return [self handlerForRequest:task.currentRequest ?: task.originalRequest] != nil;
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+    return request;
+}
+
+- (void)startLoading {
+    //客户端的回调都回到开始加载的线程和run loop mode
+    self.clientThread = [NSThread currentThread];
+    self.clientRunLoopModes = @[[[NSRunLoop currentRunLoop] currentMode] ?: NSDefaultRunLoopMode];
+
+    NSURLRequest *request = self.request;
+    AFTestURLProtocolHandler handler = [[self class] handlerForRequest:request];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        self.HTTPBody = AFTestURLProtocolReadBody(request);
+
+        NSMutableURLRequest *receivedRequest = [request mutableCopy];
+        receivedRequest.HTTPBodyStream = nil;
+        receivedRequest.HTTPBody = self.HTTPBody;
+        [AFTestURLProtocolLock() lock];
+        [AFTestURLProtocolRequests()[[request.URL.host lowercaseString]] addObject:[receivedRequest copy]];
+        [AFTestURLProtocolLock() unlock];
+
+        if (handler) {
+            handler(self);
+        }
+    });
+}
+
+- (void)stopLoading {
+    if (self.stopped) {
+        return;
+    }
+    self.stopped = YES;
+
+    //正常结束之后客户端也会调用stopLoading、不算取消
+    if (self.completed) {
+        return;
+    }
+    [AFTestURLProtocolLock() lock];
+    [AFTestURLProtocolStoppedHosts() addObject:[self.request.URL.host lowercaseString] ?: @""];
+    [AFTestURLProtocolLock() unlock];
+}
+
+#pragma mark -
+
+- (void)performOnClientThread:(dispatch_block_t)block {
+    [self performSelector:@selector(performBlock:) onThread:self.clientThread withObject:[block copy] waitUntilDone:NO modes:self.clientRunLoopModes];
+}
+
+- (void)performBlock:(dispatch_block_t)block {
+    //stopLoading之后不能再回调客户端
+    if (!self.stopped) {
+        block();
+    }
+}
+
+- (void)respondWithStatusCode:(NSInteger)statusCode headerFields:(NSDictionary <NSString *, NSString *> *)headerFields {
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL statusCode:statusCode HTTPVersion:@"HTTP/1.1" headerFields:headerFields];
+    [self performOnClientThread:^{
+        [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+    }];
+}
+
+- (void)sendData:(NSData *)data {
+    NSData *sentData = [data copy];
+    [self performOnClientThread:^{
+        [self.client URLProtocol:self didLoadData:sentData];
+    }];
+}
+
+- (void)finish {
+    [self performOnClientThread:^{
+        self.completed = YES;
+        [self.client URLProtocolDidFinishLoading:self];
+    }];
+}
+
+- (void)failWithError:(NSError *)error {
+    [self performOnClientThread:^{
+        self.completed = YES;
+        [self.client URLProtocol:self didFailWithError:error];
+    }];
+}
+
+- (void)respondWithStatusCode:(NSInteger)statusCode headerFields:(NSDictionary <NSString *, NSString *> *)headerFields data:(NSData *)data {
+    [self respondWithStatusCode:statusCode headerFields:headerFields];
+    if ([data length] > 0) {
+        [self sendData:data];
+    }
+    [self finish];
+}
+
+- (void)sendData:(NSData *)data chunkLength:(NSUInteger)chunkLength interval:(NSTimeInterval)interval {
+    for (NSUInteger offset = 0; offset < [data length] && !self.stopped; offset += chunkLength) {
+        [self sendData:[data subdataWithRange:NSMakeRange(offset, MIN(chunkLength, [data length] - offset))]];
+        if (interval > 0) {
+            [NSThread sleepForTimeInterval:interval];
+        }
+    }
+}
+
+@end
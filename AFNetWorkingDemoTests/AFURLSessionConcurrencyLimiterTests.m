@@ -0,0 +1,104 @@
+//
+//  AFURLSessionConcurrencyLimiterTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFConcurrencyLimiterTestHost = @"limiter.test";
+
+@interface AFURLSessionConcurrencyLimiterTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@property (nonatomic, strong) AFURLSessionConcurrencyLimiter *limiter;
+@property (atomic, assign) NSTimeInterval responseDelay;
+@property (atomic, assign) NSInteger statusCode;
+@end
+
+@implementation AFURLSessionConcurrencyLimiterTests
+
+- (void)setUp {
+    [super setUp];
+    self.limiter = [[AFURLSessionConcurrencyLimiter alloc] init];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.manager.responseSerializer = [AFHTTPResponseSerializer serializer];
+    self.manager.concurrencyLimiter = self.limiter;
+    self.statusCode = 200;
+
+    //服务器的延迟和状态码由测试随时切换
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        if (self.responseDelay > 0) {
+            [NSThread sleepForTimeInterval:self.responseDelay];
+        }
+        [connection respondWithStatusCode:self.statusCode headerFields:@{@"Content-Type": @"text/plain"} data:[@"ok" dataUsingEncoding:NSUTF8StringEncoding]];
+    } forHost:AFConcurrencyLimiterTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFConcurrencyLimiterTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    [super tearDown];
+}
+
+- (NSURL *)URL {
+    return [NSURL URLWithString:[NSString stringWithFormat:@"https://%@/items", AFConcurrencyLimiterTestHost]];
+}
+
+//同时发出count个请求、等待全部完成
+- (void)performRequestCount:(NSUInteger)count {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"requests"];
+    expectation.expectedFulfillmentCount = count;
+    for (NSUInteger idx = 0; idx < count; idx++) {
+        NSURLRequest *request = [NSURLRequest requestWithURL:[self URL]];
+        [[self.manager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(__unused NSURLResponse *response, __unused id responseObject, __unused NSError *error) {
+            [expectation fulfill];
+        }] resume];
+    }
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+}
+
+- (void)testLimitRisesWhileLatencyStaysAtBaseline {
+    XCTAssertEqual([self.limiter limitForURL:[self URL]], (NSUInteger)4);
+
+    [self performRequestCount:200];
+
+    XCTAssertGreaterThan([self.limiter limitForURL:[self URL]], (NSUInteger)4);
+}
+
+- (void)testLimitFallsWhenLatencyGrows {
+    [self performRequestCount:200];
+    NSUInteger raisedLimit = [self.limiter limitForURL:[self URL]];
+    XCTAssertGreaterThan(raisedLimit, (NSUInteger)4);
+
+    //服务器开始排队、耗时远超基线
+    self.responseDelay = 0.2;
+    for (NSUInteger round = 0; round < 4; round++) {
+        [self performRequestCount:raisedLimit];
+    }
+
+    XCTAssertLessThan([self.limiter limitForURL:[self URL]], raisedLimit);
+}
+
+- (void)testOverloadedResponsesHalveTheLimit {
+    [self performRequestCount:200];
+    NSUInteger raisedLimit = [self.limiter limitForURL:[self URL]];
+
+    self.statusCode = 503;
+    [self performRequestCount:1];
+
+    XCTAssertLessThanOrEqual([self.limiter limitForURL:[self URL]], MAX(raisedLimit / 2, (NSUInteger)1));
+}
+
+- (void)testLimitIsKeyedByHostAndPort {
+    [self performRequestCount:200];
+
+    //与任务使用同一个key、大小写不同也是同一个主机、不同端口是另一个主机
+    NSURL *uppercaseURL = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@/other", [AFConcurrencyLimiterTestHost uppercaseString]]];
+    NSURL *portURL = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@:8443/items", AFConcurrencyLimiterTestHost]];
+    XCTAssertEqual([self.limiter limitForURL:uppercaseURL], [self.limiter limitForURL:[self URL]]);
+    XCTAssertGreaterThan([self.limiter limitForURL:uppercaseURL], (NSUInteger)4);
+    XCTAssertEqual([self.limiter limitForURL:portURL], (NSUInteger)4);
+}
+
+@end
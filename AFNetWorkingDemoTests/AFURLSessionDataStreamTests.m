@@ -0,0 +1,223 @@
+//
+//  AFURLSessionDataStreamTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+#import "AFTestMemory.h"
+
+static NSString * const AFDataStreamTestHost = @"stream.test";
+static NSUInteger const AFDataStreamTestChunkLength = 16 * 1024;
+
+@interface AFURLSessionDataStreamTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@property (nonatomic, strong) NSData *body;
+@property (nonatomic, strong) AFURLSessionDataStream *stream;
+@property (nonatomic, assign) NSUInteger sentLength;
+@end
+
+@implementation AFURLSessionDataStreamTests
+
+- (void)setUp {
+    [super setUp];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.manager.responseSerializer = [AFHTTPResponseSerializer serializer];
+
+    //替身服务器在客户端暂停任务时停止发送、和真实连接上TCP窗口关闭的效果一样
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        NSData *body = self.body;
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/octet-stream", @"Content-Length": [NSString stringWithFormat:@"%lu", (unsigned long)[body length]]}];
+        for (NSUInteger offset = 0; offset < [body length] && !connection.stopped; offset += AFDataStreamTestChunkLength) {
+            @autoreleasepool {
+                while (self.stream.task.state == NSURLSessionTaskStateSuspended && !connection.stopped) {
+                    [NSThread sleepForTimeInterval:0.001];
+                }
+                NSUInteger length = MIN(AFDataStreamTestChunkLength, [body length] - offset);
+                [connection sendData:[body subdataWithRange:NSMakeRange(offset, length)]];
+                @synchronized (self) {
+                    self.sentLength += length;
+                }
+                [NSThread sleepForTimeInterval:0.0005];
+            }
+        }
+        [connection finish];
+    } forHost:AFDataStreamTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFDataStreamTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    self.stream = nil;
+    self.body = nil;
+    [super tearDown];
+}
+
+- (NSData *)bodyWithLength:(NSUInteger)length {
+    NSMutableData *body = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = [body mutableBytes];
+    for (NSUInteger idx = 0; idx < length; idx++) {
+        bytes[idx] = (uint8_t)(idx * 31 + idx / 7);
+    }
+
+    return body;
+}
+
+- (NSUInteger)currentSentLength {
+    @synchronized (self) {
+        return self.sentLength;
+    }
+}
+
+- (AFURLSessionDataStream *)streamWithMaximumBufferedLength:(NSUInteger)maximumBufferedLength {
+    NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/file", AFDataStreamTestHost]]];
+    return [self.manager streamingDataTaskWithRequest:request maximumBufferedLength:maximumBufferedLength];
+}
+
+- (BOOL)waitForTaskState:(NSURLSessionTaskState)state timeout:(NSTimeInterval)timeout {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (self.stream.task.state != state && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+
+    return self.stream.task.state == state;
+}
+
+- (void)testTaskSuspendsWhileConsumerIsIdleAndResumesWhenItPulls {
+    self.body = [self bodyWithLength:1024 * 1024];
+    NSUInteger maximumBufferedLength = 64 * 1024;
+    self.stream = [self streamWithMaximumBufferedLength:maximumBufferedLength];
+    [self.stream resume];
+
+    //使用者不读取、队列满了之后任务被暂停、服务器停止发送
+    XCTAssertTrue([self waitForTaskState:NSURLSessionTaskStateSuspended timeout:5]);
+    NSUInteger sentLength = [self currentSentLength];
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+    XCTAssertEqual(self.stream.task.state, NSURLSessionTaskStateSuspended);
+    XCTAssertGreaterThanOrEqual(self.stream.bufferedLength, maximumBufferedLength);
+    XCTAssertLessThanOrEqual(self.stream.bufferedLength, maximumBufferedLength * 2);
+    XCTAssertLessThanOrEqual([self currentSentLength], sentLength + maximumBufferedLength);
+    XCTAssertLessThan([self currentSentLength], [self.body length]);
+
+    //读出一半以上后任务恢复
+    NSMutableData *receivedData = [NSMutableData data];
+    while (self.stream.bufferedLength > maximumBufferedLength / 2) {
+        [receivedData appendData:[self.stream readData:nil]];
+    }
+    XCTAssertEqual(self.stream.task.state, NSURLSessionTaskStateRunning);
+
+    //读到结束、数据完整
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    __block NSError *readError = nil;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSData *data = nil;
+        NSError *error = nil;
+        while ((data = [self.stream readData:&error])) {
+            [receivedData appendData:data];
+        }
+        readError = error;
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertNil(readError);
+    XCTAssertEqualObjects(receivedData, self.body);
+    XCTAssertEqual(self.stream.bufferedLength, (NSUInteger)0);
+}
+
+//一段读完再读下一段、直到结束
+- (void)readDataIntoData:(NSMutableData *)receivedData completion:(void (^)(NSError *error))completion {
+    [self.stream readDataWithCompletionHandler:^(NSData *data, NSError *error) {
+        if (!data) {
+            completion(error);
+            return;
+        }
+        [receivedData appendData:data];
+        [self readDataIntoData:receivedData completion:completion];
+    }];
+}
+
+- (void)testAsynchronousReadsResumeSuspendedTask {
+    self.body = [self bodyWithLength:512 * 1024];
+    NSUInteger maximumBufferedLength = 32 * 1024;
+    self.stream = [self streamWithMaximumBufferedLength:maximumBufferedLength];
+    [self.stream resume];
+    XCTAssertTrue([self waitForTaskState:NSURLSessionTaskStateSuspended timeout:5]);
+
+    NSMutableData *receivedData = [NSMutableData data];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [self readDataIntoData:receivedData completion:^(NSError *error) {
+        XCTAssertNil(error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects(receivedData, self.body);
+    XCTAssertEqual(self.stream.task.state, NSURLSessionTaskStateCompleted);
+}
+
+- (void)testCancelEndsPendingReadsWithCancellationError {
+    self.body = [self bodyWithLength:512 * 1024];
+    self.stream = [self streamWithMaximumBufferedLength:32 * 1024];
+    [self.stream resume];
+    XCTAssertTrue([self waitForTaskState:NSURLSessionTaskStateSuspended timeout:5]);
+
+    [self.stream cancel];
+    XCTAssertEqual(self.stream.bufferedLength, (NSUInteger)0);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    [self.stream readDataWithCompletionHandler:^(NSData *data, NSError *error) {
+        XCTAssertNil(data);
+        XCTAssertEqual(error.code, NSURLErrorCancelled);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+//基准:32MB的下载交给每段耗时1毫秒的慢速使用者、队列和进程内存都保持平稳
+- (void)testSlowConsumerMemoryStaysFlat {
+    self.body = [self bodyWithLength:32 * 1024 * 1024];
+    NSUInteger maximumBufferedLength = 256 * 1024;
+    uint64_t baselineFootprint = AFTestMemoryFootprint();
+
+    self.stream = [self streamWithMaximumBufferedLength:maximumBufferedLength];
+    [self.stream resume];
+
+    __block NSUInteger receivedLength = 0;
+    __block NSUInteger peakBufferedLength = 0;
+    __block uint64_t peakFootprint = baselineFootprint;
+    __block NSUInteger chunkCount = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"read"];
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        while (YES) {
+            @autoreleasepool {
+                peakBufferedLength = MAX(peakBufferedLength, self.stream.bufferedLength);
+                NSData *data = [self.stream readData:nil];
+                if (!data) {
+                    break;
+                }
+                receivedLength += [data length];
+                if (++chunkCount % 64 == 0) {
+                    peakFootprint = MAX(peakFootprint, AFTestMemoryFootprint());
+                }
+                //模拟本地处理
+                [NSThread sleepForTimeInterval:0.001];
+            }
+        }
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:120 handler:nil];
+    CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - startTime;
+
+    uint64_t footprintGrowth = peakFootprint > baselineFootprint ? peakFootprint - baselineFootprint : 0;
+    NSLog(@"streamed %lu bytes in %.2fs, peak buffered %lu bytes, peak footprint growth %llu bytes", (unsigned long)receivedLength, duration, (unsigned long)peakBufferedLength, footprintGrowth);
+
+    XCTAssertEqual(receivedLength, [self.body length]);
+    XCTAssertLessThanOrEqual(peakBufferedLength, maximumBufferedLength * 2);
+    //整个响应的八分之一以内、说明内存没有随下载量增长
+    XCTAssertLessThan(footprintGrowth, (uint64_t)[self.body length] / 8);
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  AFURLSessionDeliveryQueueTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFDeliveryQueueTestHost = @"delivery.test";
+
+@interface AFURLSessionDeliveryQueueTests : XCTestCase
+@end
+
+@implementation AFURLSessionDeliveryQueueTests
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFDeliveryQueueTestHost];
+    [super tearDown];
+}
+
+- (void)testBlocksWithinIntervalRunInOneDrainInOrder {
+    dispatch_queue_t queue = dispatch_queue_create("com.alamofire.networking.tests.delivery", DISPATCH_QUEUE_SERIAL);
+    AFURLSessionDeliveryQueue *deliveryQueue = [[AFURLSessionDeliveryQueue alloc] initWithQueue:queue coalescingInterval:0.1];
+
+    NSMutableArray *order = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"delivered"];
+    expectation.expectedFulfillmentCount = 10;
+    for (NSUInteger idx = 0; idx < 10; idx++) {
+        [deliveryQueue enqueueBlock:^{
+            [order addObject:@(idx)];
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertEqualObjects(order, (@[@0, @1, @2, @3, @4, @5, @6, @7, @8, @9]));
+    XCTAssertEqual(deliveryQueue.drainCount, (NSUInteger)1);
+    XCTAssertEqual(deliveryQueue.deliveredBlockCount, (NSUInteger)10);
+}
+
+- (void)testBlocksEnqueuedDuringDrainRunInSameDrain {
+    dispatch_queue_t queue = dispatch_queue_create("com.alamofire.networking.tests.delivery", DISPATCH_QUEUE_SERIAL);
+    AFURLSessionDeliveryQueue *deliveryQueue = [[AFURLSessionDeliveryQueue alloc] initWithQueue:queue];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"delivered"];
+    [deliveryQueue enqueueBlock:^{
+        //完成回调里发出的通知
+        [deliveryQueue enqueueBlock:^{
+            [expectation fulfill];
+        }];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertEqual(deliveryQueue.drainCount, (NSUInteger)1);
+    XCTAssertEqual(deliveryQueue.deliveredBlockCount, (NSUInteger)2);
+}
+
+- (void)testCoalescingIntervalIsPerManager {
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"text/plain"} data:[@"ok" dataUsingEncoding:NSUTF8StringEncoding]];
+    } forHost:AFDeliveryQueueTestHost];
+
+    //一个manager等待0.5秒合并、另一个不等待、两者都投递到主队列
+    AFURLSessionManager *waitingManager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    waitingManager.responseSerializer = [AFHTTPResponseSerializer serializer];
+    waitingManager.coalescesCompletionDelivery = YES;
+    waitingManager.completionDeliveryCoalescingInterval = 0.5;
+    AFURLSessionManager *immediateManager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    immediateManager.responseSerializer = [AFHTTPResponseSerializer serializer];
+    immediateManager.coalescesCompletionDelivery = YES;
+
+    NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/", AFDeliveryQueueTestHost]]];
+    NSMutableArray *order = [NSMutableArray array];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+    expectation.expectedFulfillmentCount = 2;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    __block CFAbsoluteTime waitingTime = 0;
+    [[waitingManager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(__unused NSURLResponse *response, __unused id responseObject, NSError *error) {
+        XCTAssertNil(error);
+        waitingTime = CFAbsoluteTimeGetCurrent() - startTime;
+        [order addObject:@"waiting"];
+        [expectation fulfill];
+    }] resume];
+    [[immediateManager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(__unused NSURLResponse *response, __unused id responseObject, NSError *error) {
+        XCTAssertNil(error);
+        [order addObject:@"immediate"];
+        [expectation fulfill];
+    }] resume];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    //等待间隔只影响设置它的manager、共用的主队列实例不受影响
+    XCTAssertEqualObjects(order, (@[@"immediate", @"waiting"]));
+    XCTAssertGreaterThanOrEqual(waitingTime, 0.5);
+    XCTAssertEqual([AFURLSessionDeliveryQueue mainDeliveryQueue].coalescingInterval, 0);
+
+    [waitingManager invalidateSessionCancelingTasks:YES];
+    [immediateManager invalidateSessionCancelingTasks:YES];
+}
+
+@end
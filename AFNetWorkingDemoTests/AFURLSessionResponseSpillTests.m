@@ -0,0 +1,213 @@
+//
+//  AFURLSessionResponseSpillTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+#import "AFTestMemory.h"
+
+static NSString * const AFResponseSpillTestHost = @"spill.test";
+static NSUInteger const AFResponseSpillTestChunkLength = 64 * 1024;
+
+typedef NS_ENUM(NSInteger, AFResponseSpillTestEnding) {
+    AFResponseSpillTestEndingFinish,
+    AFResponseSpillTestEndingFail,
+    AFResponseSpillTestEndingStall,//发送一半后等待客户端取消
+};
+
+@interface AFURLSessionResponseSpillTests : XCTestCase
+@property (nonatomic, strong) AFURLSessionManager *manager;
+@property (nonatomic, strong) NSData *body;
+@property (nonatomic, assign) AFResponseSpillTestEnding ending;
+@end
+
+@implementation AFURLSessionResponseSpillTests
+
+- (void)setUp {
+    [super setUp];
+    self.manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    self.manager.responseSerializer = [AFHTTPResponseSerializer serializer];
+
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        NSData *body = self.body;
+        AFResponseSpillTestEnding ending = self.ending;
+        NSUInteger length = ending == AFResponseSpillTestEndingFinish ? [body length] : [body length] / 2;
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/octet-stream", @"Content-Length": [NSString stringWithFormat:@"%lu", (unsigned long)[body length]]}];
+        for (NSUInteger offset = 0; offset < length && !connection.stopped; offset += AFResponseSpillTestChunkLength) {
+            @autoreleasepool {
+                [connection sendData:[body subdataWithRange:NSMakeRange(offset, MIN(AFResponseSpillTestChunkLength, length - offset))]];
+                [NSThread sleepForTimeInterval:0.0005];
+            }
+        }
+
+        switch (ending) {
+            case AFResponseSpillTestEndingFinish:
+                [connection finish];
+                break;
+            case AFResponseSpillTestEndingFail:
+                [NSThread sleepForTimeInterval:0.2];
+                [connection failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+                break;
+            case AFResponseSpillTestEndingStall:
+                for (NSUInteger idx = 0; idx < 500 && !connection.stopped; idx++) {
+                    [NSThread sleepForTimeInterval:0.01];
+                }
+                break;
+        }
+    } forHost:AFResponseSpillTestHost];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFResponseSpillTestHost];
+    [self.manager invalidateSessionCancelingTasks:YES];
+    self.body = nil;
+    [super tearDown];
+}
+
+- (NSData *)bodyWithLength:(NSUInteger)length {
+    NSMutableData *body = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = [body mutableBytes];
+    for (NSUInteger idx = 0; idx < length; idx++) {
+        bytes[idx] = (uint8_t)(idx * 31 + idx / 7);
+    }
+
+    return body;
+}
+
+//临时目录里的转存文件
+- (NSSet <NSString *> *)spillFileNames {
+    NSArray *fileNames = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:NSTemporaryDirectory() error:nil];
+    return [NSSet setWithArray:[fileNames filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'AFNetworking-'"]]];
+}
+
+- (BOOL)waitForNewSpillFileExcluding:(NSSet <NSString *> *)existingFileNames {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    while ([deadline timeIntervalSinceNow] > 0) {
+        NSMutableSet *fileNames = [[self spillFileNames] mutableCopy];
+        [fileNames minusSet:existingFileNames];
+        if ([fileNames count] > 0) {
+            return YES;
+        }
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.005]];
+    }
+
+    return NO;
+}
+
+- (NSURLSessionDataTask *)dataTaskWithCompletionHandler:(void (^)(NSData *responseData, NSError *error))completionHandler {
+    NSURLRequest *request = [NSURLRequest requestWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/file", AFResponseSpillTestHost]]];
+    NSURLSessionDataTask *task = [self.manager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(__unused NSURLResponse *response, id responseObject, NSError *error) {
+        completionHandler(responseObject, error);
+    }];
+    [task resume];
+
+    return task;
+}
+
+- (void)testBodyAboveThresholdIsDeliveredFromMappedFile {
+    self.body = [self bodyWithLength:4 * 1024 * 1024];
+    self.manager.responseDataSpillThreshold = 256 * 1024;
+    NSSet *existingFileNames = [self spillFileNames];
+
+    __block NSData *responseData = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+    [self dataTaskWithCompletionHandler:^(NSData *data, NSError *error) {
+        XCTAssertNil(error);
+        responseData = data;
+        [expectation fulfill];
+    }];
+    XCTAssertTrue([self waitForNewSpillFileExcluding:existingFileNames]);
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects(responseData, self.body);
+    //映射后文件已经删除、数据仍然可读
+    XCTAssertEqualObjects([self spillFileNames], existingFileNames);
+}
+
+- (void)testBodyBelowThresholdStaysInMemory {
+    self.body = [self bodyWithLength:128 * 1024];
+    self.manager.responseDataSpillThreshold = 256 * 1024;
+    NSSet *existingFileNames = [self spillFileNames];
+
+    __block NSData *responseData = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+    [self dataTaskWithCompletionHandler:^(NSData *data, NSError *error) {
+        XCTAssertNil(error);
+        responseData = data;
+        XCTAssertEqualObjects([self spillFileNames], existingFileNames);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects(responseData, self.body);
+}
+
+- (void)testSpillFileIsRemovedWhenTaskFails {
+    self.body = [self bodyWithLength:2 * 1024 * 1024];
+    self.ending = AFResponseSpillTestEndingFail;
+    self.manager.responseDataSpillThreshold = 256 * 1024;
+    NSSet *existingFileNames = [self spillFileNames];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+    [self dataTaskWithCompletionHandler:^(NSData *data, NSError *error) {
+        XCTAssertNil(data);
+        XCTAssertEqual(error.code, NSURLErrorNetworkConnectionLost);
+        [expectation fulfill];
+    }];
+    XCTAssertTrue([self waitForNewSpillFileExcluding:existingFileNames]);
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects([self spillFileNames], existingFileNames);
+}
+
+- (void)testSpillFileIsRemovedWhenTaskIsCancelled {
+    self.body = [self bodyWithLength:2 * 1024 * 1024];
+    self.ending = AFResponseSpillTestEndingStall;
+    self.manager.responseDataSpillThreshold = 256 * 1024;
+    NSSet *existingFileNames = [self spillFileNames];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+    NSURLSessionDataTask *task = [self dataTaskWithCompletionHandler:^(NSData *data, NSError *error) {
+        XCTAssertNil(data);
+        XCTAssertEqual(error.code, NSURLErrorCancelled);
+        [expectation fulfill];
+    }];
+    XCTAssertTrue([self waitForNewSpillFileExcluding:existingFileNames]);
+    [task cancel];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects([self spillFileNames], existingFileNames);
+}
+
+//64MB的响应、转存后进程内存的增长应该和阈值同一量级而不是和响应同一量级
+- (void)testPeakMemoryStaysBoundedWhileSpilling {
+    self.body = [self bodyWithLength:64 * 1024 * 1024];
+    self.manager.responseDataSpillThreshold = 1024 * 1024;
+    uint64_t baselineFootprint = AFTestMemoryFootprint();
+
+    __block BOOL completed = NO;
+    __block NSUInteger responseLength = 0;
+    [self dataTaskWithCompletionHandler:^(NSData *data, NSError *error) {
+        XCTAssertNil(error);
+        responseLength = [data length];
+        completed = YES;
+    }];
+
+    uint64_t peakFootprint = baselineFootprint;
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:60];
+    while (!completed && [deadline timeIntervalSinceNow] > 0) {
+        peakFootprint = MAX(peakFootprint, AFTestMemoryFootprint());
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+
+    uint64_t footprintGrowth = peakFootprint > baselineFootprint ? peakFootprint - baselineFootprint : 0;
+    NSLog(@"spilled %lu bytes, peak footprint growth %llu bytes", (unsigned long)responseLength, footprintGrowth);
+
+    XCTAssertTrue(completed);
+    XCTAssertEqual(responseLength, [self.body length]);
+    XCTAssertLessThan(footprintGrowth, (uint64_t)[self.body length] / 4);
+}
+
+@end
@@ -0,0 +1,151 @@
+//
+//  AFURLSessionTaskTimingTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+
+@interface AFURLSessionTaskTimingTests : XCTestCase
+@end
+
+@implementation AFURLSessionTaskTimingTests
+
+- (AFURLSessionTaskTimingRecord)recordWithTaskIdentifier:(NSUInteger)taskIdentifier statusCode:(NSInteger)statusCode {
+    AFURLSessionTaskTimingRecord record;
+    memset(&record, 0, sizeof(record));
+    record.taskIdentifier = taskIdentifier;
+    record.statusCode = statusCode;
+
+    return record;
+}
+
+- (void)testCapacityIsRoundedUpToPowerOfTwo {
+    XCTAssertEqual([[AFURLSessionTaskTimingRecorder alloc] initWithCapacity:5].capacity, (NSUInteger)8);
+    XCTAssertEqual([[AFURLSessionTaskTimingRecorder alloc] initWithCapacity:0].capacity, (NSUInteger)2);
+    XCTAssertEqual([[AFURLSessionTaskTimingRecorder alloc] init].capacity, (NSUInteger)1024);
+}
+
+- (void)testDrainReturnsRecordsInOrderAndDropsWhenFull {
+    AFURLSessionTaskTimingRecorder *recorder = [[AFURLSessionTaskTimingRecorder alloc] initWithCapacity:4];
+    for (NSInteger index = 0; index < 4; index++) {
+        AFURLSessionTaskTimingRecord record = [self recordWithTaskIdentifier:1 statusCode:index];
+        XCTAssertTrue([recorder appendRecord:&record]);
+    }
+
+    //缓冲区满时丢弃新的记录
+    AFURLSessionTaskTimingRecord overflow = [self recordWithTaskIdentifier:1 statusCode:4];
+    XCTAssertFalse([recorder appendRecord:&overflow]);
+    XCTAssertEqual(recorder.droppedRecordCount, (NSUInteger)1);
+
+    NSMutableArray *statusCodes = [NSMutableArray array];
+    XCTAssertEqual([recorder drainRecordsUsingBlock:^(const AFURLSessionTaskTimingRecord *record) {
+        [statusCodes addObject:@(record->statusCode)];
+    }], (NSUInteger)4);
+    XCTAssertEqualObjects(statusCodes, (@[@0, @1, @2, @3]));
+
+    //取走之后可以继续写入
+    XCTAssertTrue([recorder appendRecord:&overflow]);
+    XCTAssertEqual([recorder drainRecordsUsingBlock:^(__unused const AFURLSessionTaskTimingRecord *record) {}], (NSUInteger)1);
+    XCTAssertEqual([recorder drainRecordsUsingBlock:^(__unused const AFURLSessionTaskTimingRecord *record) {}], (NSUInteger)0);
+}
+
+- (void)testConcurrentProducersAndConsumer {
+    NSUInteger producerCount = 4;
+    NSInteger recordsPerProducer = 20000;
+    //容量远小于总记录数、生产者在缓冲区满时重试、覆盖环形缓冲区的回绕
+    AFURLSessionTaskTimingRecorder *recorder = [[AFURLSessionTaskTimingRecorder alloc] initWithCapacity:64];
+    NSInteger *expectedStatusCodes = calloc(producerCount, sizeof(NSInteger));
+    __block NSUInteger receivedCount = 0;
+    __block BOOL outOfOrder = NO;
+
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger producer = 0; producer < producerCount; producer++) {
+        dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            for (NSInteger index = 0; index < recordsPerProducer; index++) {
+                AFURLSessionTaskTimingRecord record = [self recordWithTaskIdentifier:producer statusCode:index];
+                while (![recorder appendRecord:&record]) {
+                    sched_yield();
+                }
+            }
+        });
+    }
+
+    //同一个生产者的记录按写入的顺序、每条只取出一次
+    while (receivedCount < producerCount * (NSUInteger)recordsPerProducer) {
+        [recorder drainRecordsUsingBlock:^(const AFURLSessionTaskTimingRecord *record) {
+            if (record->taskIdentifier >= producerCount || record->statusCode != expectedStatusCodes[record->taskIdentifier]) {
+                outOfOrder = YES;
+                return;
+            }
+            expectedStatusCodes[record->taskIdentifier]++;
+            receivedCount++;
+        }];
+        if (outOfOrder) {
+            break;
+        }
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    XCTAssertFalse(outOfOrder);
+    XCTAssertEqual(receivedCount, producerCount * (NSUInteger)recordsPerProducer);
+    for (NSUInteger producer = 0; producer < producerCount; producer++) {
+        XCTAssertEqual(expectedStatusCodes[producer], recordsPerProducer);
+    }
+    XCTAssertEqual([recorder drainRecordsUsingBlock:^(__unused const AFURLSessionTaskTimingRecord *record) {}], (NSUInteger)0);
+    free(expectedStatusCodes);
+}
+
+- (void)testRecordNameIsTruncated {
+    AFURLSessionTaskTimingRecord record = [self recordWithTaskIdentifier:1 statusCode:200];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/users?page=2"]];
+    request.HTTPMethod = @"POST";
+    AFURLSessionTaskTimingRecordSetName(&record, request);
+    XCTAssertEqualObjects([NSString stringWithUTF8String:record.name], @"POST /users");
+
+    NSString *longPath = [@"/" stringByPaddingToLength:200 withString:@"a" startingAtIndex:0];
+    request.URL = [NSURL URLWithString:[@"https://example.com" stringByAppendingString:longPath]];
+    AFURLSessionTaskTimingRecordSetName(&record, request);
+    XCTAssertEqual(strlen(record.name), sizeof(record.name) - 1);
+}
+
+- (void)testTraceExporterWritesSpansInMicroseconds {
+    AFURLSessionTaskTimingRecorder *recorder = [[AFURLSessionTaskTimingRecorder alloc] initWithCapacity:4];
+    AFURLSessionTaskTimingRecord record = [self recordWithTaskIdentifier:7 statusCode:200];
+    strlcpy(record.name, "GET /users", sizeof(record.name));
+    record.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationStart] = 1000000;
+    record.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationEnd] = 1500000;
+    record.timestamps[AFURLSessionTaskTimingPhaseResume] = 2000000;
+    record.timestamps[AFURLSessionTaskTimingPhaseFirstByte] = 5000000;
+    record.timestamps[AFURLSessionTaskTimingPhaseCallbackStart] = 6000000;
+    record.timestamps[AFURLSessionTaskTimingPhaseCallbackEnd] = 6250000;
+    [recorder appendRecord:&record];
+
+    //没有任何时间的记录不输出
+    AFURLSessionTaskTimingRecord emptyRecord = [self recordWithTaskIdentifier:8 statusCode:0];
+    [recorder appendRecord:&emptyRecord];
+
+    AFURLSessionTaskTimingTraceExporter *exporter = [[AFURLSessionTaskTimingTraceExporter alloc] init];
+    XCTAssertEqual([exporter appendRecordsFromRecorder:recorder], (NSUInteger)2);
+    XCTAssertEqual(exporter.recordCount, (NSUInteger)1);
+
+    NSDictionary *trace = [NSJSONSerialization JSONObjectWithData:[exporter traceData] options:0 error:nil];
+    NSMutableDictionary *spans = [NSMutableDictionary dictionary];
+    for (NSDictionary *event in trace[@"traceEvents"]) {
+        if ([event[@"ph"] isEqualToString:@"X"]) {
+            XCTAssertEqualObjects(event[@"tid"], @7);
+            XCTAssertEqualObjects(event[@"args"][@"status"], @200);
+            spans[event[@"name"]] = event;
+        }
+    }
+
+    XCTAssertEqualObjects([NSSet setWithArray:[spans allKeys]], ([NSSet setWithObjects:@"GET /users", @"request serialization", @"waiting", @"callback", nil]));
+    XCTAssertEqualWithAccuracy([spans[@"GET /users"][@"ts"] doubleValue], 1000, 0.001);
+    XCTAssertEqualWithAccuracy([spans[@"GET /users"][@"dur"] doubleValue], 5250, 0.001);
+    XCTAssertEqualWithAccuracy([spans[@"request serialization"][@"dur"] doubleValue], 500, 0.001);
+    XCTAssertEqualWithAccuracy([spans[@"waiting"][@"ts"] doubleValue], 2000, 0.001);
+    XCTAssertEqualWithAccuracy([spans[@"waiting"][@"dur"] doubleValue], 3000, 0.001);
+    XCTAssertEqualWithAccuracy([spans[@"callback"][@"dur"] doubleValue], 250, 0.001);
+}
+
+@end
@@ -0,0 +1,153 @@
+//
+//  AFXMLStreamingResponseSerializerTests.m
+//  AFNetWorkingDemoTests
+//
+
+#import <XCTest/XCTest.h>
+#import "AFURLSessionManager.h"
+#import "AFTestURLProtocol.h"
+
+static NSString * const AFXMLStreamingTestHost = @"xml.test";
+
+@interface AFXMLStreamingResponseSerializerTests : XCTestCase
+@property (nonatomic, strong) NSHTTPURLResponse *response;
+@end
+
+@implementation AFXMLStreamingResponseSerializerTests
+
+- (void)setUp {
+    [super setUp];
+    self.response = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"https://%@/feed", AFXMLStreamingTestHost]] statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Content-Type": @"application/xml"}];
+}
+
+- (void)tearDown {
+    [AFTestURLProtocol unregisterHost:AFXMLStreamingTestHost];
+    [super tearDown];
+}
+
+- (NSData *)feedData {
+    NSString *XML = @"<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                    @"<feed xmlns:media=\"http://search.yahoo.com/mrss/\">"
+                    @"<news><item id=\"1\" title=\"Tom &amp; Jerry\"><name>第一条</name><media:thumbnail url=\"https://example.com/1.png?a=1&amp;b=2\"/></item></news>"
+                    @"<sports><item id=\"2\"><name><![CDATA[<b>Second</b>]]></name></item></sports>"
+                    @"<item id=\"3\"><name>outside</name></item>"
+                    @"</feed>";
+    return [XML dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (NSArray <AFXMLElement *> *)elementsFromData:(NSData *)data serializer:(AFXMLStreamingResponseSerializer *)serializer chunkLength:(NSUInteger)chunkLength error:(NSError * __autoreleasing *)error {
+    id <AFURLResponseIncrementalParsing> parser = [serializer incrementalParserForResponse:self.response];
+    for (NSUInteger offset = 0; offset < [data length]; offset += chunkLength) {
+        [parser appendData:[data subdataWithRange:NSMakeRange(offset, MIN(chunkLength, [data length] - offset))]];
+    }
+
+    return [parser finishParsingWithError:error];
+}
+
+- (void)testWildcardPathsMatchAnyParent {
+    AFXMLStreamingResponseSerializer *serializer = [AFXMLStreamingResponseSerializer serializerWithMatchingPaths:[NSSet setWithObject:@"/feed/*/item"]];
+    NSArray <AFXMLElement *> *elements = [serializer responseObjectForResponse:self.response data:[self feedData] error:nil];
+
+    //只匹配第三级的item、/feed/item不匹配
+    XCTAssertEqualObjects([elements valueForKey:@"name"], (@[@"item", @"item"]));
+    XCTAssertEqualObjects([elements valueForKeyPath:@"attributes.id"], (@[@"1", @"2"]));
+    XCTAssertEqualObjects([elements[0] firstChildNamed:@"name"].text, @"第一条");
+    XCTAssertEqualObjects([elements[1] firstChildNamed:@"name"].text, @"<b>Second</b>");
+
+    serializer.matchingPaths = [NSSet setWithObjects:@"/*/item", @"/feed/news/item/media:thumbnail", nil];
+    elements = [serializer responseObjectForResponse:self.response data:[self feedData] error:nil];
+    XCTAssertEqualObjects([elements valueForKey:@"name"], (@[@"media:thumbnail", @"item"]));
+    XCTAssertEqualObjects(elements[0].namespaceURI, @"http://search.yahoo.com/mrss/");
+    XCTAssertEqualObjects(elements[1].attributes[@"id"], @"3");
+}
+
+- (void)testElementsSplitAcrossChunksParseLikeWholeDocument {
+    AFXMLStreamingResponseSerializer *serializer = [AFXMLStreamingResponseSerializer serializerWithMatchingPaths:[NSSet setWithObjects:@"/feed/*/item", @"/feed/item", nil]];
+    NSArray <AFXMLElement *> *expectedElements = [serializer responseObjectForResponse:self.response data:[self feedData] error:nil];
+    XCTAssertEqual([expectedElements count], (NSUInteger)3);
+
+    //逐字节和其他长度分段、标签、属性、实体和多字节字符都会被截断
+    for (NSNumber *chunkLength in @[@1, @2, @3, @7, @64]) {
+        NSError *error = nil;
+        NSArray <AFXMLElement *> *elements = [self elementsFromData:[self feedData] serializer:serializer chunkLength:[chunkLength unsignedIntegerValue] error:&error];
+        XCTAssertNil(error);
+        XCTAssertEqual([elements count], [expectedElements count]);
+        for (NSUInteger idx = 0; idx < MIN([elements count], [expectedElements count]); idx++) {
+            XCTAssertEqualObjects(elements[idx].name, expectedElements[idx].name);
+            XCTAssertEqualObjects(elements[idx].attributes, expectedElements[idx].attributes);
+            XCTAssertEqualObjects([elements[idx] firstChildNamed:@"name"].text, [expectedElements[idx] firstChildNamed:@"name"].text);
+            XCTAssertEqual([elements[idx].children count], [expectedElements[idx].children count]);
+        }
+    }
+}
+
+- (void)testAmpersandsInAttributesAreUnescaped {
+    AFXMLStreamingResponseSerializer *serializer = [AFXMLStreamingResponseSerializer serializerWithMatchingPaths:[NSSet setWithObject:@"/feed/news/item"]];
+    NSArray <AFXMLElement *> *elements = [self elementsFromData:[self feedData] serializer:serializer chunkLength:5 error:nil];
+
+    XCTAssertEqualObjects(elements[0].attributes[@"title"], @"Tom & Jerry");
+    XCTAssertEqualObjects([elements[0] firstChildNamed:@"media:thumbnail"].attributes[@"url"], @"https://example.com/1.png?a=1&b=2");
+
+    NSData *data = [@"<a b=\"&amp;&amp;\" c=\"x&#38;y\" d=\"&lt;&amp;&gt;\"/>" dataUsingEncoding:NSUTF8StringEncoding];
+    serializer.matchingPaths = [NSSet setWithObject:@"/a"];
+    elements = [serializer responseObjectForResponse:self.response data:data error:nil];
+    XCTAssertEqualObjects(elements[0].attributes, (@{@"b": @"&&", @"c": @"x&y", @"d": @"<&>"}));
+}
+
+- (void)testMalformedDocumentProducesError {
+    AFXMLStreamingResponseSerializer *serializer = [AFXMLStreamingResponseSerializer serializerWithMatchingPaths:[NSSet setWithObject:@"/a/b"]];
+    NSData *data = [@"<a><b>text</a>" dataUsingEncoding:NSUTF8StringEncoding];
+
+    NSError *error = nil;
+    XCTAssertNil([serializer responseObjectForResponse:self.response data:data error:&error]);
+    XCTAssertEqualObjects(error.domain, AFURLResponseSerializationErrorDomain);
+    XCTAssertEqual(error.code, NSURLErrorCannotDecodeContentData);
+    XCTAssertEqualObjects(error.userInfo[AFNetworkingOperationFailingURLResponseErrorKey], self.response);
+    XCTAssertEqualObjects(error.userInfo[AFNetworkingOperationFailingURLResponseDataErrorKey], data);
+
+    //边接收边解析时错误也带有响应和出错位置的数据
+    error = nil;
+    XCTAssertNil([self elementsFromData:data serializer:serializer chunkLength:4 error:&error]);
+    XCTAssertEqual(error.code, NSURLErrorCannotDecodeContentData);
+    XCTAssertEqualObjects(error.userInfo[AFNetworkingOperationFailingURLResponseErrorKey], self.response);
+    XCTAssertGreaterThan([error.userInfo[AFNetworkingOperationFailingURLResponseDataErrorKey] length], (NSUInteger)0);
+
+    //不完整的文档在结束时出错
+    error = nil;
+    XCTAssertNil([self elementsFromData:[@"<a><b>text</b>" dataUsingEncoding:NSUTF8StringEncoding] serializer:serializer chunkLength:4 error:&error]);
+    XCTAssertEqual(error.code, NSURLErrorCannotDecodeContentData);
+    XCTAssertEqualObjects(error.userInfo[AFNetworkingOperationFailingURLResponseDataErrorKey], [@"b>" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (void)testIncrementalErrorReachesCompletionAndNotification {
+    NSData *data = [@"<feed><item id=\"1\"/><item id=\"2\"></feed>" dataUsingEncoding:NSUTF8StringEncoding];
+    [AFTestURLProtocol registerHandler:^(AFTestURLProtocol *connection) {
+        [connection respondWithStatusCode:200 headerFields:@{@"Content-Type": @"application/xml"}];
+        [connection sendData:data chunkLength:8 interval:0.001];
+        [connection finish];
+    } forHost:AFXMLStreamingTestHost];
+
+    AFURLSessionManager *manager = [[AFURLSessionManager alloc] initWithSessionConfiguration:[AFTestURLProtocol sessionConfiguration]];
+    manager.responseSerializer = [AFXMLStreamingResponseSerializer serializerWithMatchingPaths:[NSSet setWithObject:@"/feed/item"]];
+
+    __block NSError *completionError = nil;
+    XCTestExpectation *notificationExpectation = [self expectationForNotification:AFNetworkingTaskDidCompleteNotification object:nil handler:^BOOL(NSNotification *notification) {
+        XCTAssertNotNil(notification.userInfo[AFNetworkingTaskDidCompleteErrorKey]);
+        XCTAssertGreaterThan([notification.userInfo[AFNetworkingTaskDidCompleteResponseDataKey] length], (NSUInteger)0);
+        return YES;
+    }];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+    [[manager dataTaskWithRequest:[NSURLRequest requestWithURL:self.response.URL] uploadProgress:nil downloadProgress:nil completionHandler:^(__unused NSURLResponse *response, id responseObject, NSError *error) {
+        XCTAssertNil(responseObject);
+        completionError = error;
+        [expectation fulfill];
+    }] resume];
+    [self waitForExpectations:@[expectation, notificationExpectation] timeout:5];
+
+    XCTAssertEqual(completionError.code, NSURLErrorCannotDecodeContentData);
+    XCTAssertEqualObjects([completionError.userInfo[AFNetworkingOperationFailingURLResponseErrorKey] URL], self.response.URL);
+
+    [manager invalidateSessionCancelingTasks:YES];
+}
+
+@end
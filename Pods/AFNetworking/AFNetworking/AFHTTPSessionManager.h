@@ -73,6 +73,184 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+    `AFHTTPResponseCache` 在内存中缓存GET请求解析后的responseObject以及响应的`ETag`/`Last-Modified`
+
+    新鲜期内(`Cache-Control: max-age`、没有时为`defaultFreshnessLifetime`)直接返回缓存、不发请求
+    过期后仍在`staleWhileRevalidateLifetime`内时、先返回缓存、同时在后台发送条件请求(`If-None-Match`/`If-Modified-Since`)
+    超过这个时间则发送条件请求并等待结果
+    服务器返回304时只刷新缓存的时间、不再解析、返回缓存的responseObject
+    `Cache-Control: no-store`的响应不缓存、`no-cache`的响应每次都会验证
+ */
+@interface AFHTTPResponseCache : NSObject
+
+/**
+    最多缓存的响应数、默认为100、0为不限制
+ */
+@property (nonatomic, assign) NSUInteger countLimit;
+
+/**
+    响应没有`max-age`时的新鲜期、默认为0(每次都验证)
+ */
+@property (nonatomic, assign) NSTimeInterval defaultFreshnessLifetime;
+
+/**
+    过期后还可以先返回缓存再在后台验证的时长、响应带有`stale-while-revalidate`时以响应为准、默认为1天
+ */
+@property (nonatomic, assign) NSTimeInterval staleWhileRevalidateLifetime;
+
+/**
+    除了URL以外还要比较的请求头、默认为`Accept`、`Accept-Encoding`、`Accept-Language`、`Authorization`
+ */
+@property (nonatomic, copy) NSArray <NSString *> *varyHTTPHeaderFields;
+
+/**
+    由缓存直接返回的次数(包括后台验证的)
+ */
+@property (readonly, nonatomic, assign) NSUInteger hitCount;
+
+/**
+    服务器返回304的次数
+ */
+@property (readonly, nonatomic, assign) NSUInteger notModifiedCount;
+
+/**
+    因为命中缓存或者304而没有重新下载的响应体字节数
+ */
+@property (readonly, nonatomic, assign) int64_t savedByteCount;
+
+/**
+    返回请求对应的缓存、没有时为nil、不检查是否过期
+ */
+- (nullable id)cachedResponseObjectForRequest:(NSURLRequest *)request;
+
+/**
+    移除请求对应的缓存
+ */
+- (void)removeCachedResponseForRequest:(NSURLRequest *)request;
+
+/**
+    移除所有缓存
+ */
+- (void)removeAllCachedResponses;
+
+@end
+
+/**
+    批量请求中的一个请求
+ */
+@interface AFHTTPBatchRequest : NSObject
+
+/**
+    请求方法
+ */
+@property (nonatomic, copy) NSString *HTTPMethod;
+
+/**
+    URL、可以是相对`baseURL`的路径
+ */
+@property (nonatomic, copy) NSString *URLString;
+
+/**
+    参数、由`requestSerializer`编码
+ */
+@property (nonatomic, strong, nullable) id parameters;
+
++ (instancetype)requestWithMethod:(NSString *)method
+                        URLString:(NSString *)URLString
+                       parameters:(nullable id)parameters;
+
+@end
+
+/**
+    批量请求中一个请求的结果
+ */
+@interface AFHTTPBatchResult : NSObject
+
+/**
+    请求在批量请求中的序号
+ */
+@property (readonly, nonatomic, assign) NSUInteger index;
+
+@property (readonly, nonatomic, strong, nullable) NSURLResponse *response;
+
+@property (readonly, nonatomic, strong, nullable) id responseObject;
+
+@property (readonly, nonatomic, strong, nullable) NSError *error;
+
+@end
+
+/**
+    批量请求结果的交付顺序
+ */
+typedef NS_ENUM(NSUInteger, AFHTTPBatchResultOrder) {
+    AFHTTPBatchResultOrderSubmission,//按提交的顺序、前面的请求没完成时后面的结果会等待
+    AFHTTPBatchResultOrderCompletion,//按完成的顺序
+};
+
+/**
+    `AFHTTPBatchTask` 由`-batchTaskWithRequests:maximumConcurrentRequestCount:resultOrder:queue:chunkSize:resultsHandler:completionHandler:`返回
+ */
+@interface AFHTTPBatchTask : NSObject
+
+/**
+    请求总数
+ */
+@property (readonly, nonatomic, assign) NSUInteger requestCount;
+
+/**
+    已经完成的请求数
+ */
+@property (readonly, nonatomic, assign) NSUInteger completedRequestCount;
+
+/**
+    取消所有未完成的请求、它们的结果为`NSURLErrorCancelled`错误
+ */
+- (void)cancel;
+
+@end
+
+/**
+    `AFHTTPRequestHedgingPolicy` 对冲请求策略、只用于幂等请求(GET、HEAD)
+
+    每个路由(方法 + 主机 + 路径、路径中的数字和长ID段视为同一个)用一个流式直方图记录耗时、耗时从原请求开始到先成功的请求结束
+    请求在该路由的`latencyPercentile`耗时内还没有完成时、再发送一个相同的请求、先成功返回的为准、另一个被取消
+    对冲请求数不超过普通请求数的`budgetRatio`、避免服务器本身变慢时成倍增加压力
+ */
+@interface AFHTTPRequestHedgingPolicy : NSObject
+
+/**
+    触发对冲的耗时百分位、默认为0.95
+ */
+@property (nonatomic, assign) double latencyPercentile;
+
+/**
+    对冲请求占普通请求的最大比例、默认为0.05
+ */
+@property (nonatomic, assign) double budgetRatio;
+
+/**
+    路由至少有多少个样本后才开始对冲、默认为20
+ */
+@property (nonatomic, assign) NSUInteger minimumSampleCount;
+
+/**
+    已经发送的对冲请求数
+ */
+@property (readonly, nonatomic, assign) NSUInteger hedgedRequestCount;
+
+/**
+    对冲请求先于原请求返回的次数
+ */
+@property (readonly, nonatomic, assign) NSUInteger hedgeWinCount;
+
+/**
+    请求所属路由当前的对冲延迟、样本不足时为0(不对冲)
+ */
+- (NSTimeInterval)hedgeDelayForRequest:(NSURLRequest *)request;
+
+@end
+
 @interface AFHTTPSessionManager : AFURLSessionManager <NSSecureCoding, NSCopying>
 
 /**
@@ -90,6 +268,48 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, strong) AFHTTPResponseSerializer <AFURLResponseSerialization> * responseSerializer;
 
+///---------------------------
+/// @name 请求合并
+///---------------------------
+
+/**
+    是否合并相同的幂等请求(GET、HEAD) 默认NO
+    开启后、与正在进行中的请求完全相同的请求不会再发出、而是挂到进行中的任务上、
+    最后一个调用方拿到解析后的responseObject、其余调用方各自拿到一份深拷贝、互相修改不会影响。返回的task也是同一个、直接对它调用`cancel`会取消所有调用方、
+    需要单独取消时使用`-cancelCoalescedTask:receiptID:`
+ */
+@property (nonatomic, assign) BOOL coalescesIdempotentRequests;
+
+/**
+    判断两个请求是否相同时、除了请求方法和URL以外还要比较的请求头
+    默认为`Accept`、`Accept-Encoding`、`Accept-Language`、`Authorization`
+ */
+@property (nonatomic, copy) NSArray <NSString *> *coalescingHTTPHeaderFields;
+
+///---------------------------
+/// @name 响应缓存
+///---------------------------
+
+/**
+    GET请求的响应缓存、默认为nil(只使用`NSURLCache`)
+    新鲜的缓存与网络请求的回调一样通过`completionQueue`投递(包括`coalescesCompletionDelivery`的合并投递)、此时GET返回nil、success的task也为nil
+    先返回缓存再后台验证时、GET返回验证任务、验证结果只用于更新缓存、不会再次回调
+    缓存保存responseObject的拷贝、每次命中返回一份新的拷贝、调用方修改返回的对象不会影响缓存
+    响应带有`Vary`时、只有其中列出的请求头与生成缓存的请求一致才会命中、`Vary: *`的响应不缓存
+ */
+@property (nonatomic, strong, nullable) AFHTTPResponseCache *responseCache;
+
+///---------------------------
+/// @name 对冲请求
+///---------------------------
+
+/**
+    GET、HEAD请求的对冲策略、默认为nil(不对冲)
+    返回的task是第一个请求、success/failure收到的task是先返回的那个
+    取消返回的task会同时取消对冲请求
+ */
+@property (nonatomic, strong, nullable) AFHTTPRequestHedgingPolicy *hedgingPolicy;
+
 ///---------------------
 /// @name 初始化
 ///---------------------
@@ -129,7 +349,7 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (nullable NSURLSessionDataTask *)GET:(NSString *)URLString
                    parameters:(nullable id)parameters
-                      success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
+                      success:(nullable void (^)(NSURLSessionDataTask * _Nullable task, id _Nullable responseObject))success
                       failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure DEPRECATED_ATTRIBUTE;
 
 
@@ -147,9 +367,35 @@ NS_ASSUME_NONNULL_BEGIN
 - (nullable NSURLSessionDataTask *)GET:(NSString *)URLString
                             parameters:(nullable id)parameters
                               progress:(nullable void (^)(NSProgress *downloadProgress))downloadProgress
-                               success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
+                               success:(nullable void (^)(NSURLSessionDataTask * _Nullable task, id _Nullable responseObject))success
                                failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
 
+/**
+    GET请求、可以通过receiptID单独取消
+
+ @param URLString URL
+ @param parameters 参数
+ @param receiptID 调用方标识、用于`-cancelCoalescedTask:receiptID:`
+ @param downloadProgress 下载进度、合并后每个还在等待的调用方都会收到
+ @param success 成功
+ @param failure 失败
+ */
+- (nullable NSURLSessionDataTask *)GET:(NSString *)URLString
+                            parameters:(nullable id)parameters
+                             receiptID:(NSUUID *)receiptID
+                              progress:(nullable void (^)(NSProgress *downloadProgress))downloadProgress
+                               success:(nullable void (^)(NSURLSessionDataTask * _Nullable task, id _Nullable responseObject))success
+                               failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
+
+/**
+    取消合并请求中的一个调用方
+    该调用方的failure会收到`NSURLErrorCancelled`、当所有调用方都取消后才真正取消任务
+
+ @param task GET/HEAD返回的任务
+ @param receiptID 调用方标识
+ */
+- (void)cancelCoalescedTask:(NSURLSessionDataTask *)task receiptID:(NSUUID *)receiptID;
+
 /**
     HEAD请求
 
@@ -271,6 +517,34 @@ NS_ASSUME_NONNULL_BEGIN
                          success:(nullable void (^)(NSURLSessionDataTask *task, id _Nullable responseObject))success
                          failure:(nullable void (^)(NSURLSessionDataTask * _Nullable task, NSError *error))failure;
 
+///---------------------------
+/// @name 批量请求
+///---------------------------
+
+/**
+    批量请求、最多同时进行`maximumConcurrentRequestCount`个、一个完成后立即开始下一个
+
+    任务和普通请求一样由manager创建、受`concurrencyLimiter`限制、由`taskTimingRecorder`记录、响应在处理队列上用`responseSerializer`解析
+    不经过请求合并、响应缓存和对冲、结果成组交付到`queue`上
+
+ @param requests 请求列表
+ @param maximumConcurrentRequestCount 最多同时进行的请求数
+ @param resultOrder 结果的交付顺序
+ @param queue 回调队列、为nil时使用`completionQueue`、都没有时使用主队列
+ @param chunkSize 每收集到多少个结果调用一次resultsHandler、0为只在最后调用一次
+ @param resultsHandler 分批交付结果、为nil时只通过completionHandler交付
+ @param completionHandler 所有请求完成时调用、设置了resultsHandler时`results`为nil(结果已经分批交付、不再保留)
+
+ @return 返回的批量任务已经开始
+ */
+- (AFHTTPBatchTask *)batchTaskWithRequests:(NSArray <AFHTTPBatchRequest *> *)requests
+             maximumConcurrentRequestCount:(NSUInteger)maximumConcurrentRequestCount
+                               resultOrder:(AFHTTPBatchResultOrder)resultOrder
+                                     queue:(nullable dispatch_queue_t)queue
+                                 chunkSize:(NSUInteger)chunkSize
+                            resultsHandler:(nullable void (^)(NSArray <AFHTTPBatchResult *> *results))resultsHandler
+                         completionHandler:(nullable void (^)(NSArray <AFHTTPBatchResult *> * _Nullable results))completionHandler;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -40,8 +40,572 @@
 #import <WatchKit/WatchKit.h>
 #endif
 
+//判断请求是否相同的key: 请求方法 + URL + 影响响应结果的请求头
+static NSString * AFCoalescingKeyForRequest(NSURLRequest *request, NSArray <NSString *> *HTTPHeaderFields) {
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%@ %@", request.HTTPMethod, request.URL.absoluteString];
+    for (NSString *field in HTTPHeaderFields) {
+        NSString *value = [request valueForHTTPHeaderField:field];
+        if (value) {
+            [key appendFormat:@"\n%@: %@", [field lowercaseString], value];
+        }
+    }
+
+    return key;
+}
+
+//响应头的名字不区分大小写、统一转成小写之后再查
+static NSDictionary <NSString *, NSString *> * AFLowercasedHTTPHeaderFields(NSDictionary *headerFields) {
+    NSMutableDictionary *lowercasedHeaderFields = [NSMutableDictionary dictionaryWithCapacity:[headerFields count]];
+    [headerFields enumerateKeysAndObjectsUsingBlock:^(id field, id value, __unused BOOL *stop) {
+        if ([field isKindOfClass:[NSString class]]) {
+            lowercasedHeaderFields[[(NSString *)field lowercaseString]] = value;
+        }
+    }];
+
+    return lowercasedHeaderFields;
+}
+
+//深拷贝解析后的responseObject、容器保持原来的可变性
+//字符串、数字等不可变对象以及模型对象直接共用
+static id AFCopiedResponseObject(id responseObject) {
+    if ([responseObject isKindOfClass:[NSDictionary class]]) {
+        NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:[(NSDictionary *)responseObject count]];
+        [(NSDictionary *)responseObject enumerateKeysAndObjectsUsingBlock:^(id key, id value, __unused BOOL *stop) {
+            dictionary[key] = AFCopiedResponseObject(value);
+        }];
+        return [responseObject isKindOfClass:[NSMutableDictionary class]] ? dictionary : [dictionary copy];
+    } else if ([responseObject isKindOfClass:[NSArray class]]) {
+        NSMutableArray *array = [NSMutableArray arrayWithCapacity:[(NSArray *)responseObject count]];
+        for (id value in (NSArray *)responseObject) {
+            [array addObject:AFCopiedResponseObject(value)];
+        }
+        return [responseObject isKindOfClass:[NSMutableArray class]] ? array : [array copy];
+    } else if ([responseObject isKindOfClass:[NSMutableString class]] || [responseObject isKindOfClass:[NSMutableData class]]) {
+        return [responseObject mutableCopy];
+    }
+
+    return responseObject;
+}
+
+//挂在同一个任务上的调用方
+@interface AFHTTPSessionManagerCoalescedHandler : NSObject
+@property (nonatomic, strong) NSUUID *receiptID;
+@property (nonatomic, copy) void (^downloadProgress)(NSProgress *downloadProgress);
+@property (nonatomic, copy) void (^success)(NSURLSessionDataTask *task, id responseObject);
+@property (nonatomic, copy) void (^failure)(NSURLSessionDataTask *task, NSError *error);
+@end
+
+@implementation AFHTTPSessionManagerCoalescedHandler
+@end
+
+//进行中的合并任务
+@interface AFHTTPSessionManagerCoalescedTask : NSObject
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, strong) NSURLSessionDataTask *task;
+@property (nonatomic, strong) NSMutableArray <AFHTTPSessionManagerCoalescedHandler *> *handlers;
+@end
+
+@implementation AFHTTPSessionManagerCoalescedTask
+
+- (instancetype)initWithKey:(NSString *)key {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.key = key;
+    self.handlers = [[NSMutableArray alloc] init];
+
+    return self;
+}
+
+@end
+
+/**
+    判断相对路径能否直接拼接在baseURL后面
+    带scheme、以"//"、"?"、"#"开头或者包含"."、".."路径段的、都需要交给NSURL按RFC 3986完整解析
+ */
+static BOOL AFURLStringCanBeAppendedToBaseURL(NSString *URLString) {
+    NSUInteger length = [URLString length];
+    if (length == 0) {
+        return NO;
+    }
+
+    unichar firstCharacter = [URLString characterAtIndex:0];
+    if (firstCharacter == '?' || firstCharacter == '#') {
+        return NO;
+    }
+    if (firstCharacter == '/' && length > 1 && [URLString characterAtIndex:1] == '/') {
+        return NO;
+    }
+
+    BOOL isFirstSegment = YES;
+    NSUInteger segmentStart = 0;
+    //末尾当作一个'/'、方便检查最后一个路径段
+    for (NSUInteger idx = 0; idx <= length; idx++) {
+        unichar character = idx < length ? [URLString characterAtIndex:idx] : '/';
+        if (character == ':' && isFirstSegment) {
+            //第一个路径段里出现':'代表带有scheme
+            return NO;
+        }
+
+        if (character == '/' || character == '?' || character == '#') {
+            NSUInteger segmentLength = idx - segmentStart;
+            BOOL isDotSegment = (segmentLength == 1 && [URLString characterAtIndex:segmentStart] == '.') || (segmentLength == 2 && [URLString characterAtIndex:segmentStart] == '.' && [URLString characterAtIndex:segmentStart + 1] == '.');
+            if (isDotSegment) {
+                return NO;
+            }
+
+            isFirstSegment = NO;
+            if (character != '/') {
+                //后面是query或者fragment、不再检查
+                break;
+            }
+            segmentStart = idx + 1;
+        }
+    }
+
+    return YES;
+}
+
+#pragma mark -
+
+//缓存的一个响应、刷新时整体替换、不在原对象上修改
+@interface AFHTTPResponseCacheEntry : NSObject
+@property (nonatomic, strong) id responseObject;
+@property (nonatomic, copy) NSString *entityTag;
+@property (nonatomic, copy) NSString *lastModified;
+@property (nonatomic, assign) CFAbsoluteTime storedTime;
+@property (nonatomic, assign) NSTimeInterval freshnessLifetime;
+@property (nonatomic, assign) NSTimeInterval staleWhileRevalidateLifetime;
+@property (nonatomic, assign) int64_t byteCount;//响应体长度、用于统计节省的流量
+@property (nonatomic, copy) NSDictionary <NSString *, NSString *> *varyHTTPHeaderValues;//响应Vary中列出的请求头、key为小写、请求中没有的为@""
+
+- (BOOL)isFresh;
+- (BOOL)canServeStale;
+- (BOOL)matchesRequest:(NSURLRequest *)request;
+@end
+
+@implementation AFHTTPResponseCacheEntry
+
+- (BOOL)isFresh {
+    return CFAbsoluteTimeGetCurrent() - self.storedTime < self.freshnessLifetime;
+}
+
+- (BOOL)canServeStale {
+    return CFAbsoluteTimeGetCurrent() - self.storedTime < self.freshnessLifetime + self.staleWhileRevalidateLifetime;
+}
+
+//Vary中列出的请求头与生成缓存的请求一致时才能使用
+- (BOOL)matchesRequest:(NSURLRequest *)request {
+    __block BOOL matches = YES;
+    [self.varyHTTPHeaderValues enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *value, BOOL *stop) {
+        matches = [([request valueForHTTPHeaderField:field] ?: @"") isEqualToString:value];
+        *stop = !matches;
+    }];
+
+    return matches;
+}
+
+@end
+
+//解析Cache-Control、例如 "max-age=60, stale-while-revalidate=30" -> @{@"max-age": @"60", @"stale-while-revalidate": @"30"}
+static NSDictionary <NSString *, NSString *> * AFCacheControlDirectives(NSString *cacheControl) {
+    NSMutableDictionary *directives = [NSMutableDictionary dictionary];
+    for (NSString *component in [cacheControl componentsSeparatedByString:@","]) {
+        NSString *directive = [component stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        NSRange equalRange = [directive rangeOfString:@"="];
+        if (equalRange.location == NSNotFound) {
+            if ([directive length] > 0) {
+                directives[[directive lowercaseString]] = @"";
+            }
+        } else {
+            NSString *value = [[directive substringFromIndex:NSMaxRange(equalRange)] stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"\" "]];
+            directives[[[directive substringToIndex:equalRange.location] lowercaseString]] = value;
+        }
+    }
+
+    return directives;
+}
+
+@interface AFHTTPResponseCache ()
+@property (readwrite, nonatomic, strong) NSCache <NSString *, AFHTTPResponseCacheEntry *> *entries;
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, assign) NSUInteger hitCount;
+@property (readwrite, nonatomic, assign) NSUInteger notModifiedCount;
+@property (readwrite, nonatomic, assign) int64_t savedByteCount;
+@end
+
+@implementation AFHTTPResponseCache
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.entries = [[NSCache alloc] init];
+    self.countLimit = 100;
+    self.staleWhileRevalidateLifetime = 60 * 60 * 24;
+    self.varyHTTPHeaderFields = @[@"Accept", @"Accept-Encoding", @"Accept-Language", @"Authorization"];
+    self.lock = [[NSLock alloc] init];
+
+    return self;
+}
+
+- (void)setCountLimit:(NSUInteger)countLimit {
+    _countLimit = countLimit;
+    self.entries.countLimit = countLimit;
+}
+
+- (NSString *)keyForRequest:(NSURLRequest *)request {
+    return AFCoalescingKeyForRequest(request, self.varyHTTPHeaderFields);
+}
+
+- (AFHTTPResponseCacheEntry *)entryForRequest:(NSURLRequest *)request {
+    AFHTTPResponseCacheEntry *entry = [self.entries objectForKey:[self keyForRequest:request]];
+
+    return [entry matchesRequest:request] ? entry : nil;
+}
+
+- (id)cachedResponseObjectForRequest:(NSURLRequest *)request {
+    return AFCopiedResponseObject([self entryForRequest:request].responseObject);
+}
+
+- (void)removeCachedResponseForRequest:(NSURLRequest *)request {
+    [self.entries removeObjectForKey:[self keyForRequest:request]];
+}
+
+- (void)removeAllCachedResponses {
+    [self.entries removeAllObjects];
+}
+
+//根据响应头生成缓存项、不能缓存时返回nil
+- (AFHTTPResponseCacheEntry *)entryWithResponseObject:(id)responseObject
+                                             response:(NSHTTPURLResponse *)response
+                                            byteCount:(int64_t)byteCount
+                                              request:(NSURLRequest *)request
+{
+    if (!responseObject || ![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return nil;
+    }
+
+    NSDictionary *headers = AFLowercasedHTTPHeaderFields(response.allHeaderFields);
+    NSDictionary *directives = AFCacheControlDirectives(headers[@"cache-control"]);
+    if (directives[@"no-store"]) {
+        return nil;
+    }
+
+    //Vary: * 表示响应取决于请求以外的因素、不能缓存
+    NSMutableDictionary *varyHTTPHeaderValues = [NSMutableDictionary dictionary];
+    for (NSString *component in [headers[@"vary"] componentsSeparatedByString:@","]) {
+        NSString *field = [[component stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] lowercaseString];
+        if ([field isEqualToString:@"*"]) {
+            return nil;
+        }
+        if ([field length] > 0) {
+            varyHTTPHeaderValues[field] = [request valueForHTTPHeaderField:field] ?: @"";
+        }
+    }
+
+    AFHTTPResponseCacheEntry *entry = [[AFHTTPResponseCacheEntry alloc] init];
+    entry.responseObject = responseObject;
+    entry.varyHTTPHeaderValues = varyHTTPHeaderValues;
+    entry.entityTag = headers[@"etag"];
+    entry.lastModified = headers[@"last-modified"];
+    entry.storedTime = CFAbsoluteTimeGetCurrent();
+    entry.byteCount = byteCount;
+
+    if (directives[@"no-cache"]) {
+        entry.freshnessLifetime = 0;
+    } else if (directives[@"max-age"]) {
+        //减去响应在中间缓存里已经存放的时间
+        entry.freshnessLifetime = MAX([directives[@"max-age"] doubleValue] - [headers[@"age"] doubleValue], 0);
+    } else {
+        entry.freshnessLifetime = self.defaultFreshnessLifetime;
+    }
+    entry.staleWhileRevalidateLifetime = directives[@"stale-while-revalidate"] ? [directives[@"stale-while-revalidate"] doubleValue] : self.staleWhileRevalidateLifetime;
+
+    return entry;
+}
+
+- (void)storeResponseObject:(id)responseObject
+                   response:(NSHTTPURLResponse *)response
+                  byteCount:(int64_t)byteCount
+                 forRequest:(NSURLRequest *)request
+{
+    //调用方拿到的是同一个对象、缓存保存一份拷贝、之后的修改不会影响缓存
+    AFHTTPResponseCacheEntry *entry = [self entryWithResponseObject:AFCopiedResponseObject(responseObject) response:response byteCount:byteCount request:request];
+    if (entry) {
+        [self.entries setObject:entry forKey:[self keyForRequest:request]];
+    } else {
+        [self removeCachedResponseForRequest:request];
+    }
+}
+
+//304: 沿用原来的responseObject、用新的响应头刷新时间和验证信息
+- (void)refreshEntry:(AFHTTPResponseCacheEntry *)entry
+        withResponse:(NSHTTPURLResponse *)response
+          forRequest:(NSURLRequest *)request
+{
+    AFHTTPResponseCacheEntry *refreshedEntry = [self entryWithResponseObject:entry.responseObject response:response byteCount:entry.byteCount request:request];
+    if (refreshedEntry) {
+        refreshedEntry.entityTag = refreshedEntry.entityTag ?: entry.entityTag;
+        refreshedEntry.lastModified = refreshedEntry.lastModified ?: entry.lastModified;
+        //304没有Vary时沿用原来的
+        if ([refreshedEntry.varyHTTPHeaderValues count] == 0) {
+            refreshedEntry.varyHTTPHeaderValues = entry.varyHTTPHeaderValues;
+        }
+        [self.entries setObject:refreshedEntry forKey:[self keyForRequest:request]];
+    } else {
+        [self removeCachedResponseForRequest:request];
+    }
+
+    [self.lock lock];
+    self.notModifiedCount++;
+    self.savedByteCount += entry.byteCount;
+    [self.lock unlock];
+}
+
+//后台验证的命中不计入节省的流量、由验证结果决定
+- (void)recordHitForEntry:(AFHTTPResponseCacheEntry *)entry savesBytes:(BOOL)savesBytes {
+    [self.lock lock];
+    self.hitCount++;
+    if (savesBytes) {
+        self.savedByteCount += entry.byteCount;
+    }
+    [self.lock unlock];
+}
+
+@end
+
+#pragma mark -
+
+//路由: 方法 + 主机 + 路径、纯数字或者较长的十六进制段(ID、UUID)替换为":id"
+static NSString * AFHedgingRouteForRequest(NSURLRequest *request) {
+    NSURL *URL = request.URL;
+    NSMutableString *route = [NSMutableString stringWithFormat:@"%@ %@://%@", request.HTTPMethod, [URL.scheme lowercaseString], [URL.host lowercaseString]];
+    if (URL.port) {
+        [route appendFormat:@":%@", URL.port];
+    }
+
+    NSCharacterSet *nonDigitCharacterSet = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+    NSCharacterSet *nonIdentifierCharacterSet = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdefABCDEF-"] invertedSet];
+    for (NSString *component in [URL.path componentsSeparatedByString:@"/"]) {
+        if ([component length] == 0) {
+            continue;
+        }
+        BOOL isNumber = [component rangeOfCharacterFromSet:nonDigitCharacterSet].location == NSNotFound;
+        BOOL isIdentifier = [component length] >= 16 && [component rangeOfCharacterFromSet:nonIdentifierCharacterSet].location == NSNotFound;
+        [route appendString:@"/"];
+        [route appendString:(isNumber || isIdentifier) ? @":id" : component];
+    }
+
+    return route;
+}
+
+static NSUInteger const kAFLatencyHistogramBucketCount = 256;
+//每个桶比前一个宽5%、从1ms到大约260s
+static double const kAFLatencyHistogramBucketGrowth = 1.05;
+//样本数达到这个值时所有桶减半、旧样本的权重逐渐降低
+static uint32_t const kAFLatencyHistogramDecayCount = 2000;
+
+//对数分桶的流式直方图、固定内存、百分位的误差在5%以内
+@interface AFHTTPLatencyHistogram : NSObject
+@property (nonatomic, strong) NSMutableData *bucketCounts;//uint32_t[kAFLatencyHistogramBucketCount]
+@property (nonatomic, assign) uint32_t count;
+@end
+
+@implementation AFHTTPLatencyHistogram
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.bucketCounts = [NSMutableData dataWithLength:kAFLatencyHistogramBucketCount * sizeof(uint32_t)];
+
+    return self;
+}
+
+- (void)addSample:(NSTimeInterval)latency {
+    double milliseconds = latency * 1000;
+    NSUInteger index = milliseconds <= 1 ? 0 : (NSUInteger)MIN(ceil(log(milliseconds) / log(kAFLatencyHistogramBucketGrowth)), (double)(kAFLatencyHistogramBucketCount - 1));
+
+    uint32_t *buckets = [self.bucketCounts mutableBytes];
+    buckets[index]++;
+    self.count++;
+
+    if (self.count >= kAFLatencyHistogramDecayCount) {
+        uint32_t count = 0;
+        for (NSUInteger i = 0; i < kAFLatencyHistogramBucketCount; i++) {
+            buckets[i] /= 2;
+            count += buckets[i];
+        }
+        self.count = count;
+    }
+}
+
+//返回所在桶的上界
+- (NSTimeInterval)latencyAtPercentile:(double)percentile {
+    if (self.count == 0) {
+        return 0;
+    }
+
+    const uint32_t *buckets = [self.bucketCounts bytes];
+    uint32_t target = (uint32_t)MAX(ceil(percentile * self.count), 1.0);
+    uint32_t cumulativeCount = 0;
+    for (NSUInteger i = 0; i < kAFLatencyHistogramBucketCount; i++) {
+        cumulativeCount += buckets[i];
+        if (cumulativeCount >= target) {
+            return pow(kAFLatencyHistogramBucketGrowth, (double)i) / 1000;
+        }
+    }
+
+    return pow(kAFLatencyHistogramBucketGrowth, (double)(kAFLatencyHistogramBucketCount - 1)) / 1000;
+}
+
+@end
+
+//最多记录的路由数、超过时全部清空重新统计
+static NSUInteger const kAFHedgingMaximumRouteCount = 512;
+
+@interface AFHTTPRequestHedgingPolicy ()
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, strong) NSMutableDictionary <NSString *, AFHTTPLatencyHistogram *> *histograms;
+@property (readwrite, nonatomic, assign) double requestCount;
+@property (readwrite, nonatomic, assign) double hedgeCount;
+@property (readwrite, nonatomic, assign) NSUInteger hedgedRequestCount;
+@property (readwrite, nonatomic, assign) NSUInteger hedgeWinCount;
+@end
+
+@implementation AFHTTPRequestHedgingPolicy
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.latencyPercentile = 0.95;
+    self.budgetRatio = 0.05;
+    self.minimumSampleCount = 20;
+    self.lock = [[NSLock alloc] init];
+    self.histograms = [NSMutableDictionary dictionary];
+
+    return self;
+}
+
+- (NSTimeInterval)hedgeDelayForRequest:(NSURLRequest *)request {
+    return [self hedgeDelayForRoute:AFHedgingRouteForRequest(request)];
+}
+
+- (NSTimeInterval)hedgeDelayForRoute:(NSString *)route {
+    [self.lock lock];
+    AFHTTPLatencyHistogram *histogram = self.histograms[route];
+    NSTimeInterval delay = histogram.count >= MAX(self.minimumSampleCount, (NSUInteger)1) ? [histogram latencyAtPercentile:self.latencyPercentile] : 0;
+    [self.lock unlock];
+
+    return delay;
+}
+
+- (void)recordLatency:(NSTimeInterval)latency forRoute:(NSString *)route {
+    [self.lock lock];
+    AFHTTPLatencyHistogram *histogram = self.histograms[route];
+    if (!histogram) {
+        if ([self.histograms count] >= kAFHedgingMaximumRouteCount) {
+            [self.histograms removeAllObjects];
+        }
+        histogram = [[AFHTTPLatencyHistogram alloc] init];
+        self.histograms[route] = histogram;
+    }
+    [histogram addSample:latency];
+    [self.lock unlock];
+}
+
+//预算按请求数衰减、反映最近的比例
+- (void)recordRequest {
+    [self.lock lock];
+    self.requestCount += 1;
+    if (self.requestCount >= 1000) {
+        self.requestCount /= 2;
+        self.hedgeCount /= 2;
+    }
+    [self.lock unlock];
+}
+
+- (BOOL)acquireHedgeBudget {
+    [self.lock lock];
+    BOOL allowed = self.hedgeCount + 1 <= self.budgetRatio * self.requestCount;
+    if (allowed) {
+        self.hedgeCount += 1;
+        self.hedgedRequestCount++;
+    }
+    [self.lock unlock];
+
+    return allowed;
+}
+
+- (void)recordHedgeWin {
+    [self.lock lock];
+    self.hedgeWinCount++;
+    [self.lock unlock];
+}
+
+@end
+
+//一次对冲请求的状态、原请求和对冲请求共享
+@interface AFHTTPHedgedRequest : NSObject
+@property (nonatomic, strong) NSLock *lock;
+@property (nonatomic, copy) NSURLRequest *request;
+@property (nonatomic, strong) NSURLSessionDataTask *primaryTask;
+@property (nonatomic, strong) NSURLSessionDataTask *hedgeTask;
+@property (nonatomic, assign) NSUInteger pendingCount;
+@property (nonatomic, assign) BOOL finished;
+@property (nonatomic, assign) uint64_t startTime;//原请求开始的时间、AFURLSessionTaskTimingTimestamp()
+@property (nonatomic, strong) AFHTTPRequestHedgingPolicy *hedgingPolicy;
+@property (nonatomic, copy) NSString *route;
+@property (nonatomic, copy) void (^completionHandler)(NSURLSessionDataTask *task, id responseObject, NSError *error);
+@end
+
+@implementation AFHTTPHedgedRequest
+@end
+
 @interface AFHTTPSessionManager ()
 @property (readwrite, nonatomic, strong) NSURL *baseURL;
+//拼接相对路径用的前缀 scheme://authority/path/ 到最后一个'/'为止
+@property (readwrite, nonatomic, copy) NSString *baseURLRelativePathPrefix;
+//拼接绝对路径用的前缀 scheme://authority
+@property (readwrite, nonatomic, copy) NSString *baseURLAbsolutePathPrefix;
+//key: AFCoalescingKeyForRequest  value: AFHTTPSessionManagerCoalescedTask
+@property (readwrite, nonatomic, strong) NSMutableDictionary <NSString *, AFHTTPSessionManagerCoalescedTask *> *coalescedTasks;
+@property (readwrite, nonatomic, strong) NSLock *coalescingLock;
+//原请求还没有真正开始的对冲请求、开始或者结束时移除
+@property (readwrite, nonatomic, strong) NSMapTable <NSURLSessionTask *, AFHTTPHedgedRequest *> *pendingHedgedRequests;
+@property (readwrite, nonatomic, strong) NSLock *hedgingLock;
+
+- (NSString *)absoluteURLStringForURLString:(NSString *)URLString;
+@end
+
+@interface AFURLSessionManager ()
+//把回调投递到completionQueue、`coalescesCompletionDelivery`为YES时合并投递
+- (void)deliverCompletionBlock:(dispatch_block_t)block;
+//任务真正开始(通过并发限制之后)
+- (void)taskDidResume:(NSNotification *)notification;
+@end
+
+@interface AFHTTPBatchTask ()
+- (instancetype)initWithManager:(AFHTTPSessionManager *)manager
+                       requests:(NSArray <AFHTTPBatchRequest *> *)requests
+  maximumConcurrentRequestCount:(NSUInteger)maximumConcurrentRequestCount
+                    resultOrder:(AFHTTPBatchResultOrder)resultOrder
+                          queue:(dispatch_queue_t)queue
+                      chunkSize:(NSUInteger)chunkSize
+                 resultsHandler:(void (^)(NSArray <AFHTTPBatchResult *> *results))resultsHandler
+              completionHandler:(void (^)(NSArray <AFHTTPBatchResult *> *results))completionHandler;
+
+- (void)startRequests;
 @end
 
 @implementation AFHTTPSessionManager
@@ -82,6 +646,17 @@
     //解码器
     self.responseSerializer = [AFJSONResponseSerializer serializer];
 
+    //请求合并
+    self.coalescingHTTPHeaderFields = @[@"Accept", @"Accept-Encoding", @"Accept-Language", @"Authorization"];
+    self.coalescedTasks = [[NSMutableDictionary alloc] init];
+    self.coalescingLock = [[NSLock alloc] init];
+    self.coalescingLock.name = @"com.alamofire.networking.session.manager.coalescing.lock";
+
+    //对冲
+    self.pendingHedgedRequests = [NSMapTable strongToStrongObjectsMapTable];
+    self.hedgingLock = [[NSLock alloc] init];
+    self.hedgingLock.name = @"com.alamofire.networking.session.manager.hedging.lock";
+
     return self;
 }
 
@@ -99,6 +674,60 @@
     [super setResponseSerializer:responseSerializer];
 }
 
+#pragma mark - URL拼接
+
+//设置baseURL时预先拆分好前缀、之后每个请求只需要拼接字符串
+- (void)setBaseURL:(NSURL *)baseURL {
+    _baseURL = baseURL;
+    self.baseURLRelativePathPrefix = nil;
+    self.baseURLAbsolutePathPrefix = nil;
+
+    NSString *baseURLString = [baseURL absoluteString];
+    if (!baseURLString || !baseURL.host) {
+        return;
+    }
+
+    //query和fragment不参与拼接
+    NSRange queryRange = [baseURLString rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"?#"]];
+    if (queryRange.location != NSNotFound) {
+        baseURLString = [baseURLString substringToIndex:queryRange.location];
+    }
+
+    NSRange schemeSeparatorRange = [baseURLString rangeOfString:@"://"];
+    //baseURL自身带有"."、".."路径段的交给NSURL处理
+    if (schemeSeparatorRange.location == NSNotFound || [baseURLString rangeOfString:@"/."].location != NSNotFound) {
+        return;
+    }
+
+    NSUInteger authorityStart = NSMaxRange(schemeSeparatorRange);
+    NSRange pathRange = [baseURLString rangeOfString:@"/" options:(NSStringCompareOptions)0 range:NSMakeRange(authorityStart, baseURLString.length - authorityStart)];
+    if (pathRange.location == NSNotFound) {
+        self.baseURLAbsolutePathPrefix = baseURLString;
+        self.baseURLRelativePathPrefix = [baseURLString stringByAppendingString:@"/"];
+    } else {
+        self.baseURLAbsolutePathPrefix = [baseURLString substringToIndex:pathRange.location];
+        self.baseURLRelativePathPrefix = [baseURLString substringToIndex:NSMaxRange([baseURLString rangeOfString:@"/" options:NSBackwardsSearch])];
+    }
+}
+
+/*
+    把相对路径转化成完整的URL字符串
+    常见的相对路径直接拼接在baseURL前缀后面、只由请求器解析一次
+    其余情况仍然使用`URLWithString:relativeToURL:`
+ */
+- (NSString *)absoluteURLStringForURLString:(NSString *)URLString {
+    if (!self.baseURL) {
+        return URLString;
+    }
+
+    NSString *prefix = [URLString hasPrefix:@"/"] ? self.baseURLAbsolutePathPrefix : self.baseURLRelativePathPrefix;
+    if (prefix && AFURLStringCanBeAppendedToBaseURL(URLString)) {
+        return [prefix stringByAppendingString:URLString];
+    }
+
+    return [[NSURL URLWithString:URLString relativeToURL:self.baseURL] absoluteString];
+}
+
 #pragma mark -
 
 - (NSURLSessionDataTask *)GET:(NSString *)URLString
@@ -113,18 +742,30 @@
 - (NSURLSessionDataTask *)GET:(NSString *)URLString
                    parameters:(id)parameters
                      progress:(void (^)(NSProgress * _Nonnull))downloadProgress
-                      success:(void (^)(NSURLSessionDataTask * _Nonnull, id _Nullable))success
+                      success:(void (^)(NSURLSessionDataTask * _Nullable, id _Nullable))success
+                      failure:(void (^)(NSURLSessionDataTask * _Nullable, NSError * _Nonnull))failure
+{
+    return [self GET:URLString parameters:parameters receiptID:[NSUUID UUID] progress:downloadProgress success:success failure:failure];
+}
+
+- (NSURLSessionDataTask *)GET:(NSString *)URLString
+                   parameters:(id)parameters
+                    receiptID:(NSUUID *)receiptID
+                     progress:(void (^)(NSProgress * _Nonnull))downloadProgress
+                      success:(void (^)(NSURLSessionDataTask * _Nullable, id _Nullable))success
                       failure:(void (^)(NSURLSessionDataTask * _Nullable, NSError * _Nonnull))failure
 {
     //所有只需要url和参数的请求都要汇聚于此
     NSURLSessionDataTask *dataTask = [self dataTaskWithHTTPMethod:@"GET"
                                                         URLString:URLString
                                                        parameters:parameters
+                                                        receiptID:receiptID
                                                    uploadProgress:nil
                                                  downloadProgress:downloadProgress
                                                           success:success
                                                           failure:failure];
 
+    //如果是合并到了进行中的任务上、resume不会有任何影响
     [dataTask resume];
 
     return dataTask;
@@ -136,7 +777,7 @@
                        failure:(void (^)(NSURLSessionDataTask *task, NSError *error))failure
 {
     //所有只需要url和参数的请求都要汇聚于此
-    NSURLSessionDataTask *dataTask = [self dataTaskWithHTTPMethod:@"HEAD" URLString:URLString parameters:parameters uploadProgress:nil downloadProgress:nil success:^(NSURLSessionDataTask *task, __unused id responseObject) {
+    NSURLSessionDataTask *dataTask = [self dataTaskWithHTTPMethod:@"HEAD" URLString:URLString parameters:parameters receiptID:[NSUUID UUID] uploadProgress:nil downloadProgress:nil success:^(NSURLSessionDataTask *task, __unused id responseObject) {
         if (success) {
             success(task);
         }
@@ -185,10 +826,12 @@
                        success:(void (^)(NSURLSessionDataTask *task, id responseObject))success
                        failure:(void (^)(NSURLSessionDataTask *task, NSError *error))failure
 {
+    uint64_t serializationStartTime = self.taskTimingRecorder ? AFURLSessionTaskTimingTimestamp() : 0;
     NSError *serializationError = nil;
     //将block的数据以流的形式分片上传
     //边拼边传、而不是拼好了一起传
-    NSMutableURLRequest *request = [self.requestSerializer multipartFormRequestWithMethod:@"POST" URLString:[[NSURL URLWithString:URLString relativeToURL:self.baseURL] absoluteString] parameters:parameters constructingBodyWithBlock:block error:&serializationError];
+    NSMutableURLRequest *request = [self.requestSerializer multipartFormRequestWithMethod:@"POST" URLString:[self absoluteURLStringForURLString:URLString] parameters:parameters constructingBodyWithBlock:block error:&serializationError];
+    uint64_t serializationEndTime = self.taskTimingRecorder ? AFURLSessionTaskTimingTimestamp() : 0;
     if (serializationError) {
         if (failure) {
 #pragma clang diagnostic push
@@ -215,6 +858,7 @@
             }
         }
     }];
+    [self recordRequestSerializationStartTime:serializationStartTime endTime:serializationEndTime forTask:task];
 
     [task resume];
 
@@ -268,9 +912,24 @@
                                          success:(void (^)(NSURLSessionDataTask *, id))success
                                          failure:(void (^)(NSURLSessionDataTask *, NSError *))failure
 {
+    return [self dataTaskWithHTTPMethod:method URLString:URLString parameters:parameters receiptID:nil uploadProgress:uploadProgress downloadProgress:downloadProgress success:success failure:failure];
+}
+
+//receiptID不为nil的请求(GET、HEAD)才有可能被合并
+- (NSURLSessionDataTask *)dataTaskWithHTTPMethod:(NSString *)method
+                                       URLString:(NSString *)URLString
+                                      parameters:(id)parameters
+                                       receiptID:(nullable NSUUID *)receiptID
+                                  uploadProgress:(nullable void (^)(NSProgress *uploadProgress)) uploadProgress
+                                downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                         success:(void (^)(NSURLSessionDataTask *, id))success
+                                         failure:(void (^)(NSURLSessionDataTask *, NSError *))failure
+{
+    uint64_t serializationStartTime = self.taskTimingRecorder ? AFURLSessionTaskTimingTimestamp() : 0;
     NSError *serializationError = nil;
     //生成一个可变请求
-    NSMutableURLRequest *request = [self.requestSerializer requestWithMethod:method URLString:[[NSURL URLWithString:URLString relativeToURL:self.baseURL] absoluteString] parameters:parameters error:&serializationError];
+    NSMutableURLRequest *request = [self.requestSerializer requestWithMethod:method URLString:[self absoluteURLStringForURLString:URLString] parameters:parameters error:&serializationError];
+    uint64_t serializationEndTime = self.taskTimingRecorder ? AFURLSessionTaskTimingTimestamp() : 0;
     if (serializationError) {
         if (failure) {
 #pragma clang diagnostic push
@@ -284,29 +943,455 @@
         return nil;
     }
 
-    __block NSURLSessionDataTask *dataTask = nil;
+    NSURLSessionDataTask *dataTask = nil;
+    if (receiptID && self.responseCache && [method isEqualToString:@"GET"]) {
+        dataTask = [self cachedDataTaskWithRequest:request receiptID:receiptID serializationStartTime:serializationStartTime serializationEndTime:serializationEndTime downloadProgress:downloadProgress success:success failure:failure];
+    } else {
+        dataTask = [self networkDataTaskWithRequest:request receiptID:receiptID coalescingHTTPHeaderFields:self.coalescingHTTPHeaderFields uploadProgress:uploadProgress downloadProgress:downloadProgress success:success failure:failure];
+    }
+
+    //缓存命中时没有任务
+    if (dataTask) {
+        [self recordRequestSerializationStartTime:serializationStartTime endTime:serializationEndTime forTask:dataTask];
+    }
+
+    return dataTask;
+}
+
+//真正发出请求、可以被合并的请求交给合并逻辑、coalescingHTTPHeaderFields中的请求头都相同的请求才会合并
+- (NSURLSessionDataTask *)networkDataTaskWithRequest:(NSURLRequest *)request
+                                           receiptID:(nullable NSUUID *)receiptID
+                          coalescingHTTPHeaderFields:(NSArray <NSString *> *)coalescingHTTPHeaderFields
+                                      uploadProgress:(nullable void (^)(NSProgress *uploadProgress)) uploadProgress
+                                    downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                             success:(void (^)(NSURLSessionDataTask *, id))success
+                                             failure:(void (^)(NSURLSessionDataTask *, NSError *))failure
+{
+    if (receiptID && self.coalescesIdempotentRequests) {
+        return [self coalescedDataTaskWithRequest:request receiptID:receiptID coalescingHTTPHeaderFields:coalescingHTTPHeaderFields downloadProgress:downloadProgress success:success failure:failure];
+    }
+
     //这个就回到AFURLSessionManager的原生方法了
-    //通过req生成一个数据任务
-    dataTask = [self dataTaskWithRequest:request
-                          uploadProgress:uploadProgress
-                        downloadProgress:downloadProgress
-                       completionHandler:^(NSURLResponse * __unused response, id responseObject, NSError *error) {
+    //通过req生成一个数据任务、幂等请求可能被对冲、回调的task是先返回的那个
+    return [self hedgedDataTaskWithRequest:request
+                            uploadProgress:uploadProgress
+                          downloadProgress:downloadProgress
+                         completionHandler:^(NSURLSessionDataTask *task, id responseObject, NSError *error) {
         if (error) {
             //失败
             if (failure) {
-                failure(dataTask, error);
+                failure(task, error);
             }
         } else {
             //成功
             if (success) {
-                success(dataTask, responseObject);
+                success(task, responseObject);
             }
         }
     }];
+}
+
+#pragma mark - Batch
+
+- (AFHTTPBatchTask *)batchTaskWithRequests:(NSArray <AFHTTPBatchRequest *> *)requests
+             maximumConcurrentRequestCount:(NSUInteger)maximumConcurrentRequestCount
+                               resultOrder:(AFHTTPBatchResultOrder)resultOrder
+                                     queue:(dispatch_queue_t)queue
+                                 chunkSize:(NSUInteger)chunkSize
+                            resultsHandler:(void (^)(NSArray <AFHTTPBatchResult *> *results))resultsHandler
+                         completionHandler:(void (^)(NSArray <AFHTTPBatchResult *> *results))completionHandler
+{
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu"
+    AFHTTPBatchTask *batchTask = [[AFHTTPBatchTask alloc] initWithManager:self requests:requests maximumConcurrentRequestCount:maximumConcurrentRequestCount resultOrder:resultOrder queue:queue ?: self.completionQueue ?: dispatch_get_main_queue() chunkSize:chunkSize resultsHandler:resultsHandler completionHandler:completionHandler];
+#pragma clang diagnostic pop
+    [batchTask startRequests];
+
+    return batchTask;
+}
+
+#pragma mark - Hedging
+
+- (NSURLSessionDataTask *)hedgedDataTaskWithRequest:(NSURLRequest *)request
+                                     uploadProgress:(nullable void (^)(NSProgress *uploadProgress)) uploadProgress
+                                   downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                  completionHandler:(void (^)(NSURLSessionDataTask *task, id responseObject, NSError *error))completionHandler
+{
+    AFHTTPRequestHedgingPolicy *hedgingPolicy = self.hedgingPolicy;
+    BOOL idempotent = [request.HTTPMethod isEqualToString:@"GET"] || [request.HTTPMethod isEqualToString:@"HEAD"];
+    if (!hedgingPolicy || !idempotent) {
+        __block NSURLSessionDataTask *dataTask = nil;
+        dataTask = [self dataTaskWithRequest:request uploadProgress:uploadProgress downloadProgress:downloadProgress completionHandler:^(NSURLResponse * __unused response, id responseObject, NSError *error) {
+            completionHandler(dataTask, responseObject, error);
+        }];
+
+        return dataTask;
+    }
+
+    NSString *route = AFHedgingRouteForRequest(request);
+    [hedgingPolicy recordRequest];
+
+    AFHTTPHedgedRequest *hedgedRequest = [[AFHTTPHedgedRequest alloc] init];
+    hedgedRequest.lock = [[NSLock alloc] init];
+    hedgedRequest.request = request;
+    hedgedRequest.completionHandler = completionHandler;
+    hedgedRequest.pendingCount = 1;
+    hedgedRequest.hedgingPolicy = hedgingPolicy;
+    hedgedRequest.route = route;
+    hedgedRequest.primaryTask = [self attemptTaskWithRequest:request hedgedRequest:hedgedRequest hedgingPolicy:hedgingPolicy route:route downloadProgress:downloadProgress];
+
+    //任务可能还在并发限制的队列里、等真正开始时再计时
+    [self.hedgingLock lock];
+    [self.pendingHedgedRequests setObject:hedgedRequest forKey:hedgedRequest.primaryTask];
+    [self.hedgingLock unlock];
+
+    return hedgedRequest.primaryTask;
+}
+
+- (void)taskDidResume:(NSNotification *)notification {
+    [super taskDidResume:notification];
+
+    NSURLSessionTask *task = notification.object;
+    [self.hedgingLock lock];
+    AFHTTPHedgedRequest *hedgedRequest = [self.pendingHedgedRequests objectForKey:task];
+    [self.pendingHedgedRequests removeObjectForKey:task];
+    [self.hedgingLock unlock];
+
+    if (hedgedRequest) {
+        [self scheduleHedgeForRequest:hedgedRequest];
+    }
+}
+
+//原请求开始之后、等待路由的对冲延迟还没有结果时再发出一个相同的请求
+- (void)scheduleHedgeForRequest:(AFHTTPHedgedRequest *)hedgedRequest {
+    [hedgedRequest.lock lock];
+    hedgedRequest.startTime = AFURLSessionTaskTimingTimestamp();
+    [hedgedRequest.lock unlock];
+
+    NSTimeInterval hedgeDelay = [hedgedRequest.hedgingPolicy hedgeDelayForRoute:hedgedRequest.route];
+    if (hedgeDelay <= 0) {
+        return;
+    }
+
+    //manager释放后不再发出对冲请求
+    __weak __typeof__(self) weakSelf = self;
+    __weak AFHTTPHedgedRequest *weakHedgedRequest = hedgedRequest;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(hedgeDelay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        AFHTTPHedgedRequest *hedgedRequest = weakHedgedRequest;
+        if (!strongSelf || !hedgedRequest) {
+            return;
+        }
+
+        AFHTTPRequestHedgingPolicy *hedgingPolicy = hedgedRequest.hedgingPolicy;
+        [hedgedRequest.lock lock];
+        if (hedgedRequest.finished || hedgedRequest.hedgeTask || hedgedRequest.primaryTask.state != NSURLSessionTaskStateRunning || ![hedgingPolicy acquireHedgeBudget]) {
+            [hedgedRequest.lock unlock];
+            return;
+        }
+        hedgedRequest.pendingCount++;
+        hedgedRequest.hedgeTask = [strongSelf attemptTaskWithRequest:hedgedRequest.request hedgedRequest:hedgedRequest hedgingPolicy:hedgingPolicy route:hedgedRequest.route downloadProgress:nil];
+        [hedgedRequest.lock unlock];
+
+        [hedgedRequest.hedgeTask resume];
+    });
+}
+
+//原请求或者对冲请求中的一个
+- (NSURLSessionDataTask *)attemptTaskWithRequest:(NSURLRequest *)request
+                                   hedgedRequest:(AFHTTPHedgedRequest *)hedgedRequest
+                                   hedgingPolicy:(AFHTTPRequestHedgingPolicy *)hedgingPolicy
+                                           route:(NSString *)route
+                                downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+{
+    __weak __typeof__(self) weakSelf = self;
+    __block NSURLSessionDataTask *dataTask = nil;
+    dataTask = [self dataTaskWithRequest:request uploadProgress:nil downloadProgress:downloadProgress completionHandler:^(NSURLResponse * __unused response, id responseObject, NSError *error) {
+        //在并发限制的队列中就结束(比如被取消)的原请求不会再开始
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        [strongSelf.hedgingLock lock];
+        [strongSelf.pendingHedgedRequests removeObjectForKey:dataTask];
+        [strongSelf.hedgingLock unlock];
+
+        [hedgedRequest.lock lock];
+        if (hedgedRequest.finished) {
+            //输掉的请求被取消
+            [hedgedRequest.lock unlock];
+            return;
+        }
+        hedgedRequest.pendingCount--;
+
+        //出错时如果另一个还在进行、等待另一个的结果、调用方取消时直接结束
+        BOOL cancelled = [error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled;
+        if (error && !cancelled && hedgedRequest.pendingCount > 0) {
+            [hedgedRequest.lock unlock];
+            return;
+        }
+
+        hedgedRequest.finished = YES;
+        NSURLSessionDataTask *losingTask = dataTask == hedgedRequest.primaryTask ? hedgedRequest.hedgeTask : hedgedRequest.primaryTask;
+        [hedgedRequest.lock unlock];
+
+        [losingTask cancel];
+        if (!error) {
+            //从原请求开始计算、对冲请求赢了也包括原请求已经等待的时间、与调用方感受到的一致
+            [hedgingPolicy recordLatency:(double)(AFURLSessionTaskTimingTimestamp() - hedgedRequest.startTime) / NSEC_PER_SEC forRoute:route];
+            if (dataTask == hedgedRequest.hedgeTask) {
+                [hedgingPolicy recordHedgeWin];
+            }
+        }
+
+        hedgedRequest.completionHandler(dataTask, responseObject, error);
+    }];
 
     return dataTask;
 }
 
+#pragma mark - Response Cache
+
+- (NSURLSessionDataTask *)cachedDataTaskWithRequest:(NSURLRequest *)request
+                                          receiptID:(NSUUID *)receiptID
+                             serializationStartTime:(uint64_t)serializationStartTime
+                               serializationEndTime:(uint64_t)serializationEndTime
+                                   downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                            success:(void (^)(NSURLSessionDataTask *, id))success
+                                            failure:(void (^)(NSURLSessionDataTask *, NSError *))failure
+{
+    AFHTTPResponseCache *responseCache = self.responseCache;
+    AFHTTPResponseCacheEntry *entry = [responseCache entryForRequest:request];
+
+    //新鲜的缓存直接返回、没有任务、每个调用方拿到各自的拷贝
+    if ([entry isFresh]) {
+        [responseCache recordHitForEntry:entry savesBytes:YES];
+        [self deliverCachedResponseObject:entry.responseObject task:nil request:request serializationStartTime:serializationStartTime serializationEndTime:serializationEndTime success:success];
+
+        return nil;
+    }
+
+    NSMutableURLRequest *conditionalRequest = [request mutableCopy];
+    if (entry.entityTag) {
+        [conditionalRequest setValue:entry.entityTag forHTTPHeaderField:@"If-None-Match"];
+    }
+    if (entry.lastModified) {
+        [conditionalRequest setValue:entry.lastModified forHTTPHeaderField:@"If-Modified-Since"];
+    }
+
+    //过期不久的缓存先返回、验证结果只用来更新缓存
+    BOOL servesStaleResponse = [entry canServeStale];
+
+    //304只对Vary中列出的请求头都相同的请求有效、这些请求头和验证条件也参与合并的判断、
+    //否则一个请求的304会交给没有对应缓存的调用方、变成一个失败
+    NSMutableArray <NSString *> *coalescingHTTPHeaderFields = [NSMutableArray arrayWithArray:self.coalescingHTTPHeaderFields];
+    [coalescingHTTPHeaderFields addObjectsFromArray:@[@"If-None-Match", @"If-Modified-Since"]];
+    [coalescingHTTPHeaderFields addObjectsFromArray:[[entry.varyHTTPHeaderValues allKeys] sortedArrayUsingSelector:@selector(compare:)]];
+
+    NSURLSessionDataTask *dataTask = [self networkDataTaskWithRequest:conditionalRequest receiptID:receiptID coalescingHTTPHeaderFields:coalescingHTTPHeaderFields uploadProgress:nil downloadProgress:servesStaleResponse ? nil : downloadProgress success:^(NSURLSessionDataTask *task, id responseObject) {
+        [responseCache storeResponseObject:responseObject response:(NSHTTPURLResponse *)task.response byteCount:task.countOfBytesReceived forRequest:request];
+        if (!servesStaleResponse && success) {
+            success(task, responseObject);
+        }
+    } failure:^(NSURLSessionDataTask *task, NSError *error) {
+        //304在序列化器中是一个错误、这里转成缓存刷新、不需要重新解析
+        NSHTTPURLResponse *response = (NSHTTPURLResponse *)task.response;
+        AFHTTPResponseCacheEntry *cachedEntry = entry ?: [responseCache entryForRequest:request];
+        if (cachedEntry && [response isKindOfClass:[NSHTTPURLResponse class]] && response.statusCode == 304) {
+            [responseCache refreshEntry:cachedEntry withResponse:response forRequest:request];
+            if (!servesStaleResponse && success) {
+                success(task, AFCopiedResponseObject(cachedEntry.responseObject));
+            }
+            return;
+        }
+
+        if (!servesStaleResponse && failure) {
+            failure(task, error);
+        }
+    }];
+
+    if (servesStaleResponse) {
+        [responseCache recordHitForEntry:entry savesBytes:NO];
+        [self deliverCachedResponseObject:entry.responseObject task:dataTask request:request serializationStartTime:serializationStartTime serializationEndTime:serializationEndTime success:success];
+    }
+
+    return dataTask;
+}
+
+//缓存命中没有经过任务的回调、单独生成一条计时记录、验证任务有自己的记录
+- (void)deliverCachedResponseObject:(id)responseObject
+                               task:(NSURLSessionDataTask *)task
+                            request:(NSURLRequest *)request
+             serializationStartTime:(uint64_t)serializationStartTime
+               serializationEndTime:(uint64_t)serializationEndTime
+                            success:(void (^)(NSURLSessionDataTask *, id))success
+{
+    AFURLSessionTaskTimingRecorder *recorder = self.taskTimingRecorder;
+    if (!success && !recorder) {
+        return;
+    }
+
+    AFURLSessionTaskTimingRecord record;
+    memset(&record, 0, sizeof(record));
+    if (recorder) {
+        AFURLSessionTaskTimingRecordSetName(&record, request);
+        record.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationStart] = serializationStartTime;
+        record.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationEnd] = serializationEndTime;
+        record.timestamps[AFURLSessionTaskTimingPhaseCallbackDispatch] = AFURLSessionTaskTimingTimestamp();
+    }
+
+    [self deliverCompletionBlock:^{
+        AFURLSessionTaskTimingRecord deliveredRecord = record;
+        if (recorder) {
+            deliveredRecord.timestamps[AFURLSessionTaskTimingPhaseCallbackStart] = AFURLSessionTaskTimingTimestamp();
+        }
+        if (success) {
+            success(task, AFCopiedResponseObject(responseObject));
+        }
+        if (recorder) {
+            deliveredRecord.timestamps[AFURLSessionTaskTimingPhaseCallbackEnd] = AFURLSessionTaskTimingTimestamp();
+            [recorder appendRecord:&deliveredRecord];
+        }
+    }];
+}
+
+#pragma mark - Coalescing
+
+- (NSURLSessionDataTask *)coalescedDataTaskWithRequest:(NSURLRequest *)request
+                                             receiptID:(NSUUID *)receiptID
+                            coalescingHTTPHeaderFields:(NSArray <NSString *> *)coalescingHTTPHeaderFields
+                                      downloadProgress:(nullable void (^)(NSProgress *downloadProgress)) downloadProgress
+                                               success:(void (^)(NSURLSessionDataTask *, id))success
+                                               failure:(void (^)(NSURLSessionDataTask *, NSError *))failure
+{
+    NSString *key = AFCoalescingKeyForRequest(request, coalescingHTTPHeaderFields);
+
+    AFHTTPSessionManagerCoalescedHandler *handler = [[AFHTTPSessionManagerCoalescedHandler alloc] init];
+    handler.receiptID = receiptID;
+    handler.downloadProgress = downloadProgress;
+    handler.success = success;
+    handler.failure = failure;
+
+    [self.coalescingLock lock];
+    AFHTTPSessionManagerCoalescedTask *coalescedTask = self.coalescedTasks[key];
+    if (coalescedTask) {
+        //已经有相同的请求在进行中、挂上去等结果就好
+        [coalescedTask.handlers addObject:handler];
+        [self.coalescingLock unlock];
+
+        return coalescedTask.task;
+    }
+
+    coalescedTask = [[AFHTTPSessionManagerCoalescedTask alloc] initWithKey:key];
+    [coalescedTask.handlers addObject:handler];
+    //任务完成时释放coalescedTask、打破循环引用、manager不被任务持有
+    __weak __typeof__(self) weakSelf = self;
+    __weak AFHTTPSessionManagerCoalescedTask *weakCoalescedTask = coalescedTask;
+    coalescedTask.task = [self hedgedDataTaskWithRequest:request
+                                          uploadProgress:nil
+                                        downloadProgress:^(NSProgress *progress) {
+        //进度发给每一个还在等待的调用方、包括之后挂上来的
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        AFHTTPSessionManagerCoalescedTask *strongCoalescedTask = weakCoalescedTask;
+        if (!strongSelf || !strongCoalescedTask) {
+            return;
+        }
+        [strongSelf.coalescingLock lock];
+        NSArray <AFHTTPSessionManagerCoalescedHandler *> *coalescedHandlers = [strongCoalescedTask.handlers copy];
+        [strongSelf.coalescingLock unlock];
+        for (AFHTTPSessionManagerCoalescedHandler *coalescedHandler in coalescedHandlers) {
+            if (coalescedHandler.downloadProgress) {
+                coalescedHandler.downloadProgress(progress);
+            }
+        }
+    }
+                                       completionHandler:^(NSURLSessionDataTask *task, id responseObject, NSError *error) {
+        //最后一个调用方拿到原对象、之前的各拿一份拷贝
+        //拷贝都在原对象交出之前生成、一个调用方修改后不会影响其他调用方
+        NSArray <AFHTTPSessionManagerCoalescedHandler *> *coalescedHandlers = [weakSelf removeCoalescedTask:coalescedTask] ?: [coalescedTask.handlers copy];
+        NSUInteger remainingSuccessCount = [[coalescedHandlers indexesOfObjectsPassingTest:^BOOL(AFHTTPSessionManagerCoalescedHandler *coalescedHandler, __unused NSUInteger idx, __unused BOOL *stop) {
+            return coalescedHandler.success != nil;
+        }] count];
+        for (AFHTTPSessionManagerCoalescedHandler *coalescedHandler in coalescedHandlers) {
+            if (error) {
+                if (coalescedHandler.failure) {
+                    coalescedHandler.failure(task, error);
+                }
+            } else {
+                if (coalescedHandler.success) {
+                    remainingSuccessCount--;
+                    coalescedHandler.success(task, remainingSuccessCount > 0 ? AFCopiedResponseObject(responseObject) : responseObject);
+                }
+            }
+        }
+    }];
+    self.coalescedTasks[key] = coalescedTask;
+    [self.coalescingLock unlock];
+
+    return coalescedTask.task;
+}
+
+//移除合并任务、并返回还在等待结果的调用方
+- (NSArray <AFHTTPSessionManagerCoalescedHandler *> *)removeCoalescedTask:(AFHTTPSessionManagerCoalescedTask *)coalescedTask {
+    [self.coalescingLock lock];
+    if (self.coalescedTasks[coalescedTask.key] == coalescedTask) {
+        [self.coalescedTasks removeObjectForKey:coalescedTask.key];
+    }
+    NSArray <AFHTTPSessionManagerCoalescedHandler *> *handlers = [coalescedTask.handlers copy];
+    [coalescedTask.handlers removeAllObjects];
+    [self.coalescingLock unlock];
+
+    return handlers;
+}
+
+- (void)cancelCoalescedTask:(NSURLSessionDataTask *)task receiptID:(NSUUID *)receiptID {
+    BOOL coalesced = NO;
+    BOOL shouldCancelTask = NO;
+    AFHTTPSessionManagerCoalescedHandler *cancelledHandler = nil;
+
+    [self.coalescingLock lock];
+    for (AFHTTPSessionManagerCoalescedTask *coalescedTask in [self.coalescedTasks allValues]) {
+        if (coalescedTask.task != task) {
+            continue;
+        }
+
+        coalesced = YES;
+        NSUInteger index = [coalescedTask.handlers indexOfObjectPassingTest:^BOOL(AFHTTPSessionManagerCoalescedHandler * _Nonnull handler, __unused NSUInteger idx, __unused BOOL * _Nonnull stop) {
+            return [handler.receiptID isEqual:receiptID];
+        }];
+        if (index != NSNotFound) {
+            cancelledHandler = coalescedTask.handlers[index];
+            [coalescedTask.handlers removeObjectAtIndex:index];
+        }
+
+        //引用计数归零、真正取消任务
+        if (coalescedTask.handlers.count == 0) {
+            [self.coalescedTasks removeObjectForKey:coalescedTask.key];
+            shouldCancelTask = YES;
+        }
+        break;
+    }
+    [self.coalescingLock unlock];
+
+    //没有被合并过的任务、直接取消
+    if (!coalesced) {
+        [task cancel];
+        return;
+    }
+
+    if (cancelledHandler.failure) {
+        NSString *failureReason = [NSString stringWithFormat:@"Coalesced request cancelled: %@", task.originalRequest.URL.absoluteString];
+        NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:@{NSLocalizedFailureReasonErrorKey: failureReason}];
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu"
+        dispatch_async(self.completionQueue ?: dispatch_get_main_queue(), ^{
+            cancelledHandler.failure(task, error);
+        });
+#pragma clang diagnostic pop
+    }
+
+    if (shouldCancelTask) {
+        [task cancel];
+    }
+}
+
 #pragma mark - NSObject
 
 - (NSString *)description {
@@ -370,7 +1455,255 @@
     HTTPClient.requestSerializer = [self.requestSerializer copyWithZone:zone];
     HTTPClient.responseSerializer = [self.responseSerializer copyWithZone:zone];
     HTTPClient.securityPolicy = [self.securityPolicy copyWithZone:zone];
+    HTTPClient.coalescesIdempotentRequests = self.coalescesIdempotentRequests;
+    HTTPClient.coalescingHTTPHeaderFields = self.coalescingHTTPHeaderFields;
+    HTTPClient.responseCache = self.responseCache;
+    HTTPClient.hedgingPolicy = self.hedgingPolicy;
     return HTTPClient;
 }
 
 @end
+
+#pragma mark -
+
+@implementation AFHTTPBatchRequest
+
++ (instancetype)requestWithMethod:(NSString *)method
+                        URLString:(NSString *)URLString
+                       parameters:(id)parameters
+{
+    AFHTTPBatchRequest *request = [[self alloc] init];
+    request.HTTPMethod = method;
+    request.URLString = URLString;
+    request.parameters = parameters;
+
+    return request;
+}
+
+@end
+
+@interface AFHTTPBatchResult ()
+@property (readwrite, nonatomic, assign) NSUInteger index;
+@property (readwrite, nonatomic, strong) NSURLResponse *response;
+@property (readwrite, nonatomic, strong) id responseObject;
+@property (readwrite, nonatomic, strong) NSError *error;
+@end
+
+@implementation AFHTTPBatchResult
+@end
+
+//没有生成NSURLRequest的请求(序列化失败、取消)用方法和URLString命名
+static void AFHTTPBatchTimingRecordSetName(AFURLSessionTaskTimingRecord *record, AFHTTPBatchRequest *batchRequest) {
+    NSString *name = [NSString stringWithFormat:@"%@ %@", batchRequest.HTTPMethod ?: @"GET", batchRequest.URLString ?: @""];
+    NSUInteger length = 0;
+    [name getBytes:record->name maxLength:sizeof(record->name) - 1 usedLength:&length encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [name length]) remainingRange:NULL];
+    record->name[length] = '\0';
+}
+
+@interface AFHTTPBatchTask ()
+@property (readwrite, nonatomic, strong) AFHTTPSessionManager *manager;//完成后释放
+@property (readwrite, nonatomic, copy) NSArray <AFHTTPBatchRequest *> *requests;
+@property (readwrite, nonatomic, assign) NSUInteger requestCount;
+@property (readwrite, nonatomic, assign) NSUInteger completedRequestCount;
+@property (readwrite, nonatomic, assign) NSUInteger maximumConcurrentRequestCount;
+@property (readwrite, nonatomic, assign) AFHTTPBatchResultOrder resultOrder;
+@property (readwrite, nonatomic, strong) dispatch_queue_t deliveryQueue;
+@property (readwrite, nonatomic, assign) NSUInteger chunkSize;
+@property (readwrite, nonatomic, copy) void (^resultsHandler)(NSArray <AFHTTPBatchResult *> *results);
+@property (readwrite, nonatomic, copy) void (^completionHandler)(NSArray <AFHTTPBatchResult *> *results);
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, assign) NSUInteger nextRequestIndex;
+@property (readwrite, nonatomic, assign) NSUInteger nextDeliveryIndex;//按提交顺序时下一个要交付的序号
+@property (readwrite, nonatomic, strong) NSMutableDictionary <NSNumber *, AFHTTPBatchResult *> *outOfOrderResults;
+@property (readwrite, nonatomic, strong) NSMutableArray <AFHTTPBatchResult *> *pendingResults;//等待交付的结果
+@property (readwrite, nonatomic, strong) NSMutableSet <NSURLSessionDataTask *> *runningTasks;
+@property (readwrite, nonatomic, strong) AFURLSessionTaskTimingRecorder *timingRecorder;//只用于没有创建任务的请求、任务由manager记录
+@property (readwrite, nonatomic, assign) BOOL cancelled;
+@property (readwrite, nonatomic, assign) BOOL finished;
+@end
+
+@implementation AFHTTPBatchTask
+
+- (instancetype)initWithManager:(AFHTTPSessionManager *)manager
+                       requests:(NSArray <AFHTTPBatchRequest *> *)requests
+  maximumConcurrentRequestCount:(NSUInteger)maximumConcurrentRequestCount
+                    resultOrder:(AFHTTPBatchResultOrder)resultOrder
+                          queue:(dispatch_queue_t)queue
+                      chunkSize:(NSUInteger)chunkSize
+                 resultsHandler:(void (^)(NSArray <AFHTTPBatchResult *> *results))resultsHandler
+              completionHandler:(void (^)(NSArray <AFHTTPBatchResult *> *results))completionHandler
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.manager = manager;
+    self.requests = requests;
+    self.requestCount = [requests count];
+    self.maximumConcurrentRequestCount = MAX(maximumConcurrentRequestCount, (NSUInteger)1);
+    self.resultOrder = resultOrder;
+    //串行队列指向调用方的队列、即使调用方的队列是并行的、分批的结果也按顺序交付
+    self.deliveryQueue = dispatch_queue_create("com.alamofire.networking.batch.delivery", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(self.deliveryQueue, queue);
+    self.chunkSize = chunkSize;
+    self.resultsHandler = resultsHandler;
+    self.completionHandler = completionHandler;
+    self.lock = [[NSLock alloc] init];
+    self.outOfOrderResults = [NSMutableDictionary dictionary];
+    self.pendingResults = [NSMutableArray array];
+    self.runningTasks = [NSMutableSet set];
+    self.timingRecorder = manager.taskTimingRecorder;
+
+    return self;
+}
+
+- (void)cancel {
+    [self.lock lock];
+    self.cancelled = YES;
+    NSArray *runningTasks = [self.runningTasks allObjects];
+    //还没有开始的请求直接以取消结束
+    while (self.nextRequestIndex < self.requestCount) {
+        NSUInteger index = self.nextRequestIndex++;
+        [self recordTimingForUnstartedRequestAtIndex:index serializationStartTime:0 serializationEndTime:0];
+        [self addResultWithIndex:index response:nil responseObject:nil error:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+    }
+    [self finishIfNeeded];
+    [self.lock unlock];
+
+    [runningTasks makeObjectsPerformSelector:@selector(cancel)];
+}
+
+#pragma mark -
+
+- (void)startRequests {
+    NSMutableArray *tasks = [NSMutableArray array];
+
+    [self.lock lock];
+    AFHTTPSessionManager *manager = self.manager;
+    while (!self.cancelled && [self.runningTasks count] < self.maximumConcurrentRequestCount && self.nextRequestIndex < self.requestCount) {
+        NSUInteger index = self.nextRequestIndex++;
+        AFHTTPBatchRequest *batchRequest = self.requests[index];
+
+        NSError *serializationError = nil;
+        uint64_t serializationStartTime = self.timingRecorder ? AFURLSessionTaskTimingTimestamp() : 0;
+        NSMutableURLRequest *request = [manager.requestSerializer requestWithMethod:batchRequest.HTTPMethod URLString:[manager absoluteURLStringForURLString:batchRequest.URLString] parameters:batchRequest.parameters error:&serializationError];
+        uint64_t serializationEndTime = self.timingRecorder ? AFURLSessionTaskTimingTimestamp() : 0;
+        if (!request) {
+            [self recordTimingForUnstartedRequestAtIndex:index serializationStartTime:serializationStartTime serializationEndTime:serializationEndTime];
+            [self addResultWithIndex:index response:nil responseObject:nil error:serializationError];
+            continue;
+        }
+
+        //和普通请求一样经过manager创建任务、受并发限制、记录计时、由responseSerializer在处理队列上解析
+        __block NSURLSessionDataTask *task = nil;
+        task = [manager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+            [self task:task index:index didCompleteWithResponse:response responseObject:responseObject error:error];
+        }];
+        [manager recordRequestSerializationStartTime:serializationStartTime endTime:serializationEndTime forTask:task];
+        [self.runningTasks addObject:task];
+        [tasks addObject:task];
+    }
+    [self finishIfNeeded];
+    [self.lock unlock];
+
+    [tasks makeObjectsPerformSelector:@selector(resume)];
+}
+
+- (void)task:(NSURLSessionDataTask *)task
+                  index:(NSUInteger)index
+didCompleteWithResponse:(NSURLResponse *)response
+         responseObject:(id)responseObject
+                  error:(NSError *)error
+{
+    //在completionQueue上回调、下一批请求的序列化不占用它
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self.lock lock];
+        [self.runningTasks removeObject:task];
+        [self addResultWithIndex:index response:response responseObject:responseObject error:error];
+        [self.lock unlock];
+
+        [self startRequests];
+    });
+}
+
+//以下方法需要在持有lock时调用
+
+- (void)addResultWithIndex:(NSUInteger)index
+                  response:(NSURLResponse *)response
+            responseObject:(id)responseObject
+                     error:(NSError *)error
+{
+    AFHTTPBatchResult *result = [[AFHTTPBatchResult alloc] init];
+    result.index = index;
+    result.response = response;
+    result.responseObject = responseObject;
+    result.error = error;
+    self.completedRequestCount++;
+
+    if (self.resultOrder == AFHTTPBatchResultOrderCompletion) {
+        [self.pendingResults addObject:result];
+    } else {
+        //前面还有没完成的请求时先放着
+        self.outOfOrderResults[@(index)] = result;
+        AFHTTPBatchResult *nextResult = nil;
+        while ((nextResult = self.outOfOrderResults[@(self.nextDeliveryIndex)])) {
+            [self.outOfOrderResults removeObjectForKey:@(self.nextDeliveryIndex)];
+            [self.pendingResults addObject:nextResult];
+            self.nextDeliveryIndex++;
+        }
+    }
+
+    if (self.resultsHandler && self.chunkSize > 0 && [self.pendingResults count] >= self.chunkSize) {
+        NSArray *results = [self.pendingResults copy];
+        [self.pendingResults removeAllObjects];
+        void (^resultsHandler)(NSArray <AFHTTPBatchResult *> *results) = self.resultsHandler;
+        dispatch_async(self.deliveryQueue, ^{
+            resultsHandler(results);
+        });
+    }
+}
+
+- (void)finishIfNeeded {
+    if (self.finished || self.completedRequestCount < self.requestCount) {
+        return;
+    }
+    self.finished = YES;
+
+    NSArray *results = [self.pendingResults copy];
+    [self.pendingResults removeAllObjects];
+    void (^resultsHandler)(NSArray <AFHTTPBatchResult *> *results) = self.resultsHandler;
+    void (^completionHandler)(NSArray <AFHTTPBatchResult *> *results) = self.completionHandler;
+    self.resultsHandler = nil;
+    self.completionHandler = nil;
+    self.manager = nil;
+
+    dispatch_async(self.deliveryQueue, ^{
+        if (resultsHandler && [results count] > 0) {
+            resultsHandler(results);
+        }
+        if (completionHandler) {
+            completionHandler(resultsHandler ? nil : results);
+        }
+    });
+}
+
+//序列化失败或者取消的请求没有任务、单独生成一条计时记录
+- (void)recordTimingForUnstartedRequestAtIndex:(NSUInteger)index
+                        serializationStartTime:(uint64_t)serializationStartTime
+                          serializationEndTime:(uint64_t)serializationEndTime
+{
+    if (!self.timingRecorder) {
+        return;
+    }
+
+    AFURLSessionTaskTimingRecord record;
+    memset(&record, 0, sizeof(record));
+    AFHTTPBatchTimingRecordSetName(&record, self.requests[index]);
+    record.failed = YES;
+    record.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationStart] = serializationStartTime;
+    record.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationEnd] = serializationEndTime;
+    [self.timingRecorder appendRecord:&record];
+}
+
+@end
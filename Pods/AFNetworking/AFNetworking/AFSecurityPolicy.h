@@ -64,6 +64,20 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, assign) BOOL validatesDomainName;
 
+/**
+    校验结果的缓存时间(秒) 默认`0`即不缓存
+    大于0时、同一个域名返回同一条证书链的握手在这段时间内直接复用上次和本地证书/公钥比对通过的结果
+    证书链本身(有效期、域名、根证书)每次握手都会重新校验、缓存只省掉比对这一步
+    只缓存比对通过的结果、修改任何配置都会清空缓存
+ */
+@property (nonatomic, assign) NSTimeInterval trustEvaluationCacheTimeout;
+
+/**
+    公钥指纹文件的位置、通过`policyWithPinSetContentsOfURL:`设置
+    文件在第一次校验时才会被读取
+ */
+@property (readonly, nonatomic, strong, nullable) NSURL *pinSetURL;
+
 ///-----------------------------------------
 /// @name 获取证书
 ///-----------------------------------------
@@ -92,6 +106,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 /**
     通过指定的验证策略`AFSSLPinningMode`来创建
+    bundle内的证书在第一次校验时才会加载
  */
 + (instancetype)policyWithPinningMode:(AFSSLPinningMode)pinningMode;
 
@@ -100,6 +115,24 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (instancetype)policyWithPinningMode:(AFSSLPinningMode)pinningMode withPinnedCertificates:(NSSet <NSData *> *)pinnedCertificates;
 
+/**
+    通过公钥指纹文件来创建、验证策略为`AFSSLPinningModePublicKey`
+
+    创建时不读取文件也不解析任何证书、第一次收到服务器的challenge时才加载
+    文件格式: 每行一个base64编码的SHA-256(SPKI)指纹、空行和`#`开头的行会被忽略
+    指纹直接取自证书DER里的SubjectPublicKeyInfo、不限公钥算法和长度(RSA、ECDSA、Ed25519等)、也不限系统版本
+    可以在编译时用脚本生成:
+    `openssl x509 -in cert.cer -inform der -pubkey -noout | openssl pkey -pubin -outform der | openssl dgst -sha256 -binary | base64`
+    也可以在第一次运行时用`pinSetDataWithCertificates:`生成后写入沙盒
+ */
++ (instancetype)policyWithPinSetContentsOfURL:(NSURL *)pinSetURL;
+
+/**
+    将证书合集转化成公钥指纹文件的内容、格式同`policyWithPinSetContentsOfURL:`
+    无法解析的证书会被跳过
+ */
++ (NSData *)pinSetDataWithCertificates:(NSSet <NSData *> *)certificates;
+
 ///------------------------------
 /// @name Evaluating Server Trust
 ///------------------------------
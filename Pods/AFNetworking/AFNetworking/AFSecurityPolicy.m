@@ -22,6 +22,7 @@
 #import "AFSecurityPolicy.h"
 
 #import <AssertMacros.h>
+#import <CommonCrypto/CommonDigest.h>
 
 
 #if !TARGET_OS_IOS && !TARGET_OS_WATCH && !TARGET_OS_TV
@@ -102,6 +103,173 @@ _out:
     return allowedPublicKey;
 }
 
+static NSData * AFSHA256DigestForData(NSData *data) {
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(data.bytes, (CC_LONG)data.length, digest);
+
+    return [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
+
+//读取一个DER元素、tag不符或长度越界都返回NO
+//成功时cursor移到这个元素之后、contents指向元素的内容
+static BOOL AFDERReadElement(const uint8_t **cursor, const uint8_t *end, uint8_t expectedTag, const uint8_t **contents, size_t *contentsLength) {
+    const uint8_t *p = *cursor;
+    if (end - p < 2 || p[0] != expectedTag) {
+        return NO;
+    }
+    p++;
+
+    size_t length = *p++;
+    if (length & 0x80) {
+        size_t lengthByteCount = length & 0x7f;
+        if (lengthByteCount == 0 || lengthByteCount > sizeof(uint32_t) || (size_t)(end - p) < lengthByteCount) {
+            return NO;
+        }
+        length = 0;
+        for (size_t i = 0; i < lengthByteCount; i++) {
+            length = (length << 8) | *p++;
+        }
+    }
+
+    if ((size_t)(end - p) < length) {
+        return NO;
+    }
+
+    if (contents) {
+        *contents = p;
+    }
+    if (contentsLength) {
+        *contentsLength = length;
+    }
+    *cursor = p + length;
+
+    return YES;
+}
+
+/*
+    直接从证书的DER数据里取出完整的SubjectPublicKeyInfo
+    Certificate ::= SEQUENCE { tbsCertificate, ... }
+    TBSCertificate ::= SEQUENCE { [0] version OPTIONAL, serialNumber, signature, issuer, validity, subject, subjectPublicKeyInfo, ... }
+    和`openssl x509 -pubkey | openssl pkey -pubin -outform der`输出的是同一串字节
+    不依赖SecKeyCopyExternalRepresentation、任何算法和长度的公钥、任何系统版本都能算出一致的指纹
+ */
+static NSData * AFSubjectPublicKeyInfoForCertificate(NSData *certificate) {
+    const uint8_t *cursor = certificate.bytes;
+    const uint8_t *end = cursor + certificate.length;
+    const uint8_t *contents = NULL;
+    size_t contentsLength = 0;
+
+    if (!AFDERReadElement(&cursor, end, 0x30, &contents, &contentsLength)) {
+        return nil;
+    }
+    cursor = contents;
+    end = contents + contentsLength;
+
+    if (!AFDERReadElement(&cursor, end, 0x30, &contents, &contentsLength)) {
+        return nil;
+    }
+    cursor = contents;
+    end = contents + contentsLength;
+
+    //v1证书没有version字段
+    if (cursor < end && *cursor == 0xa0 && !AFDERReadElement(&cursor, end, 0xa0, NULL, NULL)) {
+        return nil;
+    }
+    if (!AFDERReadElement(&cursor, end, 0x02, NULL, NULL)) {
+        return nil;
+    }
+    //signature、issuer、validity、subject
+    for (NSUInteger i = 0; i < 4; i++) {
+        if (!AFDERReadElement(&cursor, end, 0x30, NULL, NULL)) {
+            return nil;
+        }
+    }
+
+    const uint8_t *subjectPublicKeyInfo = cursor;
+    if (!AFDERReadElement(&cursor, end, 0x30, NULL, NULL)) {
+        return nil;
+    }
+
+    return [NSData dataWithBytes:subjectPublicKeyInfo length:(NSUInteger)(cursor - subjectPublicKeyInfo)];
+}
+
+//证书 -> 公钥指纹 的全局缓存
+//服务器每次握手返回的证书链基本相同、同一张证书只需要提取一次公钥
+static NSCache * AFPublicKeyHashCache() {
+    static NSCache *_publicKeyHashCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _publicKeyHashCache = [[NSCache alloc] init];
+        _publicKeyHashCache.countLimit = 256;
+    });
+
+    return _publicKeyHashCache;
+}
+
+static NSData * AFPublicKeyHashForCertificate(NSData *certificate) {
+    id publicKeyHash = [AFPublicKeyHashCache() objectForKey:certificate];
+    if (!publicKeyHash) {
+        NSData *subjectPublicKeyInfo = AFSubjectPublicKeyInfoForCertificate(certificate);
+        publicKeyHash = subjectPublicKeyInfo ? AFSHA256DigestForData(subjectPublicKeyInfo) : nil;
+        //解析失败也缓存下来、避免每次握手都重新解析一遍
+        [AFPublicKeyHashCache() setObject:(publicKeyHash ?: [NSNull null]) forKey:certificate];
+    }
+
+    return publicKeyHash == [NSNull null] ? nil : publicKeyHash;
+}
+
+/*
+    解析公钥指纹文件
+    每行一个base64编码的SHA-256(SPKI)指纹、空行和`#`开头的注释行会被忽略
+ */
+static NSSet <NSData *> * AFPublicKeyHashesWithPinSetData(NSData *pinSetData) {
+    NSString *pinSet = [[NSString alloc] initWithData:pinSetData encoding:NSUTF8StringEncoding];
+    NSMutableSet *publicKeyHashes = [NSMutableSet set];
+    for (NSString *line in [pinSet componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+        NSString *pin = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if (pin.length == 0 || [pin hasPrefix:@"#"]) {
+            continue;
+        }
+
+        NSData *publicKeyHash = [[NSData alloc] initWithBase64EncodedString:pin options:0];
+        if (publicKeyHash.length == CC_SHA256_DIGEST_LENGTH) {
+            [publicKeyHashes addObject:publicKeyHash];
+        }
+    }
+
+    return [NSSet setWithSet:publicKeyHashes];
+}
+
+//校验结果缓存的key: 校验配置 + 域名 + 服务器返回的整条证书链的指纹
+//只看叶子证书的话、同一张叶子证书配上不同的中间证书也会命中缓存
+static NSString * AFTrustVerdictCacheKeyForServerTrust(SecTrustRef serverTrust, NSString *domain, NSString *policyKey) {
+    CFIndex certificateCount = SecTrustGetCertificateCount(serverTrust);
+    if (certificateCount == 0) {
+        return nil;
+    }
+
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    for (CFIndex i = 0; i < certificateCount; i++) {
+        SecCertificateRef certificate = SecTrustGetCertificateAtIndex(serverTrust, i);
+        NSData *certificateData = (__bridge_transfer NSData *)SecCertificateCopyData(certificate);
+        if (!certificateData) {
+            return nil;
+        }
+
+        //每张证书前面先放长度、不同的证书切分方式不会拼出同一串数据
+        uint32_t length = CFSwapInt32HostToBig((uint32_t)certificateData.length);
+        CC_SHA256_Update(&context, &length, sizeof(length));
+        CC_SHA256_Update(&context, certificateData.bytes, (CC_LONG)certificateData.length);
+    }
+
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &context);
+    NSData *chainHash = [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+
+    return [NSString stringWithFormat:@"%@|%@|%@", policyKey, domain ?: @"", [chainHash base64EncodedStringWithOptions:0]];
+}
+
 //返回服务器是否可以被信任
 static BOOL AFServerTrustIsValid(SecTrustRef serverTrust) {
     BOOL isValid = NO;
@@ -169,10 +337,25 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
 
 @interface AFSecurityPolicy()
 @property (readwrite, nonatomic, assign) AFSSLPinningMode SSLPinningMode;
+//解析不出SubjectPublicKeyInfo的本地证书的公钥、只用于逐个比对SecKeyRef
 @property (readwrite, nonatomic, strong) NSSet *pinnedPublicKeys;
+//本地证书预先转化好的SecCertificateRef、用作根证书
+@property (readwrite, nonatomic, strong) NSArray *pinnedCertificateRefs;
+//本地证书公钥的SHA-256(SPKI)指纹
+@property (readwrite, nonatomic, strong) NSSet <NSData *> *pinnedPublicKeyHashes;
+//校验通过的结果缓存 key: AFTrustVerdictCacheKeyForServerTrust value: 过期时间
+@property (readwrite, nonatomic, strong) NSCache <NSString *, NSNumber *> *trustVerdictCache;
+@property (readwrite, nonatomic, strong) NSURL *pinSetURL;
+//上面几个由本地证书衍生出来的属性都是在第一次校验时才生成的
+@property (readwrite, nonatomic, assign) BOOL needsPinCompilation;
+//policyWithPinningMode:创建的对象、第一次用到时才去扫描bundle
+@property (readwrite, nonatomic, assign) BOOL loadsDefaultPinnedCertificates;
+@property (readwrite, nonatomic, strong) NSLock *pinCompilationLock;
 @end
 
 @implementation AFSecurityPolicy
+//同时重写了pinnedCertificates的setter和getter
+@synthesize pinnedCertificates = _pinnedCertificates;
 
 //取出某个bundle下所有的证书
 + (NSSet *)certificatesInBundle:(NSBundle *)bundle {
@@ -212,7 +395,13 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
 }
 
 + (instancetype)policyWithPinningMode:(AFSSLPinningMode)pinningMode {
-    return [self policyWithPinningMode:pinningMode withPinnedCertificates:[self defaultPinnedCertificates]];
+    AFSecurityPolicy *securityPolicy = [[self alloc] init];
+    securityPolicy.SSLPinningMode = pinningMode;
+    //不在创建时扫描bundle、等到第一次校验或者读取pinnedCertificates时再加载
+    securityPolicy.loadsDefaultPinnedCertificates = YES;
+    securityPolicy.needsPinCompilation = YES;
+
+    return securityPolicy;
 }
 
 + (instancetype)policyWithPinningMode:(AFSSLPinningMode)pinningMode withPinnedCertificates:(NSSet *)pinnedCertificates {
@@ -224,33 +413,134 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     return securityPolicy;
 }
 
++ (instancetype)policyWithPinSetContentsOfURL:(NSURL *)pinSetURL {
+    AFSecurityPolicy *securityPolicy = [[self alloc] init];
+    securityPolicy.SSLPinningMode = AFSSLPinningModePublicKey;
+    securityPolicy.pinSetURL = pinSetURL;
+    securityPolicy.needsPinCompilation = YES;
+
+    return securityPolicy;
+}
+
++ (NSData *)pinSetDataWithCertificates:(NSSet <NSData *> *)certificates {
+    NSMutableString *pinSet = [NSMutableString string];
+    for (NSData *certificate in certificates) {
+        NSData *publicKeyHash = AFPublicKeyHashForCertificate(certificate);
+        if (!publicKeyHash) {
+            continue;
+        }
+        [pinSet appendFormat:@"%@\n", [publicKeyHash base64EncodedStringWithOptions:0]];
+    }
+
+    return [pinSet dataUsingEncoding:NSUTF8StringEncoding];
+}
+
 - (instancetype)init {
     self = [super init];
     if (!self) {
         return nil;
     }
 
+    self.trustVerdictCache = [[NSCache alloc] init];
+    self.pinCompilationLock = [[NSLock alloc] init];
     self.validatesDomainName = YES;
 
     return self;
 }
-//将证书的合集转化成公钥的合集并且赋值给self.pinnedPublicKeys持有备用
+//只保存证书、公钥等衍生数据推迟到第一次校验时生成
 - (void)setPinnedCertificates:(NSSet *)pinnedCertificates {
+    [self.pinCompilationLock lock];
     _pinnedCertificates = pinnedCertificates;
+    self.loadsDefaultPinnedCertificates = NO;
+    self.needsPinCompilation = YES;
+    [self.pinCompilationLock unlock];
 
-    if (self.pinnedCertificates) {
-        NSMutableSet *mutablePinnedPublicKeys = [NSMutableSet setWithCapacity:[self.pinnedCertificates count]];
-        for (NSData *certificate in self.pinnedCertificates) {
-            id publicKey = AFPublicKeyForCertificate(certificate);
-            if (!publicKey) {
+    [self.trustVerdictCache removeAllObjects];
+}
+
+- (NSSet *)pinnedCertificates {
+    [self.pinCompilationLock lock];
+    if (self.loadsDefaultPinnedCertificates) {
+        _pinnedCertificates = [[self class] defaultPinnedCertificates];
+        self.loadsDefaultPinnedCertificates = NO;
+    }
+    NSSet *pinnedCertificates = _pinnedCertificates;
+    [self.pinCompilationLock unlock];
+
+    return pinnedCertificates;
+}
+
+//将证书的合集转化成公钥指纹的合集、并合并指纹文件中的指纹
+//同时生成根证书、之后的握手不用再重复转化
+- (void)compilePinsIfNeeded {
+    [self.pinCompilationLock lock];
+    if (!self.needsPinCompilation) {
+        [self.pinCompilationLock unlock];
+        return;
+    }
+
+    if (self.loadsDefaultPinnedCertificates) {
+        _pinnedCertificates = [[self class] defaultPinnedCertificates];
+        self.loadsDefaultPinnedCertificates = NO;
+    }
+
+    NSSet *pinSetHashes = self.pinSetURL ? AFPublicKeyHashesWithPinSetData([NSData dataWithContentsOfURL:self.pinSetURL]) : nil;
+
+    if (_pinnedCertificates || pinSetHashes) {
+        NSMutableSet *mutablePinnedPublicKeys = [NSMutableSet setWithCapacity:[_pinnedCertificates count]];
+        NSMutableSet *mutablePinnedPublicKeyHashes = [NSMutableSet setWithSet:pinSetHashes ?: [NSSet set]];
+        NSMutableArray *mutablePinnedCertificateRefs = [NSMutableArray arrayWithCapacity:[_pinnedCertificates count]];
+        for (NSData *certificate in _pinnedCertificates) {
+            SecCertificateRef certificateRef = SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certificate);
+            if (certificateRef) {
+                [mutablePinnedCertificateRefs addObject:(__bridge_transfer id)certificateRef];
+            }
+
+            //能算出指纹的证书不再提取SecKeyRef、省掉每张证书一次的SecTrustEvaluate
+            NSData *publicKeyHash = AFPublicKeyHashForCertificate(certificate);
+            if (publicKeyHash) {
+                [mutablePinnedPublicKeyHashes addObject:publicKeyHash];
                 continue;
             }
-            [mutablePinnedPublicKeys addObject:publicKey];
+
+            NSLog(@"Unable to read the public key info of a pinned certificate, falling back to SecKeyRef comparison.");
+            id publicKey = AFPublicKeyForCertificate(certificate);
+            if (publicKey) {
+                [mutablePinnedPublicKeys addObject:publicKey];
+            }
         }
         self.pinnedPublicKeys = [NSSet setWithSet:mutablePinnedPublicKeys];
+        self.pinnedPublicKeyHashes = [NSSet setWithSet:mutablePinnedPublicKeyHashes];
+        self.pinnedCertificateRefs = [NSArray arrayWithArray:mutablePinnedCertificateRefs];
     } else {
         self.pinnedPublicKeys = nil;
+        self.pinnedPublicKeyHashes = nil;
+        self.pinnedCertificateRefs = nil;
     }
+
+    self.needsPinCompilation = NO;
+    [self.pinCompilationLock unlock];
+}
+
+//配置改变后、之前缓存的校验结果全部作废
+- (void)setSSLPinningMode:(AFSSLPinningMode)SSLPinningMode {
+    _SSLPinningMode = SSLPinningMode;
+    [self.trustVerdictCache removeAllObjects];
+}
+
+- (void)setAllowInvalidCertificates:(BOOL)allowInvalidCertificates {
+    _allowInvalidCertificates = allowInvalidCertificates;
+    [self.trustVerdictCache removeAllObjects];
+}
+
+- (void)setValidatesDomainName:(BOOL)validatesDomainName {
+    _validatesDomainName = validatesDomainName;
+    [self.trustVerdictCache removeAllObjects];
+}
+
+- (void)setTrustEvaluationCacheTimeout:(NSTimeInterval)trustEvaluationCacheTimeout {
+    _trustEvaluationCacheTimeout = trustEvaluationCacheTimeout;
+    [self.trustVerdictCache removeAllObjects];
 }
 
 #pragma mark -
@@ -260,7 +550,7 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
 {
     //验证不通过
     //host存在 && 允许使用过期证书(通常都是NO) && 验证域名 && (无条件信任服务器证书 || 没有证书)
-    if (domain && self.allowInvalidCertificates && self.validatesDomainName && (self.SSLPinningMode == AFSSLPinningModeNone || [self.pinnedCertificates count] == 0)) {
+    if (domain && self.allowInvalidCertificates && self.validatesDomainName && (self.SSLPinningMode == AFSSLPinningModeNone || ([self.pinnedCertificates count] == 0 && !self.pinSetURL))) {
         // https://developer.apple.com/library/mac/documentation/NetworkingInternet/Conceptual/NetworkingTopics/Articles/OverridingSSLChainValidationCorrectly.html
         //  According to the docs, you should only trust your provided certs for evaluation.
         //  Pinned certificates are added to the trust. Without pinned certificates,
@@ -272,7 +562,9 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
         NSLog(@"In order to validate a domain name for self signed certificates, you MUST use pinning.");
         return NO;
     }
-    
+
+    [self compilePinsIfNeeded];
+
     //证书数组
     NSMutableArray *policies = [NSMutableArray array];
     
@@ -291,16 +583,51 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
         //无条件信任服务器的证书
         //允许使用过期或无效证书 || 服务器返回的证书可以信任 则返回YES否则NO
         return self.allowInvalidCertificates || AFServerTrustIsValid(serverTrust);
-    } else if (!AFServerTrustIsValid(serverTrust) && !self.allowInvalidCertificates) {
-        //服务器返回的证书不通过 && 不允许使用过期或无效证书 则不通过
+    } else if (!self.allowInvalidCertificates && !AFServerTrustIsValid(serverTrust)) {
+        //不允许使用过期或无效证书 && 服务器返回的证书不通过 则不通过
+        //允许无效证书时这次校验的结果用不到、直接跳过
         return NO;
     }
 
-    
+    if (self.SSLPinningMode == AFSSLPinningModeCertificate) {
+        //把本地的证书设为根证书、即服务器应该信任的证书
+        //SecCertificateRef在第一次校验时就已经转化好了
+        SecTrustSetAnchorCertificates(serverTrust, (__bridge CFArrayRef)self.pinnedCertificateRefs);
+
+        //看看能否被信任
+        if (!AFServerTrustIsValid(serverTrust)) {
+            return NO;
+        }
+    }
+
+    //证书链每次握手都要校验(证书可能已经过期或被吊销)、缓存只省掉和本地证书/公钥的比对
+    //同一套配置下、同一个域名返回同一条证书链、在有效期内直接使用上次比对的结果
+    NSString *verdictCacheKey = nil;
+    if (self.trustEvaluationCacheTimeout > 0) {
+        NSString *policyKey = [NSString stringWithFormat:@"%lu|%d|%d", (unsigned long)self.SSLPinningMode, self.allowInvalidCertificates, self.validatesDomainName];
+        verdictCacheKey = AFTrustVerdictCacheKeyForServerTrust(serverTrust, domain, policyKey);
+        NSNumber *expirationTime = verdictCacheKey ? [self.trustVerdictCache objectForKey:verdictCacheKey] : nil;
+        if (expirationTime && CFAbsoluteTimeGetCurrent() < [expirationTime doubleValue]) {
+            return YES;
+        }
+    }
+
+    BOOL isPinned = [self serverTrustMatchesPinnedCertificates:serverTrust];
+
+    //只缓存比对通过的结果、失败的每次都重新比对
+    if (isPinned && verdictCacheKey) {
+        [self.trustVerdictCache setObject:@(CFAbsoluteTimeGetCurrent() + self.trustEvaluationCacheTimeout) forKey:verdictCacheKey];
+    }
+
+    return isPinned;
+}
+
+//证书链已经校验通过、再看服务器的证书或公钥是否和本地的一致
+- (BOOL)serverTrustMatchesPinnedCertificates:(SecTrustRef)serverTrust {
     /*
         代码走到这里、有两个条件
         1、验证策略并不是无条件信任服务器的证书
-        2、服务器证书通过了信任并且不允许使用过期或无效的证书
+        2、服务器证书通过了信任(证书模式下以本地证书为根证书)或者允许使用过期或无效的证书
      
         也就是说证书没问题、但是需要进一步验证(公钥或者本地证书)
      */
@@ -311,21 +638,6 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
         default:
             return NO;
         case AFSSLPinningModeCertificate: {
-            //全部检查
-            NSMutableArray *pinnedCertificates = [NSMutableArray array];
-            for (NSData *certificateData in self.pinnedCertificates) {
-                //将本地的二进制证书转化成SecCertificateRef证书并且加入数组
-                [pinnedCertificates addObject:(__bridge_transfer id)SecCertificateCreateWithData(NULL, (__bridge CFDataRef)certificateData)];
-            }
-            
-            //把本地的证书设为根证书、即服务器应该信任的证书
-            SecTrustSetAnchorCertificates(serverTrust, (__bridge CFArrayRef)pinnedCertificates);
-
-            //看看能否被信任
-            if (!AFServerTrustIsValid(serverTrust)) {
-                return NO;
-            }
-
             // 取出所有服务器返回的证书
             NSArray *serverCertificates = AFCertificateTrustChainForServerTrust(serverTrust);
             
@@ -339,6 +651,19 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
             return NO;
         }
         case AFSSLPinningModePublicKey: {
+            //用服务器证书的公钥指纹去本地指纹集合里查、每张证书的指纹只计算一次
+            for (NSData *trustChainCertificate in AFCertificateTrustChainForServerTrust(serverTrust)) {
+                NSData *publicKeyHash = AFPublicKeyHashForCertificate(trustChainCertificate);
+                if (publicKeyHash && [self.pinnedPublicKeyHashes containsObject:publicKeyHash]) {
+                    return YES;
+                }
+            }
+
+            if (self.pinnedPublicKeys.count == 0) {
+                return NO;
+            }
+
+            //本地有解析不出SubjectPublicKeyInfo的证书时、再逐个比对SecKeyRef
             NSUInteger trustedPublicKeyCount = 0;
             //取出所有服务器返回证书的公钥
             NSArray *publicKeys = AFPublicKeyTrustChainForServerTrust(serverTrust);
@@ -381,6 +706,9 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     self.allowInvalidCertificates = [decoder decodeBoolForKey:NSStringFromSelector(@selector(allowInvalidCertificates))];
     self.validatesDomainName = [decoder decodeBoolForKey:NSStringFromSelector(@selector(validatesDomainName))];
     self.pinnedCertificates = [decoder decodeObjectOfClass:[NSArray class] forKey:NSStringFromSelector(@selector(pinnedCertificates))];
+    self.trustEvaluationCacheTimeout = [decoder decodeDoubleForKey:NSStringFromSelector(@selector(trustEvaluationCacheTimeout))];
+    self.pinSetURL = [decoder decodeObjectOfClass:[NSURL class] forKey:NSStringFromSelector(@selector(pinSetURL))];
+    self.needsPinCompilation = YES;
 
     return self;
 }
@@ -390,6 +718,8 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     [coder encodeBool:self.allowInvalidCertificates forKey:NSStringFromSelector(@selector(allowInvalidCertificates))];
     [coder encodeBool:self.validatesDomainName forKey:NSStringFromSelector(@selector(validatesDomainName))];
     [coder encodeObject:self.pinnedCertificates forKey:NSStringFromSelector(@selector(pinnedCertificates))];
+    [coder encodeDouble:self.trustEvaluationCacheTimeout forKey:NSStringFromSelector(@selector(trustEvaluationCacheTimeout))];
+    [coder encodeObject:self.pinSetURL forKey:NSStringFromSelector(@selector(pinSetURL))];
 }
 
 #pragma mark - NSCopying
@@ -400,6 +730,9 @@ static NSArray * AFPublicKeyTrustChainForServerTrust(SecTrustRef serverTrust) {
     securityPolicy.allowInvalidCertificates = self.allowInvalidCertificates;
     securityPolicy.validatesDomainName = self.validatesDomainName;
     securityPolicy.pinnedCertificates = [self.pinnedCertificates copyWithZone:zone];
+    securityPolicy.trustEvaluationCacheTimeout = self.trustEvaluationCacheTimeout;
+    securityPolicy.pinSetURL = self.pinSetURL;
+    securityPolicy.needsPinCompilation = YES;
 
     return securityPolicy;
 }
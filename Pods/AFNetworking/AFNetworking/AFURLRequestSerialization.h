@@ -157,6 +157,15 @@ typedef NS_ENUM(NSUInteger, AFHTTPRequestQueryStringSerializationStyle) {
  */
 @property (nonatomic, assign) NSTimeInterval timeoutInterval;
 
+/**
+    是否以数据流(`HTTPBodyStream`)的形式生成请求体、默认NO
+    开启后参数会在上传时边读边编码、适合很大的请求体、内存中不会出现完整的请求体
+    请求体的长度要编码完才知道、不设置`Content-Length`、以分块传输编码(chunked)发送
+    调用方已经知道长度时可以通过`-setValue:forHTTPHeaderField:`自己设置
+    `GET``HEAD``DELETE`以及自定义了参数转译block的请求不受影响
+ */
+@property (nonatomic, assign) BOOL streamsHTTPBody;
+
 ///---------------------------------------
 /// @name Configuring HTTP Request Headers
 ///---------------------------------------
@@ -398,6 +407,68 @@ forHTTPHeaderField:(NSString *)field;
 
 #pragma mark -
 
+/**
+    `AFCBORRequestSerializer` 将参数编码成CBOR(RFC 8949)格式的请求体、`Content-Type`为`application/cbor`
+
+    与`AFJSONRequestSerializer`使用相同的Foundation类型映射:
+    NSDictionary -> map、NSArray -> array、NSString -> text string、NSNumber -> 整数/浮点数/布尔、NSNull -> null
+    另外支持 NSData -> byte string、NSDate -> tag 1(时间戳)
+ */
+@interface AFCBORRequestSerializer : AFHTTPRequestSerializer
+
+@end
+
+#pragma mark -
+
+/**
+    请求体的压缩格式
+ */
+typedef NS_ENUM(NSUInteger, AFHTTPRequestBodyCompressionEncoding) {
+    AFHTTPRequestBodyCompressionEncodingGzip,//Content-Encoding: gzip
+    AFHTTPRequestBodyCompressionEncodingDeflate,//Content-Encoding: deflate(zlib格式)
+};
+
+/**
+    `AFCompressingRequestSerializer` 包装任意一个请求器、用zlib压缩其生成的请求体并设置`Content-Encoding`
+
+    `HTTPBody`会被直接压缩、`HTTPBodyStream`(包括multipart表单)会在上传时边读边压缩
+    压缩后的数据流长度未知、会移除`Content-Length`以chunked方式上传
+    已经带有`Content-Encoding`的请求不会被再次压缩
+    请求头、超时时间等配置请设置在被包装的请求器上
+    通过`NSSecureCoding`解档时只会还原AFN自带的请求器(及其子类)、其它请求器会被忽略
+ */
+@interface AFCompressingRequestSerializer : AFHTTPRequestSerializer
+
+/**
+    被包装的请求器 默认`AFHTTPRequestSerializer`
+ */
+@property (readonly, nonatomic, strong) id <AFURLRequestSerialization> requestSerializer;
+
+/**
+    压缩格式 默认`AFHTTPRequestBodyCompressionEncodingGzip`
+ */
+@property (nonatomic, assign) AFHTTPRequestBodyCompressionEncoding compressionEncoding;
+
+/**
+    压缩等级 0-9、默认`-1`即zlib的默认等级(6)
+ */
+@property (nonatomic, assign) NSInteger compressionLevel;
+
+/**
+    请求体小于这个长度(字节)时不压缩 默认`1024`
+    长度未知的数据流总是会被压缩
+ */
+@property (nonatomic, assign) NSUInteger minimumCompressibleBodyLength;
+
+/**
+    包装一个请求器
+ */
++ (instancetype)serializerWithRequestSerializer:(id <AFURLRequestSerialization>)requestSerializer;
+
+@end
+
+#pragma mark -
+
 ///----------------
 /// @name Constants
 ///----------------
@@ -21,6 +21,8 @@
 
 #import "AFURLRequestSerialization.h"
 
+#import <zlib.h>
+
 #if TARGET_OS_IOS || TARGET_OS_WATCH || TARGET_OS_TV
 #import <MobileCoreServices/MobileCoreServices.h>
 #else
@@ -206,6 +208,112 @@ NSArray * AFQueryStringPairsFromKeyAndValue(NSString *key, id value) {
 
 #pragma mark -
 
+@interface AFQueryStringPairFrame : NSObject
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, strong) id container;
+//字典为排好序的key、数组和集合为排好序的元素
+@property (nonatomic, strong) NSArray *elements;
+@property (nonatomic, assign) NSUInteger elementIndex;
+@end
+
+@implementation AFQueryStringPairFrame
+@end
+
+/*
+    按照`AFQueryStringPairsFromKeyAndValue`相同的顺序逐个生成`AFQueryStringPair`
+    只有正在展开的那几层容器会被排序、不会一次性生成全部的键值对
+ */
+@interface AFQueryStringPairEnumerator : NSEnumerator
+- (instancetype)initWithParameters:(id)parameters;
+@end
+
+@interface AFQueryStringPairEnumerator ()
+@property (nonatomic, strong) NSMutableArray <AFQueryStringPairFrame *> *frames;
+//参数本身不是容器时、直接作为唯一的键值对
+@property (nonatomic, strong) id pendingValue;
+@end
+
+static BOOL AFQueryStringValueIsContainer(id value) {
+    return [value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSSet class]];
+}
+
+@implementation AFQueryStringPairEnumerator
+
+- (instancetype)initWithParameters:(id)parameters {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.frames = [NSMutableArray array];
+    if (AFQueryStringValueIsContainer(parameters)) {
+        [self pushFrameWithKey:nil container:parameters];
+    } else {
+        self.pendingValue = parameters;
+    }
+
+    return self;
+}
+
+- (void)pushFrameWithKey:(NSString *)key container:(id)container {
+    NSSortDescriptor *sortDescriptor = [NSSortDescriptor sortDescriptorWithKey:@"description" ascending:YES selector:@selector(compare:)];
+
+    AFQueryStringPairFrame *frame = [[AFQueryStringPairFrame alloc] init];
+    frame.key = key;
+    frame.container = container;
+    if ([container isKindOfClass:[NSDictionary class]]) {
+        frame.elements = [[container allKeys] sortedArrayUsingDescriptors:@[ sortDescriptor ]];
+    } else if ([container isKindOfClass:[NSSet class]]) {
+        frame.elements = [container sortedArrayUsingDescriptors:@[ sortDescriptor ]];
+    } else {
+        frame.elements = container;
+    }
+    [self.frames addObject:frame];
+}
+
+- (id)nextObject {
+    if (self.pendingValue) {
+        id value = self.pendingValue;
+        self.pendingValue = nil;
+        return [[AFQueryStringPair alloc] initWithField:nil value:value];
+    }
+
+    while ([self.frames count] > 0) {
+        AFQueryStringPairFrame *frame = [self.frames lastObject];
+        if (frame.elementIndex >= [frame.elements count]) {
+            [self.frames removeLastObject];
+            continue;
+        }
+
+        id element = frame.elements[frame.elementIndex++];
+        id key = nil;
+        id value = nil;
+        if ([frame.container isKindOfClass:[NSDictionary class]]) {
+            key = frame.key ? [NSString stringWithFormat:@"%@[%@]", frame.key, element] : element;
+            value = frame.container[element];
+        } else if ([frame.container isKindOfClass:[NSArray class]]) {
+            key = [NSString stringWithFormat:@"%@[]", frame.key];
+            value = element;
+        } else {
+            key = frame.key;
+            value = element;
+        }
+
+        if (AFQueryStringValueIsContainer(value)) {
+            [self pushFrameWithKey:key container:value];
+            continue;
+        }
+
+        return [[AFQueryStringPair alloc] initWithField:key value:value];
+    }
+
+    return nil;
+}
+
+@end
+
+#pragma mark -
+
 @interface AFStreamingMultipartFormData : NSObject <AFMultipartFormData>
 //初始化
 - (instancetype)initWithURLRequest:(NSMutableURLRequest *)urlRequest
@@ -215,6 +323,52 @@ NSArray * AFQueryStringPairsFromKeyAndValue(NSString *key, id value) {
 - (NSMutableURLRequest *)requestByFinalizingMultipartFormData;
 @end
 
+#pragma mark -
+
+//每次调用返回请求体的下一段数据、结束时返回nil
+typedef NSData * (^AFStreamingBodyChunkProducer)(void);
+//每次打开(或复制)数据流时、生成一个从头开始的producer
+typedef AFStreamingBodyChunkProducer (^AFStreamingBodyChunkProducerFactory)(void);
+
+//每段数据的目标大小
+static NSUInteger const kAFStreamingBodyChunkLength = 16 * 1024;
+
+/*
+    边读边生成请求体的数据流
+    内存中最多只保留一段数据、不会把整个请求体生成出来
+ */
+@interface AFStreamingBodyInputStream : NSInputStream <NSCopying>
+- (instancetype)initWithChunkProducerFactory:(AFStreamingBodyChunkProducerFactory)chunkProducerFactory;
+@end
+
+//x-www-form-urlencoded请求体、每段编码若干个键值对
+static AFStreamingBodyChunkProducerFactory AFQueryStringBodyChunkProducerFactory(id parameters, NSStringEncoding stringEncoding) {
+    return ^AFStreamingBodyChunkProducer {
+        //键值对和编码都推迟到读取时、逐个生成
+        AFQueryStringPairEnumerator *pairEnumerator = [[AFQueryStringPairEnumerator alloc] initWithParameters:parameters];
+        __block AFQueryStringPair *nextPair = [pairEnumerator nextObject];
+        __block BOOL hasPairs = NO;
+
+        return ^NSData * {
+            if (!nextPair) {
+                return nil;
+            }
+
+            NSMutableString *chunk = [NSMutableString string];
+            while (nextPair && [chunk length] < kAFStreamingBodyChunkLength) {
+                if (hasPairs) {
+                    [chunk appendString:@"&"];
+                }
+                [chunk appendString:[nextPair URLEncodedStringValue]];
+                hasPairs = YES;
+                nextPair = [pairEnumerator nextObject];
+            }
+
+            return [chunk dataUsingEncoding:stringEncoding];
+        };
+    };
+}
+
 #pragma mark -
 //监听集合。蜂窝网络、缓存策略、cookie、管线链接、网络服务类型、超时连接
 static NSArray * AFHTTPRequestSerializerObservedKeyPaths() {
@@ -234,6 +388,18 @@ static void *AFHTTPRequestSerializerObserverContext = &AFHTTPRequestSerializerOb
 @property (readwrite, nonatomic, strong) NSMutableDictionary *mutableHTTPRequestHeaders;//请求头字典
 @property (readwrite, nonatomic, assign) AFHTTPRequestQueryStringSerializationStyle queryStringSerializationStyle;//参数转义的样式
 @property (readwrite, nonatomic, copy) AFQueryStringSerializationBlock queryStringSerialization;//自定义参数转义block
+@property (readwrite, nonatomic, strong) NSURLRequest *requestTemplate;//由当前配置编译出的请求模板、配置改变时作废
+@property (readwrite, nonatomic, strong) NSDictionary *HTTPRequestHeadersSnapshot;//与模板同时生成的请求头快照
+@property (readwrite, nonatomic, strong) NSLock *requestTemplateLock;
+
+/*
+    把参数写进一个已经带好请求头的请求里、直接修改传入的请求、失败时返回NO
+    `requestWithMethod:`复制模板后直接调用这个方法、不用再复制请求和重新设置请求头
+    内置的子类只重写这个方法来生成各自的请求体
+ */
+- (BOOL)serializeParameters:(id)parameters
+                intoRequest:(NSMutableURLRequest *)mutableRequest
+                      error:(NSError *__autoreleasing *)error;
 @end
 
 @implementation AFHTTPRequestSerializer
@@ -248,6 +414,8 @@ static void *AFHTTPRequestSerializerObserverContext = &AFHTTPRequestSerializerOb
         return nil;
     }
 
+    self.requestTemplateLock = [[NSLock alloc] init];
+
     self.stringEncoding = NSUTF8StringEncoding;
 
     self.mutableHTTPRequestHeaders = [NSMutableDictionary dictionary];
@@ -354,26 +522,93 @@ static void *AFHTTPRequestSerializerObserverContext = &AFHTTPRequestSerializerOb
     [self didChangeValueForKey:NSStringFromSelector(@selector(timeoutInterval))];
 }
 
+#pragma mark - 请求模板
+
+/*
+    根据当前配置编译一个不可变的请求模板
+    包含被修改过的请求属性和全部请求头、生成请求时只需要复制模板再设置URL和请求体
+    调用前需要持有requestTemplateLock
+ */
+- (void)compileRequestTemplateIfNeeded {
+    if (self.requestTemplate) {
+        return;
+    }
+
+    NSMutableURLRequest *requestTemplate = [[NSMutableURLRequest alloc] init];
+    //只有被自主设置过的属性才写入模板、其余的保持`NSMutableURLRequest`的默认值
+    for (NSString *keyPath in AFHTTPRequestSerializerObservedKeyPaths()) {
+        if ([self.mutableObservedChangedKeyPaths containsObject:keyPath]) {
+            [requestTemplate setValue:[self valueForKeyPath:keyPath] forKey:keyPath];
+        }
+    }
+
+    self.HTTPRequestHeadersSnapshot = [NSDictionary dictionaryWithDictionary:self.mutableHTTPRequestHeaders];
+    requestTemplate.allHTTPHeaderFields = self.HTTPRequestHeadersSnapshot;
+    self.requestTemplate = [requestTemplate copy];
+}
+
+- (NSURLRequest *)compiledRequestTemplate {
+    [self.requestTemplateLock lock];
+    [self compileRequestTemplateIfNeeded];
+    NSURLRequest *requestTemplate = self.requestTemplate;
+    [self.requestTemplateLock unlock];
+
+    return requestTemplate;
+}
+
+//请求头或者请求属性改变时调用、下次生成请求时重新编译
+- (void)invalidateRequestTemplate {
+    [self.requestTemplateLock lock];
+    [self discardRequestTemplate];
+    [self.requestTemplateLock unlock];
+}
+
+//调用前需要持有requestTemplateLock
+- (void)discardRequestTemplate {
+    self.requestTemplate = nil;
+    self.HTTPRequestHeadersSnapshot = nil;
+}
+
+//请求头字典和模板一样由requestTemplateLock保护、修改和编译模板不会同时进行
+- (void)setMutableHTTPRequestHeaders:(NSMutableDictionary *)mutableHTTPRequestHeaders {
+    [self.requestTemplateLock lock];
+    _mutableHTTPRequestHeaders = mutableHTTPRequestHeaders;
+    [self discardRequestTemplate];
+    [self.requestTemplateLock unlock];
+}
+
 #pragma mark -
 
 /*
     对请求头进行操作
  */
 - (NSDictionary *)HTTPRequestHeaders {
-    //将不可变字典转换成可变字典
-    return [NSDictionary dictionaryWithDictionary:self.mutableHTTPRequestHeaders];
+    //返回与模板一同生成的不可变快照、不用每次都复制一份
+    [self.requestTemplateLock lock];
+    [self compileRequestTemplateIfNeeded];
+    NSDictionary *HTTPRequestHeaders = self.HTTPRequestHeadersSnapshot;
+    [self.requestTemplateLock unlock];
+
+    return HTTPRequestHeaders;
 }
 
 - (void)setValue:(NSString *)value
 forHTTPHeaderField:(NSString *)field
 {
     //对请求头字典进行追加
+    [self.requestTemplateLock lock];
 	[self.mutableHTTPRequestHeaders setValue:value forKey:field];
+    [self discardRequestTemplate];
+    [self.requestTemplateLock unlock];
 }
 
 - (NSString *)valueForHTTPHeaderField:(NSString *)field {
     //根据不同的key提取出value
-    return [self.mutableHTTPRequestHeaders valueForKey:field];
+    [self.requestTemplateLock lock];
+    NSString *value = [self.mutableHTTPRequestHeaders valueForKey:field];
+    [self.requestTemplateLock unlock];
+
+    return value;
 }
 
 //通过账号密码设置授权请求头
@@ -390,7 +625,10 @@ forHTTPHeaderField:(NSString *)field
 
 //清除授权用请求头
 - (void)clearAuthorizationHeader {
+    [self.requestTemplateLock lock];
 	[self.mutableHTTPRequestHeaders removeObjectForKey:@"Authorization"];
+    [self discardRequestTemplate];
+    [self.requestTemplateLock unlock];
 }
 
 #pragma mark -
@@ -420,19 +658,22 @@ forHTTPHeaderField:(NSString *)field
 
     NSParameterAssert(url);
 
-    NSMutableURLRequest *mutableRequest = [[NSMutableURLRequest alloc] initWithURL:url];
+    //复制请求模板、被自主设置过的属性和请求头都已经在模板里了
+    NSMutableURLRequest *mutableRequest = [[self compiledRequestTemplate] mutableCopy];
+    mutableRequest.URL = url;
     //设置请求方式
     mutableRequest.HTTPMethod = method;
 
-    //如果某个关键属性被自主设置过、则用新的。不然直接用模板生成的`NSMutableURLRequest`即可
-    for (NSString *keyPath in AFHTTPRequestSerializerObservedKeyPaths()) {
-        if ([self.mutableObservedChangedKeyPaths containsObject:keyPath]) {
-            [mutableRequest setValue:[self valueForKeyPath:keyPath] forKey:keyPath];
-        }
+    //子类重写了`requestBySerializingRequest:`时、交给它去设置(拼接URL、请求体、请求头)
+    SEL serializingSelector = @selector(requestBySerializingRequest:withParameters:error:);
+    if ([[self class] instanceMethodForSelector:serializingSelector] != [AFHTTPRequestSerializer instanceMethodForSelector:serializingSelector]) {
+        return [[self requestBySerializingRequest:mutableRequest withParameters:parameters error:error] mutableCopy];
     }
 
-    //对req进一步设置(拼接URL、请求体、请求头)
-    mutableRequest = [[self requestBySerializingRequest:mutableRequest withParameters:parameters error:error] mutableCopy];
+    //模板里已经带好了请求头、直接把参数写进这份请求
+    if (![self serializeParameters:parameters intoRequest:mutableRequest error:error]) {
+        return nil;
+    }
 
 	return mutableRequest;
 }
@@ -564,21 +805,36 @@ forHTTPHeaderField:(NSString *)field
         }
     }];
 
+    if (![self serializeParameters:parameters intoRequest:mutableRequest error:error]) {
+        return nil;
+    }
+
+    return mutableRequest;
+}
+
+- (BOOL)serializeParameters:(id)parameters
+                intoRequest:(NSMutableURLRequest *)mutableRequest
+                      error:(NSError *__autoreleasing *)error
+{
+    //请求体以数据流的形式生成时、不需要先把参数拼成完整的字符串
+    BOOL encodesParametersInURI = [self.HTTPMethodsEncodingParametersInURI containsObject:[[mutableRequest HTTPMethod] uppercaseString]];
+    BOOL streamsHTTPBody = self.streamsHTTPBody && parameters && !encodesParametersInURI && !self.queryStringSerialization;
+
     //根据参数parameters设置查询字段
     NSString *query = nil;
-    if (parameters) {
+    if (parameters && !streamsHTTPBody) {
         //看看参数是否需要用户自定义转译
         if (self.queryStringSerialization) {
             NSError *serializationError;
             //调用用户block、获得参数转译的字符串
-            query = self.queryStringSerialization(request, parameters, &serializationError);
+            query = self.queryStringSerialization(mutableRequest, parameters, &serializationError);
 
             if (serializationError) {
                 if (error) {
                     *error = serializationError;
                 }
 
-                return nil;
+                return NO;
             }
         } else {
             //使用AFN的默认转译方式
@@ -591,7 +847,7 @@ forHTTPHeaderField:(NSString *)field
     }
 
     //如果请求方式是需要将查询参数拼接到URL后面的(默认包含`GET``HEAD``DELETE`)、则拼接
-    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[request HTTPMethod] uppercaseString]]) {
+    if (encodesParametersInURI) {
         if (query && query.length > 0) {
             //原url带有参数、则拼接'&'。没参数则拼接'?'
             mutableRequest.URL = [NSURL URLWithString:[[mutableRequest.URL absoluteString] stringByAppendingFormat:mutableRequest.URL.query ? @"&%@" : @"?%@", query]];
@@ -605,10 +861,15 @@ forHTTPHeaderField:(NSString *)field
         if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
             [mutableRequest setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
         }
-        [mutableRequest setHTTPBody:[query dataUsingEncoding:self.stringEncoding]];
+        if (streamsHTTPBody) {
+            AFStreamingBodyInputStream *bodyStream = [[AFStreamingBodyInputStream alloc] initWithChunkProducerFactory:AFQueryStringBodyChunkProducerFactory(parameters, self.stringEncoding)];
+            [mutableRequest setHTTPBodyStream:bodyStream];
+        } else {
+            [mutableRequest setHTTPBody:[query dataUsingEncoding:self.stringEncoding]];
+        }
     }
 
-    return mutableRequest;
+    return YES;
 }
 
 #pragma mark - NSKeyValueObserving
@@ -634,6 +895,7 @@ forHTTPHeaderField:(NSString *)field
         } else {
             [self.mutableObservedChangedKeyPaths addObject:keyPath];
         }
+        [self invalidateRequestTemplate];
     }
 }
 
@@ -651,22 +913,25 @@ forHTTPHeaderField:(NSString *)field
 
     self.mutableHTTPRequestHeaders = [[decoder decodeObjectOfClass:[NSDictionary class] forKey:NSStringFromSelector(@selector(mutableHTTPRequestHeaders))] mutableCopy];
     self.queryStringSerializationStyle = (AFHTTPRequestQueryStringSerializationStyle)[[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(queryStringSerializationStyle))] unsignedIntegerValue];
+    self.streamsHTTPBody = [decoder decodeBoolForKey:NSStringFromSelector(@selector(streamsHTTPBody))];
 
     return self;
 }
 
 - (void)encodeWithCoder:(NSCoder *)coder {
-    [coder encodeObject:self.mutableHTTPRequestHeaders forKey:NSStringFromSelector(@selector(mutableHTTPRequestHeaders))];
+    [coder encodeObject:self.HTTPRequestHeaders forKey:NSStringFromSelector(@selector(mutableHTTPRequestHeaders))];
     [coder encodeInteger:self.queryStringSerializationStyle forKey:NSStringFromSelector(@selector(queryStringSerializationStyle))];
+    [coder encodeBool:self.streamsHTTPBody forKey:NSStringFromSelector(@selector(streamsHTTPBody))];
 }
 
 #pragma mark - NSCopying
 
 - (instancetype)copyWithZone:(NSZone *)zone {
     AFHTTPRequestSerializer *serializer = [[[self class] allocWithZone:zone] init];
-    serializer.mutableHTTPRequestHeaders = [self.mutableHTTPRequestHeaders mutableCopyWithZone:zone];
+    serializer.mutableHTTPRequestHeaders = [self.HTTPRequestHeaders mutableCopyWithZone:zone];
     serializer.queryStringSerializationStyle = self.queryStringSerializationStyle;
     serializer.queryStringSerialization = self.queryStringSerialization;
+    serializer.streamsHTTPBody = self.streamsHTTPBody;
 
     return serializer;
 }
@@ -1026,6 +1291,8 @@ NSTimeInterval const kAFUploadStream3GSuggestedDelay = 0.2;
         if (!self.currentHTTPBodyPart || ![self.currentHTTPBodyPart hasBytesAvailable]) {
             //把下一个body文件赋值给当前body
             if (!(self.currentHTTPBodyPart = [self.HTTPBodyPartEnumerator nextObject])) {
+                //所有body都读完了、标记结束、包装它的数据流据此判断是否真正读完
+                self.streamStatus = NSStreamStatusAtEnd;
                 break;
             }
         } else {
@@ -1411,120 +1678,363 @@ typedef enum {
 
 @end
 
-#pragma mark - AFJSONRequestSerializer
-//可以将参数转化成json上传
-@implementation AFJSONRequestSerializer
+#pragma mark - AFStreamingBodyInputStream
 
-+ (instancetype)serializer {
-    return [self serializerWithWritingOptions:(NSJSONWritingOptions)0];
-}
+@interface AFStreamingBodyInputStream ()
+@property (readwrite, nonatomic, copy) AFStreamingBodyChunkProducerFactory chunkProducerFactory;
+@property (readwrite, nonatomic, copy) AFStreamingBodyChunkProducer chunkProducer;//当前正在使用的producer
+@property (readwrite, nonatomic, strong) NSData *currentChunk;//当前正在读取的数据段
+@property (readwrite, nonatomic, assign) NSUInteger currentChunkOffset;
+@end
 
-+ (instancetype)serializerWithWritingOptions:(NSJSONWritingOptions)writingOptions
-{
-    AFJSONRequestSerializer *serializer = [[self alloc] init];
-    serializer.writingOptions = writingOptions;
+@implementation AFStreamingBodyInputStream
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wimplicit-atomic-properties"
+#if (defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && __IPHONE_OS_VERSION_MAX_ALLOWED >= 80000) || (defined(__MAC_OS_X_VERSION_MAX_ALLOWED) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 1100)
+@synthesize delegate;
+#endif
+@synthesize streamStatus;
+@synthesize streamError;
+#pragma clang diagnostic pop
 
-    return serializer;
+- (instancetype)initWithChunkProducerFactory:(AFStreamingBodyChunkProducerFactory)chunkProducerFactory {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.chunkProducerFactory = chunkProducerFactory;
+
+    return self;
 }
 
-#pragma mark - AFURLRequestSerialization
+#pragma mark - NSInputStream
 
-- (NSURLRequest *)requestBySerializingRequest:(NSURLRequest *)request
-                               withParameters:(id)parameters
-                                        error:(NSError *__autoreleasing *)error
+- (NSInteger)read:(uint8_t *)buffer
+        maxLength:(NSUInteger)length
 {
-    NSParameterAssert(request);
-
-    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[request HTTPMethod] uppercaseString]]) {
-        return [super requestBySerializingRequest:request withParameters:parameters error:error];
+    if ([self streamStatus] != NSStreamStatusOpen) {
+        return 0;
     }
 
-    NSMutableURLRequest *mutableRequest = [request mutableCopy];
-
-    [self.HTTPRequestHeaders enumerateKeysAndObjectsUsingBlock:^(id field, id value, BOOL * __unused stop) {
-        if (![request valueForHTTPHeaderField:field]) {
-            [mutableRequest setValue:value forHTTPHeaderField:field];
-        }
-    }];
-
-    if (parameters) {
-        if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
-            [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    NSUInteger totalNumberOfBytesRead = 0;
+    while (totalNumberOfBytesRead < length) {
+        //当前数据段读完了、生成下一段
+        if (self.currentChunkOffset >= [self.currentChunk length]) {
+            self.currentChunk = self.chunkProducer();
+            self.currentChunkOffset = 0;
+            if (!self.currentChunk) {
+                self.streamStatus = NSStreamStatusAtEnd;
+                break;
+            }
+            continue;
         }
 
-        [mutableRequest setHTTPBody:[NSJSONSerialization dataWithJSONObject:parameters options:self.writingOptions error:error]];
+        NSUInteger numberOfBytesToRead = MIN(length - totalNumberOfBytesRead, [self.currentChunk length] - self.currentChunkOffset);
+        [self.currentChunk getBytes:&buffer[totalNumberOfBytesRead] range:NSMakeRange(self.currentChunkOffset, numberOfBytesToRead)];
+        self.currentChunkOffset += numberOfBytesToRead;
+        totalNumberOfBytesRead += numberOfBytesToRead;
     }
 
-    return mutableRequest;
+    return (NSInteger)totalNumberOfBytesRead;
 }
 
-#pragma mark - NSSecureCoding
+- (BOOL)getBuffer:(__unused uint8_t **)buffer
+           length:(__unused NSUInteger *)len
+{
+    return NO;
+}
 
-- (instancetype)initWithCoder:(NSCoder *)decoder {
-    self = [super initWithCoder:decoder];
-    if (!self) {
-        return nil;
+- (BOOL)hasBytesAvailable {
+    return [self streamStatus] == NSStreamStatusOpen;
+}
+
+#pragma mark - NSStream
+
+- (void)open {
+    if (self.streamStatus == NSStreamStatusOpen) {
+        return;
     }
 
-    self.writingOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(writingOptions))] unsignedIntegerValue];
+    self.streamStatus = NSStreamStatusOpen;
+    self.chunkProducer = self.chunkProducerFactory();
+    self.currentChunk = nil;
+    self.currentChunkOffset = 0;
+}
 
-    return self;
+- (void)close {
+    self.streamStatus = NSStreamStatusClosed;
+    self.chunkProducer = nil;
+    self.currentChunk = nil;
 }
 
-- (void)encodeWithCoder:(NSCoder *)coder {
-    [super encodeWithCoder:coder];
+- (id)propertyForKey:(__unused NSString *)key {
+    return nil;
+}
 
-    [coder encodeInteger:self.writingOptions forKey:NSStringFromSelector(@selector(writingOptions))];
+- (BOOL)setProperty:(__unused id)property
+             forKey:(__unused NSString *)key
+{
+    return NO;
+}
+
+- (void)scheduleInRunLoop:(__unused NSRunLoop *)aRunLoop
+                  forMode:(__unused NSString *)mode
+{}
+
+- (void)removeFromRunLoop:(__unused NSRunLoop *)aRunLoop
+                  forMode:(__unused NSString *)mode
+{}
+
+#pragma mark - Undocumented CFReadStream Bridged Methods
+
+- (void)_scheduleInCFRunLoop:(__unused CFRunLoopRef)aRunLoop
+                     forMode:(__unused CFStringRef)aMode
+{}
+
+- (void)_unscheduleFromCFRunLoop:(__unused CFRunLoopRef)aRunLoop
+                         forMode:(__unused CFStringRef)aMode
+{}
+
+- (BOOL)_setCFClientFlags:(__unused CFOptionFlags)inFlags
+                 callback:(__unused CFReadStreamClientCallBack)inCallback
+                  context:(__unused CFStreamClientContext *)inContext {
+    return NO;
 }
 
 #pragma mark - NSCopying
 
+//重定向或者认证时NSURLSession需要一个新的数据流、从头重新生成
 - (instancetype)copyWithZone:(NSZone *)zone {
-    AFJSONRequestSerializer *serializer = [super copyWithZone:zone];
-    serializer.writingOptions = self.writingOptions;
-
-    return serializer;
+    return [[[self class] allocWithZone:zone] initWithChunkProducerFactory:self.chunkProducerFactory];
 }
 
 @end
 
-#pragma mark -
+#pragma mark - JSON请求体数据流
 
-@implementation AFPropertyListRequestSerializer
+//元素个数达到这个值的容器会被拆开逐段生成、更小的容器直接整体序列化
+static NSUInteger const kAFStreamingJSONMinimumContainerCount = 64;
+//每次最多把多少个相邻的元素合并成一次序列化
+static NSUInteger const kAFStreamingJSONMaximumBatchCount = 256;
+//即`NSJSONWritingSortedKeys`(iOS 11 / macOS 10.13)、直接用数值以免低版本SDK下无法编译
+static NSJSONWritingOptions const AFJSONWritingSortedKeys = (NSJSONWritingOptions)(1UL << 1);
 
-+ (instancetype)serializer {
-    return [self serializerWithFormat:NSPropertyListXMLFormat_v1_0 writeOptions:0];
-}
+@interface AFStreamingJSONFrame : NSObject
+@property (nonatomic, strong) id container;
+@property (nonatomic, strong) NSEnumerator *enumerator;
+@property (nonatomic, assign) BOOL hasElements;
+@end
 
-+ (instancetype)serializerWithFormat:(NSPropertyListFormat)format
-                        writeOptions:(NSPropertyListWriteOptions)writeOptions
-{
-    AFPropertyListRequestSerializer *serializer = [[self alloc] init];
-    serializer.format = format;
-    serializer.writeOptions = writeOptions;
+@implementation AFStreamingJSONFrame
+@end
 
-    return serializer;
+static BOOL AFStreamingJSONShouldSplitObject(id object) {
+    return ([object isKindOfClass:[NSArray class]] || [object isKindOfClass:[NSDictionary class]]) && [object count] >= kAFStreamingJSONMinimumContainerCount;
 }
 
-#pragma mark - AFURLRequestSerializer
-
-- (NSURLRequest *)requestBySerializingRequest:(NSURLRequest *)request
-                               withParameters:(id)parameters
-                                        error:(NSError *__autoreleasing *)error
-{
-    NSParameterAssert(request);
+//序列化后去掉首尾的括号、只保留里面的元素
+static void AFStreamingJSONAppendContentsOfContainer(NSMutableData *chunk, AFStreamingJSONFrame *frame, id container, NSJSONWritingOptions writingOptions) {
+    NSData *data = [NSJSONSerialization dataWithJSONObject:container options:writingOptions error:nil];
+    if ([data length] <= 2) {
+        return;
+    }
 
-    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[request HTTPMethod] uppercaseString]]) {
-        return [super requestBySerializingRequest:request withParameters:parameters error:error];
+    if (frame.hasElements) {
+        [chunk appendBytes:"," length:1];
+    }
+    [chunk appendBytes:(const uint8_t *)[data bytes] + 1 length:[data length] - 2];
+    frame.hasElements = YES;
+}
+
+static void AFStreamingJSONPushFrame(NSMutableData *chunk, NSMutableArray <AFStreamingJSONFrame *> *frames, id container, NSJSONWritingOptions writingOptions) {
+    AFStreamingJSONFrame *frame = [[AFStreamingJSONFrame alloc] init];
+    frame.container = container;
+    if ([container isKindOfClass:[NSDictionary class]]) {
+        //要求key有序时先排好序再拆分、每一批内部由NSJSONSerialization排序、拼起来整体仍然有序
+        //排序规则和NSJSONSerialization一致
+        if (writingOptions & AFJSONWritingSortedKeys) {
+            frame.enumerator = [[[container allKeys] sortedArrayUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+                return [key1 compare:key2 options:NSNumericSearch | NSCaseInsensitiveSearch | NSForcedOrderingSearch range:NSMakeRange(0, [key1 length]) locale:[NSLocale systemLocale]];
+            }] objectEnumerator];
+        } else {
+            frame.enumerator = [container keyEnumerator];
+        }
+        [chunk appendBytes:"{" length:1];
+    } else {
+        frame.enumerator = [container objectEnumerator];
+        [chunk appendBytes:"[" length:1];
     }
+    [frames addObject:frame];
+}
 
-    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+/*
+    JSON请求体
+    顶层容器和元素较多的子容器会被拆开、其余部分分批交给NSJSONSerialization序列化
+    调用前需要保证`+[NSJSONSerialization isValidJSONObject:]`
+ */
+static AFStreamingBodyChunkProducerFactory AFJSONBodyChunkProducerFactory(id JSONObject, NSJSONWritingOptions writingOptions) {
+    return ^AFStreamingBodyChunkProducer {
+        NSMutableArray <AFStreamingJSONFrame *> *frames = [NSMutableArray array];
+        __block BOOL hasStarted = NO;
+
+        return ^NSData * {
+            NSMutableData *chunk = [NSMutableData dataWithCapacity:kAFStreamingBodyChunkLength];
+            if (!hasStarted) {
+                hasStarted = YES;
+                AFStreamingJSONPushFrame(chunk, frames, JSONObject, writingOptions);
+            }
 
-    [self.HTTPRequestHeaders enumerateKeysAndObjectsUsingBlock:^(id field, id value, BOOL * __unused stop) {
-        if (![request valueForHTTPHeaderField:field]) {
-            [mutableRequest setValue:value forHTTPHeaderField:field];
+            while ([frames count] > 0 && [chunk length] < kAFStreamingBodyChunkLength) {
+                AFStreamingJSONFrame *frame = [frames lastObject];
+                BOOL isDictionary = [frame.container isKindOfClass:[NSDictionary class]];
+                //相邻的小元素合并成一个临时容器一起序列化
+                id batch = isDictionary ? [NSMutableDictionary dictionary] : [NSMutableArray array];
+
+                while (YES) {
+                    id element = [frame.enumerator nextObject];
+                    if (!element) {
+                        AFStreamingJSONAppendContentsOfContainer(chunk, frame, batch, writingOptions);
+                        [chunk appendBytes:(isDictionary ? "}" : "]") length:1];
+                        [frames removeLastObject];
+                        break;
+                    }
+
+                    id value = isDictionary ? frame.container[element] : element;
+                    if (AFStreamingJSONShouldSplitObject(value)) {
+                        AFStreamingJSONAppendContentsOfContainer(chunk, frame, batch, writingOptions);
+                        if (frame.hasElements) {
+                            [chunk appendBytes:"," length:1];
+                        }
+                        frame.hasElements = YES;
+                        if (isDictionary) {
+                            //key单独序列化、同样借用数组再去掉括号
+                            NSData *keyData = [NSJSONSerialization dataWithJSONObject:@[element] options:writingOptions error:nil];
+                            [chunk appendBytes:(const uint8_t *)[keyData bytes] + 1 length:[keyData length] - 2];
+                            [chunk appendBytes:":" length:1];
+                        }
+                        AFStreamingJSONPushFrame(chunk, frames, value, writingOptions);
+                        break;
+                    }
+
+                    if (isDictionary) {
+                        [batch setObject:value forKey:element];
+                    } else {
+                        [batch addObject:value];
+                    }
+
+                    if ([batch count] >= kAFStreamingJSONMaximumBatchCount) {
+                        AFStreamingJSONAppendContentsOfContainer(chunk, frame, batch, writingOptions);
+                        break;
+                    }
+                }
+            }
+
+            return [chunk length] > 0 ? chunk : nil;
+        };
+    };
+}
+
+#pragma mark - AFJSONRequestSerializer
+//可以将参数转化成json上传
+@implementation AFJSONRequestSerializer
+
++ (instancetype)serializer {
+    return [self serializerWithWritingOptions:(NSJSONWritingOptions)0];
+}
+
++ (instancetype)serializerWithWritingOptions:(NSJSONWritingOptions)writingOptions
+{
+    AFJSONRequestSerializer *serializer = [[self alloc] init];
+    serializer.writingOptions = writingOptions;
+
+    return serializer;
+}
+
+#pragma mark - AFURLRequestSerialization
+
+- (BOOL)serializeParameters:(id)parameters
+                intoRequest:(NSMutableURLRequest *)mutableRequest
+                      error:(NSError *__autoreleasing *)error
+{
+    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[mutableRequest HTTPMethod] uppercaseString]]) {
+        return [super serializeParameters:parameters intoRequest:mutableRequest error:error];
+    }
+
+    if (parameters) {
+        if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
+            [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
         }
-    }];
+
+        //格式化输出的缩进依赖层级、无法拆开生成
+        if (self.streamsHTTPBody && !(self.writingOptions & NSJSONWritingPrettyPrinted) && [NSJSONSerialization isValidJSONObject:parameters]) {
+            AFStreamingBodyInputStream *bodyStream = [[AFStreamingBodyInputStream alloc] initWithChunkProducerFactory:AFJSONBodyChunkProducerFactory(parameters, self.writingOptions)];
+            [mutableRequest setHTTPBodyStream:bodyStream];
+        } else {
+            [mutableRequest setHTTPBody:[NSJSONSerialization dataWithJSONObject:parameters options:self.writingOptions error:error]];
+        }
+    }
+
+    return YES;
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    self.writingOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(writingOptions))] unsignedIntegerValue];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeInteger:self.writingOptions forKey:NSStringFromSelector(@selector(writingOptions))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFJSONRequestSerializer *serializer = [super copyWithZone:zone];
+    serializer.writingOptions = self.writingOptions;
+
+    return serializer;
+}
+
+@end
+
+#pragma mark -
+
+@implementation AFPropertyListRequestSerializer
+
++ (instancetype)serializer {
+    return [self serializerWithFormat:NSPropertyListXMLFormat_v1_0 writeOptions:0];
+}
+
++ (instancetype)serializerWithFormat:(NSPropertyListFormat)format
+                        writeOptions:(NSPropertyListWriteOptions)writeOptions
+{
+    AFPropertyListRequestSerializer *serializer = [[self alloc] init];
+    serializer.format = format;
+    serializer.writeOptions = writeOptions;
+
+    return serializer;
+}
+
+#pragma mark - AFURLRequestSerializer
+
+- (BOOL)serializeParameters:(id)parameters
+                intoRequest:(NSMutableURLRequest *)mutableRequest
+                      error:(NSError *__autoreleasing *)error
+{
+    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[mutableRequest HTTPMethod] uppercaseString]]) {
+        return [super serializeParameters:parameters intoRequest:mutableRequest error:error];
+    }
 
     if (parameters) {
         if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
@@ -1534,7 +2044,7 @@ typedef enum {
         [mutableRequest setHTTPBody:[NSPropertyListSerialization dataWithPropertyList:parameters format:self.format options:self.writeOptions error:error]];
     }
 
-    return mutableRequest;
+    return YES;
 }
 
 #pragma mark - NSSecureCoding
@@ -1569,3 +2079,580 @@ typedef enum {
 }
 
 @end
+
+#pragma mark - AFCBORRequestSerializer
+
+//最大嵌套层级、防止循环引用导致栈溢出
+static NSUInteger const kAFCBORMaximumNestingDepth = 512;
+
+//写入CBOR的头部: 3位主类型 + 参数(长度或者数值)、大端序
+static void AFCBORAppendHead(NSMutableData *data, uint8_t majorType, uint64_t value) {
+    uint8_t initialByte = (uint8_t)(majorType << 5);
+    if (value < 24) {
+        initialByte |= (uint8_t)value;
+        [data appendBytes:&initialByte length:1];
+    } else if (value <= UINT8_MAX) {
+        uint8_t bytes[2] = {initialByte | 24, (uint8_t)value};
+        [data appendBytes:bytes length:sizeof(bytes)];
+    } else if (value <= UINT16_MAX) {
+        initialByte |= 25;
+        uint16_t bigEndianValue = CFSwapInt16HostToBig((uint16_t)value);
+        [data appendBytes:&initialByte length:1];
+        [data appendBytes:&bigEndianValue length:sizeof(bigEndianValue)];
+    } else if (value <= UINT32_MAX) {
+        initialByte |= 26;
+        uint32_t bigEndianValue = CFSwapInt32HostToBig((uint32_t)value);
+        [data appendBytes:&initialByte length:1];
+        [data appendBytes:&bigEndianValue length:sizeof(bigEndianValue)];
+    } else {
+        initialByte |= 27;
+        uint64_t bigEndianValue = CFSwapInt64HostToBig(value);
+        [data appendBytes:&initialByte length:1];
+        [data appendBytes:&bigEndianValue length:sizeof(bigEndianValue)];
+    }
+}
+
+static void AFCBORAppendNumber(NSMutableData *data, NSNumber *number) {
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+        //simple value 20:false 21:true
+        uint8_t simpleValue = [number boolValue] ? 0xf5 : 0xf4;
+        [data appendBytes:&simpleValue length:1];
+    } else if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+        double doubleValue = [number doubleValue];
+        float floatValue = (float)doubleValue;
+        //单精度能无损表示的用单精度、节省4个字节
+        if ((double)floatValue == doubleValue || doubleValue != doubleValue) {
+            uint8_t initialByte = 0xfa;
+            uint32_t bits;
+            memcpy(&bits, &floatValue, sizeof(bits));
+            bits = CFSwapInt32HostToBig(bits);
+            [data appendBytes:&initialByte length:1];
+            [data appendBytes:&bits length:sizeof(bits)];
+        } else {
+            uint8_t initialByte = 0xfb;
+            uint64_t bits;
+            memcpy(&bits, &doubleValue, sizeof(bits));
+            bits = CFSwapInt64HostToBig(bits);
+            [data appendBytes:&initialByte length:1];
+            [data appendBytes:&bits length:sizeof(bits)];
+        }
+    } else if (strcmp([number objCType], @encode(unsigned long long)) == 0 || strcmp([number objCType], @encode(unsigned long)) == 0) {
+        AFCBORAppendHead(data, 0, [number unsignedLongLongValue]);
+    } else {
+        long long value = [number longLongValue];
+        if (value >= 0) {
+            AFCBORAppendHead(data, 0, (uint64_t)value);
+        } else {
+            //负整数存储为 -1 - n
+            AFCBORAppendHead(data, 1, (uint64_t)(-1 - value));
+        }
+    }
+}
+
+//字符串直接编码进data、不生成中间的NSData
+static void AFCBORAppendString(NSMutableData *data, NSString *string) {
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    AFCBORAppendHead(data, 3, length);
+
+    NSUInteger offset = [data length];
+    [data increaseLengthBy:length];
+    [string getBytes:(uint8_t *)[data mutableBytes] + offset maxLength:length usedLength:NULL encoding:NSUTF8StringEncoding options:(NSStringEncodingConversionOptions)0 range:NSMakeRange(0, [string length]) remainingRange:NULL];
+}
+
+static BOOL AFCBORAppendObject(NSMutableData *data, id object, NSUInteger depth, NSError *__autoreleasing *error) {
+    if (depth > kAFCBORMaximumNestingDepth) {
+        if (error) {
+            *error = [NSError errorWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:@{NSLocalizedDescriptionKey: NSLocalizedStringFromTable(@"CBOR encoding exceeded the maximum nesting depth", @"AFNetworking", nil)}];
+        }
+        return NO;
+    }
+
+    if ([object isKindOfClass:[NSString class]]) {
+        AFCBORAppendString(data, object);
+    } else if ([object isKindOfClass:[NSNumber class]]) {
+        AFCBORAppendNumber(data, object);
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = object;
+        AFCBORAppendHead(data, 5, [dictionary count]);
+        __block BOOL succeeded = YES;
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if (!AFCBORAppendObject(data, key, depth + 1, error) || !AFCBORAppendObject(data, value, depth + 1, error)) {
+                succeeded = NO;
+                *stop = YES;
+            }
+        }];
+        return succeeded;
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        NSArray *array = object;
+        AFCBORAppendHead(data, 4, [array count]);
+        for (id value in array) {
+            if (!AFCBORAppendObject(data, value, depth + 1, error)) {
+                return NO;
+            }
+        }
+    } else if ([object isKindOfClass:[NSNull class]]) {
+        uint8_t simpleValue = 0xf6;
+        [data appendBytes:&simpleValue length:1];
+    } else if ([object isKindOfClass:[NSData class]]) {
+        AFCBORAppendHead(data, 2, [object length]);
+        [data appendData:object];
+    } else if ([object isKindOfClass:[NSDate class]]) {
+        //tag 1: 距1970的秒数
+        AFCBORAppendHead(data, 6, 1);
+        AFCBORAppendNumber(data, @([(NSDate *)object timeIntervalSince1970]));
+    } else {
+        if (error) {
+            *error = [NSError errorWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedStringFromTable(@"Invalid type in CBOR write (%@)", @"AFNetworking", nil), NSStringFromClass([object class])]}];
+        }
+        return NO;
+    }
+
+    return YES;
+}
+
+@implementation AFCBORRequestSerializer
+
+#pragma mark - AFURLRequestSerialization
+
+- (BOOL)serializeParameters:(id)parameters
+                intoRequest:(NSMutableURLRequest *)mutableRequest
+                      error:(NSError *__autoreleasing *)error
+{
+    if ([self.HTTPMethodsEncodingParametersInURI containsObject:[[mutableRequest HTTPMethod] uppercaseString]]) {
+        return [super serializeParameters:parameters intoRequest:mutableRequest error:error];
+    }
+
+    if (parameters) {
+        if (![mutableRequest valueForHTTPHeaderField:@"Content-Type"]) {
+            [mutableRequest setValue:@"application/cbor" forHTTPHeaderField:@"Content-Type"];
+        }
+
+        NSMutableData *body = [NSMutableData data];
+        if (!AFCBORAppendObject(body, parameters, 0, error)) {
+            return NO;
+        }
+
+        [mutableRequest setHTTPBody:body];
+    }
+
+    return YES;
+}
+
+@end
+
+#pragma mark - AFCompressingRequestSerializer
+
+//压缩数据流每次从原始数据流读取的长度
+static NSUInteger const kAFCompressingInputStreamBufferLength = 16 * 1024;
+
+static NSString * AFContentEncodingForCompressionEncoding(AFHTTPRequestBodyCompressionEncoding compressionEncoding) {
+    switch (compressionEncoding) {
+        case AFHTTPRequestBodyCompressionEncodingGzip:
+            return @"gzip";
+        case AFHTTPRequestBodyCompressionEncodingDeflate:
+            return @"deflate";
+    }
+
+    return nil;
+}
+
+//15为最大的窗口、再加16输出gzip格式
+static int AFZlibWindowBitsForCompressionEncoding(AFHTTPRequestBodyCompressionEncoding compressionEncoding) {
+    return compressionEncoding == AFHTTPRequestBodyCompressionEncodingGzip ? MAX_WBITS + 16 : MAX_WBITS;
+}
+
+static NSData * AFCompressedDataWithData(NSData *data, int windowBits, int level) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nil;
+    }
+
+    NSMutableData *compressedData = [NSMutableData dataWithLength:deflateBound(&stream, (uLong)[data length])];
+    stream.next_in = (Bytef *)[data bytes];
+    stream.avail_in = (uInt)[data length];
+
+    int status = Z_OK;
+    do {
+        if (stream.total_out >= [compressedData length]) {
+            [compressedData increaseLengthBy:kAFCompressingInputStreamBufferLength];
+        }
+        stream.next_out = (Bytef *)[compressedData mutableBytes] + stream.total_out;
+        stream.avail_out = (uInt)([compressedData length] - stream.total_out);
+        status = deflate(&stream, Z_FINISH);
+    } while (status == Z_OK || status == Z_BUF_ERROR);
+
+    [compressedData setLength:stream.total_out];
+    deflateEnd(&stream);
+
+    return status == Z_STREAM_END ? compressedData : nil;
+}
+
+/*
+    边读边压缩的数据流
+    从原始数据流读取一段、压缩后写入调用方的buffer
+ */
+@interface AFCompressingInputStream : NSInputStream <NSCopying> {
+    z_stream _zStream;
+}
+@property (readwrite, nonatomic, strong) NSInputStream *inputStream;//原始数据流
+@property (readwrite, nonatomic, strong) NSMutableData *inputBuffer;//从原始数据流读取的数据
+@property (readwrite, nonatomic, assign) int windowBits;
+@property (readwrite, nonatomic, assign) int level;
+@property (readwrite, nonatomic, assign) BOOL zStreamInitialized;
+@property (readwrite, nonatomic, assign) BOOL inputStreamAtEnd;
+
+- (instancetype)initWithInputStream:(NSInputStream *)inputStream
+                         windowBits:(int)windowBits
+                              level:(int)level;
+@end
+
+@implementation AFCompressingInputStream
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wimplicit-atomic-properties"
+#if (defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && __IPHONE_OS_VERSION_MAX_ALLOWED >= 80000) || (defined(__MAC_OS_X_VERSION_MAX_ALLOWED) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 1100)
+@synthesize delegate;
+#endif
+@synthesize streamStatus;
+@synthesize streamError;
+#pragma clang diagnostic pop
+
+- (instancetype)initWithInputStream:(NSInputStream *)inputStream
+                         windowBits:(int)windowBits
+                              level:(int)level
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.inputStream = inputStream;
+    self.inputBuffer = [NSMutableData dataWithLength:kAFCompressingInputStreamBufferLength];
+    self.windowBits = windowBits;
+    self.level = level;
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_zStreamInitialized) {
+        deflateEnd(&_zStream);
+    }
+}
+
+#pragma mark - NSInputStream
+
+- (NSInteger)read:(uint8_t *)buffer
+        maxLength:(NSUInteger)length
+{
+    if ([self streamStatus] != NSStreamStatusOpen) {
+        return 0;
+    }
+
+    _zStream.next_out = buffer;
+    _zStream.avail_out = (uInt)MIN(length, (NSUInteger)UINT_MAX);
+    NSUInteger maxLength = _zStream.avail_out;
+
+    while (_zStream.avail_out > 0) {
+        //上一段已经压缩完了、从原始数据流读取下一段
+        if (_zStream.avail_in == 0 && !self.inputStreamAtEnd) {
+            NSInteger numberOfBytesRead = [self.inputStream read:[self.inputBuffer mutableBytes] maxLength:[self.inputBuffer length]];
+            if (numberOfBytesRead < 0) {
+                self.streamError = self.inputStream.streamError;
+                self.streamStatus = NSStreamStatusError;
+                return -1;
+            } else if (numberOfBytesRead == 0) {
+                //暂时没有数据可读时也会返回0、只有原始数据流确实结束了才结束压缩
+                if ([self.inputStream streamStatus] != NSStreamStatusAtEnd) {
+                    break;
+                }
+                self.inputStreamAtEnd = YES;
+            } else {
+                _zStream.next_in = [self.inputBuffer mutableBytes];
+                _zStream.avail_in = (uInt)numberOfBytesRead;
+            }
+        }
+
+        int status = deflate(&_zStream, self.inputStreamAtEnd ? Z_FINISH : Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            self.streamStatus = NSStreamStatusAtEnd;
+            break;
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            self.streamError = [NSError errorWithDomain:AFURLRequestSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:nil];
+            self.streamStatus = NSStreamStatusError;
+            return -1;
+        }
+    }
+
+    return (NSInteger)(maxLength - _zStream.avail_out);
+}
+
+- (BOOL)getBuffer:(__unused uint8_t **)buffer
+           length:(__unused NSUInteger *)len
+{
+    return NO;
+}
+
+- (BOOL)hasBytesAvailable {
+    return [self streamStatus] == NSStreamStatusOpen;
+}
+
+#pragma mark - NSStream
+
+- (void)open {
+    if (self.streamStatus == NSStreamStatusOpen) {
+        return;
+    }
+
+    memset(&_zStream, 0, sizeof(_zStream));
+    if (deflateInit2(&_zStream, self.level, Z_DEFLATED, self.windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        self.streamStatus = NSStreamStatusError;
+        return;
+    }
+    self.zStreamInitialized = YES;
+    self.inputStreamAtEnd = NO;
+
+    [self.inputStream open];
+    self.streamStatus = NSStreamStatusOpen;
+}
+
+- (void)close {
+    self.streamStatus = NSStreamStatusClosed;
+    [self.inputStream close];
+
+    if (self.zStreamInitialized) {
+        deflateEnd(&_zStream);
+        self.zStreamInitialized = NO;
+    }
+}
+
+- (id)propertyForKey:(__unused NSString *)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(__unused id)property
+             forKey:(__unused NSString *)key
+{
+    return NO;
+}
+
+- (void)scheduleInRunLoop:(__unused NSRunLoop *)aRunLoop
+                  forMode:(__unused NSString *)mode
+{}
+
+- (void)removeFromRunLoop:(__unused NSRunLoop *)aRunLoop
+                  forMode:(__unused NSString *)mode
+{}
+
+#pragma mark - Undocumented CFReadStream Bridged Methods
+
+- (void)_scheduleInCFRunLoop:(__unused CFRunLoopRef)aRunLoop
+                     forMode:(__unused CFStringRef)aMode
+{}
+
+- (void)_unscheduleFromCFRunLoop:(__unused CFRunLoopRef)aRunLoop
+                         forMode:(__unused CFStringRef)aMode
+{}
+
+- (BOOL)_setCFClientFlags:(__unused CFOptionFlags)inFlags
+                 callback:(__unused CFReadStreamClientCallBack)inCallback
+                  context:(__unused CFStreamClientContext *)inContext {
+    return NO;
+}
+
+#pragma mark - NSCopying
+
+//原始数据流可以复制时、才能重新生成一个压缩数据流
+- (instancetype)copyWithZone:(NSZone *)zone {
+    if (![self.inputStream conformsToProtocol:@protocol(NSCopying)]) {
+        return nil;
+    }
+
+    return [[[self class] allocWithZone:zone] initWithInputStream:[(id <NSCopying>)self.inputStream copyWithZone:zone] windowBits:self.windowBits level:self.level];
+}
+
+@end
+
+#pragma mark -
+
+@interface AFCompressingRequestSerializer ()
+@property (readwrite, nonatomic, strong) id <AFURLRequestSerialization> requestSerializer;
+@end
+
+@implementation AFCompressingRequestSerializer
+
++ (instancetype)serializer {
+    return [self serializerWithRequestSerializer:[AFHTTPRequestSerializer serializer]];
+}
+
++ (instancetype)serializerWithRequestSerializer:(id <AFURLRequestSerialization>)requestSerializer {
+    AFCompressingRequestSerializer *serializer = [[self alloc] init];
+    serializer.requestSerializer = requestSerializer;
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.requestSerializer = [AFHTTPRequestSerializer serializer];
+    self.compressionEncoding = AFHTTPRequestBodyCompressionEncodingGzip;
+    self.compressionLevel = Z_DEFAULT_COMPRESSION;
+    self.minimumCompressibleBodyLength = 1024;
+
+    return self;
+}
+
+//请求体是否需要压缩
+- (BOOL)shouldCompressRequest:(NSURLRequest *)request {
+    if (!request || [request valueForHTTPHeaderField:@"Content-Encoding"]) {
+        return NO;
+    }
+
+    if (request.HTTPBody) {
+        return [request.HTTPBody length] >= self.minimumCompressibleBodyLength;
+    }
+
+    if (request.HTTPBodyStream) {
+        //multipart表单会带有Content-Length、可以用来判断是否需要压缩
+        NSString *contentLength = [request valueForHTTPHeaderField:@"Content-Length"];
+        return !contentLength || (unsigned long long)[contentLength longLongValue] >= self.minimumCompressibleBodyLength;
+    }
+
+    return NO;
+}
+
+//压缩请求体、并设置对应的请求头、直接修改传入的请求
+- (void)compressBodyOfRequest:(NSMutableURLRequest *)mutableRequest {
+    if (![self shouldCompressRequest:mutableRequest]) {
+        return;
+    }
+
+    int windowBits = AFZlibWindowBitsForCompressionEncoding(self.compressionEncoding);
+    int level = (int)self.compressionLevel;
+
+    if (mutableRequest.HTTPBody) {
+        NSData *compressedBody = AFCompressedDataWithData(mutableRequest.HTTPBody, windowBits, level);
+        //压缩后反而更大的就不压缩了
+        if (!compressedBody || [compressedBody length] >= [mutableRequest.HTTPBody length]) {
+            return;
+        }
+
+        [mutableRequest setHTTPBody:compressedBody];
+        [mutableRequest setValue:AFContentEncodingForCompressionEncoding(self.compressionEncoding) forHTTPHeaderField:@"Content-Encoding"];
+        [mutableRequest setValue:[NSString stringWithFormat:@"%lu", (unsigned long)[compressedBody length]] forHTTPHeaderField:@"Content-Length"];
+    } else {
+        [mutableRequest setHTTPBodyStream:[[AFCompressingInputStream alloc] initWithInputStream:mutableRequest.HTTPBodyStream windowBits:windowBits level:level]];
+        [mutableRequest setValue:AFContentEncodingForCompressionEncoding(self.compressionEncoding) forHTTPHeaderField:@"Content-Encoding"];
+        [mutableRequest setValue:nil forHTTPHeaderField:@"Content-Length"];
+    }
+}
+
+//不需要压缩时原样返回、否则复制一份再压缩、不修改传入的请求
+- (NSURLRequest *)requestByCompressingRequest:(NSURLRequest *)request {
+    if (![self shouldCompressRequest:request]) {
+        return request;
+    }
+
+    NSMutableURLRequest *mutableRequest = [request mutableCopy];
+    [self compressBodyOfRequest:mutableRequest];
+
+    return mutableRequest;
+}
+
+#pragma mark - AFHTTPRequestSerializer
+
+//被包装的是`AFHTTPRequestSerializer`时、由它自己生成请求、保证使用的是它的请求头和配置
+- (NSMutableURLRequest *)requestWithMethod:(NSString *)method
+                                 URLString:(NSString *)URLString
+                                parameters:(id)parameters
+                                     error:(NSError *__autoreleasing *)error
+{
+    if ([self.requestSerializer isKindOfClass:[AFHTTPRequestSerializer class]]) {
+        NSMutableURLRequest *request = [(AFHTTPRequestSerializer *)self.requestSerializer requestWithMethod:method URLString:URLString parameters:parameters error:error];
+        //请求是刚生成的、直接在上面压缩
+        [self compressBodyOfRequest:request];
+
+        return request;
+    }
+
+    return [super requestWithMethod:method URLString:URLString parameters:parameters error:error];
+}
+
+- (NSMutableURLRequest *)multipartFormRequestWithMethod:(NSString *)method
+                                              URLString:(NSString *)URLString
+                                             parameters:(NSDictionary *)parameters
+                              constructingBodyWithBlock:(void (^)(id <AFMultipartFormData> formData))block
+                                                  error:(NSError *__autoreleasing *)error
+{
+    NSMutableURLRequest *request = nil;
+    if ([self.requestSerializer isKindOfClass:[AFHTTPRequestSerializer class]]) {
+        request = [(AFHTTPRequestSerializer *)self.requestSerializer multipartFormRequestWithMethod:method URLString:URLString parameters:parameters constructingBodyWithBlock:block error:error];
+    } else {
+        request = [super multipartFormRequestWithMethod:method URLString:URLString parameters:parameters constructingBodyWithBlock:block error:error];
+    }
+
+    [self compressBodyOfRequest:request];
+
+    return request;
+}
+
+#pragma mark - AFURLRequestSerialization
+
+- (NSURLRequest *)requestBySerializingRequest:(NSURLRequest *)request
+                               withParameters:(id)parameters
+                                        error:(NSError *__autoreleasing *)error
+{
+    NSParameterAssert(request);
+
+    NSURLRequest *serializedRequest = [self.requestSerializer requestBySerializingRequest:request withParameters:parameters error:error];
+
+    return [self requestByCompressingRequest:serializedRequest];
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    //只允许解码AFN自带的请求序列化器(及其子类)
+    NSSet *requestSerializerClasses = [NSSet setWithObjects:[AFHTTPRequestSerializer class], [AFJSONRequestSerializer class], [AFPropertyListRequestSerializer class], [AFCBORRequestSerializer class], [AFCompressingRequestSerializer class], nil];
+    id <AFURLRequestSerialization> requestSerializer = [decoder decodeObjectOfClasses:requestSerializerClasses forKey:NSStringFromSelector(@selector(requestSerializer))];
+    if (requestSerializer) {
+        self.requestSerializer = requestSerializer;
+    }
+    self.compressionEncoding = (AFHTTPRequestBodyCompressionEncoding)[decoder decodeIntegerForKey:NSStringFromSelector(@selector(compressionEncoding))];
+    self.compressionLevel = [decoder decodeIntegerForKey:NSStringFromSelector(@selector(compressionLevel))];
+    self.minimumCompressibleBodyLength = (NSUInteger)[decoder decodeIntegerForKey:NSStringFromSelector(@selector(minimumCompressibleBodyLength))];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeObject:self.requestSerializer forKey:NSStringFromSelector(@selector(requestSerializer))];
+    [coder encodeInteger:self.compressionEncoding forKey:NSStringFromSelector(@selector(compressionEncoding))];
+    [coder encodeInteger:self.compressionLevel forKey:NSStringFromSelector(@selector(compressionLevel))];
+    [coder encodeInteger:(NSInteger)self.minimumCompressibleBodyLength forKey:NSStringFromSelector(@selector(minimumCompressibleBodyLength))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFCompressingRequestSerializer *serializer = [super copyWithZone:zone];
+    serializer.requestSerializer = [self.requestSerializer copyWithZone:zone];
+    serializer.compressionEncoding = self.compressionEncoding;
+    serializer.compressionLevel = self.compressionLevel;
+    serializer.minimumCompressibleBodyLength = self.minimumCompressibleBodyLength;
+
+    return serializer;
+}
+
+@end
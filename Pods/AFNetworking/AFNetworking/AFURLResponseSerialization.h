@@ -52,6 +52,39 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+/**
+ 增量解析的状态、每个响应一个实例
+ */
+@protocol AFURLResponseIncrementalParsing <NSObject>
+
+/**
+ 追加一段响应数据、在AF的处理队列上按接收顺序串行调用
+ */
+- (void)appendData:(NSData *)data;
+
+/**
+ 数据接收完毕、返回解析结果
+ */
+- (nullable id)finishParsingWithError:(NSError * _Nullable __autoreleasing *)error;
+
+@end
+
+/**
+ 可以边接收边解析的序列化器
+
+ 作为`AFURLSessionManager`的`responseSerializer`时、数据任务收到第一段数据时会为响应创建一个增量解析器
+ 之后的数据直接交给解析器、不再缓存在内存中、任务结束时由`-finishParsingWithError:`得到`responseObject`
+ */
+@protocol AFURLResponseIncrementalSerialization <AFURLResponseSerialization>
+
+/**
+ 为响应创建增量解析器
+ 返回nil时按照普通方式缓存全部数据后调用`-responseObjectForResponse:data:error:`(比如状态码或content-type不符合、由它生成错误)
+ */
+- (nullable id <AFURLResponseIncrementalParsing>)incrementalParserForResponse:(NSURLResponse *)response;
+
+@end
+
 #pragma mark -
 
 /**
@@ -106,6 +139,19 @@ NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark -
 
+/**
+ JSON解析后端
+ `AFJSONResponseSerializer`默认使用`NSJSONSerialization`、可以替换成其他实现
+ 同一个实例会被多个请求在不同线程同时使用、实现需要是线程安全的
+ */
+@protocol AFJSONParserBackend <NSObject>
+
+- (nullable id)JSONObjectWithData:(NSData *)data
+                          options:(NSJSONReadingOptions)options
+                            error:(NSError * _Nullable __autoreleasing *)error;
+
+@end
+
 
 /**
  Json序列化
@@ -134,9 +180,24 @@ NS_ASSUME_NONNULL_BEGIN
 
 /**
  是否屏蔽NSNULL、默认为NO
+ `parserBackend`为`AFStructuralIndexJSONParser`时在解析过程中跳过、否则解析后再遍历一遍重建容器
  */
 @property (nonatomic, assign) BOOL removesKeysWithNullValues;
 
+/**
+ 是否在同一个响应内共享相同的字符串、默认为NO
+ 相同的key、不超过32个字符的字符串值共享同一个实例、小整数使用缓存的NSNumber
+ `parserBackend`为`AFStructuralIndexJSONParser`时在解析过程中直接共享、懒加载的结果不会被展开
+ 其他后端会在解析后多一次遍历重建容器
+ */
+@property (nonatomic, assign) BOOL internsStrings;
+
+/**
+ JSON解析后端、默认为nil即使用`NSJSONSerialization`
+ copy时共享同一个实例、不参与归档
+ */
+@property (nonatomic, strong, nullable) id <AFJSONParserBackend> parserBackend;
+
 /**
  根据指定策略创建一个实例
  */
@@ -146,6 +207,126 @@ NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark -
 
+/**
+ CBOR(RFC 8949)序列化
+
+ 默认接收以下content-type:
+
+ - `application/cbor`
+
+ 与`AFJSONResponseSerializer`使用相同的Foundation类型映射
+ 另外 byte string -> NSData、tag 1 -> NSDate、undefined -> NSNull
+ */
+@interface AFCBORResponseSerializer : AFHTTPResponseSerializer
+
+- (instancetype)init;
+
+/**
+ 是否屏蔽NSNULL、默认为NO
+ 在解析时直接跳过、不需要再遍历一遍
+ */
+@property (nonatomic, assign) BOOL removesKeysWithNullValues;
+
+/**
+ 是否直接引用响应数据中的字符串和二进制、默认为NO
+ 开启后较长的字符串和NSData不会复制、而是持有整个响应数据
+ 只要还有一个这样的对象存活、响应数据就不会被释放
+ */
+@property (nonatomic, assign) BOOL usesZeroCopyViews;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFJSONModelSchema` 声明JSON与模型类之间的映射
+
+ 只需要声明一次、第一次解析时根据runtime信息编译成属性表、之后的解析都直接查表
+ 支持的属性类型: 整数、浮点数、BOOL、NSString、NSNumber、嵌套的模型、模型数组以及NSArray/NSDictionary/id(按JSON原样生成)
+ */
+@interface AFJSONModelSchema : NSObject <NSSecureCoding, NSCopying>
+
+/**
+ 模型类、需要能通过`-init`创建
+ */
+@property (readonly, nonatomic, strong) Class modelClass;
+
+/**
+ JSON中的key -> 属性名
+ 为nil时使用模型类(包括父类)所有可写属性的同名key
+ */
+@property (readonly, nonatomic, copy, nullable) NSDictionary <NSString *, NSString *> *keyMapping;
+
++ (instancetype)schemaWithModelClass:(Class)modelClass
+                          keyMapping:(nullable NSDictionary <NSString *, NSString *> *)keyMapping;
+
+/**
+ 为属性指定嵌套的模型
+ 属性为模型时解析成该模型、属性为NSArray时解析成该模型的数组
+ 可以指定自身、用来解析递归的结构、指定自身不会产生循环引用
+ 其他schema会被强引用、两个schema互相指定时需要在不再使用后传nil解除其中一个
+ 传nil移除已指定的schema
+ 修改后下一次解析才生效、正在进行的解析不受影响
+ */
+- (void)setSchema:(nullable AFJSONModelSchema *)schema forPropertyName:(NSString *)propertyName;
+
+@end
+
+/**
+ 直接把JSON解析成模型、不生成中间的NSDictionary/NSArray
+
+ JSON中没有声明的key会被直接跳过、不会生成任何对象
+ 顶层为数组时返回模型数组、顶层为对象时返回模型
+ 默认接收的content-type与`AFJSONResponseSerializer`相同
+ */
+@interface AFJSONModelResponseSerializer : AFHTTPResponseSerializer
+
+- (instancetype)init;
+
+/**
+ 映射关系
+ */
+@property (nonatomic, strong, nullable) AFJSONModelSchema *schema;
+
++ (instancetype)serializerWithSchema:(AFJSONModelSchema *)schema;
+
+@end
+
+#pragma mark -
+
+/**
+ 基于结构索引的JSON解析器、可以作为`AFJSONResponseSerializer`的`parserBackend`
+
+ 分两个阶段:
+ 1. 每次处理64字节、用SIMD(AVX2/SSE、arm64上为NEON、其他平台为标量实现)找出所有结构字符的位置、同时校验UTF-8
+ 2. 按结构索引校验语法并生成tape、之后再由tape生成Foundation对象
+
+ UTF-16/UTF-32编码以及超过2GB的数据会交给`NSJSONSerialization`处理
+ */
+@interface AFStructuralIndexJSONParser : NSObject <AFJSONParserBackend>
+
++ (instancetype)parser;
+
+/**
+ 是否返回懒加载的对象、默认为NO
+
+ 为YES时返回的NSDictionary/NSArray只持有原始数据和tape、访问到的值才会生成对象并缓存
+ 适合很大的响应中只读取少量字段的情况、返回的对象会持有整个响应数据
+ 此模式下忽略`NSJSONReadingMutableContainers`和`NSJSONReadingMutableLeaves`
+ */
+@property (nonatomic, assign) BOOL producesLazyObjects;
+
+/**
+ 是否在同一个响应内共享相同的key、短字符串和小整数、默认为NO
+ 在由tape生成对象时直接查表、不需要再遍历一次
+ 懒加载模式下在访问到的时候共享
+ */
+@property (nonatomic, assign) BOOL internsStrings;
+
+@end
+
+#pragma mark -
+
 /**
  XML序列化
 
@@ -160,6 +341,77 @@ NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark -
 
+/**
+ 流式解析得到的XML元素
+ */
+@interface AFXMLElement : NSObject
+
+/**
+ 带前缀的元素名、比如`soap:Body`
+ */
+@property (readonly, nonatomic, copy) NSString *name;
+
+@property (readonly, nonatomic, copy, nullable) NSString *namespaceURI;
+
+@property (readonly, nonatomic, copy) NSDictionary <NSString *, NSString *> *attributes;
+
+/**
+ 元素直接包含的文本(包括CDATA)、不包括子元素的文本
+ */
+@property (readonly, nonatomic, copy) NSString *text;
+
+@property (readonly, nonatomic, copy) NSArray <AFXMLElement *> *children;
+
+- (nullable AFXMLElement *)firstChildNamed:(NSString *)name;
+
+@end
+
+/**
+ 流式(SAX)解析XML
+
+ 使用libxml2的push parser、作为`AFURLSessionManager`的`responseSerializer`时边接收边解析、不会缓存整个响应
+ 只有路径匹配`matchingPaths`的元素会生成`AFXMLElement`、其他元素只发送事件、内存占用只与匹配元素的大小和嵌套深度有关
+ 所有handler都在AF的处理队列上串行调用、不占用session的`operationQueue`
+ 解析出错时错误信息带有`AFNetworkingOperationFailingURLResponseErrorKey`、边接收边解析时`AFNetworkingOperationFailingURLResponseDataErrorKey`只有出错位置附近最多64KB的数据
+
+ 默认接收的content-type
+
+ - `application/xml`
+ - `text/xml`
+ */
+@interface AFXMLStreamingResponseSerializer : AFHTTPResponseSerializer <AFURLResponseIncrementalSerialization>
+
+- (instancetype)init;
+
++ (instancetype)serializerWithMatchingPaths:(nullable NSSet <NSString *> *)matchingPaths;
+
+/**
+ 需要生成元素树的路径、形如`/rss/channel/item`、`*`匹配任意一级
+ 为nil时不生成任何元素
+ */
+@property (nonatomic, copy, nullable) NSSet <NSString *> *matchingPaths;
+
+/**
+ 匹配的元素解析完成时调用
+ 设置后元素交给handler之后不再保留、`responseObject`为nil
+ 没有设置时`responseObject`为所有匹配元素组成的数组
+ */
+@property (nonatomic, copy, nullable) void (^elementHandler)(AFXMLElement *element);
+
+/**
+ 元素开始、path为包括当前元素的完整路径
+ */
+@property (nonatomic, copy, nullable) void (^didStartElementHandler)(NSString *path, NSString *name, NSDictionary <NSString *, NSString *> *attributes);
+
+/**
+ 元素结束
+ */
+@property (nonatomic, copy, nullable) void (^didEndElementHandler)(NSString *path, NSString *name);
+
+@end
+
+#pragma mark -
+
 #ifdef __MAC_OS_X_VERSION_MIN_REQUIRED
 
 /**
@@ -233,6 +485,40 @@ NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark -
 
+#if TARGET_OS_IOS || TARGET_OS_TV || TARGET_OS_WATCH
+/**
+ 图片解压时使用的位图内存池
+
+ 按尺寸分级缓存像素内存。解压时从池中取出、图片释放时(比如从图片缓存中被淘汰)自动归还到池中、
+ 避免每次解压都申请并很快释放一块大内存、减少内存分配器的抖动和缺页中断。
+ 收到内存警告时会自动清空。
+ */
+@interface AFImageBitmapBufferPool : NSObject
+
+/**
+ 全局共享的内存池、`AFImageResponseSerializer`默认使用
+ */
++ (instancetype)sharedPool;
+
+/**
+ 池中最多保留的空闲字节数、超出时归还的内存将直接释放
+ 默认20MB
+ */
+@property (nonatomic, assign) NSUInteger maximumPooledBytes;
+
+/**
+ 当前池中空闲的字节数
+ */
+@property (readonly, nonatomic, assign) NSUInteger pooledBytes;
+
+/**
+ 释放池中所有空闲内存
+ */
+- (void)trim;
+
+@end
+#endif
+
 /**
  图像格式化
 
@@ -262,6 +548,12 @@ NS_ASSUME_NONNULL_BEGIN
  默认YES
  */
 @property (nonatomic, assign) BOOL automaticallyInflatesResponseImage;
+
+/**
+ 解压图片时使用的位图内存池
+ 默认为`[AFImageBitmapBufferPool sharedPool]`、设置为nil则每次解压都重新申请内存
+ */
+@property (nonatomic, strong, nullable) AFImageBitmapBufferPool *bitmapBufferPool;
 #endif
 
 @end
@@ -22,6 +22,18 @@
 #import "AFURLResponseSerialization.h"
 
 #import <TargetConditionals.h>
+#import <objc/runtime.h>
+#import <objc/message.h>
+#import <xlocale.h>
+#import <libxml/parser.h>
+
+#if defined(__AVX2__)
+#import <immintrin.h>
+#elif defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#import <arm_neon.h>
+#endif
 
 #if TARGET_OS_IOS
 #import <UIKit/UIKit.h>
@@ -77,40 +89,98 @@ static BOOL AFErrorOrUnderlyingErrorHasCodeInDomain(NSError *error, NSInteger co
     return NO;
 }
 
-//删除响应里的NSNULL
-static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingOptions readingOptions) {
+//不超过这个长度的字符串值会被共享、key不限长度
+static NSUInteger const kAFJSONInternedStringMaximumLength = 32;
+static long long const kAFJSONCachedNumberMinimum = -128;
+static long long const kAFJSONCachedNumberMaximum = 1023;
+
+//常用的小整数共享同一个NSNumber(64位系统上本来就是tagged pointer、主要影响32位设备)
+static NSNumber * AFJSONCachedNumber(long long value) {
+    static NSArray <NSNumber *> *cachedNumbers = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableArray *mutableNumbers = [NSMutableArray arrayWithCapacity:(NSUInteger)(kAFJSONCachedNumberMaximum - kAFJSONCachedNumberMinimum + 1)];
+        for (long long number = kAFJSONCachedNumberMinimum; number <= kAFJSONCachedNumberMaximum; number++) {
+            [mutableNumbers addObject:@(number)];
+        }
+        cachedNumbers = [mutableNumbers copy];
+    });
+
+    if (value < kAFJSONCachedNumberMinimum || value > kAFJSONCachedNumberMaximum) {
+        return nil;
+    }
+
+    return cachedNumbers[(NSUInteger)(value - kAFJSONCachedNumberMinimum)];
+}
+
+//相同内容的字符串返回第一次出现的实例
+static inline NSString * AFJSONInternedString(NSMutableSet *internedStrings, NSString *string) {
+    NSString *internedString = [internedStrings member:string];
+    if (internedString) {
+        return internedString;
+    }
+    [internedStrings addObject:string];
+
+    return string;
+}
+
+//共享短字符串和小整数、NSJSONReadingMutableLeaves时字符串是可变的、不能共享
+static id AFJSONInternedValue(id value, NSMutableSet *internedStrings, NSJSONReadingOptions readingOptions) {
+    if ([value isKindOfClass:[NSString class]]) {
+        if ((readingOptions & NSJSONReadingMutableLeaves) || [(NSString *)value length] > kAFJSONInternedStringMaximumLength) {
+            return value;
+        }
+        return AFJSONInternedString(internedStrings, value);
+    } else if ([value isKindOfClass:[NSNumber class]] && CFGetTypeID((__bridge CFTypeRef)value) != CFBooleanGetTypeID()) {
+        //只处理有符号整数、BOOL和浮点数保持原样
+        const char *type = [(NSNumber *)value objCType];
+        if (type[0] != '\0' && strchr("silq", type[0])) {
+            return AFJSONCachedNumber([(NSNumber *)value longLongValue]) ?: value;
+        }
+    }
+
+    return value;
+}
+
+/*
+    删除响应里的NSNULL
+    removesKeysWithNullValues为NO时只重建容器、internedStrings不为nil时共享相同的key、短字符串和小整数
+ */
+static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingOptions readingOptions, BOOL removesKeysWithNullValues, NSMutableSet *internedStrings) {
     //数组
     if ([JSONObject isKindOfClass:[NSArray class]]) {
         //生成一个可变数组
         NSMutableArray *mutableArray = [NSMutableArray arrayWithCapacity:[(NSArray *)JSONObject count]];
         for (id value in (NSArray *)JSONObject) {
             //将数组里不为NULL的元素转译进来
-            [mutableArray addObject:AFJSONObjectByRemovingKeysWithNullValues(value, readingOptions)];
+            [mutableArray addObject:AFJSONObjectByRemovingKeysWithNullValues(value, readingOptions, removesKeysWithNullValues, internedStrings)];
         }
 
         //如果是NSJSONReadingMutableContainers、则返回一个可变的数组。否则返回一个不可变的
         return (readingOptions & NSJSONReadingMutableContainers) ? mutableArray : [NSArray arrayWithArray:mutableArray];
     } else if ([JSONObject isKindOfClass:[NSDictionary class]]) {
         //字典
-        NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionaryWithDictionary:JSONObject];
+        NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionaryWithCapacity:[(NSDictionary *)JSONObject count]];
         //遍历所有key
-        for (id <NSCopying> key in [(NSDictionary *)JSONObject allKeys]) {
-            
-            id value = (NSDictionary *)JSONObject[key];
-            if (!value || [value isEqual:[NSNull null]]) {
-                //value为空则移除
-                [mutableDictionary removeObjectForKey:key];
-            } else if ([value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSDictionary class]]) {
-                //如果value是数组或者字典、递归排空
-                mutableDictionary[key] = AFJSONObjectByRemovingKeysWithNullValues(value, readingOptions);
+        [(NSDictionary *)JSONObject enumerateKeysAndObjectsUsingBlock:^(id key, id value, __unused BOOL *stop) {
+            if (removesKeysWithNullValues && (!value || [value isEqual:[NSNull null]])) {
+                //value为空则不加入
+                return;
             }
-        }
+
+            if (internedStrings && [key isKindOfClass:[NSString class]]) {
+                //重建的字典直接使用共享的key
+                key = AFJSONInternedString(internedStrings, key);
+            }
+            //如果value是数组或者字典、递归排空
+            mutableDictionary[key] = AFJSONObjectByRemovingKeysWithNullValues(value, readingOptions, removesKeysWithNullValues, internedStrings);
+        }];
         //如果是NSJSONReadingMutableContainers、则返回一个可变的字典。否则返回一个不可变的
         return (readingOptions & NSJSONReadingMutableContainers) ? mutableDictionary : [NSDictionary dictionaryWithDictionary:mutableDictionary];
     }
 
     //不是数组也不是字典、返回原对象(应该就是个字符串了)
-    return JSONObject;
+    return internedStrings ? AFJSONInternedValue(JSONObject, internedStrings, readingOptions) : JSONObject;
 }
 
 @implementation AFHTTPResponseSerializer
@@ -264,6 +334,15 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
 
 #pragma mark -
 
+@interface AFStructuralIndexJSONParser ()
+//共享字符串、删除null都在由tape生成对象时完成、懒加载的对象也不会被展开
+- (id)JSONObjectWithData:(NSData *)data
+                 options:(NSJSONReadingOptions)options
+          internsStrings:(BOOL)internsStrings
+removesKeysWithNullValues:(BOOL)removesKeysWithNullValues
+                   error:(NSError *__autoreleasing *)error;
+@end
+
 @implementation AFJSONResponseSerializer
 
 + (instancetype)serializer {
@@ -312,15 +391,24 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
     // Workaround for behavior of Rails to return a single space for `head :ok` (a workaround for a bug in Safari), which is not interpreted as valid input by NSJSONSerialization.
     // See https://github.com/rails/rails/issues/1742
     BOOL isSpace = [data isEqualToData:[NSData dataWithBytes:" " length:1]];
+    BOOL needsPostProcessing = self.removesKeysWithNullValues || self.internsStrings;
     if (data.length > 0 && !isSpace) {
-        responseObject = [NSJSONSerialization JSONObjectWithData:data options:self.readingOptions error:&serializationError];
+        if ([self.parserBackend isKindOfClass:[AFStructuralIndexJSONParser class]]) {
+            AFStructuralIndexJSONParser *parser = (AFStructuralIndexJSONParser *)self.parserBackend;
+            responseObject = [parser JSONObjectWithData:data options:self.readingOptions internsStrings:(self.internsStrings || parser.internsStrings) removesKeysWithNullValues:self.removesKeysWithNullValues error:&serializationError];
+            needsPostProcessing = NO;
+        } else if (self.parserBackend) {
+            responseObject = [self.parserBackend JSONObjectWithData:data options:self.readingOptions error:&serializationError];
+        } else {
+            responseObject = [NSJSONSerialization JSONObjectWithData:data options:self.readingOptions error:&serializationError];
+        }
     } else {
         return nil;
     }
 
-    //删除响应里的NSNULL(内部可以递归)
-    if (self.removesKeysWithNullValues && responseObject) {
-        responseObject = AFJSONObjectByRemovingKeysWithNullValues(responseObject, self.readingOptions);
+    //删除响应里的NSNULL(内部可以递归)、同时共享相同的字符串
+    if (needsPostProcessing && responseObject) {
+        responseObject = AFJSONObjectByRemovingKeysWithNullValues(responseObject, self.readingOptions, self.removesKeysWithNullValues, self.internsStrings ? [NSMutableSet set] : nil);
     }
 
     if (error) {
@@ -341,6 +429,7 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
 
     self.readingOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(readingOptions))] unsignedIntegerValue];
     self.removesKeysWithNullValues = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))] boolValue];
+    self.internsStrings = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(internsStrings))] boolValue];
 
     return self;
 }
@@ -350,6 +439,7 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
 
     [coder encodeObject:@(self.readingOptions) forKey:NSStringFromSelector(@selector(readingOptions))];
     [coder encodeObject:@(self.removesKeysWithNullValues) forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))];
+    [coder encodeObject:@(self.internsStrings) forKey:NSStringFromSelector(@selector(internsStrings))];
 }
 
 #pragma mark - NSCopying
@@ -358,150 +448,349 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
     AFJSONResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
     serializer.readingOptions = self.readingOptions;
     serializer.removesKeysWithNullValues = self.removesKeysWithNullValues;
+    serializer.internsStrings = self.internsStrings;
+    serializer.parserBackend = self.parserBackend;
 
     return serializer;
 }
 
 @end
 
-#pragma mark -
+#pragma mark - AFCBORResponseSerializer
 
-@implementation AFXMLParserResponseSerializer
+//最大嵌套层级、防止恶意数据导致栈溢出
+static NSUInteger const kAFCBORMaximumNestingDepth = 512;
+//短于这个长度的字符串和二进制直接复制、比引用更省
+static NSUInteger const kAFCBORMinimumZeroCopyLength = 32;
 
-+ (instancetype)serializer {
-    AFXMLParserResponseSerializer *serializer = [[self alloc] init];
+//引用响应数据的字符串由这个allocator"释放"、实际只是释放对响应数据的持有
+static const void * AFCBORSourceDataRetain(const void *info) {
+    return CFRetain(info);
+}
 
-    return serializer;
+static void AFCBORSourceDataRelease(const void *info) {
+    CFRelease(info);
 }
 
-- (instancetype)init {
-    self = [super init];
-    if (!self) {
-        return nil;
-    }
+static void * AFCBORSourceDataAllocate(__unused CFIndex allocSize, __unused CFOptionFlags hint, __unused void *info) {
+    return NULL;
+}
 
-    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/xml", @"text/xml", nil];
+static void AFCBORSourceDataDeallocate(__unused void *ptr, __unused void *info) {}
 
-    return self;
-}
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger offset;
+    BOOL failed;
+    BOOL removesKeysWithNullValues;
+    __unsafe_unretained NSData *sourceData;//不为nil时使用零拷贝
+    CFAllocatorRef sourceDataAllocator;
+} AFCBORDecoder;
 
-#pragma mark - AFURLResponseSerialization
-//XML解析
-- (id)responseObjectForResponse:(NSHTTPURLResponse *)response
-                           data:(NSData *)data
-                          error:(NSError *__autoreleasing *)error
-{
-    //看看能不能解析
-    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
-        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
-            return nil;
-        }
+static id AFCBORDecodeObject(AFCBORDecoder *decoder, NSUInteger depth);
+
+static BOOL AFCBORDecoderReadBytes(AFCBORDecoder *decoder, void *buffer, NSUInteger length) {
+    if (decoder->length - decoder->offset < length) {
+        decoder->failed = YES;
+        return NO;
     }
 
-    //返回XML对象
-    return [[NSXMLParser alloc] initWithData:data];
-}
+    memcpy(buffer, decoder->bytes + decoder->offset, length);
+    decoder->offset += length;
 
-@end
+    return YES;
+}
 
-#pragma mark -
+//读取头部的参数、additionalInformation为31(不定长)时返回NO并且不算失败
+static BOOL AFCBORDecoderReadArgument(AFCBORDecoder *decoder, uint8_t additionalInformation, uint64_t *argument) {
+    if (additionalInformation < 24) {
+        *argument = additionalInformation;
+        return YES;
+    }
 
-#ifdef __MAC_OS_X_VERSION_MIN_REQUIRED
+    switch (additionalInformation) {
+        case 24: {
+            uint8_t value;
+            if (!AFCBORDecoderReadBytes(decoder, &value, sizeof(value))) {
+                return NO;
+            }
+            *argument = value;
+            return YES;
+        }
+        case 25: {
+            uint16_t value;
+            if (!AFCBORDecoderReadBytes(decoder, &value, sizeof(value))) {
+                return NO;
+            }
+            *argument = CFSwapInt16BigToHost(value);
+            return YES;
+        }
+        case 26: {
+            uint32_t value;
+            if (!AFCBORDecoderReadBytes(decoder, &value, sizeof(value))) {
+                return NO;
+            }
+            *argument = CFSwapInt32BigToHost(value);
+            return YES;
+        }
+        case 27: {
+            uint64_t value;
+            if (!AFCBORDecoderReadBytes(decoder, &value, sizeof(value))) {
+                return NO;
+            }
+            *argument = CFSwapInt64BigToHost(value);
+            return YES;
+        }
+        case 31:
+            return NO;
+        default:
+            decoder->failed = YES;
+            return NO;
+    }
+}
 
-@implementation AFXMLDocumentResponseSerializer
+//不定长的字符串、数组、字典以0xff结束
+static BOOL AFCBORDecoderConsumeBreak(AFCBORDecoder *decoder) {
+    if (decoder->offset < decoder->length && decoder->bytes[decoder->offset] == 0xff) {
+        decoder->offset++;
+        return YES;
+    }
 
-+ (instancetype)serializer {
-    return [self serializerWithXMLDocumentOptions:0];
+    return NO;
 }
 
-+ (instancetype)serializerWithXMLDocumentOptions:(NSUInteger)mask {
-    AFXMLDocumentResponseSerializer *serializer = [[self alloc] init];
-    serializer.options = mask;
+static id AFCBORDecodeStringOrBytes(AFCBORDecoder *decoder, const uint8_t *bytes, NSUInteger length, BOOL isString) {
+    if (!decoder->sourceData || length < kAFCBORMinimumZeroCopyLength) {
+        if (isString) {
+            return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+        }
+        return [NSData dataWithBytes:bytes length:length];
+    }
 
-    return serializer;
+    if (isString) {
+        return (__bridge_transfer NSString *)CFStringCreateWithBytesNoCopy(kCFAllocatorDefault, bytes, (CFIndex)length, kCFStringEncodingUTF8, false, decoder->sourceDataAllocator);
+    }
+
+    NSData *sourceData = decoder->sourceData;
+    return [[NSData alloc] initWithBytesNoCopy:(void *)bytes length:length deallocator:^(__unused void *deallocatedBytes, __unused NSUInteger deallocatedLength) {
+        //由block持有响应数据
+        (void)sourceData;
+    }];
 }
 
-- (instancetype)init {
-    self = [super init];
-    if (!self) {
+static id AFCBORDecodeDefiniteStringOrBytes(AFCBORDecoder *decoder, uint64_t length, BOOL isString) {
+    if (length > decoder->length - decoder->offset) {
+        decoder->failed = YES;
         return nil;
     }
 
-    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/xml", @"text/xml", nil];
+    const uint8_t *bytes = decoder->bytes + decoder->offset;
+    decoder->offset += (NSUInteger)length;
 
-    return self;
+    id object = AFCBORDecodeStringOrBytes(decoder, bytes, (NSUInteger)length, isString);
+    if (!object) {
+        //非法的UTF-8
+        decoder->failed = YES;
+    }
+
+    return object;
 }
 
-#pragma mark - AFURLResponseSerialization
-//XML解析 formac
-- (id)responseObjectForResponse:(NSURLResponse *)response
-                           data:(NSData *)data
-                          error:(NSError *__autoreleasing *)error
-{
-    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
-        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+//不定长的字符串由多段定长的字符串拼接而成
+static id AFCBORDecodeIndefiniteStringOrBytes(AFCBORDecoder *decoder, uint8_t majorType) {
+    NSMutableData *mutableData = [NSMutableData data];
+    while (!AFCBORDecoderConsumeBreak(decoder)) {
+        uint8_t initialByte;
+        uint64_t length;
+        if (!AFCBORDecoderReadBytes(decoder, &initialByte, 1) || (initialByte >> 5) != majorType || !AFCBORDecoderReadArgument(decoder, initialByte & 0x1f, &length) || length > decoder->length - decoder->offset) {
+            decoder->failed = YES;
             return nil;
         }
+        [mutableData appendBytes:decoder->bytes + decoder->offset length:(NSUInteger)length];
+        decoder->offset += (NSUInteger)length;
     }
 
-    NSError *serializationError = nil;
-    NSXMLDocument *document = [[NSXMLDocument alloc] initWithData:data options:self.options error:&serializationError];
+    if (majorType == 3) {
+        NSString *string = [[NSString alloc] initWithData:mutableData encoding:NSUTF8StringEncoding];
+        if (!string) {
+            decoder->failed = YES;
+        }
+        return string;
+    }
 
-    if (error) {
-        *error = AFErrorWithUnderlyingError(serializationError, *error);
+    return mutableData;
+}
+
+//半精度浮点数 RFC 8949 Appendix D
+static double AFCBORDoubleFromHalf(uint16_t half) {
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = mantissa == 0 ? INFINITY : NAN;
     }
 
-    return document;
+    return (half & 0x8000) ? -value : value;
 }
 
-#pragma mark - NSSecureCoding
+static id AFCBORDecodeSimpleOrFloat(AFCBORDecoder *decoder, uint8_t additionalInformation) {
+    switch (additionalInformation) {
+        case 20:
+            return @NO;
+        case 21:
+            return @YES;
+        case 22:
+        case 23:
+            return [NSNull null];
+        case 25: {
+            uint16_t bits;
+            if (!AFCBORDecoderReadBytes(decoder, &bits, sizeof(bits))) {
+                return nil;
+            }
+            return @(AFCBORDoubleFromHalf(CFSwapInt16BigToHost(bits)));
+        }
+        case 26: {
+            uint32_t bits;
+            if (!AFCBORDecoderReadBytes(decoder, &bits, sizeof(bits))) {
+                return nil;
+            }
+            bits = CFSwapInt32BigToHost(bits);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return @(value);
+        }
+        case 27: {
+            uint64_t bits;
+            if (!AFCBORDecoderReadBytes(decoder, &bits, sizeof(bits))) {
+                return nil;
+            }
+            bits = CFSwapInt64BigToHost(bits);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return @(value);
+        }
+        default:
+            //其他simple value在JSON里没有对应的类型
+            decoder->failed = YES;
+            return nil;
+    }
+}
 
-- (instancetype)initWithCoder:(NSCoder *)decoder {
-    self = [super initWithCoder:decoder];
-    if (!self) {
+static id AFCBORDecodeArray(AFCBORDecoder *decoder, uint64_t count, BOOL isIndefinite, NSUInteger depth) {
+    //每个元素至少占一个字节、用来防止恶意的长度导致预分配过大
+    if (!isIndefinite && count > decoder->length - decoder->offset) {
+        decoder->failed = YES;
         return nil;
     }
 
-    self.options = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(options))] unsignedIntegerValue];
+    NSMutableArray *mutableArray = [NSMutableArray arrayWithCapacity:isIndefinite ? 0 : (NSUInteger)count];
+    for (uint64_t idx = 0; isIndefinite || idx < count; idx++) {
+        if (isIndefinite && AFCBORDecoderConsumeBreak(decoder)) {
+            break;
+        }
 
-    return self;
+        id value = AFCBORDecodeObject(decoder, depth + 1);
+        if (!value) {
+            return nil;
+        }
+        [mutableArray addObject:value];
+    }
+
+    return mutableArray;
 }
 
-- (void)encodeWithCoder:(NSCoder *)coder {
-    [super encodeWithCoder:coder];
+static id AFCBORDecodeMap(AFCBORDecoder *decoder, uint64_t count, BOOL isIndefinite, NSUInteger depth) {
+    if (!isIndefinite && count > (decoder->length - decoder->offset) / 2) {
+        decoder->failed = YES;
+        return nil;
+    }
 
-    [coder encodeObject:@(self.options) forKey:NSStringFromSelector(@selector(options))];
-}
+    NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionaryWithCapacity:isIndefinite ? 0 : (NSUInteger)count];
+    for (uint64_t idx = 0; isIndefinite || idx < count; idx++) {
+        if (isIndefinite && AFCBORDecoderConsumeBreak(decoder)) {
+            break;
+        }
 
-#pragma mark - NSCopying
+        id key = AFCBORDecodeObject(decoder, depth + 1);
+        id value = key ? AFCBORDecodeObject(decoder, depth + 1) : nil;
+        if (!value || ![key conformsToProtocol:@protocol(NSCopying)]) {
+            decoder->failed = YES;
+            return nil;
+        }
 
-- (instancetype)copyWithZone:(NSZone *)zone {
-    AFXMLDocumentResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
-    serializer.options = self.options;
+        //解析时直接跳过null、不需要事后再遍历
+        if (decoder->removesKeysWithNullValues && value == [NSNull null]) {
+            continue;
+        }
+        mutableDictionary[key] = value;
+    }
 
-    return serializer;
+    return mutableDictionary;
 }
 
-@end
-
-#endif
+static id AFCBORDecodeObject(AFCBORDecoder *decoder, NSUInteger depth) {
+    uint8_t initialByte;
+    if (depth > kAFCBORMaximumNestingDepth || !AFCBORDecoderReadBytes(decoder, &initialByte, 1)) {
+        decoder->failed = YES;
+        return nil;
+    }
 
-#pragma mark -
+    uint8_t majorType = initialByte >> 5;
+    uint8_t additionalInformation = initialByte & 0x1f;
+    if (majorType == 7) {
+        return AFCBORDecodeSimpleOrFloat(decoder, additionalInformation);
+    }
 
-@implementation AFPropertyListResponseSerializer
+    uint64_t argument = 0;
+    BOOL isIndefinite = !AFCBORDecoderReadArgument(decoder, additionalInformation, &argument);
+    if (decoder->failed || (isIndefinite && (majorType < 2 || majorType == 6))) {
+        decoder->failed = YES;
+        return nil;
+    }
 
-+ (instancetype)serializer {
-    return [self serializerWithFormat:NSPropertyListXMLFormat_v1_0 readOptions:0];
+    switch (majorType) {
+        case 0:
+            return @(argument);
+        case 1:
+            //负整数 -1 - n、超出long long范围的不支持
+            if (argument > (uint64_t)LLONG_MAX) {
+                decoder->failed = YES;
+                return nil;
+            }
+            return @(-1 - (long long)argument);
+        case 2:
+        case 3:
+            if (isIndefinite) {
+                return AFCBORDecodeIndefiniteStringOrBytes(decoder, majorType);
+            }
+            return AFCBORDecodeDefiniteStringOrBytes(decoder, argument, majorType == 3);
+        case 4:
+            return AFCBORDecodeArray(decoder, argument, isIndefinite, depth);
+        case 5:
+            return AFCBORDecodeMap(decoder, argument, isIndefinite, depth);
+        case 6: {
+            id taggedObject = AFCBORDecodeObject(decoder, depth + 1);
+            //tag 1: 距1970的秒数、其余的tag忽略、直接返回内容
+            if (argument == 1 && [taggedObject isKindOfClass:[NSNumber class]]) {
+                return [NSDate dateWithTimeIntervalSince1970:[taggedObject doubleValue]];
+            }
+            return taggedObject;
+        }
+        default:
+            decoder->failed = YES;
+            return nil;
+    }
 }
 
-+ (instancetype)serializerWithFormat:(NSPropertyListFormat)format
-                         readOptions:(NSPropertyListReadOptions)readOptions
-{
-    AFPropertyListResponseSerializer *serializer = [[self alloc] init];
-    serializer.format = format;
-    serializer.readOptions = readOptions;
+@implementation AFCBORResponseSerializer
 
-    return serializer;
++ (instancetype)serializer {
+    return [[self alloc] init];
 }
 
 - (instancetype)init {
@@ -510,13 +799,13 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
         return nil;
     }
 
-    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/x-plist", nil];
+    self.acceptableContentTypes = [NSSet setWithObjects:@"application/cbor", nil];
 
     return self;
 }
 
 #pragma mark - AFURLResponseSerialization
-//PList 序列化
+
 - (id)responseObjectForResponse:(NSURLResponse *)response
                            data:(NSData *)data
                           error:(NSError *__autoreleasing *)error
@@ -527,12 +816,38 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
         }
     }
 
-    id responseObject;
-    NSError *serializationError = nil;
+    if ([data length] == 0) {
+        return nil;
+    }
 
-    if (data) {
-        //转化成NSPropertyListSerialization对象
-        responseObject = [NSPropertyListSerialization propertyListWithData:data options:self.readOptions format:NULL error:&serializationError];
+    //零拷贝的对象引用的是data的内存、必须保证data不可变
+    NSData *sourceData = [data copy];
+
+    AFCBORDecoder decoder;
+    memset(&decoder, 0, sizeof(decoder));
+    decoder.bytes = [sourceData bytes];
+    decoder.length = [sourceData length];
+    decoder.removesKeysWithNullValues = self.removesKeysWithNullValues;
+    if (self.usesZeroCopyViews) {
+        decoder.sourceData = sourceData;
+        CFAllocatorContext context = {0, (__bridge void *)sourceData, AFCBORSourceDataRetain, AFCBORSourceDataRelease, NULL, AFCBORSourceDataAllocate, NULL, AFCBORSourceDataDeallocate, NULL};
+        decoder.sourceDataAllocator = CFAllocatorCreate(kCFAllocatorDefault, &context);
+    }
+
+    id responseObject = AFCBORDecodeObject(&decoder, 0);
+    //结尾还有多余的数据也视为非法
+    if (!decoder.failed && decoder.offset != decoder.length) {
+        decoder.failed = YES;
+    }
+
+    if (decoder.sourceDataAllocator) {
+        CFRelease(decoder.sourceDataAllocator);
+    }
+
+    NSError *serializationError = nil;
+    if (decoder.failed) {
+        responseObject = nil;
+        serializationError = [NSError errorWithDomain:AFURLResponseSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedStringFromTable(@"Invalid CBOR data around byte %lu", @"AFNetworking", nil), (unsigned long)decoder.offset]}];
     }
 
     if (error) {
@@ -550,8 +865,8 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
         return nil;
     }
 
-    self.format = (NSPropertyListFormat)[[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(format))] unsignedIntegerValue];
-    self.readOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(readOptions))] unsignedIntegerValue];
+    self.removesKeysWithNullValues = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))] boolValue];
+    self.usesZeroCopyViews = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(usesZeroCopyViews))] boolValue];
 
     return self;
 }
@@ -559,73 +874,2957 @@ static id AFJSONObjectByRemovingKeysWithNullValues(id JSONObject, NSJSONReadingO
 - (void)encodeWithCoder:(NSCoder *)coder {
     [super encodeWithCoder:coder];
 
-    [coder encodeObject:@(self.format) forKey:NSStringFromSelector(@selector(format))];
-    [coder encodeObject:@(self.readOptions) forKey:NSStringFromSelector(@selector(readOptions))];
+    [coder encodeObject:@(self.removesKeysWithNullValues) forKey:NSStringFromSelector(@selector(removesKeysWithNullValues))];
+    [coder encodeObject:@(self.usesZeroCopyViews) forKey:NSStringFromSelector(@selector(usesZeroCopyViews))];
 }
 
 #pragma mark - NSCopying
 
 - (instancetype)copyWithZone:(NSZone *)zone {
-    AFPropertyListResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
-    serializer.format = self.format;
-    serializer.readOptions = self.readOptions;
+    AFCBORResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
+    serializer.removesKeysWithNullValues = self.removesKeysWithNullValues;
+    serializer.usesZeroCopyViews = self.usesZeroCopyViews;
 
     return serializer;
 }
 
 @end
 
-#pragma mark -
-
-#if TARGET_OS_IOS || TARGET_OS_TV || TARGET_OS_WATCH
-#import <CoreGraphics/CoreGraphics.h>
-#import <UIKit/UIKit.h>
+#pragma mark - JSON扫描
+
+//最大嵌套层级、防止恶意数据导致栈溢出
+static NSUInteger const kAFJSONMaximumNestingDepth = 512;
+
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger offset;
+    NSUInteger depth;
+    BOOL failed;
+} AFJSONScanner;
+
+typedef struct {
+    BOOL isInteger;
+    BOOL isUnsigned;//超过long long范围的正整数
+    long long integerValue;
+    unsigned long long unsignedValue;
+    double doubleValue;
+} AFJSONNumber;
+
+static inline void AFJSONScannerSkipWhitespace(AFJSONScanner *scanner) {
+    while (scanner->offset < scanner->length) {
+        uint8_t character = scanner->bytes[scanner->offset];
+        if (character != ' ' && character != '\n' && character != '\r' && character != '\t') {
+            break;
+        }
+        scanner->offset++;
+    }
+}
 
-/**
-    AFN对于图片解析的类别
- */
-@interface UIImage (AFNetworkingSafeImageLoading)
+//跳过空白后、如果下一个字符是character则消耗掉
+static inline BOOL AFJSONScannerConsume(AFJSONScanner *scanner, uint8_t character) {
+    AFJSONScannerSkipWhitespace(scanner);
+    if (scanner->offset < scanner->length && scanner->bytes[scanner->offset] == character) {
+        scanner->offset++;
+        return YES;
+    }
 
-+ (UIImage *)af_safeImageWithData:(NSData *)data;
-@end
+    return NO;
+}
 
-static NSLock* imageLock = nil;
+static inline BOOL AFJSONScannerFail(AFJSONScanner *scanner) {
+    scanner->failed = YES;
+    return NO;
+}
 
-@implementation UIImage (AFNetworkingSafeImageLoading)
+static BOOL AFJSONScannerScanLiteral(AFJSONScanner *scanner, const char *literal, NSUInteger length) {
+    if (scanner->length - scanner->offset < length || memcmp(scanner->bytes + scanner->offset, literal, length) != 0) {
+        return AFJSONScannerFail(scanner);
+    }
+    scanner->offset += length;
 
-+ (UIImage *)af_safeImageWithData:(NSData *)data {
-    UIImage* image = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        imageLock = [[NSLock alloc] init];
-    });
-    
-    [imageLock lock];
-    //保证data在使用过程中不会被修改
-    image = [UIImage imageWithData:data];
-    [imageLock unlock];
-    return image;
+    return YES;
 }
 
-@end
-
-//用data生成指定比例的图片
-static UIImage * AFImageWithDataAtScale(NSData *data, CGFloat scale) {
-    UIImage *image = [UIImage af_safeImageWithData:data];
-    if (image.images) {
-        return image;
-    }
-    
-    return [[UIImage alloc] initWithCGImage:[image CGImage] scale:scale orientation:image.imageOrientation];
+static inline BOOL AFJSONIsHexDigit(uint8_t character) {
+    return (character >= '0' && character <= '9') || (character >= 'a' && character <= 'f') || (character >= 'A' && character <= 'F');
 }
 
-//自动解压
 /*
-    这里返回的UIImage是含有bitmap数据的(因为通过解压出的bitmap绘制出的CGImage)
-    bitmap的作用在于在将UIImage交付给UIImageView的时候。如果没有bitmap将会自动解压一次。
+    扫描一个字符串、只校验格式不生成对象
+    start和length为两个引号之间的原始字节、hasEscapes表示其中是否有转义字符
+ */
+static BOOL AFJSONScannerScanString(AFJSONScanner *scanner, const uint8_t **start, NSUInteger *length, BOOL *hasEscapes) {
+    if (!AFJSONScannerConsume(scanner, '"')) {
+        return AFJSONScannerFail(scanner);
+    }
+
+    *start = scanner->bytes + scanner->offset;
+    *hasEscapes = NO;
+    while (scanner->offset < scanner->length) {
+        uint8_t character = scanner->bytes[scanner->offset];
+        if (character == '"') {
+            *length = (NSUInteger)(scanner->bytes + scanner->offset - *start);
+            scanner->offset++;
+            return YES;
+        } else if (character == '\\') {
+            *hasEscapes = YES;
+            if (++scanner->offset >= scanner->length) {
+                break;
+            }
+
+            uint8_t escape = scanner->bytes[scanner->offset];
+            if (escape == 'u') {
+                if (scanner->length - scanner->offset < 5) {
+                    break;
+                }
+                for (NSUInteger idx = 1; idx <= 4; idx++) {
+                    if (!AFJSONIsHexDigit(scanner->bytes[scanner->offset + idx])) {
+                        return AFJSONScannerFail(scanner);
+                    }
+                }
+                scanner->offset += 4;
+            } else if (!strchr("\"\\/bfnrt", escape) || escape == '\0') {
+                return AFJSONScannerFail(scanner);
+            }
+        } else if (character < 0x20) {
+            return AFJSONScannerFail(scanner);
+        }
+        scanner->offset++;
+    }
+
+    return AFJSONScannerFail(scanner);
+}
+
+static uint16_t AFJSONHexValue(const uint8_t *bytes) {
+    uint16_t value = 0;
+    for (NSUInteger idx = 0; idx < 4; idx++) {
+        uint8_t character = bytes[idx];
+        value = (uint16_t)(value << 4);
+        if (character >= '0' && character <= '9') {
+            value |= (uint16_t)(character - '0');
+        } else if (character >= 'a' && character <= 'f') {
+            value |= (uint16_t)(character - 'a' + 10);
+        } else {
+            value |= (uint16_t)(character - 'A' + 10);
+        }
+    }
+
+    return value;
+}
+
+static void AFJSONAppendUTF8(NSMutableData *data, uint32_t codePoint) {
+    uint8_t buffer[4];
+    NSUInteger length = 0;
+    if (codePoint < 0x80) {
+        buffer[length++] = (uint8_t)codePoint;
+    } else if (codePoint < 0x800) {
+        buffer[length++] = (uint8_t)(0xc0 | (codePoint >> 6));
+        buffer[length++] = (uint8_t)(0x80 | (codePoint & 0x3f));
+    } else if (codePoint < 0x10000) {
+        buffer[length++] = (uint8_t)(0xe0 | (codePoint >> 12));
+        buffer[length++] = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3f));
+        buffer[length++] = (uint8_t)(0x80 | (codePoint & 0x3f));
+    } else {
+        buffer[length++] = (uint8_t)(0xf0 | (codePoint >> 18));
+        buffer[length++] = (uint8_t)(0x80 | ((codePoint >> 12) & 0x3f));
+        buffer[length++] = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3f));
+        buffer[length++] = (uint8_t)(0x80 | (codePoint & 0x3f));
+    }
+    [data appendBytes:buffer length:length];
+}
+
+//由扫描出的原始字节生成字符串、非法的UTF-8返回nil
+static NSString * AFJSONStringWithBytes(const uint8_t *bytes, NSUInteger length, BOOL hasEscapes) {
+    if (!hasEscapes) {
+        return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+    }
+
+    NSMutableData *unescapedData = [NSMutableData dataWithCapacity:length];
+    NSUInteger idx = 0;
+    while (idx < length) {
+        const uint8_t *backslash = memchr(bytes + idx, '\\', length - idx);
+        NSUInteger runLength = backslash ? (NSUInteger)(backslash - bytes) - idx : length - idx;
+        [unescapedData appendBytes:bytes + idx length:runLength];
+        idx += runLength;
+        if (!backslash) {
+            break;
+        }
+
+        //扫描时已经校验过转义的格式
+        uint8_t escape = bytes[idx + 1];
+        idx += 2;
+        uint8_t character = escape;
+        switch (escape) {
+            case 'b': character = '\b'; break;
+            case 'f': character = '\f'; break;
+            case 'n': character = '\n'; break;
+            case 'r': character = '\r'; break;
+            case 't': character = '\t'; break;
+            case 'u': {
+                uint32_t codePoint = AFJSONHexValue(bytes + idx);
+                idx += 4;
+                //代理对
+                if (codePoint >= 0xd800 && codePoint <= 0xdbff && length - idx >= 6 && bytes[idx] == '\\' && bytes[idx + 1] == 'u') {
+                    uint16_t lowSurrogate = AFJSONHexValue(bytes + idx + 2);
+                    if (lowSurrogate >= 0xdc00 && lowSurrogate <= 0xdfff) {
+                        codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (lowSurrogate - 0xdc00);
+                        idx += 6;
+                    }
+                }
+                //落单的代理项替换成U+FFFD
+                if (codePoint >= 0xd800 && codePoint <= 0xdfff) {
+                    codePoint = 0xfffd;
+                }
+                AFJSONAppendUTF8(unescapedData, codePoint);
+                continue;
+            }
+            default:
+                break;
+        }
+        [unescapedData appendBytes:&character length:1];
+    }
+
+    return [[NSString alloc] initWithData:unescapedData encoding:NSUTF8StringEncoding];
+}
+
+static BOOL AFJSONScannerScanNumber(AFJSONScanner *scanner, AFJSONNumber *number) {
+    AFJSONScannerSkipWhitespace(scanner);
+
+    const uint8_t *bytes = scanner->bytes;
+    NSUInteger start = scanner->offset;
+    NSUInteger offset = start;
+    BOOL isNegative = offset < scanner->length && bytes[offset] == '-';
+    if (isNegative) {
+        offset++;
+    }
+
+    if (offset < scanner->length && bytes[offset] == '0') {
+        offset++;
+    } else if (offset < scanner->length && bytes[offset] >= '1' && bytes[offset] <= '9') {
+        while (offset < scanner->length && bytes[offset] >= '0' && bytes[offset] <= '9') {
+            offset++;
+        }
+    } else {
+        return AFJSONScannerFail(scanner);
+    }
+
+    BOOL isInteger = YES;
+    if (offset < scanner->length && bytes[offset] == '.') {
+        isInteger = NO;
+        NSUInteger fractionStart = ++offset;
+        while (offset < scanner->length && bytes[offset] >= '0' && bytes[offset] <= '9') {
+            offset++;
+        }
+        if (offset == fractionStart) {
+            return AFJSONScannerFail(scanner);
+        }
+    }
+    if (offset < scanner->length && (bytes[offset] == 'e' || bytes[offset] == 'E')) {
+        isInteger = NO;
+        offset++;
+        if (offset < scanner->length && (bytes[offset] == '+' || bytes[offset] == '-')) {
+            offset++;
+        }
+        NSUInteger exponentStart = offset;
+        while (offset < scanner->length && bytes[offset] >= '0' && bytes[offset] <= '9') {
+            offset++;
+        }
+        if (offset == exponentStart) {
+            return AFJSONScannerFail(scanner);
+        }
+    }
+    scanner->offset = offset;
+
+    //strtod需要以'\0'结尾的字符串、绝大多数数字都能放进栈上的buffer
+    NSUInteger length = offset - start;
+    char stackBuffer[64];
+    char *buffer = length < sizeof(stackBuffer) ? stackBuffer : malloc(length + 1);
+    memcpy(buffer, bytes + start, length);
+    buffer[length] = '\0';
+
+    memset(number, 0, sizeof(*number));
+    if (isInteger) {
+        errno = 0;
+        if (isNegative) {
+            number->integerValue = strtoll(buffer, NULL, 10);
+        } else {
+            unsigned long long unsignedValue = strtoull(buffer, NULL, 10);
+            if (unsignedValue > (unsigned long long)LLONG_MAX) {
+                number->isUnsigned = YES;
+                number->unsignedValue = unsignedValue;
+            } else {
+                number->integerValue = (long long)unsignedValue;
+            }
+        }
+        //超出64位整数范围的按浮点数处理
+        isInteger = errno != ERANGE;
+    }
+    number->isInteger = isInteger;
+    number->isUnsigned = isInteger && number->isUnsigned;
+    //与locale无关、始终以'.'作为小数点
+    number->doubleValue = strtod_l(buffer, NULL, NULL);
+
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
+
+    return YES;
+}
+
+static NSNumber * AFJSONNumberObject(const AFJSONNumber *number) {
+    if (!number->isInteger) {
+        return @(number->doubleValue);
+    }
+
+    return number->isUnsigned ? @(number->unsignedValue) : @(number->integerValue);
+}
+
+//跳过一个值、不生成任何对象
+static BOOL AFJSONScannerSkipValue(AFJSONScanner *scanner) {
+    AFJSONScannerSkipWhitespace(scanner);
+    if (scanner->offset >= scanner->length) {
+        return AFJSONScannerFail(scanner);
+    }
+
+    const uint8_t *start;
+    NSUInteger length;
+    BOOL hasEscapes;
+    switch (scanner->bytes[scanner->offset]) {
+        case '"':
+            return AFJSONScannerScanString(scanner, &start, &length, &hasEscapes);
+        case '{': {
+            if (++scanner->depth > kAFJSONMaximumNestingDepth) {
+                return AFJSONScannerFail(scanner);
+            }
+            scanner->offset++;
+            if (!AFJSONScannerConsume(scanner, '}')) {
+                do {
+                    if (!AFJSONScannerScanString(scanner, &start, &length, &hasEscapes) || !AFJSONScannerConsume(scanner, ':') || !AFJSONScannerSkipValue(scanner)) {
+                        return AFJSONScannerFail(scanner);
+                    }
+                } while (AFJSONScannerConsume(scanner, ','));
+                if (!AFJSONScannerConsume(scanner, '}')) {
+                    return AFJSONScannerFail(scanner);
+                }
+            }
+            scanner->depth--;
+            return YES;
+        }
+        case '[': {
+            if (++scanner->depth > kAFJSONMaximumNestingDepth) {
+                return AFJSONScannerFail(scanner);
+            }
+            scanner->offset++;
+            if (!AFJSONScannerConsume(scanner, ']')) {
+                do {
+                    if (!AFJSONScannerSkipValue(scanner)) {
+                        return NO;
+                    }
+                } while (AFJSONScannerConsume(scanner, ','));
+                if (!AFJSONScannerConsume(scanner, ']')) {
+                    return AFJSONScannerFail(scanner);
+                }
+            }
+            scanner->depth--;
+            return YES;
+        }
+        case 't':
+            return AFJSONScannerScanLiteral(scanner, "true", 4);
+        case 'f':
+            return AFJSONScannerScanLiteral(scanner, "false", 5);
+        case 'n':
+            return AFJSONScannerScanLiteral(scanner, "null", 4);
+        default: {
+            AFJSONNumber number;
+            return AFJSONScannerScanNumber(scanner, &number);
+        }
+    }
+}
+
+//生成与NSJSONSerialization相同的Foundation对象
+static id AFJSONScannerParseValue(AFJSONScanner *scanner) {
+    AFJSONScannerSkipWhitespace(scanner);
+    if (scanner->offset >= scanner->length) {
+        AFJSONScannerFail(scanner);
+        return nil;
+    }
+
+    const uint8_t *start;
+    NSUInteger length;
+    BOOL hasEscapes;
+    switch (scanner->bytes[scanner->offset]) {
+        case '"': {
+            if (!AFJSONScannerScanString(scanner, &start, &length, &hasEscapes)) {
+                return nil;
+            }
+            NSString *string = AFJSONStringWithBytes(start, length, hasEscapes);
+            if (!string) {
+                AFJSONScannerFail(scanner);
+            }
+            return string;
+        }
+        case '{': {
+            if (++scanner->depth > kAFJSONMaximumNestingDepth) {
+                AFJSONScannerFail(scanner);
+                return nil;
+            }
+            scanner->offset++;
+            NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionary];
+            if (!AFJSONScannerConsume(scanner, '}')) {
+                do {
+                    if (!AFJSONScannerScanString(scanner, &start, &length, &hasEscapes) || !AFJSONScannerConsume(scanner, ':')) {
+                        AFJSONScannerFail(scanner);
+                        return nil;
+                    }
+                    NSString *key = AFJSONStringWithBytes(start, length, hasEscapes);
+                    id value = key ? AFJSONScannerParseValue(scanner) : nil;
+                    if (!value) {
+                        AFJSONScannerFail(scanner);
+                        return nil;
+                    }
+                    mutableDictionary[key] = value;
+                } while (AFJSONScannerConsume(scanner, ','));
+                if (!AFJSONScannerConsume(scanner, '}')) {
+                    AFJSONScannerFail(scanner);
+                    return nil;
+                }
+            }
+            scanner->depth--;
+            return mutableDictionary;
+        }
+        case '[': {
+            if (++scanner->depth > kAFJSONMaximumNestingDepth) {
+                AFJSONScannerFail(scanner);
+                return nil;
+            }
+            scanner->offset++;
+            NSMutableArray *mutableArray = [NSMutableArray array];
+            if (!AFJSONScannerConsume(scanner, ']')) {
+                do {
+                    id value = AFJSONScannerParseValue(scanner);
+                    if (!value) {
+                        return nil;
+                    }
+                    [mutableArray addObject:value];
+                } while (AFJSONScannerConsume(scanner, ','));
+                if (!AFJSONScannerConsume(scanner, ']')) {
+                    AFJSONScannerFail(scanner);
+                    return nil;
+                }
+            }
+            scanner->depth--;
+            return mutableArray;
+        }
+        case 't':
+            return AFJSONScannerScanLiteral(scanner, "true", 4) ? @YES : nil;
+        case 'f':
+            return AFJSONScannerScanLiteral(scanner, "false", 5) ? @NO : nil;
+        case 'n':
+            return AFJSONScannerScanLiteral(scanner, "null", 4) ? [NSNull null] : nil;
+        default: {
+            AFJSONNumber number;
+            return AFJSONScannerScanNumber(scanner, &number) ? AFJSONNumberObject(&number) : nil;
+        }
+    }
+}
+
+#pragma mark - AFJSONModelSchema
+
+typedef NS_ENUM(NSUInteger, AFJSONModelPropertyType) {
+    AFJSONModelPropertyTypeNumeric,//整数、浮点数、BOOL
+    AFJSONModelPropertyTypeString,
+    AFJSONModelPropertyTypeNumber,
+    AFJSONModelPropertyTypeModel,
+    AFJSONModelPropertyTypeModelArray,
+    AFJSONModelPropertyTypeObject,//NSArray、NSDictionary、id 按JSON原样生成
+};
+
+//schemaIndex的两个特殊值: 没有嵌套的schema、嵌套的是schema自身
+static NSUInteger const kAFJSONModelNoSchemaIndex = NSNotFound;
+static NSUInteger const kAFJSONModelSelfSchemaIndex = NSNotFound - 1;
+
+typedef struct {
+    NSUInteger keyOffset;
+    NSUInteger keyLength;
+    SEL setter;
+    char encoding;//基本类型的type encoding
+    AFJSONModelPropertyType type;
+    NSUInteger schemaIndex;//嵌套的schema在AFJSONModelCompiledProperties.schemas中的位置
+} AFJSONModelPropertyDescriptor;
+
+//编译后的属性表为一整块内存: 表头、descriptor数组、哈希槽、所有key的字节
+typedef struct {
+    NSUInteger count;
+    NSUInteger slotMask;//哈希槽个数 - 1、槽个数为2的幂且不少于属性个数的两倍
+} AFJSONModelPropertyTableHeader;
+
+//哈希槽中存放descriptor的下标、空槽为UINT32_MAX
+static uint32_t const kAFJSONModelEmptySlot = UINT32_MAX;
+
+/*
+    属性表和它引用的嵌套schema
+    解析时由局部变量持有、即使期间schema被修改、descriptor引用的schema也不会被释放
+    自身不放进schemas、避免schema -> 属性表 -> schema的循环引用
+ */
+@interface AFJSONModelCompiledProperties : NSObject
+@property (readwrite, nonatomic, strong) NSData *table;
+@property (readwrite, nonatomic, copy) NSArray <AFJSONModelSchema *> *schemas;
+@end
+
+@implementation AFJSONModelCompiledProperties
+@end
+
+@interface AFJSONModelSchema ()
+@property (readwrite, nonatomic, strong) Class modelClass;
+@property (readwrite, nonatomic, copy) NSDictionary *keyMapping;
+@property (readwrite, nonatomic, strong) NSMutableDictionary <NSString *, AFJSONModelSchema *> *nestedSchemas;
+@property (readwrite, nonatomic, strong) NSMutableSet <NSString *> *recursivePropertyNames;//嵌套自身的属性、只记录属性名
+@property (readwrite, nonatomic, strong) AFJSONModelCompiledProperties *compiledProperties;
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@end
+
+//FNV-1a
+static inline uint32_t AFJSONModelKeyHash(const uint8_t *bytes, NSUInteger length) {
+    uint32_t hash = 2166136261u;
+    for (NSUInteger idx = 0; idx < length; idx++) {
+        hash = (hash ^ bytes[idx]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static inline const AFJSONModelPropertyDescriptor * AFJSONModelPropertyTableDescriptors(const uint8_t *table) {
+    return (const AFJSONModelPropertyDescriptor *)(table + sizeof(AFJSONModelPropertyTableHeader));
+}
+
+static inline const uint32_t * AFJSONModelPropertyTableSlots(const uint8_t *table) {
+    return (const uint32_t *)(AFJSONModelPropertyTableDescriptors(table) + ((const AFJSONModelPropertyTableHeader *)table)->count);
+}
+
+//线性探测、负载不超过一半、平均一两次比较就能找到或确定不存在
+static const AFJSONModelPropertyDescriptor * AFJSONModelPropertyTableLookup(const uint8_t *table, const uint8_t *key, NSUInteger keyLength) {
+    NSUInteger slotMask = ((const AFJSONModelPropertyTableHeader *)table)->slotMask;
+    const AFJSONModelPropertyDescriptor *descriptors = AFJSONModelPropertyTableDescriptors(table);
+    const uint32_t *slots = AFJSONModelPropertyTableSlots(table);
+
+    for (NSUInteger slot = AFJSONModelKeyHash(key, keyLength) & slotMask; slots[slot] != kAFJSONModelEmptySlot; slot = (slot + 1) & slotMask) {
+        const AFJSONModelPropertyDescriptor *descriptor = &descriptors[slots[slot]];
+        if (descriptor->keyLength == keyLength && memcmp(table + descriptor->keyOffset, key, keyLength) == 0) {
+            return descriptor;
+        }
+    }
+
+    return NULL;
+}
+
+//类(包括父类)所有可写属性、key与属性同名
+static NSDictionary * AFJSONModelDefaultKeyMapping(Class modelClass) {
+    NSMutableDictionary *keyMapping = [NSMutableDictionary dictionary];
+    for (Class cls = modelClass; cls && cls != [NSObject class]; cls = class_getSuperclass(cls)) {
+        unsigned int count = 0;
+        objc_property_t *properties = class_copyPropertyList(cls, &count);
+        for (unsigned int idx = 0; idx < count; idx++) {
+            NSString *propertyName = @(property_getName(properties[idx]));
+            if (!keyMapping[propertyName]) {
+                keyMapping[propertyName] = propertyName;
+            }
+        }
+        free(properties);
+    }
+
+    return keyMapping;
+}
+
+static BOOL AFJSONModelDescribeProperty(Class modelClass, NSString *propertyName, BOOL hasNestedSchema, AFJSONModelPropertyDescriptor *descriptor) {
+    objc_property_t property = class_getProperty(modelClass, [propertyName UTF8String]);
+    if (!property) {
+        return NO;
+    }
+
+    char *readonly = property_copyAttributeValue(property, "R");
+    if (readonly) {
+        free(readonly);
+        return NO;
+    }
+
+    char *setterName = property_copyAttributeValue(property, "S");
+    if (setterName) {
+        descriptor->setter = sel_registerName(setterName);
+        free(setterName);
+    } else {
+        descriptor->setter = NSSelectorFromString([NSString stringWithFormat:@"set%@%@:", [[propertyName substringToIndex:1] uppercaseString], [propertyName substringFromIndex:1]]);
+    }
+    if (![modelClass instancesRespondToSelector:descriptor->setter]) {
+        return NO;
+    }
+
+    char *typeEncoding = property_copyAttributeValue(property, "T");
+    if (!typeEncoding) {
+        return NO;
+    }
+
+    BOOL isSupported = YES;
+    descriptor->encoding = typeEncoding[0];
+    switch (typeEncoding[0]) {
+        case 'B': case 'c': case 's': case 'i': case 'l': case 'q':
+        case 'C': case 'S': case 'I': case 'L': case 'Q':
+        case 'f': case 'd':
+            descriptor->type = AFJSONModelPropertyTypeNumeric;
+            break;
+        case '@': {
+            //@"NSString"形式、id则只有@
+            Class valueClass = Nil;
+            size_t typeLength = strlen(typeEncoding);
+            if (typeLength > 3) {
+                NSString *className = [[NSString alloc] initWithBytes:typeEncoding + 2 length:typeLength - 3 encoding:NSUTF8StringEncoding];
+                valueClass = NSClassFromString(className);
+            }
+
+            if (hasNestedSchema && valueClass && [valueClass isSubclassOfClass:[NSArray class]]) {
+                descriptor->type = AFJSONModelPropertyTypeModelArray;
+            } else if (hasNestedSchema) {
+                descriptor->type = AFJSONModelPropertyTypeModel;
+            } else if (valueClass && [valueClass isSubclassOfClass:[NSString class]]) {
+                descriptor->type = AFJSONModelPropertyTypeString;
+            } else if (valueClass && [valueClass isSubclassOfClass:[NSNumber class]]) {
+                descriptor->type = AFJSONModelPropertyTypeNumber;
+            } else if (!valueClass || [valueClass isSubclassOfClass:[NSArray class]] || [valueClass isSubclassOfClass:[NSDictionary class]]) {
+                descriptor->type = AFJSONModelPropertyTypeObject;
+            } else {
+                isSupported = NO;
+            }
+            break;
+        }
+        default:
+            isSupported = NO;
+            break;
+    }
+    free(typeEncoding);
+
+    return isSupported;
+}
+
+@implementation AFJSONModelSchema
+
++ (BOOL)supportsSecureCoding {
+    return YES;
+}
+
++ (instancetype)schemaWithModelClass:(Class)modelClass
+                          keyMapping:(NSDictionary <NSString *, NSString *> *)keyMapping
+{
+    NSParameterAssert(modelClass);
+
+    AFJSONModelSchema *schema = [[self alloc] init];
+    schema.modelClass = modelClass;
+    schema.keyMapping = keyMapping;
+
+    return schema;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.nestedSchemas = [NSMutableDictionary dictionary];
+    self.recursivePropertyNames = [NSMutableSet set];
+    self.lock = [[NSLock alloc] init];
+
+    return self;
+}
+
+- (void)setSchema:(AFJSONModelSchema *)schema forPropertyName:(NSString *)propertyName {
+    [self.lock lock];
+    [self.nestedSchemas removeObjectForKey:propertyName];
+    [self.recursivePropertyNames removeObject:propertyName];
+    //指定自身时不能持有自己
+    if (schema == self) {
+        [self.recursivePropertyNames addObject:propertyName];
+    } else if (schema) {
+        self.nestedSchemas[propertyName] = schema;
+    }
+    //下次解析时重新编译
+    self.compiledProperties = nil;
+    [self.lock unlock];
+}
+
+/*
+    编译属性表
+    根据runtime信息确定每个key对应的setter和类型、之后的解析只需要查表
+ */
+- (AFJSONModelCompiledProperties *)compiledPropertiesForParsing {
+    [self.lock lock];
+    if (!self.compiledProperties) {
+        NSDictionary *keyMapping = self.keyMapping ?: AFJSONModelDefaultKeyMapping(self.modelClass);
+        NSMutableArray *schemas = [NSMutableArray array];
+        NSMutableData *descriptorsData = [NSMutableData data];
+        NSMutableData *keysData = [NSMutableData data];
+        for (NSString *key in keyMapping) {
+            NSString *propertyName = keyMapping[key];
+            AFJSONModelSchema *nestedSchema = [self.recursivePropertyNames containsObject:propertyName] ? self : self.nestedSchemas[propertyName];
+            AFJSONModelPropertyDescriptor descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            if (!AFJSONModelDescribeProperty(self.modelClass, propertyName, nestedSchema != nil, &descriptor)) {
+                continue;
+            }
+
+            if (nestedSchema == self) {
+                descriptor.schemaIndex = kAFJSONModelSelfSchemaIndex;
+            } else if (nestedSchema) {
+                descriptor.schemaIndex = [schemas count];
+                [schemas addObject:nestedSchema];
+            } else {
+                descriptor.schemaIndex = kAFJSONModelNoSchemaIndex;
+            }
+
+            NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+            descriptor.keyOffset = [keysData length];
+            descriptor.keyLength = [keyData length];
+            [keysData appendData:keyData];
+            [descriptorsData appendBytes:&descriptor length:sizeof(descriptor)];
+        }
+
+        AFJSONModelPropertyTableHeader header;
+        header.count = [descriptorsData length] / sizeof(AFJSONModelPropertyDescriptor);
+        NSUInteger slotCount = 1;
+        while (slotCount < header.count * 2) {
+            slotCount <<= 1;
+        }
+        header.slotMask = slotCount - 1;
+
+        NSMutableData *table = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+        [table appendData:descriptorsData];
+        NSUInteger slotsOffset = [table length];
+        [table increaseLengthBy:slotCount * sizeof(uint32_t)];
+        NSUInteger keysOffset = [table length];
+        [table appendData:keysData];
+
+        uint8_t *tableBytes = [table mutableBytes];
+        AFJSONModelPropertyDescriptor *descriptors = (AFJSONModelPropertyDescriptor *)(tableBytes + sizeof(header));
+        uint32_t *slots = (uint32_t *)(tableBytes + slotsOffset);
+        memset(slots, 0xff, slotCount * sizeof(uint32_t));
+        for (NSUInteger idx = 0; idx < header.count; idx++) {
+            //key的偏移量改为相对整块内存
+            descriptors[idx].keyOffset += keysOffset;
+            NSUInteger slot = AFJSONModelKeyHash(tableBytes + descriptors[idx].keyOffset, descriptors[idx].keyLength) & header.slotMask;
+            while (slots[slot] != kAFJSONModelEmptySlot) {
+                slot = (slot + 1) & header.slotMask;
+            }
+            slots[slot] = (uint32_t)idx;
+        }
+
+        AFJSONModelCompiledProperties *compiledProperties = [[AFJSONModelCompiledProperties alloc] init];
+        compiledProperties.table = table;
+        compiledProperties.schemas = schemas;
+        self.compiledProperties = compiledProperties;
+    }
+    AFJSONModelCompiledProperties *compiledProperties = self.compiledProperties;
+    [self.lock unlock];
+
+    return compiledProperties;
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [self init];
+    if (!self) {
+        return nil;
+    }
+
+    self.modelClass = NSClassFromString([decoder decodeObjectOfClass:[NSString class] forKey:NSStringFromSelector(@selector(modelClass))]);
+    self.keyMapping = [decoder decodeObjectOfClass:[NSDictionary class] forKey:NSStringFromSelector(@selector(keyMapping))];
+    NSDictionary *nestedSchemas = [decoder decodeObjectOfClasses:[NSSet setWithObjects:[NSDictionary class], [NSString class], [AFJSONModelSchema class], nil] forKey:NSStringFromSelector(@selector(nestedSchemas))];
+    //旧的归档里自身也在nestedSchemas中、经过setSchema:重新区分
+    [nestedSchemas enumerateKeysAndObjectsUsingBlock:^(NSString *propertyName, AFJSONModelSchema *schema, BOOL *stop) {
+        [self setSchema:schema forPropertyName:propertyName];
+    }];
+    NSSet *recursivePropertyNames = [decoder decodeObjectOfClasses:[NSSet setWithObjects:[NSSet class], [NSString class], nil] forKey:NSStringFromSelector(@selector(recursivePropertyNames))];
+    [self.recursivePropertyNames unionSet:recursivePropertyNames ?: [NSSet set]];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [coder encodeObject:NSStringFromClass(self.modelClass) forKey:NSStringFromSelector(@selector(modelClass))];
+    [coder encodeObject:self.keyMapping forKey:NSStringFromSelector(@selector(keyMapping))];
+    [self.lock lock];
+    [coder encodeObject:self.nestedSchemas forKey:NSStringFromSelector(@selector(nestedSchemas))];
+    [coder encodeObject:self.recursivePropertyNames forKey:NSStringFromSelector(@selector(recursivePropertyNames))];
+    [self.lock unlock];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFJSONModelSchema *schema = [[[self class] allocWithZone:zone] init];
+    schema.modelClass = self.modelClass;
+    schema.keyMapping = self.keyMapping;
+    [self.lock lock];
+    [schema.nestedSchemas addEntriesFromDictionary:self.nestedSchemas];
+    //嵌套自身的属性在副本中嵌套副本自身
+    [schema.recursivePropertyNames unionSet:self.recursivePropertyNames];
+    [self.lock unlock];
+
+    return schema;
+}
+
+@end
+
+#pragma mark - AFJSONModelResponseSerializer
+
+static id AFJSONScannerParseModel(AFJSONScanner *scanner, AFJSONModelSchema *schema);
+static NSArray * AFJSONScannerParseModelArray(AFJSONScanner *scanner, AFJSONModelSchema *schema);
+
+//按属性的实际类型调用setter
+static void AFJSONModelSetNumber(id model, const AFJSONModelPropertyDescriptor *descriptor, const AFJSONNumber *number) {
+    long long integerValue = number->isInteger ? (number->isUnsigned ? (long long)number->unsignedValue : number->integerValue) : (long long)number->doubleValue;
+    unsigned long long unsignedValue = number->isUnsigned ? number->unsignedValue : (unsigned long long)integerValue;
+    double doubleValue = number->doubleValue;
+    SEL setter = descriptor->setter;
+
+    switch (descriptor->encoding) {
+        case 'B': ((void (*)(id, SEL, bool))objc_msgSend)(model, setter, integerValue != 0); break;
+        case 'c': ((void (*)(id, SEL, char))objc_msgSend)(model, setter, (char)integerValue); break;
+        case 's': ((void (*)(id, SEL, short))objc_msgSend)(model, setter, (short)integerValue); break;
+        case 'i': ((void (*)(id, SEL, int))objc_msgSend)(model, setter, (int)integerValue); break;
+        case 'l': ((void (*)(id, SEL, long))objc_msgSend)(model, setter, (long)integerValue); break;
+        case 'q': ((void (*)(id, SEL, long long))objc_msgSend)(model, setter, integerValue); break;
+        case 'C': ((void (*)(id, SEL, unsigned char))objc_msgSend)(model, setter, (unsigned char)unsignedValue); break;
+        case 'S': ((void (*)(id, SEL, unsigned short))objc_msgSend)(model, setter, (unsigned short)unsignedValue); break;
+        case 'I': ((void (*)(id, SEL, unsigned int))objc_msgSend)(model, setter, (unsigned int)unsignedValue); break;
+        case 'L': ((void (*)(id, SEL, unsigned long))objc_msgSend)(model, setter, (unsigned long)unsignedValue); break;
+        case 'Q': ((void (*)(id, SEL, unsigned long long))objc_msgSend)(model, setter, unsignedValue); break;
+        case 'f': ((void (*)(id, SEL, float))objc_msgSend)(model, setter, (float)doubleValue); break;
+        case 'd': ((void (*)(id, SEL, double))objc_msgSend)(model, setter, doubleValue); break;
+        default: break;
+    }
+}
+
+static inline void AFJSONModelSetObject(id model, const AFJSONModelPropertyDescriptor *descriptor, id value) {
+    ((void (*)(id, SEL, id))objc_msgSend)(model, descriptor->setter, value);
+}
+
+static inline AFJSONModelSchema * AFJSONModelNestedSchema(const AFJSONModelPropertyDescriptor *descriptor, AFJSONModelSchema *schema, NSArray <AFJSONModelSchema *> *schemas) {
+    return descriptor->schemaIndex == kAFJSONModelSelfSchemaIndex ? schema : schemas[descriptor->schemaIndex];
+}
+
+//解析一个已声明的属性、类型与JSON不匹配的值直接跳过
+static BOOL AFJSONScannerParseProperty(AFJSONScanner *scanner, id model, const AFJSONModelPropertyDescriptor *descriptor, AFJSONModelSchema *schema, NSArray <AFJSONModelSchema *> *schemas) {
+    AFJSONScannerSkipWhitespace(scanner);
+    if (scanner->offset >= scanner->length) {
+        return AFJSONScannerFail(scanner);
+    }
+
+    uint8_t character = scanner->bytes[scanner->offset];
+    //null保持属性的默认值
+    if (character == 'n') {
+        return AFJSONScannerScanLiteral(scanner, "null", 4);
+    }
+
+    BOOL isNumber = character == '-' || (character >= '0' && character <= '9');
+    BOOL isBoolean = character == 't' || character == 'f';
+
+    switch (descriptor->type) {
+        case AFJSONModelPropertyTypeNumeric:
+        case AFJSONModelPropertyTypeNumber: {
+            AFJSONNumber number;
+            if (isBoolean) {
+                BOOL boolValue = character == 't';
+                if (!(boolValue ? AFJSONScannerScanLiteral(scanner, "true", 4) : AFJSONScannerScanLiteral(scanner, "false", 5))) {
+                    return NO;
+                }
+                if (descriptor->type == AFJSONModelPropertyTypeNumber) {
+                    AFJSONModelSetObject(model, descriptor, @(boolValue));
+                    return YES;
+                }
+                memset(&number, 0, sizeof(number));
+                number.isInteger = YES;
+                number.integerValue = boolValue;
+                number.doubleValue = boolValue;
+            } else if (isNumber) {
+                if (!AFJSONScannerScanNumber(scanner, &number)) {
+                    return NO;
+                }
+            } else {
+                return AFJSONScannerSkipValue(scanner);
+            }
+
+            if (descriptor->type == AFJSONModelPropertyTypeNumber) {
+                AFJSONModelSetObject(model, descriptor, AFJSONNumberObject(&number));
+            } else {
+                AFJSONModelSetNumber(model, descriptor, &number);
+            }
+            return YES;
+        }
+        case AFJSONModelPropertyTypeString: {
+            if (character != '"') {
+                return AFJSONScannerSkipValue(scanner);
+            }
+            const uint8_t *start;
+            NSUInteger length;
+            BOOL hasEscapes;
+            if (!AFJSONScannerScanString(scanner, &start, &length, &hasEscapes)) {
+                return NO;
+            }
+            NSString *string = AFJSONStringWithBytes(start, length, hasEscapes);
+            if (!string) {
+                return AFJSONScannerFail(scanner);
+            }
+            AFJSONModelSetObject(model, descriptor, string);
+            return YES;
+        }
+        case AFJSONModelPropertyTypeModel: {
+            if (character != '{') {
+                return AFJSONScannerSkipValue(scanner);
+            }
+            id nestedModel = AFJSONScannerParseModel(scanner, AFJSONModelNestedSchema(descriptor, schema, schemas));
+            if (!nestedModel) {
+                return NO;
+            }
+            AFJSONModelSetObject(model, descriptor, nestedModel);
+            return YES;
+        }
+        case AFJSONModelPropertyTypeModelArray: {
+            if (character != '[') {
+                return AFJSONScannerSkipValue(scanner);
+            }
+            NSArray *models = AFJSONScannerParseModelArray(scanner, AFJSONModelNestedSchema(descriptor, schema, schemas));
+            if (!models) {
+                return NO;
+            }
+            AFJSONModelSetObject(model, descriptor, models);
+            return YES;
+        }
+        case AFJSONModelPropertyTypeObject: {
+            id value = AFJSONScannerParseValue(scanner);
+            if (!value) {
+                return NO;
+            }
+            AFJSONModelSetObject(model, descriptor, value);
+            return YES;
+        }
+    }
+
+    return AFJSONScannerSkipValue(scanner);
+}
+
+static id AFJSONScannerParseModel(AFJSONScanner *scanner, AFJSONModelSchema *schema) {
+    if (++scanner->depth > kAFJSONMaximumNestingDepth || !AFJSONScannerConsume(scanner, '{')) {
+        AFJSONScannerFail(scanner);
+        return nil;
+    }
+
+    //局部变量持有属性表和嵌套的schema、解析过程中即使schema被修改也不受影响
+    AFJSONModelCompiledProperties *compiledProperties = [schema compiledPropertiesForParsing];
+    const uint8_t *table = [compiledProperties.table bytes];
+    NSArray <AFJSONModelSchema *> *schemas = compiledProperties.schemas;
+
+    id model = [[schema.modelClass alloc] init];
+    if (AFJSONScannerConsume(scanner, '}')) {
+        scanner->depth--;
+        return model;
+    }
+
+    do {
+        const uint8_t *keyStart;
+        NSUInteger keyLength;
+        BOOL hasEscapes;
+        if (!AFJSONScannerScanString(scanner, &keyStart, &keyLength, &hasEscapes) || !AFJSONScannerConsume(scanner, ':')) {
+            AFJSONScannerFail(scanner);
+            return nil;
+        }
+
+        //带转义的key很少见、先还原再比较
+        NSData *unescapedKey = nil;
+        if (hasEscapes) {
+            unescapedKey = [AFJSONStringWithBytes(keyStart, keyLength, YES) dataUsingEncoding:NSUTF8StringEncoding];
+            keyStart = [unescapedKey bytes];
+            keyLength = [unescapedKey length];
+        }
+
+        const AFJSONModelPropertyDescriptor *descriptor = AFJSONModelPropertyTableLookup(table, keyStart, keyLength);
+
+        //没有声明的key直接跳过、不生成对象
+        BOOL succeeded = descriptor ? AFJSONScannerParseProperty(scanner, model, descriptor, schema, schemas) : AFJSONScannerSkipValue(scanner);
+        if (!succeeded) {
+            return nil;
+        }
+    } while (AFJSONScannerConsume(scanner, ','));
+
+    if (!AFJSONScannerConsume(scanner, '}')) {
+        AFJSONScannerFail(scanner);
+        return nil;
+    }
+    scanner->depth--;
+
+    return model;
+}
+
+static NSArray * AFJSONScannerParseModelArray(AFJSONScanner *scanner, AFJSONModelSchema *schema) {
+    if (++scanner->depth > kAFJSONMaximumNestingDepth || !AFJSONScannerConsume(scanner, '[')) {
+        AFJSONScannerFail(scanner);
+        return nil;
+    }
+
+    NSMutableArray *models = [NSMutableArray array];
+    if (AFJSONScannerConsume(scanner, ']')) {
+        scanner->depth--;
+        return models;
+    }
+
+    do {
+        AFJSONScannerSkipWhitespace(scanner);
+        if (scanner->offset < scanner->length && scanner->bytes[scanner->offset] == '{') {
+            id model = AFJSONScannerParseModel(scanner, schema);
+            if (!model) {
+                return nil;
+            }
+            [models addObject:model];
+        } else if (!AFJSONScannerSkipValue(scanner)) {
+            //不是对象的元素(包括null)跳过
+            return nil;
+        }
+    } while (AFJSONScannerConsume(scanner, ','));
+
+    if (!AFJSONScannerConsume(scanner, ']')) {
+        AFJSONScannerFail(scanner);
+        return nil;
+    }
+    scanner->depth--;
+
+    return models;
+}
+
+@implementation AFJSONModelResponseSerializer
+
++ (instancetype)serializer {
+    return [[self alloc] init];
+}
+
++ (instancetype)serializerWithSchema:(AFJSONModelSchema *)schema {
+    AFJSONModelResponseSerializer *serializer = [[self alloc] init];
+    serializer.schema = schema;
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.acceptableContentTypes = [NSSet setWithObjects:@"application/json", @"text/json", @"text/javascript", nil];
+
+    return self;
+}
+
+#pragma mark - AFURLResponseSerialization
+
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    // Workaround for behavior of Rails to return a single space for `head :ok`, see `AFJSONResponseSerializer`
+    BOOL isSpace = [data isEqualToData:[NSData dataWithBytes:" " length:1]];
+    if (data.length == 0 || isSpace) {
+        return nil;
+    }
+
+    AFJSONScanner scanner;
+    memset(&scanner, 0, sizeof(scanner));
+    scanner.bytes = [data bytes];
+    scanner.length = [data length];
+
+    id responseObject = nil;
+    AFJSONScannerSkipWhitespace(&scanner);
+    uint8_t character = scanner.offset < scanner.length ? scanner.bytes[scanner.offset] : 0;
+    if (self.schema && character == '{') {
+        responseObject = AFJSONScannerParseModel(&scanner, self.schema);
+    } else if (self.schema && character == '[') {
+        responseObject = AFJSONScannerParseModelArray(&scanner, self.schema);
+    } else {
+        responseObject = AFJSONScannerParseValue(&scanner);
+    }
+
+    AFJSONScannerSkipWhitespace(&scanner);
+    if (!scanner.failed && scanner.offset != scanner.length) {
+        scanner.failed = YES;
+    }
+
+    NSError *serializationError = nil;
+    if (scanner.failed) {
+        responseObject = nil;
+        serializationError = [NSError errorWithDomain:AFURLResponseSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedStringFromTable(@"Invalid JSON data around byte %lu", @"AFNetworking", nil), (unsigned long)scanner.offset]}];
+    }
+
+    if (error) {
+        *error = AFErrorWithUnderlyingError(serializationError, *error);
+    }
+
+    return responseObject;
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    self.schema = [decoder decodeObjectOfClass:[AFJSONModelSchema class] forKey:NSStringFromSelector(@selector(schema))];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeObject:self.schema forKey:NSStringFromSelector(@selector(schema))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFJSONModelResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
+    serializer.schema = self.schema;
+
+    return serializer;
+}
+
+@end
+
+#pragma mark - AFStructuralIndexJSONParser
+
+/*
+    tape中每一项为64位、高8位为类型、低56位为payload
+    '{' '[': 低32位为匹配的结束项之后的位置、32~55位为元素个数(超出则为最大值)
+    '}' ']': 对应开始项的位置
+    '"'    : 字符串内容在原始数据中的偏移、下一项为长度、最高位表示是否有转义
+    'l' 'u' 'd': 下一项为int64/uint64/double的值
+    't' 'f' 'n': 无payload
+ */
+static uint64_t const kAFJSONTapePayloadMask = 0x00ffffffffffffffULL;
+static uint64_t const kAFJSONTapeCountMask = 0xffffffULL;
+
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t operators;//{}[]:,
+    uint64_t whitespace;
+    uint64_t nonASCII;
+    uint64_t control;//小于0x20的控制字符、不能直接出现在字符串中
+} AFJSONBlockMasks;
+
+#if defined(__AVX2__)
+
+static inline uint64_t AFJSONMovemask(__m256i lo, __m256i hi) {
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(lo) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+}
+
+#define AFJSONEqualMask(lo, hi, c) AFJSONMovemask(_mm256_cmpeq_epi8((lo), _mm256_set1_epi8((char)(c))), _mm256_cmpeq_epi8((hi), _mm256_set1_epi8((char)(c))))
+
+static inline void AFJSONClassifyBlock(const uint8_t *block, AFJSONBlockMasks *masks) {
+    __m256i lo = _mm256_loadu_si256((const __m256i *)(const void *)block);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(const void *)(block + 32));
+    //'['、']'与0x20按位或之后分别等于'{'、'}'
+    __m256i foldedLo = _mm256_or_si256(lo, _mm256_set1_epi8(0x20));
+    __m256i foldedHi = _mm256_or_si256(hi, _mm256_set1_epi8(0x20));
+
+    masks->quote = AFJSONEqualMask(lo, hi, '"');
+    masks->backslash = AFJSONEqualMask(lo, hi, '\\');
+    masks->operators = AFJSONEqualMask(foldedLo, foldedHi, '{') | AFJSONEqualMask(foldedLo, foldedHi, '}') | AFJSONEqualMask(lo, hi, ':') | AFJSONEqualMask(lo, hi, ',');
+    masks->whitespace = AFJSONEqualMask(lo, hi, ' ') | AFJSONEqualMask(lo, hi, '\t') | AFJSONEqualMask(lo, hi, '\n') | AFJSONEqualMask(lo, hi, '\r');
+    masks->nonASCII = AFJSONMovemask(lo, hi);
+    //无符号比较: max(c, 0x1f) == 0x1f 即 c <= 0x1f
+    __m256i controlLimit = _mm256_set1_epi8(0x1f);
+    masks->control = AFJSONMovemask(_mm256_cmpeq_epi8(_mm256_max_epu8(lo, controlLimit), controlLimit), _mm256_cmpeq_epi8(_mm256_max_epu8(hi, controlLimit), controlLimit));
+}
+
+#undef AFJSONEqualMask
+
+#elif defined(__SSE2__)
+
+static inline uint64_t AFJSONMovemask(const __m128i chunks[4]) {
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(chunks[0]) | ((uint64_t)(uint16_t)_mm_movemask_epi8(chunks[1]) << 16) | ((uint64_t)(uint16_t)_mm_movemask_epi8(chunks[2]) << 32) | ((uint64_t)(uint16_t)_mm_movemask_epi8(chunks[3]) << 48);
+}
+
+static inline uint64_t AFJSONEqualMask(const __m128i chunks[4], uint8_t character) {
+    __m128i needle = _mm_set1_epi8((char)character);
+    __m128i equals[4];
+    for (NSUInteger idx = 0; idx < 4; idx++) {
+        equals[idx] = _mm_cmpeq_epi8(chunks[idx], needle);
+    }
+
+    return AFJSONMovemask(equals);
+}
+
+static inline void AFJSONClassifyBlock(const uint8_t *block, AFJSONBlockMasks *masks) {
+    __m128i chunks[4];
+    __m128i foldedChunks[4];
+    for (NSUInteger idx = 0; idx < 4; idx++) {
+        chunks[idx] = _mm_loadu_si128((const __m128i *)(const void *)(block + idx * 16));
+        //'['、']'与0x20按位或之后分别等于'{'、'}'
+        foldedChunks[idx] = _mm_or_si128(chunks[idx], _mm_set1_epi8(0x20));
+    }
+
+    masks->quote = AFJSONEqualMask(chunks, '"');
+    masks->backslash = AFJSONEqualMask(chunks, '\\');
+    masks->operators = AFJSONEqualMask(foldedChunks, '{') | AFJSONEqualMask(foldedChunks, '}') | AFJSONEqualMask(chunks, ':') | AFJSONEqualMask(chunks, ',');
+    masks->whitespace = AFJSONEqualMask(chunks, ' ') | AFJSONEqualMask(chunks, '\t') | AFJSONEqualMask(chunks, '\n') | AFJSONEqualMask(chunks, '\r');
+    masks->nonASCII = AFJSONMovemask(chunks);
+
+    //无符号比较: max(c, 0x1f) == 0x1f 即 c <= 0x1f
+    __m128i controlLimit = _mm_set1_epi8(0x1f);
+    __m128i controls[4];
+    for (NSUInteger idx = 0; idx < 4; idx++) {
+        controls[idx] = _mm_cmpeq_epi8(_mm_max_epu8(chunks[idx], controlLimit), controlLimit);
+    }
+    masks->control = AFJSONMovemask(controls);
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+static inline uint64_t AFJSONMovemask(const uint8x16_t chunks[4]) {
+    const uint8x16_t bits = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+    uint8x16_t sum0 = vpaddq_u8(vandq_u8(chunks[0], bits), vandq_u8(chunks[1], bits));
+    uint8x16_t sum1 = vpaddq_u8(vandq_u8(chunks[2], bits), vandq_u8(chunks[3], bits));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+static inline uint64_t AFJSONEqualMask(const uint8x16_t chunks[4], uint8_t character) {
+    uint8x16_t needle = vdupq_n_u8(character);
+    uint8x16_t equals[4];
+    for (NSUInteger idx = 0; idx < 4; idx++) {
+        equals[idx] = vceqq_u8(chunks[idx], needle);
+    }
+
+    return AFJSONMovemask(equals);
+}
+
+static inline void AFJSONClassifyBlock(const uint8_t *block, AFJSONBlockMasks *masks) {
+    uint8x16_t chunks[4];
+    uint8x16_t foldedChunks[4];
+    uint8x16_t highBits[4];
+    uint8x16_t controls[4];
+    for (NSUInteger idx = 0; idx < 4; idx++) {
+        chunks[idx] = vld1q_u8(block + idx * 16);
+        //'['、']'与0x20按位或之后分别等于'{'、'}'
+        foldedChunks[idx] = vorrq_u8(chunks[idx], vdupq_n_u8(0x20));
+        highBits[idx] = vcgeq_u8(chunks[idx], vdupq_n_u8(0x80));
+        controls[idx] = vcltq_u8(chunks[idx], vdupq_n_u8(0x20));
+    }
+
+    masks->quote = AFJSONEqualMask(chunks, '"');
+    masks->backslash = AFJSONEqualMask(chunks, '\\');
+    masks->operators = AFJSONEqualMask(foldedChunks, '{') | AFJSONEqualMask(foldedChunks, '}') | AFJSONEqualMask(chunks, ':') | AFJSONEqualMask(chunks, ',');
+    masks->whitespace = AFJSONEqualMask(chunks, ' ') | AFJSONEqualMask(chunks, '\t') | AFJSONEqualMask(chunks, '\n') | AFJSONEqualMask(chunks, '\r');
+    masks->nonASCII = AFJSONMovemask(highBits);
+    masks->control = AFJSONMovemask(controls);
+}
+
+#else
+
+static inline void AFJSONClassifyBlock(const uint8_t *block, AFJSONBlockMasks *masks) {
+    memset(masks, 0, sizeof(*masks));
+    for (NSUInteger idx = 0; idx < 64; idx++) {
+        uint64_t bit = 1ULL << idx;
+        switch (block[idx]) {
+            case '"': masks->quote |= bit; break;
+            case '\\': masks->backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': masks->operators |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': masks->whitespace |= bit; break;
+            default:
+                if (block[idx] & 0x80) {
+                    masks->nonASCII |= bit;
+                }
+                break;
+        }
+        if (block[idx] < 0x20) {
+            masks->control |= bit;
+        }
+    }
+}
+
+#endif
+
+//前缀异或、得到引号之间(包括开始的引号)的区域
+static inline uint64_t AFJSONPrefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+
+    return bits;
+}
+
+//找出被反斜杠转义的字符、连续的反斜杠按奇偶处理、previousEscaped为跨block的进位
+static inline uint64_t AFJSONFindEscaped(uint64_t backslash, uint64_t *previousEscaped) {
+    backslash &= ~*previousEscaped;
+    uint64_t followsEscape = (backslash << 1) | *previousEscaped;
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    uint64_t oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+    uint64_t sequencesStartingOnEvenBits;
+    *previousEscaped = __builtin_add_overflow(oddSequenceStarts, backslash, &sequencesStartingOnEvenBits) ? 1 : 0;
+    uint64_t invertMask = sequencesStartingOnEvenBits << 1;
+
+    return (evenBits ^ invertMask) & followsEscape;
+}
+
+/*
+    校验[offset, end)范围内的UTF-8、跨过end的多字节字符会完整校验
+    成功返回校验到的位置、失败时errorOffset为出错的位置
+ */
+static BOOL AFJSONValidateUTF8(const uint8_t *bytes, NSUInteger length, NSUInteger offset, NSUInteger end, NSUInteger *validatedOffset) {
+    while (offset < end) {
+        uint8_t character = bytes[offset];
+        if (character < 0x80) {
+            offset++;
+            continue;
+        }
+
+        NSUInteger continuationCount;
+        uint8_t minimum = 0x80;
+        uint8_t maximum = 0xbf;
+        if (character >= 0xc2 && character <= 0xdf) {
+            continuationCount = 1;
+        } else if (character >= 0xe0 && character <= 0xef) {
+            continuationCount = 2;
+            //排除overlong和代理项
+            if (character == 0xe0) {
+                minimum = 0xa0;
+            } else if (character == 0xed) {
+                maximum = 0x9f;
+            }
+        } else if (character >= 0xf0 && character <= 0xf4) {
+            continuationCount = 3;
+            if (character == 0xf0) {
+                minimum = 0x90;
+            } else if (character == 0xf4) {
+                maximum = 0x8f;
+            }
+        } else {
+            *validatedOffset = offset;
+            return NO;
+        }
+
+        if (length - offset <= continuationCount || bytes[offset + 1] < minimum || bytes[offset + 1] > maximum) {
+            *validatedOffset = offset;
+            return NO;
+        }
+        for (NSUInteger idx = 2; idx <= continuationCount; idx++) {
+            if ((bytes[offset + idx] & 0xc0) != 0x80) {
+                *validatedOffset = offset;
+                return NO;
+            }
+        }
+        offset += continuationCount + 1;
+    }
+    *validatedOffset = offset;
+
+    return YES;
+}
+
+/*
+    第一阶段
+    找出所有结构字符({}[]:,)、字符串的开始引号以及标量(数字、true/false/null)的开始位置
+    同时记录每个字符串结束引号的位置、最高位表示其中是否有反斜杠(kAFJSONStringEndHasEscapes)
+    字符串中的控制字符也在这里发现、第二阶段不需要再逐字节扫描字符串
+ */
+static uint64_t const kAFJSONStringEndHasEscapes = 1ULL << 63;
+
+static NSData * AFJSONFindStructuralIndices(const uint8_t *bytes, NSUInteger length, NSData *__autoreleasing *stringEndsData, NSUInteger *errorOffset) {
+    NSUInteger capacity = length / 4 + 64;
+    NSMutableData *indicesData = [NSMutableData dataWithLength:capacity * sizeof(uint32_t)];
+    uint32_t *indices = [indicesData mutableBytes];
+    NSUInteger count = 0;
+
+    NSUInteger stringCapacity = length / 16 + 32;
+    NSMutableData *mutableStringEndsData = [NSMutableData dataWithLength:stringCapacity * sizeof(uint64_t)];
+    uint64_t *stringEnds = [mutableStringEndsData mutableBytes];
+    NSUInteger stringCount = 0;
+    BOOL stringHasEscapes = NO;
+
+    uint64_t previousEscaped = 0;
+    uint64_t previousInString = 0;
+    uint64_t previousScalar = 0;
+    NSUInteger validatedOffset = 0;
+    uint8_t paddedBlock[64];
+
+    for (NSUInteger blockOffset = 0; blockOffset < length; blockOffset += 64) {
+        const uint8_t *block = bytes + blockOffset;
+        NSUInteger blockEnd = MIN(length, blockOffset + 64);
+        //最后不足64字节的部分用空格补齐
+        if (blockEnd - blockOffset < 64) {
+            memset(paddedBlock, ' ', sizeof(paddedBlock));
+            memcpy(paddedBlock, block, blockEnd - blockOffset);
+            block = paddedBlock;
+        }
+
+        AFJSONBlockMasks masks;
+        AFJSONClassifyBlock(block, &masks);
+
+        //纯ASCII的block不需要校验UTF-8
+        if (masks.nonASCII && validatedOffset < blockEnd) {
+            if (!AFJSONValidateUTF8(bytes, length, MAX(validatedOffset, blockOffset), blockEnd, &validatedOffset)) {
+                *errorOffset = validatedOffset;
+                return nil;
+            }
+        }
+
+        uint64_t escaped = AFJSONFindEscaped(masks.backslash, &previousEscaped);
+        uint64_t quotes = masks.quote & ~escaped;
+        uint64_t inString = AFJSONPrefixXor(quotes) ^ previousInString;
+        previousInString = (uint64_t)((int64_t)inString >> 63);
+
+        if (masks.control & inString) {
+            *errorOffset = blockOffset + (NSUInteger)__builtin_ctzll(masks.control & inString);
+            return nil;
+        }
+
+        //按顺序处理引号、开始引号处inString为1、结束引号处为0
+        //结束引号与上一个开始引号(可能在之前的block)之间有反斜杠就说明有转义
+        uint64_t stringBackslashes = masks.backslash & inString;
+        uint64_t remainingQuotes = quotes;
+        NSUInteger rangeStart = 0;
+        if (stringCapacity - stringCount < 64) {
+            stringCapacity *= 2;
+            [mutableStringEndsData setLength:stringCapacity * sizeof(uint64_t)];
+            stringEnds = [mutableStringEndsData mutableBytes];
+        }
+        while (remainingQuotes) {
+            NSUInteger bitIndex = (NSUInteger)__builtin_ctzll(remainingQuotes);
+            uint64_t bit = remainingQuotes & -remainingQuotes;
+            remainingQuotes &= remainingQuotes - 1;
+            if (inString & bit) {
+                stringHasEscapes = NO;
+                rangeStart = bitIndex + 1;
+            } else {
+                stringHasEscapes = stringHasEscapes || (stringBackslashes & (bit - 1) & (~0ULL << rangeStart)) != 0;
+                stringEnds[stringCount++] = (uint64_t)(blockOffset + bitIndex) | (stringHasEscapes ? kAFJSONStringEndHasEscapes : 0);
+            }
+        }
+        if (previousInString && rangeStart < 64) {
+            stringHasEscapes = stringHasEscapes || (stringBackslashes & (~0ULL << rangeStart)) != 0;
+        }
+
+        uint64_t scalar = ~(masks.operators | masks.whitespace | masks.quote) & ~inString;
+        uint64_t structurals = (masks.operators & ~inString) | (quotes & inString) | (scalar & ~((scalar << 1) | previousScalar));
+        previousScalar = scalar >> 63;
+
+        if (capacity - count < 64) {
+            capacity *= 2;
+            [indicesData setLength:capacity * sizeof(uint32_t)];
+            indices = [indicesData mutableBytes];
+        }
+        while (structurals) {
+            indices[count++] = (uint32_t)(blockOffset + (NSUInteger)__builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+
+    //字符串没有结束
+    if (previousInString) {
+        *errorOffset = length;
+        return nil;
+    }
+
+    [indicesData setLength:count * sizeof(uint32_t)];
+    [mutableStringEndsData setLength:stringCount * sizeof(uint64_t)];
+    *stringEndsData = mutableStringEndsData;
+
+    return indicesData;
+}
+
+//只校验有反斜杠的字符串中的转义、反斜杠之间的内容在第一阶段已经校验过
+static BOOL AFJSONValidateEscapes(const uint8_t *bytes, NSUInteger offset, NSUInteger end, NSUInteger *errorOffset) {
+    while (offset < end) {
+        const uint8_t *backslash = memchr(bytes + offset, '\\', end - offset);
+        if (!backslash) {
+            break;
+        }
+
+        //结束引号没有被转义、反斜杠之后一定还有字符
+        offset = (NSUInteger)(backslash - bytes) + 1;
+        uint8_t escape = bytes[offset];
+        if (escape == 'u') {
+            if (end - offset < 5) {
+                *errorOffset = offset;
+                return NO;
+            }
+            for (NSUInteger idx = 1; idx <= 4; idx++) {
+                if (!AFJSONIsHexDigit(bytes[offset + idx])) {
+                    *errorOffset = offset + idx;
+                    return NO;
+                }
+            }
+            offset += 5;
+        } else if (escape && strchr("\"\\/bfnrt", escape)) {
+            offset++;
+        } else {
+            *errorOffset = offset;
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    const uint32_t *indices;
+    NSUInteger indexCount;
+    NSUInteger position;
+    const uint64_t *stringEnds;
+    NSUInteger stringCount;
+    NSUInteger stringPosition;//结构索引中的字符串与stringEnds按顺序一一对应
+    uint64_t *tape;
+    NSUInteger tapeLength;
+    NSUInteger depth;
+    NSUInteger errorOffset;
+} AFJSONTapeBuilder;
+
+static inline BOOL AFJSONTapeBuilderFail(AFJSONTapeBuilder *builder) {
+    builder->errorOffset = builder->position < builder->indexCount ? builder->indices[builder->position] : builder->length;
+    return NO;
+}
+
+static inline uint8_t AFJSONTapeBuilderPeek(AFJSONTapeBuilder *builder) {
+    return builder->position < builder->indexCount ? builder->bytes[builder->indices[builder->position]] : 0;
+}
+
+static inline void AFJSONTapeBuilderAppend(AFJSONTapeBuilder *builder, uint8_t type, uint64_t payload) {
+    builder->tape[builder->tapeLength++] = ((uint64_t)type << 56) | payload;
+}
+
+//标量之后必须是空白、结构字符或者结束、否则像`1x`这样的数据不会被发现
+static inline BOOL AFJSONIsScalarTerminator(const uint8_t *bytes, NSUInteger length, NSUInteger offset) {
+    if (offset >= length) {
+        return YES;
+    }
+
+    switch (bytes[offset]) {
+        case ' ': case '\t': case '\n': case '\r':
+        case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+/*
+    第二阶段
+    按结构索引校验语法并生成tape、字符串和数字在这里完成校验
+ */
+static BOOL AFJSONTapeBuilderParseValue(AFJSONTapeBuilder *builder) {
+    if (builder->position >= builder->indexCount) {
+        return AFJSONTapeBuilderFail(builder);
+    }
+
+    NSUInteger offset = builder->indices[builder->position];
+    uint8_t character = builder->bytes[offset];
+    AFJSONScanner scanner = {.bytes = builder->bytes, .length = builder->length, .offset = offset};
+    switch (character) {
+        case '{':
+        case '[': {
+            uint8_t closing = character == '{' ? '}' : ']';
+            if (++builder->depth > kAFJSONMaximumNestingDepth) {
+                return AFJSONTapeBuilderFail(builder);
+            }
+            builder->position++;
+
+            NSUInteger start = builder->tapeLength++;
+            uint64_t count = 0;
+            if (AFJSONTapeBuilderPeek(builder) == closing) {
+                builder->position++;
+            } else {
+                while (YES) {
+                    if (character == '{') {
+                        if (AFJSONTapeBuilderPeek(builder) != '"') {
+                            return AFJSONTapeBuilderFail(builder);
+                        }
+                        if (!AFJSONTapeBuilderParseValue(builder)) {
+                            return NO;
+                        }
+                        if (AFJSONTapeBuilderPeek(builder) != ':') {
+                            return AFJSONTapeBuilderFail(builder);
+                        }
+                        builder->position++;
+                    }
+                    if (!AFJSONTapeBuilderParseValue(builder)) {
+                        return NO;
+                    }
+                    count++;
+
+                    uint8_t separator = AFJSONTapeBuilderPeek(builder);
+                    if (separator != ',' && separator != closing) {
+                        return AFJSONTapeBuilderFail(builder);
+                    }
+                    builder->position++;
+                    if (separator == closing) {
+                        break;
+                    }
+                }
+            }
+            builder->depth--;
+
+            AFJSONTapeBuilderAppend(builder, closing, start);
+            builder->tape[start] = ((uint64_t)character << 56) | (MIN(count, kAFJSONTapeCountMask) << 32) | builder->tapeLength;
+            return YES;
+        }
+        case '"': {
+            //结束位置和是否有转义在第一阶段已经得到、没有转义的字符串不需要再扫描
+            if (builder->stringPosition >= builder->stringCount) {
+                return AFJSONTapeBuilderFail(builder);
+            }
+            uint64_t stringEnd = builder->stringEnds[builder->stringPosition++];
+            NSUInteger start = offset + 1;
+            NSUInteger end = (NSUInteger)(stringEnd & ~kAFJSONStringEndHasEscapes);
+            BOOL hasEscapes = (stringEnd & kAFJSONStringEndHasEscapes) != 0;
+            if (hasEscapes && !AFJSONValidateEscapes(builder->bytes, start, end, &builder->errorOffset)) {
+                return NO;
+            }
+            builder->position++;
+            AFJSONTapeBuilderAppend(builder, '"', (uint64_t)start);
+            builder->tape[builder->tapeLength++] = (uint64_t)(end - start) | ((uint64_t)hasEscapes << 63);
+            return YES;
+        }
+        case 't':
+        case 'f':
+        case 'n': {
+            BOOL isLiteral = character == 't' ? AFJSONScannerScanLiteral(&scanner, "true", 4) : (character == 'f' ? AFJSONScannerScanLiteral(&scanner, "false", 5) : AFJSONScannerScanLiteral(&scanner, "null", 4));
+            if (!isLiteral || !AFJSONIsScalarTerminator(builder->bytes, builder->length, scanner.offset)) {
+                return AFJSONTapeBuilderFail(builder);
+            }
+            builder->position++;
+            AFJSONTapeBuilderAppend(builder, character, 0);
+            return YES;
+        }
+        default: {
+            AFJSONNumber number;
+            if (character != '-' && (character < '0' || character > '9')) {
+                return AFJSONTapeBuilderFail(builder);
+            }
+            if (!AFJSONScannerScanNumber(&scanner, &number) || !AFJSONIsScalarTerminator(builder->bytes, builder->length, scanner.offset)) {
+                return AFJSONTapeBuilderFail(builder);
+            }
+            builder->position++;
+            if (!number.isInteger) {
+                uint64_t bits;
+                memcpy(&bits, &number.doubleValue, sizeof(bits));
+                AFJSONTapeBuilderAppend(builder, 'd', 0);
+                builder->tape[builder->tapeLength++] = bits;
+            } else if (number.isUnsigned) {
+                AFJSONTapeBuilderAppend(builder, 'u', 0);
+                builder->tape[builder->tapeLength++] = number.unsignedValue;
+            } else {
+                AFJSONTapeBuilderAppend(builder, 'l', 0);
+                builder->tape[builder->tapeLength++] = (uint64_t)number.integerValue;
+            }
+            return YES;
+        }
+    }
+}
+
+static inline NSUInteger AFJSONTapeNextIndex(const uint64_t *tape, NSUInteger index) {
+    switch (tape[index] >> 56) {
+        case '{':
+        case '[':
+            return (NSUInteger)(uint32_t)tape[index];
+        case '"':
+        case 'l':
+        case 'u':
+        case 'd':
+            return index + 2;
+        default:
+            return index + 1;
+    }
+}
+
+static NSUInteger AFJSONTapeContainerCount(const uint64_t *tape, NSUInteger index) {
+    NSUInteger count = (NSUInteger)((tape[index] >> 32) & kAFJSONTapeCountMask);
+    if (count < kAFJSONTapeCountMask) {
+        return count;
+    }
+
+    //元素个数超出了payload的范围、逐个数
+    BOOL isObject = (tape[index] >> 56) == '{';
+    NSUInteger end = (NSUInteger)(uint32_t)tape[index] - 1;
+    count = 0;
+    for (NSUInteger idx = index + 1; idx < end; count++) {
+        idx = AFJSONTapeNextIndex(tape, isObject ? idx + 2 : idx);
+    }
+
+    return count;
+}
+
+static inline NSString * AFJSONTapeString(const uint8_t *bytes, const uint64_t *tape, NSUInteger index) {
+    uint64_t lengthWord = tape[index + 1];
+    return AFJSONStringWithBytes(bytes + (tape[index] & kAFJSONTapePayloadMask), (NSUInteger)(lengthWord & ~(1ULL << 63)), (BOOL)(lengthWord >> 63));
+}
+
+static id AFJSONTapeScalarObject(const uint8_t *bytes, const uint64_t *tape, NSUInteger index, NSJSONReadingOptions options, NSMutableSet *internedStrings) {
+    switch (tape[index] >> 56) {
+        case '"': {
+            NSString *string = AFJSONTapeString(bytes, tape, index);
+            if (options & NSJSONReadingMutableLeaves) {
+                return [string mutableCopy];
+            }
+            return (internedStrings && [string length] <= kAFJSONInternedStringMaximumLength) ? AFJSONInternedString(internedStrings, string) : string;
+        }
+        case 'l': {
+            NSNumber *cachedNumber = internedStrings ? AFJSONCachedNumber((long long)tape[index + 1]) : nil;
+            return cachedNumber ?: @((long long)tape[index + 1]);
+        }
+        case 'u':
+            return @((unsigned long long)tape[index + 1]);
+        case 'd': {
+            double value;
+            memcpy(&value, &tape[index + 1], sizeof(value));
+            return @(value);
+        }
+        case 't':
+            return @YES;
+        case 'f':
+            return @NO;
+        default:
+            return [NSNull null];
+    }
+}
+
+/*
+    由tape生成完整的Foundation对象
+    internedStrings不为nil时共享相同的key、短字符串和小整数
+    removesNullValues为YES时字典中值为null的项直接跳过、不需要生成后再遍历一遍
+ */
+static id AFJSONTapeObject(const uint8_t *bytes, const uint64_t *tape, NSUInteger index, NSJSONReadingOptions options, NSMutableSet *internedStrings, BOOL removesNullValues) {
+    uint64_t word = tape[index];
+    uint8_t type = (uint8_t)(word >> 56);
+    if (type != '{' && type != '[') {
+        return AFJSONTapeScalarObject(bytes, tape, index, options, internedStrings);
+    }
+
+    BOOL isMutable = (options & NSJSONReadingMutableContainers) != 0;
+    NSUInteger count = AFJSONTapeContainerCount(tape, index);
+    if (count == 0) {
+        if (type == '{') {
+            return isMutable ? [NSMutableDictionary dictionary] : @{};
+        }
+        return isMutable ? [NSMutableArray array] : @[];
+    }
+
+    NSUInteger end = (NSUInteger)(uint32_t)word - 1;
+    __strong id *objects = (__strong id *)calloc(count, sizeof(id));
+    id container = nil;
+    if (type == '{') {
+        __strong id <NSCopying> *keys = (__strong id <NSCopying> *)calloc(count, sizeof(id));
+        NSUInteger idx = 0;
+        for (NSUInteger tapeIndex = index + 1; tapeIndex < end; tapeIndex = AFJSONTapeNextIndex(tape, tapeIndex + 2)) {
+            if (removesNullValues && (tape[tapeIndex + 2] >> 56) == 'n') {
+                continue;
+            }
+            NSString *key = AFJSONTapeString(bytes, tape, tapeIndex);
+            keys[idx] = internedStrings ? AFJSONInternedString(internedStrings, key) : key;
+            objects[idx] = AFJSONTapeObject(bytes, tape, tapeIndex + 2, options, internedStrings, removesNullValues);
+            idx++;
+        }
+        container = isMutable ? [NSMutableDictionary dictionaryWithObjects:objects forKeys:keys count:idx] : [NSDictionary dictionaryWithObjects:objects forKeys:keys count:idx];
+        for (idx = 0; idx < count; idx++) {
+            keys[idx] = nil;
+        }
+        free(keys);
+    } else {
+        NSUInteger idx = 0;
+        for (NSUInteger tapeIndex = index + 1; tapeIndex < end; idx++) {
+            objects[idx] = AFJSONTapeObject(bytes, tape, tapeIndex, options, internedStrings, removesNullValues);
+            tapeIndex = AFJSONTapeNextIndex(tape, tapeIndex);
+        }
+        container = isMutable ? [NSMutableArray arrayWithObjects:objects count:count] : [NSArray arrayWithObjects:objects count:count];
+    }
+
+    for (NSUInteger idx = 0; idx < count; idx++) {
+        objects[idx] = nil;
+    }
+    free(objects);
+
+    return container;
+}
+
+#pragma mark -
+
+//懒加载对象共享的原始数据和tape
+@interface AFJSONTapeDocument : NSObject
+@property (readwrite, nonatomic, strong) NSData *data;
+@property (readwrite, nonatomic, strong) NSData *tapeData;
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, strong) NSMutableSet *internedStrings;//不为nil时访问到的key和值在整个文档内共享、由lock保护
+@property (readwrite, nonatomic, assign) BOOL removesNullValues;//字典中值为null的key不可见
+@end
+
+@implementation AFJSONTapeDocument
+@end
+
+static id AFJSONLazyObject(AFJSONTapeDocument *document, NSUInteger index);
+
+@interface AFJSONLazyDictionary : NSDictionary
+- (instancetype)initWithDocument:(AFJSONTapeDocument *)document tapeIndex:(NSUInteger)tapeIndex;
+@end
+
+@implementation AFJSONLazyDictionary {
+    AFJSONTapeDocument *_document;
+    NSUInteger _tapeIndex;
+    NSArray *_keys;
+    NSMutableDictionary *_materializedValues;
+}
+
+- (instancetype)initWithDocument:(AFJSONTapeDocument *)document tapeIndex:(NSUInteger)tapeIndex {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    _document = document;
+    _tapeIndex = tapeIndex;
+
+    return self;
+}
+
+//去重后的key、重复的key以最后一个为准
+- (NSArray *)keys {
+    [_document.lock lock];
+    if (!_keys) {
+        const uint8_t *bytes = [_document.data bytes];
+        const uint64_t *tape = [_document.tapeData bytes];
+        NSUInteger end = (NSUInteger)(uint32_t)tape[_tapeIndex] - 1;
+        NSMutableOrderedSet *keys = [NSMutableOrderedSet orderedSetWithCapacity:AFJSONTapeContainerCount(tape, _tapeIndex)];
+        NSMutableSet *internedStrings = _document.internedStrings;
+        for (NSUInteger tapeIndex = _tapeIndex + 1; tapeIndex < end; tapeIndex = AFJSONTapeNextIndex(tape, tapeIndex + 2)) {
+            NSString *key = AFJSONTapeString(bytes, tape, tapeIndex);
+            if (_document.removesNullValues && (tape[tapeIndex + 2] >> 56) == 'n') {
+                [keys removeObject:key];
+                continue;
+            }
+            [keys addObject:internedStrings ? AFJSONInternedString(internedStrings, key) : key];
+        }
+        _keys = [keys array];
+    }
+    NSArray *keys = _keys;
+    [_document.lock unlock];
+
+    return keys;
+}
+
+- (NSUInteger)count {
+    return [[self keys] count];
+}
+
+- (NSEnumerator *)keyEnumerator {
+    return [[self keys] objectEnumerator];
+}
+
+- (id)objectForKey:(id)aKey {
+    if (![aKey isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+
+    [_document.lock lock];
+    id value = _materializedValues[aKey];
+    [_document.lock unlock];
+    if (value) {
+        return value;
+    }
+
+    //直接比较原始字节、不需要生成key的字符串
+    const uint8_t *bytes = [_document.data bytes];
+    const uint64_t *tape = [_document.tapeData bytes];
+    const char *keyBytes = [(NSString *)aKey UTF8String];
+    NSUInteger keyLength = strlen(keyBytes);
+    NSUInteger end = (NSUInteger)(uint32_t)tape[_tapeIndex] - 1;
+    NSUInteger valueIndex = NSNotFound;
+    for (NSUInteger tapeIndex = _tapeIndex + 1; tapeIndex < end; tapeIndex = AFJSONTapeNextIndex(tape, tapeIndex + 2)) {
+        uint64_t lengthWord = tape[tapeIndex + 1];
+        if (lengthWord >> 63) {
+            if ([AFJSONTapeString(bytes, tape, tapeIndex) isEqualToString:aKey]) {
+                valueIndex = tapeIndex + 2;
+            }
+        } else if ((NSUInteger)lengthWord == keyLength && memcmp(bytes + (tape[tapeIndex] & kAFJSONTapePayloadMask), keyBytes, keyLength) == 0) {
+            valueIndex = tapeIndex + 2;
+        }
+    }
+    if (valueIndex == NSNotFound || (_document.removesNullValues && (tape[valueIndex] >> 56) == 'n')) {
+        return nil;
+    }
+
+    value = AFJSONLazyObject(_document, valueIndex);
+
+    [_document.lock lock];
+    if (!_materializedValues) {
+        _materializedValues = [NSMutableDictionary dictionary];
+    }
+    id existingValue = _materializedValues[aKey];
+    if (existingValue) {
+        value = existingValue;
+    } else {
+        _materializedValues[aKey] = value;
+    }
+    [_document.lock unlock];
+
+    return value;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+@end
+
+@interface AFJSONLazyArray : NSArray
+- (instancetype)initWithDocument:(AFJSONTapeDocument *)document tapeIndex:(NSUInteger)tapeIndex;
+@end
+
+@implementation AFJSONLazyArray {
+    AFJSONTapeDocument *_document;
+    NSUInteger _tapeIndex;
+    NSUInteger _count;
+    NSUInteger *_elementIndices;
+    NSPointerArray *_materializedElements;
+}
+
+- (instancetype)initWithDocument:(AFJSONTapeDocument *)document tapeIndex:(NSUInteger)tapeIndex {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    _document = document;
+    _tapeIndex = tapeIndex;
+    _count = AFJSONTapeContainerCount([document.tapeData bytes], tapeIndex);
+
+    return self;
+}
+
+- (void)dealloc {
+    free(_elementIndices);
+}
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"index %lu beyond bounds (count %lu)", (unsigned long)index, (unsigned long)_count];
+    }
+
+    [_document.lock lock];
+    //第一次访问时记录每个元素在tape中的位置
+    if (!_elementIndices) {
+        const uint64_t *tape = [_document.tapeData bytes];
+        _elementIndices = malloc(_count * sizeof(NSUInteger));
+        NSUInteger tapeIndex = _tapeIndex + 1;
+        for (NSUInteger idx = 0; idx < _count; idx++) {
+            _elementIndices[idx] = tapeIndex;
+            tapeIndex = AFJSONTapeNextIndex(tape, tapeIndex);
+        }
+        _materializedElements = [NSPointerArray strongObjectsPointerArray];
+        _materializedElements.count = _count;
+    }
+    id element = (__bridge id)[_materializedElements pointerAtIndex:index];
+    NSUInteger elementIndex = _elementIndices[index];
+    [_document.lock unlock];
+    if (element) {
+        return element;
+    }
+
+    element = AFJSONLazyObject(_document, elementIndex);
+
+    [_document.lock lock];
+    id existingElement = (__bridge id)[_materializedElements pointerAtIndex:index];
+    if (existingElement) {
+        element = existingElement;
+    } else {
+        [_materializedElements replacePointerAtIndex:index withPointer:(__bridge void *)element];
+    }
+    [_document.lock unlock];
+
+    return element;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+@end
+
+static id AFJSONLazyObject(AFJSONTapeDocument *document, NSUInteger index) {
+    const uint64_t *tape = [document.tapeData bytes];
+    switch (tape[index] >> 56) {
+        case '{':
+            return [[AFJSONLazyDictionary alloc] initWithDocument:document tapeIndex:index];
+        case '[':
+            return [[AFJSONLazyArray alloc] initWithDocument:document tapeIndex:index];
+        default: {
+            if (!document.internedStrings) {
+                return AFJSONTapeScalarObject([document.data bytes], tape, index, 0, nil);
+            }
+            [document.lock lock];
+            id object = AFJSONTapeScalarObject([document.data bytes], tape, index, 0, document.internedStrings);
+            [document.lock unlock];
+            return object;
+        }
+    }
+}
+
+#pragma mark -
+
+static NSError * AFJSONParserErrorAtOffset(NSUInteger offset) {
+    return [NSError errorWithDomain:AFURLResponseSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedStringFromTable(@"Invalid JSON data around byte %lu", @"AFNetworking", nil), (unsigned long)offset]}];
+}
+
+@implementation AFStructuralIndexJSONParser
+
++ (instancetype)parser {
+    return [[self alloc] init];
+}
+
+- (id)JSONObjectWithData:(NSData *)data
+                 options:(NSJSONReadingOptions)options
+                   error:(NSError *__autoreleasing *)error
+{
+    return [self JSONObjectWithData:data options:options internsStrings:self.internsStrings removesKeysWithNullValues:NO error:error];
+}
+
+- (id)JSONObjectWithData:(NSData *)data
+                 options:(NSJSONReadingOptions)options
+          internsStrings:(BOOL)internsStrings
+removesKeysWithNullValues:(BOOL)removesKeysWithNullValues
+                   error:(NSError *__autoreleasing *)error
+{
+    const uint8_t *bytes = [data bytes];
+    NSUInteger length = [data length];
+
+    //UTF-8 BOM
+    if (length >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf) {
+        data = [data subdataWithRange:NSMakeRange(3, length - 3)];
+        bytes = [data bytes];
+        length = [data length];
+    }
+
+    //JSON以ASCII字符开头、前两个字节中有0或者是UTF-16的BOM说明不是UTF-8
+    BOOL isUTF8 = length < 2 || (bytes[0] != 0 && bytes[1] != 0 && !(bytes[0] == 0xfe && bytes[1] == 0xff) && !(bytes[0] == 0xff && bytes[1] == 0xfe));
+    //tape中容器的结束位置只有32位
+    if (!isUTF8 || length > UINT32_MAX / 2) {
+        return [NSJSONSerialization JSONObjectWithData:data options:options error:error];
+    }
+
+    NSUInteger errorOffset = 0;
+    NSData *stringEndsData = nil;
+    NSData *indicesData = AFJSONFindStructuralIndices(bytes, length, &stringEndsData, &errorOffset);
+    if (!indicesData) {
+        if (error) {
+            *error = AFJSONParserErrorAtOffset(errorOffset);
+        }
+        return nil;
+    }
+
+    //每个结构索引最多对应两项
+    NSUInteger indexCount = [indicesData length] / sizeof(uint32_t);
+    NSMutableData *tapeData = [NSMutableData dataWithLength:(indexCount * 2 + 2) * sizeof(uint64_t)];
+
+    AFJSONTapeBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.bytes = bytes;
+    builder.length = length;
+    builder.indices = [indicesData bytes];
+    builder.indexCount = indexCount;
+    builder.stringEnds = [stringEndsData bytes];
+    builder.stringCount = [stringEndsData length] / sizeof(uint64_t);
+    builder.tape = [tapeData mutableBytes];
+    builder.errorOffset = NSNotFound;
+
+    BOOL succeeded = AFJSONTapeBuilderParseValue(&builder);
+    if (succeeded && builder.position != indexCount) {
+        succeeded = AFJSONTapeBuilderFail(&builder);
+    }
+    if (!succeeded) {
+        if (error) {
+            *error = AFJSONParserErrorAtOffset(builder.errorOffset != NSNotFound ? builder.errorOffset : length);
+        }
+        return nil;
+    }
+
+    uint8_t rootType = (uint8_t)(builder.tape[0] >> 56);
+    if (rootType != '{' && rootType != '[' && !(options & NSJSONReadingAllowFragments)) {
+        if (error) {
+            *error = [NSError errorWithDomain:AFURLResponseSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:@{NSLocalizedDescriptionKey: NSLocalizedStringFromTable(@"JSON text did not start with array or object and option to allow fragments not set.", @"AFNetworking", nil)}];
+        }
+        return nil;
+    }
+
+    if (self.producesLazyObjects) {
+        AFJSONTapeDocument *document = [[AFJSONTapeDocument alloc] init];
+        document.data = data;
+        [tapeData setLength:builder.tapeLength * sizeof(uint64_t)];
+        document.tapeData = tapeData;
+        document.lock = [[NSLock alloc] init];
+        document.internedStrings = internsStrings ? [NSMutableSet set] : nil;
+        document.removesNullValues = removesKeysWithNullValues;
+        return AFJSONLazyObject(document, 0);
+    }
+
+    return AFJSONTapeObject(bytes, builder.tape, 0, options, internsStrings ? [NSMutableSet set] : nil, removesKeysWithNullValues);
+}
+
+@end
+
+#pragma mark -
+
+@implementation AFXMLParserResponseSerializer
+
++ (instancetype)serializer {
+    AFXMLParserResponseSerializer *serializer = [[self alloc] init];
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/xml", @"text/xml", nil];
+
+    return self;
+}
+
+#pragma mark - AFURLResponseSerialization
+//XML解析
+- (id)responseObjectForResponse:(NSHTTPURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    //看看能不能解析
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    //返回XML对象
+    return [[NSXMLParser alloc] initWithData:data];
+}
+
+@end
+
+#pragma mark - AFXMLStreamingResponseSerializer
+
+@interface AFXMLElement ()
+@property (readwrite, nonatomic, copy) NSString *name;
+@property (readwrite, nonatomic, copy) NSString *namespaceURI;
+@property (readwrite, nonatomic, copy) NSDictionary <NSString *, NSString *> *attributes;
+@property (readwrite, nonatomic, strong) NSMutableString *mutableText;
+@property (readwrite, nonatomic, strong) NSMutableArray <AFXMLElement *> *mutableChildren;
+@end
+
+@implementation AFXMLElement
+
+- (NSString *)text {
+    return [self.mutableText copy] ?: @"";
+}
+
+- (NSArray <AFXMLElement *> *)children {
+    return [self.mutableChildren copy] ?: @[];
+}
+
+- (AFXMLElement *)firstChildNamed:(NSString *)name {
+    for (AFXMLElement *child in self.mutableChildren) {
+        if ([child.name isEqualToString:name]) {
+            return child;
+        }
+    }
+
+    return nil;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p, name: %@, attributes: %@, children: %lu>", NSStringFromClass([self class]), self, self.name, self.attributes, (unsigned long)[self.mutableChildren count]];
+}
+
+@end
+
+//每个响应一个实例、持有libxml2的push parser
+@interface AFXMLStreamingParser : NSObject <AFURLResponseIncrementalParsing> {
+    xmlParserCtxtPtr _context;
+}
+@property (readwrite, nonatomic, copy) NSArray <NSArray <NSString *> *> *matchingPathComponents;
+@property (readwrite, nonatomic, copy) void (^elementHandler)(AFXMLElement *element);
+@property (readwrite, nonatomic, copy) void (^didStartElementHandler)(NSString *path, NSString *name, NSDictionary <NSString *, NSString *> *attributes);
+@property (readwrite, nonatomic, copy) void (^didEndElementHandler)(NSString *path, NSString *name);
+@property (readwrite, nonatomic, strong) NSMutableArray <NSString *> *pathComponents;
+@property (readwrite, nonatomic, strong) NSMutableString *path;
+@property (readwrite, nonatomic, strong) NSMutableArray <NSNumber *> *pathLengths;
+@property (readwrite, nonatomic, strong) NSMutableArray <AFXMLElement *> *elementStack;//正在生成的匹配元素
+@property (readwrite, nonatomic, strong) NSMutableArray <AFXMLElement *> *matchedElements;
+@property (readwrite, nonatomic, strong) NSURLResponse *response;
+@property (readwrite, nonatomic, strong) NSData *lastData;
+@property (readwrite, nonatomic, strong) NSMutableData *failingData;//出错的那段数据和之后收到的数据、放进错误信息
+@property (readwrite, nonatomic, strong) NSError *error;
+@property (readwrite, nonatomic, assign) BOOL finished;
+- (void)didStartElement:(NSString *)name namespaceURI:(NSString *)namespaceURI attributes:(NSDictionary *)attributes;
+- (void)didEndElement;
+- (void)foundCharacters:(const xmlChar *)characters length:(int)length;
+@end
+
+static NSString * AFXMLQualifiedName(const xmlChar *localname, const xmlChar *prefix) {
+    NSString *name = [NSString stringWithUTF8String:(const char *)localname] ?: @"";
+    if (prefix) {
+        //%s按系统编码解释字节、非ASCII的名字会乱码
+        NSString *prefixString = [NSString stringWithUTF8String:(const char *)prefix] ?: @"";
+        return [[prefixString stringByAppendingString:@":"] stringByAppendingString:name];
+    }
+
+    return name;
+}
+
+static void AFXMLStreamingParserStartElement(void *context, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, __unused int namespaceCount, __unused const xmlChar **namespaces, int attributeCount, __unused int defaultedAttributeCount, const xmlChar **attributes) {
+    AFXMLStreamingParser *parser = (__bridge AFXMLStreamingParser *)context;
+
+    //每个属性为5项: localname、prefix、URI、value开始、value结束
+    NSMutableDictionary *mutableAttributes = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)MAX(attributeCount, 0)];
+    for (int idx = 0; idx < attributeCount; idx++) {
+        const xmlChar **attribute = attributes + idx * 5;
+        NSString *value = [[NSString alloc] initWithBytes:attribute[3] length:(NSUInteger)(attribute[4] - attribute[3]) encoding:NSUTF8StringEncoding] ?: @"";
+        //不替换实体时libxml2会把属性值中的'&'保留为字符引用
+        if ([value rangeOfString:@"&#38;"].location != NSNotFound) {
+            value = [value stringByReplacingOccurrencesOfString:@"&#38;" withString:@"&"];
+        }
+        mutableAttributes[AFXMLQualifiedName(attribute[0], attribute[1])] = value;
+    }
+
+    [parser didStartElement:AFXMLQualifiedName(localname, prefix) namespaceURI:URI ? @((const char *)URI) : nil attributes:mutableAttributes];
+}
+
+static void AFXMLStreamingParserEndElement(void *context, __unused const xmlChar *localname, __unused const xmlChar *prefix, __unused const xmlChar *URI) {
+    [(__bridge AFXMLStreamingParser *)context didEndElement];
+}
+
+static void AFXMLStreamingParserCharacters(void *context, const xmlChar *characters, int length) {
+    [(__bridge AFXMLStreamingParser *)context foundCharacters:characters length:length];
+}
+
+//错误在xmlParseChunk返回后统一处理、不输出到stderr
+static void AFXMLStreamingParserIgnoreMessage(__unused void *context, __unused const char *message, ...) {
+}
+
+//出错后最多保留的数据长度、之后的数据直接丢弃
+static NSUInteger const AFXMLStreamingParserMaximumFailingDataLength = 64 * 1024;
+
+@implementation AFXMLStreamingParser
+
+- (instancetype)initWithSerializer:(AFXMLStreamingResponseSerializer *)serializer response:(NSURLResponse *)response {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.response = response;
+
+    NSMutableArray *matchingPathComponents = [NSMutableArray arrayWithCapacity:[serializer.matchingPaths count]];
+    for (NSString *matchingPath in serializer.matchingPaths) {
+        NSMutableArray *components = [[matchingPath componentsSeparatedByString:@"/"] mutableCopy];
+        [components removeObject:@""];
+        if ([components count] > 0) {
+            [matchingPathComponents addObject:components];
+        }
+    }
+    self.matchingPathComponents = matchingPathComponents;
+    self.elementHandler = serializer.elementHandler;
+    self.didStartElementHandler = serializer.didStartElementHandler;
+    self.didEndElementHandler = serializer.didEndElementHandler;
+
+    self.pathComponents = [NSMutableArray array];
+    self.path = [NSMutableString string];
+    self.pathLengths = [NSMutableArray array];
+    self.elementStack = [NSMutableArray array];
+    self.matchedElements = [NSMutableArray array];
+
+    xmlSAXHandler handler;
+    memset(&handler, 0, sizeof(handler));
+    handler.initialized = XML_SAX2_MAGIC;
+    handler.startElementNs = AFXMLStreamingParserStartElement;
+    handler.endElementNs = AFXMLStreamingParserEndElement;
+    handler.characters = AFXMLStreamingParserCharacters;
+    handler.cdataBlock = AFXMLStreamingParserCharacters;
+    handler.warning = AFXMLStreamingParserIgnoreMessage;
+    handler.error = AFXMLStreamingParserIgnoreMessage;
+    handler.fatalError = AFXMLStreamingParserIgnoreMessage;
+
+    _context = xmlCreatePushParserCtxt(&handler, (__bridge void *)self, NULL, 0, NULL);
+    //不访问网络、不展开外部实体
+    xmlCtxtUseOptions(_context, XML_PARSE_NONET);
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_context) {
+        xmlFreeParserCtxt(_context);
+    }
+}
+
+- (BOOL)matchesPathComponents {
+    NSUInteger depth = [self.pathComponents count];
+    for (NSArray <NSString *> *components in self.matchingPathComponents) {
+        if ([components count] != depth) {
+            continue;
+        }
+
+        BOOL matches = YES;
+        //从最后一级开始比较、最容易不同
+        for (NSUInteger idx = depth; idx > 0 && matches; idx--) {
+            NSString *component = components[idx - 1];
+            matches = [component isEqualToString:@"*"] || [component isEqualToString:self.pathComponents[idx - 1]];
+        }
+        if (matches) {
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+- (void)didStartElement:(NSString *)name namespaceURI:(NSString *)namespaceURI attributes:(NSDictionary *)attributes {
+    [self.pathComponents addObject:name];
+    [self.pathLengths addObject:@([self.path length])];
+    [self.path appendFormat:@"/%@", name];
+
+    if (self.didStartElementHandler) {
+        self.didStartElementHandler([self.path copy], name, attributes);
+    }
+
+    //已经在匹配的元素内、或者当前元素匹配时才生成元素
+    if ([self.elementStack count] > 0 || [self matchesPathComponents]) {
+        AFXMLElement *element = [[AFXMLElement alloc] init];
+        element.name = name;
+        element.namespaceURI = namespaceURI;
+        element.attributes = attributes;
+        AFXMLElement *parent = [self.elementStack lastObject];
+        if (parent) {
+            if (!parent.mutableChildren) {
+                parent.mutableChildren = [NSMutableArray array];
+            }
+            [parent.mutableChildren addObject:element];
+        }
+        [self.elementStack addObject:element];
+    }
+}
+
+- (void)didEndElement {
+    NSString *name = [self.pathComponents lastObject];
+    if (self.didEndElementHandler) {
+        self.didEndElementHandler([self.path copy], name);
+    }
+
+    [self.path deleteCharactersInRange:NSMakeRange([[self.pathLengths lastObject] unsignedIntegerValue], [self.path length] - [[self.pathLengths lastObject] unsignedIntegerValue])];
+    [self.pathLengths removeLastObject];
+    [self.pathComponents removeLastObject];
+
+    AFXMLElement *element = [self.elementStack lastObject];
+    if (!element) {
+        return;
+    }
+    [self.elementStack removeLastObject];
+
+    //匹配的元素完整解析后交出去、不再保留
+    if ([self.elementStack count] == 0) {
+        if (self.elementHandler) {
+            self.elementHandler(element);
+        } else {
+            [self.matchedElements addObject:element];
+        }
+    }
+}
+
+- (void)foundCharacters:(const xmlChar *)characters length:(int)length {
+    //匹配元素之外的文本直接丢弃
+    AFXMLElement *element = [self.elementStack lastObject];
+    if (!element || length <= 0) {
+        return;
+    }
+
+    NSString *text = [[NSString alloc] initWithBytes:characters length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    if (!text) {
+        return;
+    }
+    if (!element.mutableText) {
+        element.mutableText = [NSMutableString string];
+    }
+    [element.mutableText appendString:text];
+}
+
+- (void)parseBytes:(const char *)bytes length:(NSUInteger)length terminate:(BOOL)terminate {
+    if (self.error || !_context) {
+        return;
+    }
+
+    //xmlParseChunk的长度为int
+    do {
+        int chunkLength = (int)MIN(length, (NSUInteger)(1 << 20));
+        BOOL isLastChunk = terminate && (NSUInteger)chunkLength == length;
+        if (xmlParseChunk(_context, bytes, chunkLength, isLastChunk ? 1 : 0) != 0) {
+            const xmlError *lastError = xmlCtxtGetLastError(_context);
+            NSString *message = lastError && lastError->message ? [@(lastError->message) stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] : @"";
+            NSDictionary *userInfo = @{
+                                       NSLocalizedDescriptionKey: NSLocalizedStringFromTable(@"Invalid XML data", @"AFNetworking", nil),
+                                       NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:NSLocalizedStringFromTable(@"%@ (line %d)", @"AFNetworking", nil), message, lastError ? lastError->line : 0],
+                                       };
+            self.error = [NSError errorWithDomain:AFURLResponseSerializationErrorDomain code:NSURLErrorCannotDecodeContentData userInfo:userInfo];
+            return;
+        }
+        bytes += chunkLength;
+        length -= (NSUInteger)chunkLength;
+    } while (length > 0);
+}
+
+- (void)appendFailingData:(NSData *)data {
+    if (!self.failingData) {
+        self.failingData = [NSMutableData data];
+    }
+    if ([self.failingData length] < AFXMLStreamingParserMaximumFailingDataLength) {
+        [self.failingData appendData:[data subdataWithRange:NSMakeRange(0, MIN([data length], AFXMLStreamingParserMaximumFailingDataLength - [self.failingData length]))]];
+    }
+}
+
+#pragma mark - AFURLResponseIncrementalParsing
+
+- (void)appendData:(NSData *)data {
+    if (self.error) {
+        [self appendFailingData:data];
+        return;
+    }
+
+    self.lastData = data;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        [self parseBytes:bytes length:byteRange.length terminate:NO];
+        *stop = self.error != nil;
+    }];
+    if (self.error) {
+        [self appendFailingData:data];
+    }
+}
+
+- (id)finishParsingWithError:(NSError *__autoreleasing *)error {
+    if (!self.finished) {
+        self.finished = YES;
+        [self parseBytes:NULL length:0 terminate:YES];
+        //文档不完整时在结束时才出错、出错的位置在最后一段数据的末尾
+        if (self.error && !self.failingData && self.lastData) {
+            NSUInteger length = MIN([self.lastData length], AFXMLStreamingParserMaximumFailingDataLength);
+            [self appendFailingData:[self.lastData subdataWithRange:NSMakeRange([self.lastData length] - length, length)]];
+        }
+        self.lastData = nil;
+    }
+
+    if (self.error) {
+        if (error) {
+            //和其他序列化器一样带上响应和数据、增量解析时没有完整的数据、只带出错位置附近的一段
+            NSMutableDictionary *mutableUserInfo = [self.error.userInfo mutableCopy];
+            if (self.response) {
+                mutableUserInfo[AFNetworkingOperationFailingURLResponseErrorKey] = self.response;
+            }
+            if (self.failingData) {
+                mutableUserInfo[AFNetworkingOperationFailingURLResponseDataErrorKey] = [self.failingData copy];
+            }
+            *error = [NSError errorWithDomain:self.error.domain code:self.error.code userInfo:mutableUserInfo];
+        }
+        return nil;
+    }
+
+    return self.elementHandler ? nil : [self.matchedElements copy];
+}
+
+@end
+
+@implementation AFXMLStreamingResponseSerializer
+
++ (instancetype)serializer {
+    return [self serializerWithMatchingPaths:nil];
+}
+
++ (instancetype)serializerWithMatchingPaths:(NSSet <NSString *> *)matchingPaths {
+    AFXMLStreamingResponseSerializer *serializer = [[self alloc] init];
+    serializer.matchingPaths = matchingPaths;
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/xml", @"text/xml", nil];
+
+    return self;
+}
+
+#pragma mark - AFURLResponseIncrementalSerialization
+
+- (id <AFURLResponseIncrementalParsing>)incrementalParserForResponse:(NSURLResponse *)response {
+    //不符合的响应交给-responseObjectForResponse:data:error:生成错误
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:nil error:nil]) {
+        return nil;
+    }
+
+    return [[AFXMLStreamingParser alloc] initWithSerializer:self response:response];
+}
+
+#pragma mark - AFURLResponseSerialization
+
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    if ([data length] == 0) {
+        return nil;
+    }
+
+    //整体数据也按流式解析、结果与边接收边解析一致
+    AFXMLStreamingParser *parser = [[AFXMLStreamingParser alloc] initWithSerializer:self response:response];
+    [parser appendData:data];
+
+    NSError *serializationError = nil;
+    id responseObject = [parser finishParsingWithError:&serializationError];
+    //整体解析时有完整的数据
+    if (serializationError) {
+        NSMutableDictionary *mutableUserInfo = [serializationError.userInfo mutableCopy];
+        mutableUserInfo[AFNetworkingOperationFailingURLResponseDataErrorKey] = data;
+        serializationError = [NSError errorWithDomain:serializationError.domain code:serializationError.code userInfo:mutableUserInfo];
+    }
+
+    if (error) {
+        *error = AFErrorWithUnderlyingError(serializationError, *error);
+    }
+
+    return responseObject;
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    self.matchingPaths = [decoder decodeObjectOfClasses:[NSSet setWithObjects:[NSSet class], [NSString class], nil] forKey:NSStringFromSelector(@selector(matchingPaths))];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeObject:self.matchingPaths forKey:NSStringFromSelector(@selector(matchingPaths))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFXMLStreamingResponseSerializer *serializer = [super copyWithZone:zone];
+    serializer.matchingPaths = self.matchingPaths;
+    serializer.elementHandler = self.elementHandler;
+    serializer.didStartElementHandler = self.didStartElementHandler;
+    serializer.didEndElementHandler = self.didEndElementHandler;
+
+    return serializer;
+}
+
+@end
+
+#pragma mark -
+
+#ifdef __MAC_OS_X_VERSION_MIN_REQUIRED
+
+@implementation AFXMLDocumentResponseSerializer
+
++ (instancetype)serializer {
+    return [self serializerWithXMLDocumentOptions:0];
+}
+
++ (instancetype)serializerWithXMLDocumentOptions:(NSUInteger)mask {
+    AFXMLDocumentResponseSerializer *serializer = [[self alloc] init];
+    serializer.options = mask;
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/xml", @"text/xml", nil];
+
+    return self;
+}
+
+#pragma mark - AFURLResponseSerialization
+//XML解析 formac
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    NSError *serializationError = nil;
+    NSXMLDocument *document = [[NSXMLDocument alloc] initWithData:data options:self.options error:&serializationError];
+
+    if (error) {
+        *error = AFErrorWithUnderlyingError(serializationError, *error);
+    }
+
+    return document;
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    self.options = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(options))] unsignedIntegerValue];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeObject:@(self.options) forKey:NSStringFromSelector(@selector(options))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFXMLDocumentResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
+    serializer.options = self.options;
+
+    return serializer;
+}
+
+@end
+
+#endif
+
+#pragma mark -
+
+@implementation AFPropertyListResponseSerializer
+
++ (instancetype)serializer {
+    return [self serializerWithFormat:NSPropertyListXMLFormat_v1_0 readOptions:0];
+}
+
++ (instancetype)serializerWithFormat:(NSPropertyListFormat)format
+                         readOptions:(NSPropertyListReadOptions)readOptions
+{
+    AFPropertyListResponseSerializer *serializer = [[self alloc] init];
+    serializer.format = format;
+    serializer.readOptions = readOptions;
+
+    return serializer;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.acceptableContentTypes = [[NSSet alloc] initWithObjects:@"application/x-plist", nil];
+
+    return self;
+}
+
+#pragma mark - AFURLResponseSerialization
+//PList 序列化
+- (id)responseObjectForResponse:(NSURLResponse *)response
+                           data:(NSData *)data
+                          error:(NSError *__autoreleasing *)error
+{
+    if (![self validateResponse:(NSHTTPURLResponse *)response data:data error:error]) {
+        if (!error || AFErrorOrUnderlyingErrorHasCodeInDomain(*error, NSURLErrorCannotDecodeContentData, AFURLResponseSerializationErrorDomain)) {
+            return nil;
+        }
+    }
+
+    id responseObject;
+    NSError *serializationError = nil;
+
+    if (data) {
+        //转化成NSPropertyListSerialization对象
+        responseObject = [NSPropertyListSerialization propertyListWithData:data options:self.readOptions format:NULL error:&serializationError];
+    }
+
+    if (error) {
+        *error = AFErrorWithUnderlyingError(serializationError, *error);
+    }
+
+    return responseObject;
+}
+
+#pragma mark - NSSecureCoding
+
+- (instancetype)initWithCoder:(NSCoder *)decoder {
+    self = [super initWithCoder:decoder];
+    if (!self) {
+        return nil;
+    }
+
+    self.format = (NSPropertyListFormat)[[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(format))] unsignedIntegerValue];
+    self.readOptions = [[decoder decodeObjectOfClass:[NSNumber class] forKey:NSStringFromSelector(@selector(readOptions))] unsignedIntegerValue];
+
+    return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+    [super encodeWithCoder:coder];
+
+    [coder encodeObject:@(self.format) forKey:NSStringFromSelector(@selector(format))];
+    [coder encodeObject:@(self.readOptions) forKey:NSStringFromSelector(@selector(readOptions))];
+}
+
+#pragma mark - NSCopying
+
+- (instancetype)copyWithZone:(NSZone *)zone {
+    AFPropertyListResponseSerializer *serializer = [[[self class] allocWithZone:zone] init];
+    serializer.format = self.format;
+    serializer.readOptions = self.readOptions;
+
+    return serializer;
+}
+
+@end
+
+#pragma mark -
+
+#if TARGET_OS_IOS || TARGET_OS_TV || TARGET_OS_WATCH
+#import <CoreGraphics/CoreGraphics.h>
+#import <UIKit/UIKit.h>
+
+/**
+    AFN对于图片解析的类别
+ */
+@interface UIImage (AFNetworkingSafeImageLoading)
+
++ (UIImage *)af_safeImageWithData:(NSData *)data;
+@end
+
+static NSLock* imageLock = nil;
+
+@implementation UIImage (AFNetworkingSafeImageLoading)
+
++ (UIImage *)af_safeImageWithData:(NSData *)data {
+    UIImage* image = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        imageLock = [[NSLock alloc] init];
+    });
+    
+    [imageLock lock];
+    //保证data在使用过程中不会被修改
+    image = [UIImage imageWithData:data];
+    [imageLock unlock];
+    return image;
+}
+
+@end
+
+#pragma mark -
+
+//最小的内存分级 16KB
+static size_t const AFImageBitmapBufferMinimumSizeClass = 16 * 1024;
+
+//将申请的大小向上取整到所属的分级
+//每个2的幂次区间再四等分、这样取整后浪费的内存不超过25%
+static size_t AFImageBitmapBufferSizeClass(size_t length) {
+    if (length <= AFImageBitmapBufferMinimumSizeClass) {
+        return AFImageBitmapBufferMinimumSizeClass;
+    }
+
+    size_t power = AFImageBitmapBufferMinimumSizeClass;
+    while (power * 2 < length) {
+        power *= 2;
+    }
+
+    size_t step = power / 4;
+    return power + ((length - power + step - 1) / step) * step;
+}
+
+@interface AFImageBitmapBufferPool ()
+@property (nonatomic, strong) NSMutableDictionary <NSNumber *, NSMutableArray <NSMutableData *> *> *freeBuffers;
+@property (readwrite, nonatomic, assign) NSUInteger pooledBytes;
+@property (nonatomic, strong) NSLock *lock;
+
+- (NSMutableData *)checkoutBufferWithLength:(size_t)length reused:(BOOL *)reused;
+- (void)checkinBuffer:(NSMutableData *)buffer;
+@end
+
+//从池中借出的一块内存、作为CGDataProvider的info、图片释放时归还
+@interface AFImageBitmapBufferLease : NSObject
+@property (nonatomic, strong) AFImageBitmapBufferPool *pool;
+@property (nonatomic, strong) NSMutableData *buffer;
+@end
+
+@implementation AFImageBitmapBufferLease
+@end
+
+@implementation AFImageBitmapBufferPool
+
++ (instancetype)sharedPool {
+    static AFImageBitmapBufferPool *_sharedPool = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _sharedPool = [[self alloc] init];
+    });
+
+    return _sharedPool;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.maximumPooledBytes = 20 * 1024 * 1024;
+    self.freeBuffers = [[NSMutableDictionary alloc] init];
+    self.lock = [[NSLock alloc] init];
+    self.lock.name = @"com.alamofire.imagebitmapbufferpool.lock";
+
+#if TARGET_OS_IOS || TARGET_OS_TV
+    //内存警告时清空
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(trim)
+                                                 name:UIApplicationDidReceiveMemoryWarningNotification
+                                               object:nil];
+#endif
+
+    return self;
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (NSUInteger)pooledBytes {
+    [self.lock lock];
+    NSUInteger pooledBytes = _pooledBytes;
+    [self.lock unlock];
+
+    return pooledBytes;
+}
+
+- (NSMutableData *)checkoutBufferWithLength:(size_t)length reused:(BOOL *)reused {
+    NSNumber *sizeClass = @(AFImageBitmapBufferSizeClass(length));
+
+    [self.lock lock];
+    NSMutableArray <NSMutableData *> *buffers = self.freeBuffers[sizeClass];
+    NSMutableData *buffer = [buffers lastObject];
+    if (buffer) {
+        [buffers removeLastObject];
+        _pooledBytes -= buffer.length;
+    }
+    [self.lock unlock];
+
+    if (reused) {
+        *reused = (buffer != nil);
+    }
+
+    //池中没有同级的空闲内存、重新申请
+    return buffer ?: [[NSMutableData alloc] initWithLength:[sizeClass unsignedIntegerValue]];
+}
+
+- (void)checkinBuffer:(NSMutableData *)buffer {
+    [self.lock lock];
+    //超出上限的直接释放
+    if (_pooledBytes + buffer.length <= self.maximumPooledBytes) {
+        NSNumber *sizeClass = @(buffer.length);
+        NSMutableArray <NSMutableData *> *buffers = self.freeBuffers[sizeClass];
+        if (!buffers) {
+            buffers = [[NSMutableArray alloc] init];
+            self.freeBuffers[sizeClass] = buffers;
+        }
+        [buffers addObject:buffer];
+        _pooledBytes += buffer.length;
+    }
+    [self.lock unlock];
+}
+
+- (void)trim {
+    [self.lock lock];
+    [self.freeBuffers removeAllObjects];
+    _pooledBytes = 0;
+    [self.lock unlock];
+}
+
+@end
+
+//CGDataProvider释放时(也就是图片被释放时)、把内存归还到池中
+static void AFImageBitmapBufferLeaseRelease(void *info, __unused const void *data, __unused size_t size) {
+    AFImageBitmapBufferLease *lease = (__bridge_transfer AFImageBitmapBufferLease *)info;
+    [lease.pool checkinBuffer:lease.buffer];
+}
+
+//用data生成指定比例的图片
+static UIImage * AFImageWithDataAtScale(NSData *data, CGFloat scale) {
+    UIImage *image = [UIImage af_safeImageWithData:data];
+    if (image.images) {
+        return image;
+    }
+    
+    return [[UIImage alloc] initWithCGImage:[image CGImage] scale:scale orientation:image.imageOrientation];
+}
+
+//自动解压
+/*
+    这里返回的UIImage是含有bitmap数据的(因为通过解压出的bitmap绘制出的CGImage)
+    bitmap的作用在于在将UIImage交付给UIImageView的时候。如果没有bitmap将会自动解压一次。
     在这里提前解压了、也就不会再主线程做出解压的操作
  */
-static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *response, NSData *data, CGFloat scale) {
+static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *response, NSData *data, CGFloat scale, AFImageBitmapBufferPool *bufferPool) {
     if (!data || [data length] == 0) {
         return nil;
     }
@@ -698,20 +3897,55 @@ static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *r
 #pragma clang diagnostic pop
     }
 
-    CGContextRef context = CGBitmapContextCreate(NULL, width, height, bitsPerComponent, bytesPerRow, colorSpace, bitmapInfo);
+    //从内存池中取出像素内存(RGB + alpha/skip 共4个8位分量)
+    NSMutableData *buffer = nil;
+    BOOL bufferReused = NO;
+    if (bufferPool && bitsPerComponent == 8 && colorSpaceModel == kCGColorSpaceModelRGB) {
+        bytesPerRow = (width * 4 + 63) & ~(size_t)63;
+        buffer = [bufferPool checkoutBufferWithLength:bytesPerRow * height reused:&bufferReused];
+    }
 
-    CGColorSpaceRelease(colorSpace);
+    CGContextRef context = CGBitmapContextCreate(buffer.mutableBytes, width, height, bitsPerComponent, bytesPerRow, colorSpace, bitmapInfo);
 
     if (!context) {
+        if (buffer) {
+            [bufferPool checkinBuffer:buffer];
+        }
+        CGColorSpaceRelease(colorSpace);
         CGImageRelease(imageRef);
 
         return image;
     }
 
+    //复用的内存里还有上一张图片的像素
+    if (bufferReused) {
+        CGContextClearRect(context, CGRectMake(0.0f, 0.0f, width, height));
+    }
+
     CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, width, height), imageRef);
-    CGImageRef inflatedImageRef = CGBitmapContextCreateImage(context);
+
+    CGImageRef inflatedImageRef = NULL;
+    if (buffer) {
+        //直接用池中的内存生成CGImage、不再拷贝一次。图片释放时内存归还到池中
+        AFImageBitmapBufferLease *lease = [[AFImageBitmapBufferLease alloc] init];
+        lease.pool = bufferPool;
+        lease.buffer = buffer;
+
+        CGDataProviderRef bitmapDataProvider = CGDataProviderCreateWithData((__bridge_retained void *)lease, buffer.mutableBytes, bytesPerRow * height, AFImageBitmapBufferLeaseRelease);
+        inflatedImageRef = CGImageCreate(width, height, bitsPerComponent, bitsPerComponent * 4, bytesPerRow, colorSpace, CGBitmapContextGetBitmapInfo(context), bitmapDataProvider, NULL, false, kCGRenderingIntentDefault);
+        CGDataProviderRelease(bitmapDataProvider);
+    } else {
+        inflatedImageRef = CGBitmapContextCreateImage(context);
+    }
 
     CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+
+    if (!inflatedImageRef) {
+        CGImageRelease(imageRef);
+
+        return image;
+    }
 
     UIImage *inflatedImage = [[UIImage alloc] initWithCGImage:inflatedImageRef scale:scale orientation:image.imageOrientation];
 
@@ -737,9 +3971,11 @@ static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *r
 #if TARGET_OS_IOS || TARGET_OS_TV
     self.imageScale = [[UIScreen mainScreen] scale];
     self.automaticallyInflatesResponseImage = YES;
+    self.bitmapBufferPool = [AFImageBitmapBufferPool sharedPool];
 #elif TARGET_OS_WATCH
     self.imageScale = [[WKInterfaceDevice currentDevice] screenScale];
     self.automaticallyInflatesResponseImage = YES;
+    self.bitmapBufferPool = [AFImageBitmapBufferPool sharedPool];
 #endif
 
     return self;
@@ -758,10 +3994,15 @@ static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *r
         }
     }
 
+    return [self imageForResponse:(NSHTTPURLResponse *)response data:data];
+}
+
+//只解码、不验证响应(AFImageDownloader渐进解码时响应已经由manager验证过)
+- (id)imageForResponse:(NSHTTPURLResponse *)response data:(NSData *)data {
 #if TARGET_OS_IOS || TARGET_OS_TV || TARGET_OS_WATCH
     if (self.automaticallyInflatesResponseImage) {
         //自动解压
-        return AFInflatedImageFromResponseWithDataAtScale((NSHTTPURLResponse *)response, data, self.imageScale);
+        return AFInflatedImageFromResponseWithDataAtScale(response, data, self.imageScale, self.bitmapBufferPool);
     } else {
         //否则只改变比例
         return AFImageWithDataAtScale(data, self.imageScale);
@@ -817,6 +4058,7 @@ static UIImage * AFInflatedImageFromResponseWithDataAtScale(NSHTTPURLResponse *r
 #if TARGET_OS_IOS || TARGET_OS_TV || TARGET_OS_WATCH
     serializer.imageScale = self.imageScale;
     serializer.automaticallyInflatesResponseImage = self.automaticallyInflatesResponseImage;
+    serializer.bitmapBufferPool = self.bitmapBufferPool;
 #endif
 
     return serializer;
@@ -31,6 +31,13 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class AFURLSessionSegmentedDownload;
+@class AFURLSessionChunkedUpload;
+@class AFURLSessionDataStream;
+@class AFURLSessionConcurrencyLimiter;
+@class AFURLSessionDeliveryQueue;
+@class AFURLSessionTaskTimingRecorder;
+
 @interface AFURLSessionManager : NSObject <NSURLSessionDelegate, NSURLSessionTaskDelegate, NSURLSessionDataDelegate, NSURLSessionDownloadDelegate, NSSecureCoding, NSCopying>
 
 /**
@@ -95,6 +102,40 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, strong, nullable) dispatch_group_t completionGroup;
 
+/**
+ 数据任务缓存的响应超过这个长度时、改为写入临时文件、默认为0(不限制)
+ 之后序列化器收到的是以`NSDataReadingMappedIfSafe`映射的`NSData`、不会占用堆内存
+ 对之后创建的数据任务和上传任务生效、单个任务可以用`-setDataTaskResponseDataSpillThreshold:forTask:`修改
+ */
+@property (nonatomic, assign) NSUInteger responseDataSpillThreshold;
+
+/**
+ 按主机自适应限制并发数、默认为nil(不限制)
+ 设置后、之后创建的任务调用`resume`时先进入所属主机的队列、并发数低于当前限制时才真正开始
+ 同一个限制器可以被多个manager共享
+ */
+@property (nonatomic, strong, nullable) AFURLSessionConcurrencyLimiter *concurrencyLimiter;
+
+/**
+ 是否合并回调的投递、默认为NO
+ 设置为YES后、发往同一队列的完成回调和`AFNetworkingTaskDidCompleteNotification`通知先进入`AFURLSessionDeliveryQueue`、一次调度中按进入的顺序全部执行
+ completionQueue为nil(主队列)时、和通知、`AFImageDownloader`的回调共用`+[AFURLSessionDeliveryQueue mainDeliveryQueue]`
+ */
+@property (nonatomic, assign) BOOL coalescesCompletionDelivery;
+
+/**
+ 合并投递时、第一个回调进入后最多等待多久再执行、默认为0
+ 只影响这个manager、大于0时主队列上的回调和通知也改用manager自己的`AFURLSessionDeliveryQueue`、不再和其他manager共用
+ */
+@property (nonatomic, assign) NSTimeInterval completionDeliveryCoalescingInterval;
+
+/**
+ 记录每个任务各阶段的时间、默认为nil(不记录)
+ 设置后、之后创建的任务在回调执行完时把记录写入记录器、由使用者调用`-drainRecordsUsingBlock:`取走
+ `AFHTTPSessionManager`的批量请求和响应缓存命中也会写入记录
+ */
+@property (nonatomic, strong, nullable) AFURLSessionTaskTimingRecorder *taskTimingRecorder;
+
 /**
  这个属性非常重要，注释里面写到，在iOS7中存在一个bug，在创建后台上传任务时，有时候会返回nil，所以为了解决这个问题，AFNetworking遵照了苹果的建议，在创建失败的时候，会重新尝试创建，次数默认为3次，所以你的应用如果有场景会有在后台上传的情况的话，记得将该值设为YES，避免出现上传失败的问题.
  */
@@ -120,6 +161,16 @@ NS_ASSUME_NONNULL_BEGIN
 /// 数据请求
 ///-------------------------
 
+/**
+ 记录任务对应请求的序列化时间、供子类在生成请求之后调用、没有设置`taskTimingRecorder`时忽略
+
+ @param startTime 开始序列化的时间、来自`AFURLSessionTaskTimingTimestamp()`
+ @param endTime 序列化结束的时间
+ */
+- (void)recordRequestSerializationStartTime:(uint64_t)startTime
+                                    endTime:(uint64_t)endTime
+                                    forTask:(NSURLSessionTask *)task;
+
 /**
 用指定的请求创建一个`NSURLSessionDataTask`
 
@@ -142,6 +193,21 @@ NS_ASSUME_NONNULL_BEGIN
                              downloadProgress:(nullable void (^)(NSProgress *downloadProgress))downloadProgressBlock
                             completionHandler:(nullable void (^)(NSURLResponse *response, id _Nullable responseObject,  NSError * _Nullable error))completionHandler;
 
+/**
+ 创建一个由使用者拉取数据的流式数据任务
+
+ 收到的数据放入一个有上限的队列、使用者通过`-readDataWithCompletionHandler:`或`-readData:`逐段取出
+ 队列中的数据达到`maximumBufferedLength`时自动暂停任务、TCP窗口随之关闭、服务器停止发送
+ 使用者取走数据、队列降到上限的一半以下时自动恢复任务
+ 数据不会交给`responseSerializer`解析
+ 返回的流需要调用`-resume`才会开始
+
+ @param request HTTP请求
+ @param maximumBufferedLength 队列中最多缓存的字节数
+ */
+- (AFURLSessionDataStream *)streamingDataTaskWithRequest:(NSURLRequest *)request
+                                   maximumBufferedLength:(NSUInteger)maximumBufferedLength;
+
 ///---------------------------
 /// 上传
 ///---------------------------
@@ -217,6 +283,48 @@ NS_ASSUME_NONNULL_BEGIN
                                              destination:(nullable NSURL * (^)(NSURL *targetPath, NSURLResponse *response))destination
                                        completionHandler:(nullable void (^)(NSURLResponse *response, NSURL * _Nullable filePath, NSError * _Nullable error))completionHandler;
 
+/**
+ 分段下载(多连接)
+
+ 第一个请求为`Range: bytes=0-`、服务器返回206时按照文件总长度分成多段、每段一个数据任务并行下载
+ 每段数据用`pwrite`直接写入预先分配好的临时文件的对应位置、不在内存中缓存
+ 某一段完成后、从剩余最多的一段中分走一半继续下载
+ 服务器不支持Range、或者响应没有强ETag和Last-Modified(无法用`If-Range`保证各段来自同一个文件)时退化成单个连接
+ 每段的响应都会检查状态码、探测请求只接受200和206、其他分段只接受206、否则整个下载失败
+ 返回的下载需要调用`-resume`才会开始
+
+ @param request HTTP请求
+ @param numberOfSegments 最多同时进行的连接数
+ @param downloadProgressBlock 下载进度、所有分段汇总为一个`NSProgress`、在session的`operationQueue`上调用
+ @param destination 指定文件存储位置、返回nil时保留在临时位置、在AF的处理队列上调用
+ @param completionHandler 完成回调
+ */
+- (AFURLSessionSegmentedDownload *)segmentedDownloadTaskWithRequest:(NSURLRequest *)request
+                                                   numberOfSegments:(NSUInteger)numberOfSegments
+                                                           progress:(nullable void (^)(NSProgress *downloadProgress))downloadProgressBlock
+                                                        destination:(nullable NSURL * (^)(NSURL *targetPath, NSURLResponse *response))destination
+                                                  completionHandler:(nullable void (^)(NSURLResponse *response, NSURL * _Nullable filePath, NSError * _Nullable error))completionHandler;
+
+/**
+ 创建一个可断点续传的分块上传
+
+ 文件被切分成多个块、每块一个上传任务并行发送、上传进度记录在`manifestURL`指向的清单文件中
+ 上传中断后用相同的文件和清单再次创建、只会重新发送还没有被服务器确认的块
+ 切块时顺序读取一次文件并同时计算每块的SHA-256、之后不再为校验读取文件
+ 返回的上传需要调用`-resume`才会开始、分块协议见`AFURLSessionChunkedUpload`
+
+ @param request 上传地址、每块和最后的提交请求都基于这个请求
+ @param fileURL 要上传的本地文件
+ @param manifestURL 清单文件的位置、为nil时根据请求地址和文件路径在缓存目录中生成
+ @param uploadProgressBlock 上传进度、所有块汇总为一个`NSProgress`
+ @param completionHandler 完成回调、`responseObject`为提交请求的响应经过`responseSerializer`解析后的结果
+ */
+- (AFURLSessionChunkedUpload *)chunkedUploadTaskWithRequest:(NSURLRequest *)request
+                                                   fromFile:(NSURL *)fileURL
+                                                manifestURL:(nullable NSURL *)manifestURL
+                                                   progress:(nullable void (^)(NSProgress *uploadProgress))uploadProgressBlock
+                                          completionHandler:(nullable void (^)(NSURLResponse *response, id _Nullable responseObject, NSError * _Nullable error))completionHandler;
+
 ///---------------------------------
 /// 获取任务进度
 ///---------------------------------
@@ -313,6 +421,38 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setDataTaskDidReceiveDataBlock:(nullable void (^)(NSURLSession *session, NSURLSessionDataTask *dataTask, NSData *data))block;
 
+/**
+ 为指定的数据任务设置接收数据的block(任务级别)
+ 在session级别的`dataTaskDidReceiveData`之前调用、执行在session的operationQueue上。
+ 需要在任务`resume`之前设置、任务结束时随AFTaskDelegate一起释放。
+
+ @param block 每收到一段数据时回调、参数为session、数据任务以及本段数据
+ @param dataTask 由当前manager创建的数据任务
+ */
+- (void)setDataTaskDidReceiveDataBlock:(nullable void (^)(NSURLSession *session, NSURLSessionDataTask *dataTask, NSData *data))block
+                               forTask:(NSURLSessionDataTask *)dataTask;
+
+/**
+ 设置数据任务是否在内存中缓存收到的数据(任务级别)、默认为YES
+ 为NO时数据只交给`dataTaskDidReceiveData`、任务结束时交给序列化器的data为nil
+ 需要在任务`resume`之前设置
+
+ @param buffersResponseData 是否缓存
+ @param dataTask 由当前manager创建的数据任务
+ */
+- (void)setDataTaskBuffersResponseData:(BOOL)buffersResponseData
+                               forTask:(NSURLSessionDataTask *)dataTask;
+
+/**
+ 设置单个数据任务的响应转存阈值、覆盖`responseDataSpillThreshold`
+ 需要在任务开始之前设置
+
+ @param threshold 超过这个长度后写入临时文件、0为不限制
+ @param dataTask 由当前manager创建的数据任务
+ */
+- (void)setDataTaskResponseDataSpillThreshold:(NSUInteger)threshold
+                                      forTask:(NSURLSessionDataTask *)dataTask;
+
 /**
  Sets a block to be executed to determine the caching behavior of a data task, as handled by the `NSURLSessionDataDelegate` method `URLSession:dataTask:willCacheResponse:completionHandler:`.
 
@@ -354,6 +494,436 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+#pragma mark -
+
+/**
+ `AFURLSessionSegmentedDownload` 由`-segmentedDownloadTaskWithRequest:numberOfSegments:progress:destination:completionHandler:`创建
+ 管理同一个文件的多个分段数据任务
+ */
+@interface AFURLSessionSegmentedDownload : NSObject
+
+/**
+ 原始请求
+ */
+@property (readonly, nonatomic, copy) NSURLRequest *request;
+
+/**
+ 最多同时进行的连接数
+ */
+@property (readonly, nonatomic, assign) NSUInteger numberOfSegments;
+
+/**
+ 每段的最小长度、文件较小或剩余部分较少时不再分段、默认为1MB
+ 需要在`-resume`之前设置
+ */
+@property (nonatomic, assign) int64_t minimumSegmentLength;
+
+/**
+ 所有分段汇总的进度、文件总长度未知时`totalUnitCount`为-1
+ */
+@property (readonly, nonatomic, strong) NSProgress *progress;
+
+/**
+ 开始下载、只有第一次调用有效
+ */
+- (void)resume;
+
+/**
+ 取消所有分段、删除临时文件、以`NSURLErrorCancelled`错误回调
+ */
+- (void)cancel;
+
+@end
+
+#pragma mark -
+
+/**
+    分块方式
+ */
+typedef NS_ENUM(NSUInteger, AFURLSessionUploadChunking) {
+    AFURLSessionUploadChunkingFixedSize,//固定长度
+    AFURLSessionUploadChunkingContentDefined,//FastCDC、根据内容滚动哈希确定边界、插入或删除数据只影响附近的块
+};
+
+/**
+ `AFURLSessionChunkedUpload` 由`-chunkedUploadTaskWithRequest:fromFile:manifestURL:progress:completionHandler:`创建
+
+ 分块协议:
+ 每块发送一个请求、方法和地址与原始请求相同(原始请求为GET时使用PUT)、请求头包括
+    `Content-Range: bytes <起始>-<结束>/<文件总长度>`
+    `Upload-Chunk-Index: <序号>`
+    `Digest: sha-256=<Base64编码的SHA-256>`
+ 服务器校验摘要并保存后返回2xx、同一块重复发送应当是幂等的
+ 所有块完成后发送一个POST提交请求、请求头`Upload-Complete: ?1`、请求体为JSON
+    {"length": 文件总长度, "chunks": [{"index": 0, "offset": 0, "length": 4194304, "sha256": "<十六进制>"}, ...]}
+ 服务器按清单拼接文件、提交请求的响应作为最终结果
+
+ 开启`deduplicatesChunks`时、上传块之前先发送一个POST查询请求、请求头`Upload-Chunk-Query: ?1`、请求体为JSON
+    {"sha256": ["<十六进制>", ...]}
+ 服务器返回其中还没有保存的摘要
+    {"missing": ["<十六进制>", ...]}
+ 只上传缺少的块、文件内重复的块也只上传一次、服务器需要按摘要拼接文件
+ 查询失败时上传所有的块
+ */
+@interface AFURLSessionChunkedUpload : NSObject
+
+/**
+ 原始请求
+ */
+@property (readonly, nonatomic, copy) NSURLRequest *request;
+
+/**
+ 要上传的本地文件
+ */
+@property (readonly, nonatomic, copy) NSURL *fileURL;
+
+/**
+ 清单文件、上传成功后会被删除
+ */
+@property (readonly, nonatomic, copy) NSURL *manifestURL;
+
+/**
+ 分块方式、默认为`AFURLSessionUploadChunkingFixedSize`
+ 已有清单时沿用清单中的分块
+ */
+@property (nonatomic, assign) AFURLSessionUploadChunking chunking;
+
+/**
+ 块的长度、按内容分块时为平均长度、默认为4MB
+ */
+@property (nonatomic, assign) NSUInteger chunkSize;
+
+/**
+ 最多同时上传的块数、默认为4
+ */
+@property (nonatomic, assign) NSUInteger maximumConcurrentChunkCount;
+
+/**
+ 是否先向服务器查询已有的块、只上传缺少的块、默认为NO
+ 适合反复上传变化不大的大文件(比如数据库快照和日志)、一般配合`AFURLSessionUploadChunkingContentDefined`使用
+ 清单记录了这个设置、与清单不一致时重新切块上传
+ */
+@property (nonatomic, assign) BOOL deduplicatesChunks;
+
+/**
+ 因为服务器已有或者文件内重复而没有发送的字节数
+ */
+@property (readonly, nonatomic, assign) int64_t deduplicatedByteCount;
+
+/**
+ 所有块汇总的进度、切块完成前`totalUnitCount`为文件长度
+ */
+@property (readonly, nonatomic, strong) NSProgress *progress;
+
+/**
+ 开始上传、只有第一次调用有效
+ */
+- (void)resume;
+
+/**
+ 取消正在进行的上传任务、以`NSURLErrorCancelled`错误回调
+ 清单文件会被保留、之后可以从中断的位置继续
+ */
+- (void)cancel;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFURLSessionDataStream` 由`-streamingDataTaskWithRequest:maximumBufferedLength:`创建
+ 同一时间可以有多个读取请求、按调用顺序得到数据
+ */
+@interface AFURLSessionDataStream : NSObject
+
+/**
+ 数据任务
+ */
+@property (readonly, nonatomic, strong) NSURLSessionDataTask *task;
+
+/**
+ 服务器的响应、收到响应之前为nil
+ */
+@property (readonly, nonatomic, strong, nullable) NSURLResponse *response;
+
+/**
+ 队列中最多缓存的字节数
+ */
+@property (readonly, nonatomic, assign) NSUInteger maximumBufferedLength;
+
+/**
+ 队列中当前缓存的字节数
+ */
+@property (readonly, nonatomic, assign) NSUInteger bufferedLength;
+
+/**
+ 开始任务
+ */
+- (void)resume;
+
+/**
+ 取消任务、之后的读取以`NSURLErrorCancelled`错误结束
+ */
+- (void)cancel;
+
+/**
+ 异步读取下一段数据、在manager的`completionQueue`上回调
+ 数据读完时`data`和`error`都为nil、出错时`error`不为nil(之前收到的数据仍然会先被读出)
+
+ @param completionHandler 读取回调
+ */
+- (void)readDataWithCompletionHandler:(void (^)(NSData * _Nullable data, NSError * _Nullable error))completionHandler;
+
+/**
+ 同步读取下一段数据、没有数据时阻塞当前线程、不要在主线程调用
+ 数据读完时返回nil并且`error`为nil
+
+ @param error 出错时的错误信息
+
+ @return 下一段数据
+ */
+- (nullable NSData *)readData:(NSError * _Nullable __autoreleasing * _Nullable)error;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFURLSessionConcurrencyLimiter` 按主机(host:port)自适应调整同时进行的任务数
+
+ 采用AIMD、每个主机单独记录最小耗时作为基线
+    任务耗时不超过基线的`latencyTolerance`倍、并且并发数已经用到限制的一半以上时、限制增加1/限制(大约每轮增加1)
+    耗时超过基线的`latencyTolerance`倍时、限制乘以`backoffRatio`
+    超时、连接失败、429、503时、限制减半
+ 每轮(一个平滑耗时)最多降低一次、基线每256个样本重新测量一次、以适应服务器状态的变化
+ 耗时从任务真正开始到结束、包含传输时间、更适合接口请求而不是大文件
+ */
+@interface AFURLSessionConcurrencyLimiter : NSObject
+
+/**
+ 新主机的初始限制、默认为4
+ */
+@property (nonatomic, assign) NSUInteger initialLimit;
+
+/**
+ 最小限制、默认为1
+ */
+@property (nonatomic, assign) NSUInteger minimumLimit;
+
+/**
+ 最大限制、默认为64
+ */
+@property (nonatomic, assign) NSUInteger maximumLimit;
+
+/**
+ 耗时超过基线的多少倍时认为服务器开始排队、默认为2.0
+ */
+@property (nonatomic, assign) double latencyTolerance;
+
+/**
+ 耗时过长时限制的缩小比例、默认为0.9
+ */
+@property (nonatomic, assign) double backoffRatio;
+
+/**
+ URL所在主机当前的并发限制、与任务一样按host:port区分
+
+ @param URL 请求的URL
+ */
+- (NSUInteger)limitForURL:(NSURL *)URL;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFURLSessionDeliveryQueue` 把发往同一个队列的block合并成一次调度
+
+ 第一个block进入时向目标队列提交一次排空、之后进入的block只追加到待执行列表
+ 排空时按进入的顺序依次执行、执行中新加入的block(例如完成回调里发出的通知)在同一次排空中执行
+ `coalescingInterval`为0时等目标队列空闲就排空、主队列上相当于每次RunLoop循环一次
+ */
+@interface AFURLSessionDeliveryQueue : NSObject
+
+/**
+ 目标队列
+ */
+@property (readonly, nonatomic, strong) dispatch_queue_t queue;
+
+/**
+ 第一个block进入后最多等待多久再排空、在初始化时确定
+ 大于0时(例如一帧的时间)、这段时间内进入的block一起执行、`+mainDeliveryQueue`为0
+ */
+@property (readonly, nonatomic, assign) NSTimeInterval coalescingInterval;
+
+/**
+ 向目标队列提交的排空次数
+ */
+@property (readonly, nonatomic, assign) NSUInteger drainCount;
+
+/**
+ 已经执行的block数、和`drainCount`一起可以看出合并的效果
+ */
+@property (readonly, nonatomic, assign) NSUInteger deliveredBlockCount;
+
+/**
+ 主队列共用的实例、`coalescingInterval`为0
+ */
++ (instancetype)mainDeliveryQueue;
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue;
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue coalescingInterval:(NSTimeInterval)coalescingInterval NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ 加入一个block、在目标队列上执行
+ */
+- (void)enqueueBlock:(dispatch_block_t)block;
+
+/**
+ 加入一个block、执行完之前group保持未完成、相当于`dispatch_group_async`
+
+ @param group 分组、可以为nil
+ */
+- (void)enqueueBlock:(dispatch_block_t)block group:(nullable dispatch_group_t)group;
+
+@end
+
+#pragma mark -
+
+/**
+ 任务的计时点、记录中按这个顺序保存
+ DomainLookupStart到ResponseEnd来自`NSURLSessionTaskMetrics`(iOS 10、macOS 10.12以上)、已经换算到同一个时钟
+ */
+typedef NS_ENUM(NSUInteger, AFURLSessionTaskTimingPhase) {
+    AFURLSessionTaskTimingPhaseRequestSerializationStart = 0,
+    AFURLSessionTaskTimingPhaseRequestSerializationEnd,
+    AFURLSessionTaskTimingPhaseTaskCreation,
+    AFURLSessionTaskTimingPhaseResume,
+    AFURLSessionTaskTimingPhaseDomainLookupStart,
+    AFURLSessionTaskTimingPhaseDomainLookupEnd,
+    AFURLSessionTaskTimingPhaseConnectStart,
+    AFURLSessionTaskTimingPhaseConnectEnd,
+    AFURLSessionTaskTimingPhaseSecureConnectionStart,
+    AFURLSessionTaskTimingPhaseSecureConnectionEnd,
+    AFURLSessionTaskTimingPhaseRequestStart,
+    AFURLSessionTaskTimingPhaseResponseStart,
+    AFURLSessionTaskTimingPhaseResponseEnd,
+    AFURLSessionTaskTimingPhaseFirstByte,
+    AFURLSessionTaskTimingPhaseLastByte,
+    AFURLSessionTaskTimingPhaseSerializerEnqueue,
+    AFURLSessionTaskTimingPhaseSerializerStart,
+    AFURLSessionTaskTimingPhaseSerializerEnd,
+    AFURLSessionTaskTimingPhaseCallbackDispatch,
+    AFURLSessionTaskTimingPhaseCallbackStart,
+    AFURLSessionTaskTimingPhaseCallbackEnd,
+    AFURLSessionTaskTimingPhaseCount,
+};
+
+/**
+ 一个任务的计时记录、时间为`AFURLSessionTaskTimingTimestamp()`的纳秒数、0表示没有经过这个阶段
+ 序列化器排队时间为SerializerStart - SerializerEnqueue、执行时间为SerializerEnd - SerializerStart
+ 没有任务的回调(`AFHTTPResponseCache`命中、批量请求中序列化失败或者取消的请求)也会生成记录、taskIdentifier和statusCode为0
+ */
+typedef struct {
+    NSUInteger taskIdentifier;
+    NSInteger statusCode;
+    BOOL failed;
+    char name[64];//请求方法和路径、超长时截断
+    uint64_t timestamps[AFURLSessionTaskTimingPhaseCount];
+} AFURLSessionTaskTimingRecord;
+
+/**
+ 计时用的单调时钟、单位为纳秒
+ */
+FOUNDATION_EXPORT uint64_t AFURLSessionTaskTimingTimestamp(void);
+
+/**
+ 用请求的方法和路径填写记录的name、超长时截断
+ */
+FOUNDATION_EXPORT void AFURLSessionTaskTimingRecordSetName(AFURLSessionTaskTimingRecord *record, NSURLRequest *request);
+
+/**
+ `AFURLSessionTaskTimingRecorder` 保存任务计时记录的无锁环形缓冲区
+
+ 多个线程可以同时写入和取出、写入时只复制一条记录、不分配内存
+ 缓冲区满时丢弃新的记录并计数、需要定期调用`-drainRecordsUsingBlock:`取走
+ */
+@interface AFURLSessionTaskTimingRecorder : NSObject
+
+/**
+ 可以保存的记录数、向上取整到2的幂
+ */
+@property (readonly, nonatomic, assign) NSUInteger capacity;
+
+/**
+ 缓冲区满时丢弃的记录数
+ */
+@property (readonly, nonatomic, assign) NSUInteger droppedRecordCount;
+
+/**
+ 创建可以保存1024条记录的记录器
+ */
+- (instancetype)init;
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/**
+ 写入一条记录
+
+ @return 缓冲区已满时返回NO
+ */
+- (BOOL)appendRecord:(const AFURLSessionTaskTimingRecord *)record;
+
+/**
+ 按写入的顺序取出当前所有的记录
+
+ @param block 每条记录调用一次、record只在block内有效
+ @return 取出的记录数
+ */
+- (NSUInteger)drainRecordsUsingBlock:(void (^)(const AFURLSessionTaskTimingRecord *record))block;
+
+@end
+
+#pragma mark -
+
+/**
+ `AFURLSessionTaskTimingTraceExporter` 把计时记录转换成Chrome trace格式的JSON
+ 可以在chrome://tracing或Perfetto中打开、每个任务一行、每个阶段一段
+ */
+@interface AFURLSessionTaskTimingTraceExporter : NSObject
+
+/**
+ 已经加入的记录数
+ */
+@property (readonly, nonatomic, assign) NSUInteger recordCount;
+
+/**
+ 加入一条记录
+ */
+- (void)appendRecord:(const AFURLSessionTaskTimingRecord *)record;
+
+/**
+ 取出记录器中当前所有的记录并加入
+
+ @return 加入的记录数
+ */
+- (NSUInteger)appendRecordsFromRecorder:(AFURLSessionTaskTimingRecorder *)recorder;
+
+/**
+ Chrome trace格式的JSON数据
+ */
+- (NSData *)traceData;
+
+/**
+ 把JSON数据写入文件
+ */
+- (BOOL)writeToURL:(NSURL *)URL error:(NSError * _Nullable __autoreleasing * _Nullable)error;
+
+@end
+
 ///--------------------
 /// @name Notifications
 ///--------------------
@@ -21,6 +21,12 @@
 
 #import "AFURLSessionManager.h"
 #import <objc/runtime.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/mman.h>
+#import <CommonCrypto/CommonDigest.h>
+#import <mach/mach_time.h>
+#import <stdatomic.h>
 
 #ifndef NSFoundationVersionNumber_iOS_8_0
 #define NSFoundationVersionNumber_With_Fixed_5871104061079552_bug 1140.11
@@ -28,6 +34,15 @@
 #define NSFoundationVersionNumber_With_Fixed_5871104061079552_bug NSFoundationVersionNumber_iOS_8_0
 #endif
 
+//NSURLSessionTaskMetrics需要iOS 10、macOS 10.12以上的SDK
+#ifndef AF_CAN_INCLUDE_SESSION_TASK_METRICS
+#if ((defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && __IPHONE_OS_VERSION_MAX_ALLOWED >= 100000) || (defined(__MAC_OS_X_VERSION_MAX_ALLOWED) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 101200))
+#define AF_CAN_INCLUDE_SESSION_TASK_METRICS 1
+#else
+#define AF_CAN_INCLUDE_SESSION_TASK_METRICS 0
+#endif
+#endif
+
 static dispatch_queue_t url_session_manager_creation_queue() {
     static dispatch_queue_t af_url_session_manager_creation_queue;
     static dispatch_once_t onceToken;
@@ -69,6 +84,37 @@ static dispatch_group_t url_session_manager_completion_group() {
     return af_url_session_manager_completion_group;
 }
 
+//名字为"方法 路径"、按字符截断
+void AFURLSessionTaskTimingRecordSetName(AFURLSessionTaskTimingRecord *record, NSURLRequest *request) {
+    NSUInteger length = 0;
+    NSUInteger maximumLength = sizeof(record->name) - 1;
+    NSString *method = request.HTTPMethod ? request.HTTPMethod : @"GET";
+    [method getBytes:record->name maxLength:maximumLength usedLength:&length encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [method length]) remainingRange:NULL];
+    NSString *path = request.URL.path;
+    if ([path length] > 0 && length < maximumLength) {
+        record->name[length++] = ' ';
+        NSUInteger pathLength = 0;
+        [path getBytes:record->name + length maxLength:maximumLength - length usedLength:&pathLength encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [path length]) remainingRange:NULL];
+        length += pathLength;
+    }
+    record->name[length] = '\0';
+}
+
+uint64_t AFURLSessionTaskTimingTimestamp(void) {
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+
+    uint64_t time = mach_absolute_time();
+    if (timebase.numer == timebase.denom) {
+        return time;
+    }
+
+    return time * timebase.numer / timebase.denom;
+}
+
 NSString * const AFNetworkingTaskDidResumeNotification = @"com.alamofire.networking.task.resume";
 NSString * const AFNetworkingTaskDidCompleteNotification = @"com.alamofire.networking.task.complete";
 NSString * const AFNetworkingTaskDidSuspendNotification = @"com.alamofire.networking.task.suspend";
@@ -111,6 +157,15 @@ typedef void (^AFURLSessionTaskProgressBlock)(NSProgress *);
 typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id responseObject, NSError *error);
 
 
+#pragma mark -
+
+@interface AFURLSessionManager ()
+//把回调投递到completionQueue、`coalescesCompletionDelivery`为YES时合并投递
+- (void)deliverCompletionBlock:(dispatch_block_t)block;
+//把通知投递到主队列
+- (void)deliverMainQueueBlock:(dispatch_block_t)block;
+@end
+
 #pragma mark -
 
 @interface AFURLSessionManagerTaskDelegate : NSObject <NSURLSessionTaskDelegate, NSURLSessionDataDelegate, NSURLSessionDownloadDelegate>
@@ -123,9 +178,31 @@ typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id re
 @property (nonatomic, copy) AFURLSessionTaskProgressBlock uploadProgressBlock;//上传任务进度传递
 @property (nonatomic, copy) AFURLSessionTaskProgressBlock downloadProgressBlock;//下载任务进度传递
 @property (nonatomic, copy) AFURLSessionTaskCompletionHandler completionHandler;//任务结束时间传递
+@property (nonatomic, copy) AFURLSessionDataTaskDidReceiveDataBlock dataTaskDidReceiveData;//任务级别的数据接收回调(每一段数据都会回调)
+@property (nonatomic, strong) id <AFURLResponseIncrementalParsing> incrementalParser;//边接收边解析时的解析器、此时不再缓存数据
+@property (nonatomic, assign) BOOL didPrepareIncrementalParser;
+@property (nonatomic, strong) dispatch_queue_t incrementalParsingQueue;//增量解析的串行队列、保证数据按接收顺序解析且不占用operationQueue
+@property (nonatomic, assign) NSUInteger responseDataSpillThreshold;//缓存的数据超过这个长度时转存到临时文件
+@property (nonatomic, copy) NSURL *spillFileURL;
+@property (nonatomic, assign) int spillFileDescriptor;
+@property (nonatomic, strong) NSError *spillError;
+@property (nonatomic, strong) AFURLSessionTaskTimingRecorder *timingRecorder;//不为nil时记录各阶段的时间
+
+- (void)startTimingForTask:(NSURLSessionTask *)task recorder:(AFURLSessionTaskTimingRecorder *)recorder;
+- (void)recordTimingPhase:(AFURLSessionTaskTimingPhase)phase;
+- (void)recordRequestSerializationStartTime:(uint64_t)startTime endTime:(uint64_t)endTime;
+#if AF_CAN_INCLUDE_SESSION_TASK_METRICS
+- (void)recordTimingMetrics:(NSURLSessionTaskMetrics *)metrics;
+#endif
 @end
 
-@implementation AFURLSessionManagerTaskDelegate
+@implementation AFURLSessionManagerTaskDelegate {
+    //每个时间点只由任务生命周期中的一个阶段写入、各阶段依次交接:
+    //调用方线程(序列化、创建、resume) -> session的operationQueue(首末字节、metrics、SerializerEnqueue)
+    //-> 处理队列(序列化器) -> completionQueue(回调、写入记录器)
+    //交接都经过resume或者dispatch_async、前一阶段的写入对后一阶段可见、最后在回调结束时一次性复制到记录器
+    AFURLSessionTaskTimingRecord _timing;
+}
 
 - (instancetype)init {
     self = [super init];
@@ -134,6 +211,7 @@ typedef void (^AFURLSessionTaskCompletionHandler)(NSURLResponse *response, id re
     }
 
     self.mutableData = [NSMutableData data];
+    self.spillFileDescriptor = -1;
     self.uploadProgress = [[NSProgress alloc] initWithParent:nil userInfo:nil];
     self.uploadProgress.totalUnitCount = NSURLSessionTransferSizeUnknown;
 
@@ -267,8 +345,18 @@ didCompleteWithError:(NSError *)error
 #pragma clang diagnostic ignored "-Wgnu"
     __strong AFURLSessionManager *manager = self.manager;
 
+    //没有响应体的任务以结束的时间作为最后一个字节的时间
+    if (self.timingRecorder && _timing.timestamps[AFURLSessionTaskTimingPhaseFirstByte] != 0 && _timing.timestamps[AFURLSessionTaskTimingPhaseLastByte] == 0) {
+        [self recordTimingPhase:AFURLSessionTaskTimingPhaseLastByte];
+    }
+
     __block id responseObject = nil;
 
+    //转存失败时任务已经被取消、报告转存的错误
+    if (self.spillError) {
+        error = self.spillError;
+    }
+
     __block NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
     //保存序列化器
     userInfo[AFNetworkingTaskDidCompleteResponseSerializerKey] = manager.responseSerializer;
@@ -279,7 +367,17 @@ didCompleteWithError:(NSError *)error
         data = [self.mutableData copy];
         //抛弃了self.mutableData的引用、释放出来一些内存。
         self.mutableData = nil;
+    } else if (self.spillFileURL && !error) {
+        //映射临时文件、映射后就可以删除文件
+        close(self.spillFileDescriptor);
+        self.spillFileDescriptor = -1;
+        NSError *readError = nil;
+        data = [NSData dataWithContentsOfURL:self.spillFileURL options:NSDataReadingMappedIfSafe error:&readError];
+        if (!data) {
+            error = readError;
+        }
     }
+    [self removeSpillFile];
 
     if (self.downloadFileURL) {
         //保存下载文件储存的位置
@@ -296,24 +394,41 @@ didCompleteWithError:(NSError *)error
         userInfo[AFNetworkingTaskDidCompleteErrorKey] = error;
         // 这里 A ?: B === A ? A : B;
         //如果用户没有定制、则使用AF提供的分组和队列
-        dispatch_group_async(manager.completionGroup ?: url_session_manager_completion_group(), manager.completionQueue ?: dispatch_get_main_queue(), ^{
+        [self recordTimingPhase:AFURLSessionTaskTimingPhaseCallbackDispatch];
+        [manager deliverCompletionBlock:^{
+            [self recordTimingPhase:AFURLSessionTaskTimingPhaseCallbackStart];
             //回调给用户
             if (self.completionHandler) {
                 self.completionHandler(task.response, responseObject, error);
             }
+            [self finishTimingWithResponse:task.response error:error];
             
             //通知
-            dispatch_async(dispatch_get_main_queue(), ^{
+            [manager deliverMainQueueBlock:^{
                 [[NSNotificationCenter defaultCenter] postNotificationName:AFNetworkingTaskDidCompleteNotification object:task userInfo:userInfo];
-            });
-        });
+            }];
+        }];
     } else {
         //请求成功
         
-        dispatch_async(url_session_manager_processing_queue(), ^{
+        [self recordTimingPhase:AFURLSessionTaskTimingPhaseSerializerEnqueue];
+        //增量解析时排在已经提交的数据之后结束解析
+        dispatch_async(self.incrementalParsingQueue ?: url_session_manager_processing_queue(), ^{
+            [self recordTimingPhase:AFURLSessionTaskTimingPhaseSerializerStart];
             NSError *serializationError = nil;
-            //将数据解析成指定格式
-            responseObject = [manager.responseSerializer responseObjectForResponse:task.response data:data error:&serializationError];
+            //将数据解析成指定格式、已经边接收边解析的只需要结束解析
+            if (self.incrementalParser) {
+                responseObject = [self.incrementalParser finishParsingWithError:&serializationError];
+                self.incrementalParser = nil;
+                //没有缓存完整的数据、通知里带上解析器在错误信息中保留的那一段
+                NSData *failingData = serializationError.userInfo[AFNetworkingOperationFailingURLResponseDataErrorKey];
+                if (failingData) {
+                    userInfo[AFNetworkingTaskDidCompleteResponseDataKey] = failingData;
+                }
+            } else {
+                responseObject = [manager.responseSerializer responseObjectForResponse:task.response data:data error:&serializationError];
+            }
+            [self recordTimingPhase:AFURLSessionTaskTimingPhaseSerializerEnd];
 
             //如果数据存储到了磁盘、则返回磁盘位置
             if (self.downloadFileURL) {
@@ -330,16 +445,19 @@ didCompleteWithError:(NSError *)error
                 userInfo[AFNetworkingTaskDidCompleteErrorKey] = serializationError;
             }
             //如果用户没有定制、则使用AF提供的分组和队列
-            dispatch_group_async(manager.completionGroup ?: url_session_manager_completion_group(), manager.completionQueue ?: dispatch_get_main_queue(), ^{
+            [self recordTimingPhase:AFURLSessionTaskTimingPhaseCallbackDispatch];
+            [manager deliverCompletionBlock:^{
+                [self recordTimingPhase:AFURLSessionTaskTimingPhaseCallbackStart];
                 //回调给用户
                 if (self.completionHandler) {
                     self.completionHandler(task.response, responseObject, serializationError);
                 }
+                [self finishTimingWithResponse:task.response error:serializationError];
                 //通知
-                dispatch_async(dispatch_get_main_queue(), ^{
+                [manager deliverMainQueueBlock:^{
                     [[NSNotificationCenter defaultCenter] postNotificationName:AFNetworkingTaskDidCompleteNotification object:task userInfo:userInfo];
-                });
-            });
+                }];
+            }];
         });
     }
 #pragma clang diagnostic pop
@@ -347,12 +465,212 @@ didCompleteWithError:(NSError *)error
 
 #pragma mark - NSURLSessionDataTaskDelegate
 //服务器返回了(可能是一部分)数据
-- (void)URLSession:(__unused NSURLSession *)session
-          dataTask:(__unused NSURLSessionDataTask *)dataTask
+- (void)URLSession:(NSURLSession *)session
+          dataTask:(NSURLSessionDataTask *)dataTask
     didReceiveData:(NSData *)data
 {
-    //组合数据
-    [self.mutableData appendData:data];
+    if (self.timingRecorder) {
+        //没有收到didReceiveResponse时以第一段数据的时间作为第一个字节的时间
+        if (_timing.timestamps[AFURLSessionTaskTimingPhaseFirstByte] == 0) {
+            [self recordTimingPhase:AFURLSessionTaskTimingPhaseFirstByte];
+        }
+        [self recordTimingPhase:AFURLSessionTaskTimingPhaseLastByte];
+    }
+
+    //序列化器支持增量解析时、收到第一段数据时为响应创建解析器、之后不再缓存数据
+    //关闭了数据缓存的任务不交给序列化器解析
+    if (!self.didPrepareIncrementalParser && self.mutableData) {
+        self.didPrepareIncrementalParser = YES;
+        id <AFURLResponseSerialization> responseSerializer = self.manager.responseSerializer;
+        if ([responseSerializer conformsToProtocol:@protocol(AFURLResponseIncrementalSerialization)]) {
+            self.incrementalParser = [(id <AFURLResponseIncrementalSerialization>)responseSerializer incrementalParserForResponse:dataTask.response];
+            if (self.incrementalParser) {
+                self.mutableData = nil;
+                self.incrementalParsingQueue = dispatch_queue_create("com.alamofire.networking.session.manager.incremental-parsing", DISPATCH_QUEUE_SERIAL);
+                dispatch_set_target_queue(self.incrementalParsingQueue, url_session_manager_processing_queue());
+            }
+        }
+    }
+
+    if (self.incrementalParser) {
+        //SAX解析和用户的handler在处理队列上执行、不阻塞后续的代理回调
+        id <AFURLResponseIncrementalParsing> incrementalParser = self.incrementalParser;
+        NSData *receivedData = [data copy];
+        dispatch_async(self.incrementalParsingQueue, ^{
+            [incrementalParser appendData:receivedData];
+        });
+    } else if (self.spillFileDescriptor >= 0 || (self.mutableData && self.responseDataSpillThreshold > 0 && [self.mutableData length] + [data length] > self.responseDataSpillThreshold)) {
+        //超过阈值、写入临时文件
+        if (![self spillData:data]) {
+            [dataTask cancel];
+        }
+    } else {
+        //组合数据
+        [self.mutableData appendData:data];
+    }
+
+    //将本段数据交给任务级别的回调(比如渐进式解码)
+    if (self.dataTaskDidReceiveData) {
+        self.dataTaskDidReceiveData(session, dataTask, data);
+    }
+}
+
+#pragma mark - Task Timing
+
+- (void)startTimingForTask:(NSURLSessionTask *)task recorder:(AFURLSessionTaskTimingRecorder *)recorder {
+    //数据任务转为下载任务时会重新关联、保留原来的记录
+    if (!recorder || self.timingRecorder) {
+        return;
+    }
+
+    self.timingRecorder = recorder;
+    _timing.taskIdentifier = task.taskIdentifier;
+    _timing.timestamps[AFURLSessionTaskTimingPhaseTaskCreation] = AFURLSessionTaskTimingTimestamp();
+    AFURLSessionTaskTimingRecordSetName(&_timing, task.originalRequest);
+}
+
+- (void)recordTimingPhase:(AFURLSessionTaskTimingPhase)phase {
+    if (!self.timingRecorder) {
+        return;
+    }
+    //暂停后再次resume时任务可能已经在其他阶段、只保留第一次、不在交接之外写入
+    if (phase == AFURLSessionTaskTimingPhaseResume && _timing.timestamps[phase] != 0) {
+        return;
+    }
+
+    _timing.timestamps[phase] = AFURLSessionTaskTimingTimestamp();
+}
+
+- (void)recordRequestSerializationStartTime:(uint64_t)startTime endTime:(uint64_t)endTime {
+    //合并的请求共用一个任务、保留第一个请求的序列化时间
+    if (!self.timingRecorder || _timing.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationStart] != 0) {
+        return;
+    }
+
+    _timing.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationStart] = startTime;
+    _timing.timestamps[AFURLSessionTaskTimingPhaseRequestSerializationEnd] = endTime;
+}
+
+#if AF_CAN_INCLUDE_SESSION_TASK_METRICS
+//把墙上时间换算到单调时钟
+static uint64_t AFURLSessionTaskTimingTimestampForDate(NSDate *date, uint64_t now, NSTimeInterval referenceNow) {
+    if (!date) {
+        return 0;
+    }
+
+    double elapsed = (referenceNow - [date timeIntervalSinceReferenceDate]) * NSEC_PER_SEC;
+    if (elapsed <= 0) {
+        return now;
+    }
+
+    return elapsed < now ? now - (uint64_t)elapsed : 0;
+}
+
+- (void)recordTimingMetrics:(NSURLSessionTaskMetrics *)metrics {
+    if (!self.timingRecorder) {
+        return;
+    }
+
+    //重定向时有多个事务、只记录最后一个
+    NSURLSessionTaskTransactionMetrics *transactionMetrics = [metrics.transactionMetrics lastObject];
+    if (!transactionMetrics) {
+        return;
+    }
+
+    uint64_t now = AFURLSessionTaskTimingTimestamp();
+    NSTimeInterval referenceNow = [NSDate timeIntervalSinceReferenceDate];
+    uint64_t *timestamps = _timing.timestamps;
+    timestamps[AFURLSessionTaskTimingPhaseDomainLookupStart] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.domainLookupStartDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseDomainLookupEnd] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.domainLookupEndDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseConnectStart] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.connectStartDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseConnectEnd] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.connectEndDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseSecureConnectionStart] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.secureConnectionStartDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseSecureConnectionEnd] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.secureConnectionEndDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseRequestStart] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.requestStartDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseResponseStart] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.responseStartDate, now, referenceNow);
+    timestamps[AFURLSessionTaskTimingPhaseResponseEnd] = AFURLSessionTaskTimingTimestampForDate(transactionMetrics.responseEndDate, now, referenceNow);
+}
+#endif
+
+//回调执行完、把记录写入记录器
+- (void)finishTimingWithResponse:(NSURLResponse *)response error:(NSError *)error {
+    AFURLSessionTaskTimingRecorder *recorder = self.timingRecorder;
+    if (!recorder) {
+        return;
+    }
+
+    _timing.timestamps[AFURLSessionTaskTimingPhaseCallbackEnd] = AFURLSessionTaskTimingTimestamp();
+    if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+        _timing.statusCode = [(NSHTTPURLResponse *)response statusCode];
+    }
+    _timing.failed = error != nil;
+    [recorder appendRecord:&_timing];
+}
+
+#pragma mark - Spill To Disk
+
+- (BOOL)spillData:(NSData *)data {
+    if (self.spillFileDescriptor < 0) {
+        self.spillFileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[@"AFNetworking-" stringByAppendingString:[[NSUUID UUID] UUIDString]]]];
+        self.spillFileDescriptor = open([[self.spillFileURL path] fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (self.spillFileDescriptor < 0) {
+            self.spillError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            self.spillFileURL = nil;
+            self.mutableData = nil;
+            return NO;
+        }
+
+        //先写入已经缓存的部分
+        NSData *bufferedData = self.mutableData;
+        self.mutableData = nil;
+        if (![self writeSpillData:bufferedData]) {
+            return NO;
+        }
+    }
+
+    return [self writeSpillData:data];
+}
+
+- (BOOL)writeSpillData:(NSData *)data {
+    __block int writeError = 0;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        NSUInteger writtenLength = 0;
+        while (writtenLength < byteRange.length) {
+            ssize_t result = write(self.spillFileDescriptor, (const uint8_t *)bytes + writtenLength, byteRange.length - writtenLength);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                writeError = errno;
+                *stop = YES;
+                return;
+            }
+            writtenLength += (NSUInteger)result;
+        }
+    }];
+
+    if (writeError) {
+        self.spillError = [NSError errorWithDomain:NSPOSIXErrorDomain code:writeError userInfo:nil];
+        [self removeSpillFile];
+        return NO;
+    }
+
+    return YES;
+}
+
+- (void)removeSpillFile {
+    if (self.spillFileDescriptor >= 0) {
+        close(self.spillFileDescriptor);
+        self.spillFileDescriptor = -1;
+    }
+    if (self.spillFileURL) {
+        unlink([[self.spillFileURL path] fileSystemRepresentation]);
+        self.spillFileURL = nil;
+    }
+}
+
+- (void)dealloc {
+    [self removeSpillFile];
 }
 
 #pragma mark - NSURLSessionDownloadTaskDelegate
@@ -361,6 +679,8 @@ didCompleteWithError:(NSError *)error
       downloadTask:(NSURLSessionDownloadTask *)downloadTask
 didFinishDownloadingToURL:(NSURL *)location
 {
+    [self recordTimingPhase:AFURLSessionTaskTimingPhaseLastByte];
+
     NSError *fileManagerError = nil;
     self.downloadFileURL = nil;
 
@@ -405,6 +725,16 @@ static inline BOOL af_addMethod(Class theClass, SEL selector, Method method) {
 static NSString * const AFNSURLSessionTaskDidResumeNotification  = @"com.alamofire.networking.nsurlsessiontask.resume";
 static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofire.networking.nsurlsessiontask.suspend";
 
+//任务所属的并发限制器
+static char AFURLSessionTaskConcurrencyLimiterKey;
+
+@interface AFURLSessionConcurrencyLimiter ()
+- (void)registerTask:(NSURLSessionTask *)task session:(NSURLSession *)session;
+- (BOOL)shouldDeferResumeOfTask:(NSURLSessionTask *)task;
+- (void)taskDidComplete:(NSURLSessionTask *)task error:(NSError *)error;
+- (void)sessionDidBecomeInvalid:(NSURLSession *)session;
+@end
+
 @interface _AFURLSessionTaskSwizzling : NSObject
 
 @end
@@ -489,12 +819,18 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 
 - (void)af_resume {
     NSAssert([self respondsToSelector:@selector(state)], @"Does not respond to state");
-    NSURLSessionTaskState state = [self state];
-    [self af_resume];
-    
-    if (state != NSURLSessionTaskStateRunning) {
+    //受并发限制的任务先排队、轮到时由限制器再次调用resume
+    AFURLSessionConcurrencyLimiter *limiter = objc_getAssociatedObject(self, &AFURLSessionTaskConcurrencyLimiterKey);
+    if (limiter && [limiter shouldDeferResumeOfTask:(NSURLSessionTask *)self]) {
+        return;
+    }
+
+    //先发通知再真正开始、manager记录的开始时间在任务的任何代理回调之前写入
+    //对外的AFNetworkingTaskDidResumeNotification由manager异步发到主线程、顺序不受影响
+    if ([self state] != NSURLSessionTaskStateRunning) {
         [[NSNotificationCenter defaultCenter] postNotificationName:AFNSURLSessionTaskDidResumeNotification object:self];
     }
+    [self af_resume];
 }
 
 - (void)af_suspend {
@@ -510,6 +846,34 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 
 #pragma mark -
 
+@interface AFURLSessionSegmentedDownload ()
+@property (readwrite, nonatomic, copy) void (^downloadProgressBlock)(NSProgress *downloadProgress);
+@property (readwrite, nonatomic, copy) NSURL * (^destination)(NSURL *targetPath, NSURLResponse *response);
+@property (readwrite, nonatomic, copy) void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error);
+
+- (instancetype)initWithManager:(AFURLSessionManager *)manager
+                        request:(NSURLRequest *)request
+               numberOfSegments:(NSUInteger)numberOfSegments;
+@end
+
+@interface AFURLSessionChunkedUpload ()
+@property (readwrite, nonatomic, copy) void (^uploadProgressBlock)(NSProgress *uploadProgress);
+@property (readwrite, nonatomic, copy) void (^completionHandler)(NSURLResponse *response, id responseObject, NSError *error);
+
+- (instancetype)initWithManager:(AFURLSessionManager *)manager
+                        request:(NSURLRequest *)request
+                        fileURL:(NSURL *)fileURL
+                    manifestURL:(NSURL *)manifestURL;
+@end
+
+@interface AFURLSessionDataStream ()
+- (instancetype)initWithManager:(AFURLSessionManager *)manager
+                        request:(NSURLRequest *)request
+          maximumBufferedLength:(NSUInteger)maximumBufferedLength;
+@end
+
+#pragma mark -
+
 @interface AFURLSessionManager ()
 //配置信息
 @property (readwrite, nonatomic, strong) NSURLSessionConfiguration *sessionConfiguration;
@@ -523,6 +887,10 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 @property (readonly, nonatomic, copy) NSString *taskDescriptionForSessionTasks;
 //线程锁
 @property (readwrite, nonatomic, strong) NSLock *lock;
+//completionQueue不是主队列时使用的合并投递队列
+@property (readwrite, nonatomic, strong) AFURLSessionDeliveryQueue *completionDeliveryQueue;
+//completionDeliveryCoalescingInterval大于0时主队列使用的合并投递队列
+@property (readwrite, nonatomic, strong) AFURLSessionDeliveryQueue *mainQueueDeliveryQueue;
 
 //剩下这些全部是承接系统原生代理的Block
 @property (readwrite, nonatomic, copy) AFURLSessionDidBecomeInvalidBlock sessionDidBecomeInvalid;
@@ -622,6 +990,9 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     if ([task respondsToSelector:@selector(taskDescription)]) {
         //确定这个taks是不是属于当前的session
         if ([task.taskDescription isEqualToString:self.taskDescriptionForSessionTasks]) {
+            if (self.taskTimingRecorder) {
+                [[self delegateForTask:task] recordTimingPhase:AFURLSessionTaskTimingPhaseResume];
+            }
             dispatch_async(dispatch_get_main_queue(), ^{
                 [[NSNotificationCenter defaultCenter] postNotificationName:AFNetworkingTaskDidResumeNotification object:task];
             });
@@ -671,11 +1042,15 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     self.mutableTaskDelegatesKeyedByTaskIdentifier[@(task.taskIdentifier)] = delegate;
     //为AFTaskDelegate设置 task 的进度监听
     [delegate setupProgressForTask:task];
+    //开始记录各阶段的时间
+    [delegate startTimingForTask:task recorder:self.taskTimingRecorder];
     //为任务添加监听、包括暂停和开始
     //后面还会hook暂停和开始的方法、触发监听
     [self addNotificationObserverForTask:task];
     
     [self.lock unlock];
+
+    [self.concurrencyLimiter registerTask:task session:self.session];
 }
 
 //为每个NSURLSessionDataTask对象生成对应的delegate对象。
@@ -690,6 +1065,7 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     delegate.manager = self;
     //设置完成回调---由用户传入
     delegate.completionHandler = completionHandler;
+    delegate.responseDataSpillThreshold = self.responseDataSpillThreshold;
     //添加个描述。具体为self对象的指针str
     dataTask.taskDescription = self.taskDescriptionForSessionTasks;
     //将代理和task关联(为AFTaskDelegate设置task的进度监听、为task添加开始结束的监听等等)
@@ -706,6 +1082,7 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     AFURLSessionManagerTaskDelegate *delegate = [[AFURLSessionManagerTaskDelegate alloc] init];
     delegate.manager = self;
     delegate.completionHandler = completionHandler;
+    delegate.responseDataSpillThreshold = self.responseDataSpillThreshold;
 
     uploadTask.taskDescription = self.taskDescriptionForSessionTasks;
 
@@ -850,6 +1227,12 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     return dataTask;
 }
 
+- (AFURLSessionDataStream *)streamingDataTaskWithRequest:(NSURLRequest *)request
+                                   maximumBufferedLength:(NSUInteger)maximumBufferedLength
+{
+    return [[AFURLSessionDataStream alloc] initWithManager:self request:request maximumBufferedLength:maximumBufferedLength];
+}
+
 #pragma mark -
 
 - (NSURLSessionUploadTask *)uploadTaskWithRequest:(NSURLRequest *)request
@@ -937,6 +1320,33 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     return downloadTask;
 }
 
+- (AFURLSessionSegmentedDownload *)segmentedDownloadTaskWithRequest:(NSURLRequest *)request
+                                                   numberOfSegments:(NSUInteger)numberOfSegments
+                                                           progress:(void (^)(NSProgress *downloadProgress))downloadProgressBlock
+                                                        destination:(NSURL * (^)(NSURL *targetPath, NSURLResponse *response))destination
+                                                  completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler
+{
+    AFURLSessionSegmentedDownload *download = [[AFURLSessionSegmentedDownload alloc] initWithManager:self request:request numberOfSegments:numberOfSegments];
+    download.downloadProgressBlock = downloadProgressBlock;
+    download.destination = destination;
+    download.completionHandler = completionHandler;
+
+    return download;
+}
+
+- (AFURLSessionChunkedUpload *)chunkedUploadTaskWithRequest:(NSURLRequest *)request
+                                                   fromFile:(NSURL *)fileURL
+                                                manifestURL:(NSURL *)manifestURL
+                                                   progress:(void (^)(NSProgress *uploadProgress))uploadProgressBlock
+                                          completionHandler:(void (^)(NSURLResponse *response, id responseObject, NSError *error))completionHandler
+{
+    AFURLSessionChunkedUpload *upload = [[AFURLSessionChunkedUpload alloc] initWithManager:self request:request fileURL:fileURL manifestURL:manifestURL];
+    upload.uploadProgressBlock = uploadProgressBlock;
+    upload.completionHandler = completionHandler;
+
+    return upload;
+}
+
 #pragma mark -
 - (NSProgress *)uploadProgressForTask:(NSURLSessionTask *)task {
     return [[self delegateForTask:task] uploadProgress];
@@ -996,6 +1406,30 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     self.dataTaskDidReceiveData = block;
 }
 
+- (void)setDataTaskDidReceiveDataBlock:(void (^)(NSURLSession *session, NSURLSessionDataTask *dataTask, NSData *data))block
+                               forTask:(NSURLSessionDataTask *)dataTask
+{
+    [self delegateForTask:dataTask].dataTaskDidReceiveData = block;
+}
+
+- (void)setDataTaskBuffersResponseData:(BOOL)buffersResponseData
+                               forTask:(NSURLSessionDataTask *)dataTask
+{
+    AFURLSessionManagerTaskDelegate *delegate = [self delegateForTask:dataTask];
+    //不缓存时mutableData为nil、收到的数据直接丢弃
+    if (!buffersResponseData) {
+        delegate.mutableData = nil;
+    } else if (!delegate.mutableData) {
+        delegate.mutableData = [NSMutableData data];
+    }
+}
+
+- (void)setDataTaskResponseDataSpillThreshold:(NSUInteger)threshold
+                                      forTask:(NSURLSessionDataTask *)dataTask
+{
+    [self delegateForTask:dataTask].responseDataSpillThreshold = threshold;
+}
+
 - (void)setDataTaskWillCacheResponseBlock:(NSCachedURLResponse * (^)(NSURLSession *session, NSURLSessionDataTask *dataTask, NSCachedURLResponse *proposedResponse))block {
     self.dataTaskWillCacheResponse = block;
 }
@@ -1014,6 +1448,68 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     self.downloadTaskDidResume = block;
 }
 
+#pragma mark - Task Timing
+
+- (void)recordRequestSerializationStartTime:(uint64_t)startTime
+                                    endTime:(uint64_t)endTime
+                                    forTask:(NSURLSessionTask *)task
+{
+    if (!self.taskTimingRecorder || !task) {
+        return;
+    }
+
+    [[self delegateForTask:task] recordRequestSerializationStartTime:startTime endTime:endTime];
+}
+
+#pragma mark - Completion Delivery
+
+- (void)deliverCompletionBlock:(dispatch_block_t)block {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wgnu"
+    dispatch_group_t group = self.completionGroup ?: url_session_manager_completion_group();
+    dispatch_queue_t queue = self.completionQueue ?: dispatch_get_main_queue();
+#pragma clang diagnostic pop
+    if (!self.coalescesCompletionDelivery) {
+        dispatch_group_async(group, queue, block);
+        return;
+    }
+
+    [[self deliveryQueueForQueue:queue] enqueueBlock:block group:group];
+}
+
+- (void)deliverMainQueueBlock:(dispatch_block_t)block {
+    if (!self.coalescesCompletionDelivery) {
+        dispatch_async(dispatch_get_main_queue(), block);
+        return;
+    }
+
+    [[self deliveryQueueForQueue:dispatch_get_main_queue()] enqueueBlock:block];
+}
+
+//主队列上没有等待间隔时和通知、其他manager共用一个、完成回调和随后的通知在同一次排空中执行
+//有等待间隔时使用manager自己的、间隔不会影响其他manager
+- (AFURLSessionDeliveryQueue *)deliveryQueueForQueue:(dispatch_queue_t)queue {
+    NSTimeInterval coalescingInterval = MAX(self.completionDeliveryCoalescingInterval, 0);
+    BOOL isMainQueue = queue == dispatch_get_main_queue();
+    if (isMainQueue && coalescingInterval == 0) {
+        return [AFURLSessionDeliveryQueue mainDeliveryQueue];
+    }
+
+    [self.lock lock];
+    AFURLSessionDeliveryQueue *deliveryQueue = isMainQueue ? self.mainQueueDeliveryQueue : self.completionDeliveryQueue;
+    if (deliveryQueue.queue != queue || deliveryQueue.coalescingInterval != coalescingInterval) {
+        deliveryQueue = [[AFURLSessionDeliveryQueue alloc] initWithQueue:queue coalescingInterval:coalescingInterval];
+        if (isMainQueue) {
+            self.mainQueueDeliveryQueue = deliveryQueue;
+        } else {
+            self.completionDeliveryQueue = deliveryQueue;
+        }
+    }
+    [self.lock unlock];
+
+    return deliveryQueue;
+}
+
 #pragma mark - NSObject
 
 - (NSString *)description {
@@ -1024,12 +1520,17 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
     if (selector == @selector(URLSession:task:willPerformHTTPRedirection:newRequest:completionHandler:)) {
         return self.taskWillPerformHTTPRedirection != nil;
     } else if (selector == @selector(URLSession:dataTask:didReceiveResponse:completionHandler:)) {
-        return self.dataTaskDidReceiveResponse != nil;
+        return self.dataTaskDidReceiveResponse != nil || self.taskTimingRecorder != nil;
     } else if (selector == @selector(URLSession:dataTask:willCacheResponse:completionHandler:)) {
         return self.dataTaskWillCacheResponse != nil;
     } else if (selector == @selector(URLSessionDidFinishEventsForBackgroundURLSession:)) {
         return self.didFinishEventsForBackgroundURLSession != nil;
     }
+#if AF_CAN_INCLUDE_SESSION_TASK_METRICS
+    else if (selector == @selector(URLSession:task:didFinishCollectingMetrics:)) {
+        return self.taskTimingRecorder != nil;
+    }
+#endif
 
     return [[self class] instancesRespondToSelector:selector];
 }
@@ -1039,6 +1540,9 @@ static NSString * const AFNSURLSessionTaskDidSuspendNotification = @"com.alamofi
 - (void)URLSession:(NSURLSession *)session
 didBecomeInvalidWithError:(NSError *)error
 {
+    //没有resume或者还在排队的任务不会再结束、从限制器中移除
+    [self.concurrencyLimiter sessionDidBecomeInvalid:session];
+
     if (self.sessionDidBecomeInvalid) {
         self.sessionDidBecomeInvalid(session, error);
     }
@@ -1176,6 +1680,9 @@ totalBytesExpectedToSend:(int64_t)totalBytesExpectedToSend
               task:(NSURLSessionTask *)task
 didCompleteWithError:(NSError *)error
 {
+    //释放并发限制的名额、记录耗时
+    [objc_getAssociatedObject(task, &AFURLSessionTaskConcurrencyLimiterKey) taskDidComplete:task error:error];
+
     AFURLSessionManagerTaskDelegate *delegate = [self delegateForTask:task];
 
     if (delegate) {
@@ -1192,6 +1699,16 @@ didCompleteWithError:(NSError *)error
     }
 }
 
+#if AF_CAN_INCLUDE_SESSION_TASK_METRICS
+//任务的网络耗时统计、在任务结束之前调用
+- (void)URLSession:(__unused NSURLSession *)session
+              task:(NSURLSessionTask *)task
+didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics
+{
+    [[self delegateForTask:task] recordTimingMetrics:metrics];
+}
+#endif
+
 #pragma mark - NSURLSessionDataDelegate
 //服务器返回响应头、询问下一步操作(取消操作、普通传输、下载、数据流传输)
 - (void)URLSession:(NSURLSession *)session
@@ -1201,6 +1718,10 @@ didReceiveResponse:(NSURLResponse *)response
 {
     NSURLSessionResponseDisposition disposition = NSURLSessionResponseAllow;
 
+    if (self.taskTimingRecorder) {
+        [[self delegateForTask:dataTask] recordTimingPhase:AFURLSessionTaskTimingPhaseFirstByte];
+    }
+
     if (self.dataTaskDidReceiveResponse) {
         disposition = self.dataTaskDidReceiveResponse(session, dataTask, response);
     }
@@ -1341,3 +1862,1863 @@ expectedTotalBytes:(int64_t)expectedTotalBytes
 }
 
 @end
+
+#pragma mark -
+
+//分段下载中的一段、[offset, end)为还没有写入的范围
+@interface AFURLSessionDownloadSegment : NSObject
+@property (nonatomic, assign) int64_t offset;
+@property (nonatomic, assign) int64_t end;
+@property (nonatomic, assign) BOOL isProbe;//第一个请求、用来确定文件长度和是否支持Range
+@property (nonatomic, assign) BOOL didReceiveResponse;
+@property (nonatomic, assign) BOOL finished;
+@property (nonatomic, assign) NSUInteger retryCount;
+@property (nonatomic, strong) NSURLSessionDataTask *task;
+@end
+
+@implementation AFURLSessionDownloadSegment
+@end
+
+//分段提前断开时的最多重试次数
+static NSUInteger const kAFURLSessionDownloadSegmentMaximumRetryCount = 3;
+
+@interface AFURLSessionSegmentedDownload ()
+@property (readwrite, nonatomic, weak) AFURLSessionManager *manager;
+@property (readwrite, nonatomic, copy) NSURLRequest *request;
+@property (readwrite, nonatomic, assign) NSUInteger numberOfSegments;
+@property (readwrite, nonatomic, strong) NSProgress *progress;
+@property (readwrite, nonatomic, strong) NSMutableArray <AFURLSessionDownloadSegment *> *segments;
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, strong) NSURL *temporaryFileURL;
+@property (readwrite, nonatomic, assign) int fileDescriptor;
+@property (readwrite, nonatomic, assign) int64_t totalLength;//-1为未知
+@property (readwrite, nonatomic, copy) NSString *validator;//强ETag或Last-Modified、用于If-Range、为nil时只用一个连接
+@property (readwrite, nonatomic, strong) NSURLResponse *response;
+@property (readwrite, nonatomic, assign) BOOL started;
+@property (readwrite, nonatomic, assign) BOOL finished;
+@end
+
+@implementation AFURLSessionSegmentedDownload
+
+- (instancetype)initWithManager:(AFURLSessionManager *)manager
+                        request:(NSURLRequest *)request
+               numberOfSegments:(NSUInteger)numberOfSegments
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.manager = manager;
+    self.request = request;
+    self.numberOfSegments = MAX(numberOfSegments, (NSUInteger)1);
+    self.minimumSegmentLength = 1024 * 1024;
+    self.segments = [NSMutableArray array];
+    self.lock = [[NSLock alloc] init];
+    self.fileDescriptor = -1;
+    self.totalLength = -1;
+
+    self.progress = [[NSProgress alloc] initWithParent:nil userInfo:nil];
+    self.progress.totalUnitCount = NSURLSessionTransferSizeUnknown;
+    __weak __typeof__(self) weakSelf = self;
+    self.progress.cancellationHandler = ^{
+        [weakSelf cancel];
+    };
+
+    return self;
+}
+
+- (void)resume {
+    [self.lock lock];
+    if (self.started) {
+        [self.lock unlock];
+        return;
+    }
+    self.started = YES;
+
+    self.temporaryFileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    self.fileDescriptor = open([[self.temporaryFileURL path] fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (self.fileDescriptor < 0) {
+        [self failWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]];
+        [self.lock unlock];
+        return;
+    }
+
+    //第一段同时用来探测、范围先设为整个文件
+    AFURLSessionDownloadSegment *segment = [[AFURLSessionDownloadSegment alloc] init];
+    segment.isProbe = YES;
+    segment.end = INT64_MAX;
+    [self.segments addObject:segment];
+    [self startSegment:segment];
+    [self.lock unlock];
+}
+
+- (void)cancel {
+    [self.lock lock];
+    [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+    [self.lock unlock];
+}
+
+#pragma mark -
+
+//以下方法都需要在持有lock时调用
+
+- (void)startSegment:(AFURLSessionDownloadSegment *)segment {
+    AFURLSessionManager *manager = self.manager;
+    if (!manager) {
+        [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+        return;
+    }
+
+    NSMutableURLRequest *mutableRequest = [self.request mutableCopy];
+    if (segment.end == INT64_MAX) {
+        [mutableRequest setValue:[NSString stringWithFormat:@"bytes=%lld-", segment.offset] forHTTPHeaderField:@"Range"];
+    } else {
+        [mutableRequest setValue:[NSString stringWithFormat:@"bytes=%lld-%lld", segment.offset, segment.end - 1] forHTTPHeaderField:@"Range"];
+    }
+    //Range针对的是未压缩的内容
+    [mutableRequest setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+    //文件在下载过程中发生变化时服务器会返回200
+    if (!segment.isProbe && self.validator) {
+        [mutableRequest setValue:self.validator forHTTPHeaderField:@"If-Range"];
+    }
+
+    NSURLSessionDataTask *dataTask = [manager dataTaskWithRequest:mutableRequest uploadProgress:nil downloadProgress:nil completionHandler:^(NSURLResponse *response, __unused id responseObject, NSError *error) {
+        [self segment:segment response:response didCompleteWithError:error];
+    }];
+    [manager setDataTaskBuffersResponseData:NO forTask:dataTask];
+    [manager setDataTaskDidReceiveDataBlock:^(__unused NSURLSession *session, NSURLSessionDataTask *task, NSData *data) {
+        [self segment:segment didReceiveData:data response:task.response];
+    } forTask:dataTask];
+
+    segment.task = dataTask;
+    segment.didReceiveResponse = NO;
+    [dataTask resume];
+}
+
+//探测请求返回206时、按总长度分段
+- (void)splitSegmentsWithTotalLength:(int64_t)totalLength {
+    AFURLSessionDownloadSegment *probeSegment = [self.segments firstObject];
+    int64_t segmentLength = MAX(self.minimumSegmentLength, (totalLength + (int64_t)self.numberOfSegments - 1) / (int64_t)self.numberOfSegments);
+    probeSegment.end = MIN(totalLength, segmentLength);
+
+    for (int64_t start = probeSegment.end; start < totalLength; start += segmentLength) {
+        AFURLSessionDownloadSegment *segment = [[AFURLSessionDownloadSegment alloc] init];
+        segment.offset = start;
+        segment.end = MIN(totalLength, start + segmentLength);
+        [self.segments addObject:segment];
+        [self startSegment:segment];
+    }
+}
+
+//从剩余最多的一段中分走后一半、交给空闲的连接
+- (BOOL)stealWork {
+    //没有If-Range的条件时、新的连接无法保证拿到的是同一个文件
+    if (!self.validator) {
+        return NO;
+    }
+
+    AFURLSessionDownloadSegment *victim = nil;
+    for (AFURLSessionDownloadSegment *segment in self.segments) {
+        if (!segment.finished && segment.end != INT64_MAX && (!victim || segment.end - segment.offset > victim.end - victim.offset)) {
+            victim = segment;
+        }
+    }
+    if (!victim || victim.end - victim.offset < self.minimumSegmentLength * 2) {
+        return NO;
+    }
+
+    AFURLSessionDownloadSegment *segment = [[AFURLSessionDownloadSegment alloc] init];
+    segment.offset = victim.offset + (victim.end - victim.offset) / 2;
+    segment.end = victim.end;
+    //原来的连接写到新的结束位置后会被取消
+    victim.end = segment.offset;
+    [self.segments addObject:segment];
+    [self startSegment:segment];
+
+    return YES;
+}
+
+- (void)finishSegment:(AFURLSessionDownloadSegment *)segment {
+    segment.finished = YES;
+    [segment.task cancel];
+    segment.task = nil;
+
+    if ([self stealWork]) {
+        return;
+    }
+
+    for (AFURLSessionDownloadSegment *otherSegment in self.segments) {
+        if (!otherSegment.finished) {
+            return;
+        }
+    }
+    [self finish];
+}
+
+- (void)segment:(AFURLSessionDownloadSegment *)segment
+ didReceiveData:(NSData *)data
+       response:(NSURLResponse *)response
+{
+    [self.lock lock];
+    if (self.finished || segment.finished) {
+        [self.lock unlock];
+        return;
+    }
+
+    if (!segment.didReceiveResponse) {
+        segment.didReceiveResponse = YES;
+        if (![self segment:segment validateResponse:(NSHTTPURLResponse *)response]) {
+            [self.lock unlock];
+            return;
+        }
+    }
+
+    //只写入属于本段的部分
+    int64_t length = MIN((int64_t)[data length], segment.end - segment.offset);
+    __block int64_t writtenLength = 0;
+    __block int writeError = 0;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        while (writtenLength < length && writtenLength < (int64_t)NSMaxRange(byteRange)) {
+            size_t count = (size_t)(MIN(length, (int64_t)NSMaxRange(byteRange)) - writtenLength);
+            ssize_t result = pwrite(self.fileDescriptor, (const uint8_t *)bytes + (writtenLength - (int64_t)byteRange.location), count, (off_t)(segment.offset + writtenLength));
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                writeError = errno;
+                *stop = YES;
+                return;
+            }
+            writtenLength += result;
+        }
+        *stop = writtenLength >= length;
+    }];
+    if (writeError) {
+        [self failWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:writeError userInfo:nil]];
+        [self.lock unlock];
+        return;
+    }
+
+    segment.offset += writtenLength;
+    self.progress.completedUnitCount += writtenLength;
+    if (segment.offset >= segment.end) {
+        [self finishSegment:segment];
+    }
+    [self.lock unlock];
+
+    if (self.downloadProgressBlock) {
+        self.downloadProgressBlock(self.progress);
+    }
+}
+
+- (BOOL)segment:(AFURLSessionDownloadSegment *)segment validateResponse:(NSHTTPURLResponse *)response {
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? response.statusCode : 200;
+
+    //探测请求只接受200和206、其他的2xx(比如204)也不是文件内容
+    if (segment.isProbe && statusCode != 200 && statusCode != 206) {
+        [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSURLErrorFailingURLErrorKey: self.request.URL ?: [NSNull null]}]];
+        return NO;
+    }
+
+    if (!segment.isProbe) {
+        //不是206说明服务器不再支持Range或者文件已经变化
+        if (statusCode != 206) {
+            [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSLocalizedDescriptionKey: NSLocalizedStringFromTable(@"The server did not honor the range request", @"AFNetworking", nil), NSURLErrorFailingURLErrorKey: self.request.URL ?: [NSNull null]}]];
+            return NO;
+        }
+        return YES;
+    }
+
+    self.response = response;
+    int64_t totalLength = -1;
+    if (statusCode == 206) {
+        //Content-Range: bytes 0-1023/4096
+        NSString *contentRange = [response isKindOfClass:[NSHTTPURLResponse class]] ? response.allHeaderFields[@"Content-Range"] : nil;
+        NSRange slashRange = [contentRange rangeOfString:@"/"];
+        if (slashRange.location != NSNotFound) {
+            NSString *totalString = [contentRange substringFromIndex:NSMaxRange(slashRange)];
+            if (![totalString isEqualToString:@"*"]) {
+                totalLength = [totalString longLongValue];
+            }
+        }
+    } else {
+        totalLength = response.expectedContentLength;
+    }
+
+    self.totalLength = totalLength > 0 ? totalLength : -1;
+    self.progress.totalUnitCount = self.totalLength;
+    if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+        //If-Range只能使用强ETag、弱ETag(W/"...")不保证字节相同、退回到Last-Modified
+        NSString *ETag = response.allHeaderFields[@"ETag"];
+        if ([ETag length] > 0 && ![ETag hasPrefix:@"W/"]) {
+            self.validator = ETag;
+        } else {
+            self.validator = response.allHeaderFields[@"Last-Modified"];
+        }
+    }
+
+    if (statusCode == 206 && self.totalLength > 0 && !self.validator) {
+        //没有验证条件时不分段、探测请求读完整个文件
+        [self.segments firstObject].end = self.totalLength;
+    } else if (statusCode == 206 && self.totalLength > 0) {
+        //预先分配文件、各段直接写到对应位置
+        fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, self.totalLength, 0};
+        if (fcntl(self.fileDescriptor, F_PREALLOCATE, &store) == -1) {
+            store.fst_flags = F_ALLOCATEALL;
+            fcntl(self.fileDescriptor, F_PREALLOCATE, &store);
+        }
+        if (ftruncate(self.fileDescriptor, (off_t)self.totalLength) != 0) {
+            [self failWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]];
+            return NO;
+        }
+        [self splitSegmentsWithTotalLength:self.totalLength];
+    }
+    //不支持Range时探测请求就是唯一的连接、读到结束为止
+
+    return YES;
+}
+
+- (void)segment:(AFURLSessionDownloadSegment *)segment
+       response:(NSURLResponse *)response
+didCompleteWithError:(NSError *)error
+{
+    [self.lock lock];
+    if (self.finished || segment.finished) {
+        [self.lock unlock];
+        return;
+    }
+
+    //没有收到数据的响应(比如空的404)在这里检查状态码
+    if (!segment.didReceiveResponse && response) {
+        segment.didReceiveResponse = YES;
+        if (![self segment:segment validateResponse:(NSHTTPURLResponse *)response]) {
+            [self.lock unlock];
+            return;
+        }
+    }
+
+    //分段不缓存数据、manager的序列化器(默认为JSON)对二进制文件只会报告Content-Type之类的错误
+    //状态码已经由上面的验证检查过、忽略序列化器的错误
+    if ([error.domain isEqualToString:AFURLResponseSerializationErrorDomain]) {
+        error = nil;
+    }
+    if (error) {
+        [self failWithError:error];
+        [self.lock unlock];
+        return;
+    }
+
+    if (!segment.didReceiveResponse && segment.isProbe) {
+        //空文件
+        [self finishSegment:segment];
+    } else if (segment.end == INT64_MAX) {
+        //长度未知的单连接、读到结束即完成
+        [self finishSegment:segment];
+    } else if (segment.offset < segment.end) {
+        //连接提前结束、从断开的位置重新请求
+        if (++segment.retryCount > kAFURLSessionDownloadSegmentMaximumRetryCount) {
+            [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:@{NSURLErrorFailingURLErrorKey: self.request.URL ?: [NSNull null]}]];
+        } else {
+            segment.isProbe = NO;
+            [self startSegment:segment];
+        }
+    } else {
+        [self finishSegment:segment];
+    }
+    [self.lock unlock];
+}
+
+- (void)finish {
+    self.finished = YES;
+    close(self.fileDescriptor);
+    self.fileDescriptor = -1;
+
+    //此时持有lock、destination是用户代码、移动文件也可能很慢、放到处理队列上执行
+    NSURL *temporaryFileURL = self.temporaryFileURL;
+    NSURLResponse *response = self.response;
+    NSURL * (^destination)(NSURL *targetPath, NSURLResponse *response) = self.destination;
+    dispatch_async(url_session_manager_processing_queue(), ^{
+        NSURL *fileURL = temporaryFileURL;
+        NSError *fileManagerError = nil;
+        if (destination) {
+            NSURL *destinationURL = destination(temporaryFileURL, response);
+            if (destinationURL) {
+                if ([[NSFileManager defaultManager] moveItemAtURL:temporaryFileURL toURL:destinationURL error:&fileManagerError]) {
+                    fileURL = destinationURL;
+                } else {
+                    [[NSFileManager defaultManager] removeItemAtURL:temporaryFileURL error:nil];
+                    fileURL = nil;
+                }
+            }
+        }
+
+        [self.lock lock];
+        [self callCompletionHandlerWithFileURL:fileURL error:fileManagerError];
+        [self.lock unlock];
+    });
+}
+
+- (void)failWithError:(NSError *)error {
+    if (self.finished) {
+        return;
+    }
+    self.finished = YES;
+
+    for (AFURLSessionDownloadSegment *segment in self.segments) {
+        [segment.task cancel];
+        segment.task = nil;
+    }
+    if (self.fileDescriptor >= 0) {
+        close(self.fileDescriptor);
+        self.fileDescriptor = -1;
+    }
+    if (self.temporaryFileURL) {
+        [[NSFileManager defaultManager] removeItemAtURL:self.temporaryFileURL error:nil];
+    }
+
+    [self callCompletionHandlerWithFileURL:nil error:error];
+}
+
+- (void)callCompletionHandlerWithFileURL:(NSURL *)fileURL error:(NSError *)error {
+    void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error) = self.completionHandler;
+    self.completionHandler = nil;
+    if (!completionHandler) {
+        return;
+    }
+
+    NSURLResponse *response = self.response;
+    AFURLSessionManager *manager = self.manager;
+    [manager deliverCompletionBlock:^{
+        completionHandler(response, fileURL, error);
+    }];
+}
+
+@end
+
+#pragma mark -
+
+//Gear滚动哈希用的随机表、由固定种子的splitmix64生成、保证不同设备上切出相同的块
+static const uint64_t * AFURLSessionGearTable() {
+    static uint64_t _gearTable[256];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (NSUInteger i = 0; i < 256; i++) {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            _gearTable[i] = z ^ (z >> 31);
+        }
+    });
+
+    return _gearTable;
+}
+
+//FastCDC: 返回从bytes开始的下一个块的长度、块长度在[平均长度/4, 平均长度*8]之间
+//平均长度之前用位数更多的掩码、之后用位数更少的掩码(归一化分块)、块长度集中在平均长度附近
+static size_t AFURLSessionContentDefinedChunkLength(const uint8_t *bytes, size_t length, size_t averageSize) {
+    size_t minimumSize = averageSize / 4;
+    size_t maximumSize = averageSize * 8;
+    if (length <= minimumSize) {
+        return length;
+    }
+
+    size_t limit = MIN(length, maximumSize);
+    size_t normalSize = MIN(averageSize, limit);
+    unsigned int bits = 0;
+    while (((size_t)2 << bits) <= averageSize) {
+        bits++;
+    }
+    //使用哈希的高位、低位只受最近几个字节影响
+    uint64_t smallMask = ~0ULL << (64 - MIN(bits + 2, 63U));
+    uint64_t largeMask = ~0ULL << (64 - MAX(bits, 3U) + 2);
+
+    const uint64_t *gearTable = AFURLSessionGearTable();
+    uint64_t hash = 0;
+    size_t i = minimumSize;
+    for (; i < normalSize; i++) {
+        hash = (hash << 1) + gearTable[bytes[i]];
+        if ((hash & smallMask) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + gearTable[bytes[i]];
+        if ((hash & largeMask) == 0) {
+            return i + 1;
+        }
+    }
+
+    return limit;
+}
+
+//上传的一个块
+@interface AFURLSessionUploadChunk : NSObject
+@property (nonatomic, assign) NSUInteger index;
+@property (nonatomic, assign) int64_t offset;
+@property (nonatomic, assign) int64_t length;
+@property (nonatomic, copy) NSData *digest;//SHA-256
+@property (nonatomic, assign) BOOL uploaded;
+@property (nonatomic, assign) int64_t sentLength;//正在上传时已经发送的长度、用于汇总进度
+@property (nonatomic, assign) NSUInteger retryCount;
+@property (nonatomic, strong) NSURLSessionUploadTask *task;
+@end
+
+@implementation AFURLSessionUploadChunk
+@end
+
+static NSString * AFURLSessionHexStringFromData(NSData *data) {
+    const uint8_t *bytes = [data bytes];
+    NSMutableString *string = [NSMutableString stringWithCapacity:[data length] * 2];
+    for (NSUInteger i = 0; i < [data length]; i++) {
+        [string appendFormat:@"%02x", bytes[i]];
+    }
+
+    return string;
+}
+
+//CC_SHA256的长度是CC_LONG(32位)、超过4GB的数据分段更新
+static void AFURLSessionSHA256(const void *bytes, size_t length, uint8_t digest[CC_SHA256_DIGEST_LENGTH]) {
+    CC_SHA256_CTX context;
+    CC_SHA256_Init(&context);
+    do {
+        CC_LONG updateLength = (CC_LONG)MIN(length, (size_t)(1 << 30));
+        CC_SHA256_Update(&context, bytes, updateLength);
+        bytes = (const uint8_t *)bytes + updateLength;
+        length -= updateLength;
+    } while (length > 0);
+    CC_SHA256_Final(digest, &context);
+}
+
+//块失败时的最多重试次数
+static NSUInteger const kAFURLSessionUploadChunkMaximumRetryCount = 3;
+//2: 增加deduplicatesChunks
+static NSInteger const kAFURLSessionUploadManifestVersion = 2;
+
+@interface AFURLSessionChunkedUpload ()
+@property (readwrite, nonatomic, weak) AFURLSessionManager *manager;
+@property (readwrite, nonatomic, copy) NSURLRequest *request;
+@property (readwrite, nonatomic, copy) NSURL *fileURL;
+@property (readwrite, nonatomic, copy) NSURL *manifestURL;
+@property (readwrite, nonatomic, strong) NSProgress *progress;
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, strong) dispatch_queue_t manifestQueue;//清单文件的读写都在这个串行队列上
+@property (readwrite, nonatomic, assign) BOOL needsWriteManifest;//已经安排了写入、之后的变化会一起写入
+@property (readwrite, nonatomic, strong) NSData *fileData;
+@property (readwrite, nonatomic, assign) int64_t fileSize;
+@property (readwrite, nonatomic, strong) NSDate *fileModificationDate;
+@property (readwrite, nonatomic, strong) NSArray <AFURLSessionUploadChunk *> *chunks;
+@property (readwrite, nonatomic, assign) NSUInteger activeChunkCount;
+@property (readwrite, nonatomic, strong) NSURLSessionDataTask *queryTask;
+@property (readwrite, nonatomic, assign) BOOL didQueryServerChunks;
+@property (readwrite, nonatomic, assign) int64_t deduplicatedByteCount;
+@property (readwrite, nonatomic, strong) NSURLSessionDataTask *commitTask;
+@property (readwrite, nonatomic, assign) BOOL started;
+@property (readwrite, nonatomic, assign) BOOL finished;
+@end
+
+@implementation AFURLSessionChunkedUpload
+
+- (instancetype)initWithManager:(AFURLSessionManager *)manager
+                        request:(NSURLRequest *)request
+                        fileURL:(NSURL *)fileURL
+                    manifestURL:(NSURL *)manifestURL
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.manager = manager;
+    self.request = request;
+    self.fileURL = fileURL;
+    self.manifestURL = manifestURL ?: [[self class] defaultManifestURLForRequest:request fileURL:fileURL];
+    self.chunking = AFURLSessionUploadChunkingFixedSize;
+    self.chunkSize = 4 * 1024 * 1024;
+    self.maximumConcurrentChunkCount = 4;
+    self.lock = [[NSLock alloc] init];
+    self.manifestQueue = dispatch_queue_create("com.alamofire.networking.session.chunked-upload.manifest", DISPATCH_QUEUE_SERIAL);
+
+    self.progress = [[NSProgress alloc] initWithParent:nil userInfo:nil];
+    self.progress.totalUnitCount = NSURLSessionTransferSizeUnknown;
+    __weak __typeof__(self) weakSelf = self;
+    self.progress.cancellationHandler = ^{
+        [weakSelf cancel];
+    };
+
+    return self;
+}
+
+//缓存目录/AFURLSessionChunkedUpload/<请求地址和文件路径的SHA-256>.plist
++ (NSURL *)defaultManifestURLForRequest:(NSURLRequest *)request fileURL:(NSURL *)fileURL {
+    NSData *keyData = [[NSString stringWithFormat:@"%@\n%@", request.URL.absoluteString, fileURL.path] dataUsingEncoding:NSUTF8StringEncoding];
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    AFURLSessionSHA256([keyData bytes], [keyData length], digest);
+
+    NSURL *directoryURL = [[[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask] firstObject] URLByAppendingPathComponent:NSStringFromClass(self) isDirectory:YES];
+    if (!directoryURL) {
+        directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:NSStringFromClass(self)] isDirectory:YES];
+    }
+    [[NSFileManager defaultManager] createDirectoryAtURL:directoryURL withIntermediateDirectories:YES attributes:nil error:nil];
+
+    NSString *fileName = [AFURLSessionHexStringFromData([NSData dataWithBytes:digest length:sizeof(digest)]) stringByAppendingPathExtension:@"plist"];
+    return [directoryURL URLByAppendingPathComponent:fileName];
+}
+
+- (void)resume {
+    [self.lock lock];
+    if (self.started) {
+        [self.lock unlock];
+        return;
+    }
+    self.started = YES;
+    [self.lock unlock];
+
+    //切块需要读取整个文件、放到后台进行
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSError *error = nil;
+        BOOL prepared = [self prepareChunks:&error];
+
+        [self.lock lock];
+        if (!prepared) {
+            [self failWithError:error];
+        } else if (!self.finished) {
+            [self startChunks];
+        }
+        [self.lock unlock];
+    });
+}
+
+- (void)cancel {
+    [self.lock lock];
+    [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+    [self.lock unlock];
+}
+
+#pragma mark -
+
+- (BOOL)prepareChunks:(NSError * __autoreleasing *)error {
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:self.fileURL.path error:error];
+    if (!attributes) {
+        return NO;
+    }
+
+    NSData *fileData = [NSData dataWithContentsOfURL:self.fileURL options:NSDataReadingMappedIfSafe error:error];
+    if (!fileData) {
+        return NO;
+    }
+
+    self.fileData = fileData;
+    self.fileSize = (int64_t)[attributes fileSize];
+    self.fileModificationDate = [attributes fileModificationDate];
+
+    __block NSArray *chunks = nil;
+    dispatch_sync(self.manifestQueue, ^{
+        chunks = [self chunksFromManifest];
+    });
+    BOOL needsWriteManifest = chunks == nil;
+    if (!chunks) {
+        chunks = [self chunksByReadingFile];
+    }
+
+    int64_t uploadedLength = 0;
+    for (AFURLSessionUploadChunk *chunk in chunks) {
+        if (chunk.uploaded) {
+            uploadedLength += chunk.length;
+        }
+    }
+
+    [self.lock lock];
+    self.chunks = chunks;
+    self.progress.totalUnitCount = self.fileSize;
+    self.progress.completedUnitCount = uploadedLength;
+    if (needsWriteManifest) {
+        [self setNeedsWriteManifest];
+    }
+    [self.lock unlock];
+
+    return YES;
+}
+
+//顺序读一遍文件、同时确定块的边界并计算每块的摘要
+- (NSArray <AFURLSessionUploadChunk *> *)chunksByReadingFile {
+    const uint8_t *bytes = [self.fileData bytes];
+    size_t length = [self.fileData length];
+    size_t chunkSize = MAX(self.chunkSize, (NSUInteger)1024);
+    if (length > 0) {
+        //提示内核顺序预读
+        uintptr_t pageMask = (uintptr_t)getpagesize() - 1;
+        uintptr_t start = (uintptr_t)bytes & ~pageMask;
+        madvise((void *)start, (size_t)((uintptr_t)bytes + length - start), MADV_SEQUENTIAL);
+    }
+
+    //限制同时在计算摘要的块数、已经扫描过的块不会在内存中堆积太多
+    dispatch_queue_t hashQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create((long)MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)2));
+
+    NSMutableArray *chunks = [NSMutableArray array];
+    size_t offset = 0;
+    while (offset < length) {
+        size_t chunkLength = 0;
+        if (self.chunking == AFURLSessionUploadChunkingContentDefined) {
+            chunkLength = AFURLSessionContentDefinedChunkLength(bytes + offset, length - offset, chunkSize);
+        } else {
+            chunkLength = MIN(chunkSize, length - offset);
+        }
+
+        AFURLSessionUploadChunk *chunk = [[AFURLSessionUploadChunk alloc] init];
+        chunk.index = [chunks count];
+        chunk.offset = (int64_t)offset;
+        chunk.length = (int64_t)chunkLength;
+        [chunks addObject:chunk];
+
+        //边界扫描刚把这一块读进内存、摘要交给其他核心计算、与后面的读取重叠
+        const uint8_t *chunkBytes = bytes + offset;
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+        dispatch_group_async(group, hashQueue, ^{
+            uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+            AFURLSessionSHA256(chunkBytes, chunkLength, digest);
+            chunk.digest = [NSData dataWithBytes:digest length:sizeof(digest)];
+            dispatch_semaphore_signal(semaphore);
+        });
+
+        offset += chunkLength;
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    return chunks;
+}
+
+//清单与当前文件的长度和修改时间一致时才沿用
+//去重时服务器已有和文件内重复的块也被标记为已上传、不去重的上传不能沿用这样的清单、反过来也一样、重新切块
+- (NSArray <AFURLSessionUploadChunk *> *)chunksFromManifest {
+    NSData *manifestData = [NSData dataWithContentsOfURL:self.manifestURL];
+    if (!manifestData) {
+        return nil;
+    }
+
+    NSDictionary *manifest = [NSPropertyListSerialization propertyListWithData:manifestData options:NSPropertyListImmutable format:NULL error:nil];
+    if (![manifest isKindOfClass:[NSDictionary class]] ||
+        [manifest[@"version"] integerValue] != kAFURLSessionUploadManifestVersion ||
+        [manifest[@"length"] longLongValue] != self.fileSize ||
+        ![manifest[@"modificationDate"] isEqual:self.fileModificationDate] ||
+        ![manifest[@"URL"] isEqual:self.request.URL.absoluteString] ||
+        [manifest[@"deduplicatesChunks"] boolValue] != self.deduplicatesChunks)
+    {
+        return nil;
+    }
+
+    NSMutableArray *chunks = [NSMutableArray array];
+    int64_t offset = 0;
+    for (NSDictionary *chunkInfo in manifest[@"chunks"]) {
+        AFURLSessionUploadChunk *chunk = [[AFURLSessionUploadChunk alloc] init];
+        chunk.index = [chunks count];
+        chunk.offset = offset;
+        chunk.length = [chunkInfo[@"length"] longLongValue];
+        chunk.digest = chunkInfo[@"sha256"];
+        chunk.uploaded = [chunkInfo[@"uploaded"] boolValue];
+        if (chunk.length <= 0 || [chunk.digest length] != CC_SHA256_DIGEST_LENGTH) {
+            return nil;
+        }
+        [chunks addObject:chunk];
+        offset += chunk.length;
+    }
+
+    return offset == self.fileSize ? chunks : nil;
+}
+
+//需要在持有lock时调用
+//写入在manifestQueue上进行、不阻塞块的回调、写入开始之前的多次变化合并为一次写入
+- (void)setNeedsWriteManifest {
+    if (self.needsWriteManifest) {
+        return;
+    }
+    self.needsWriteManifest = YES;
+
+    dispatch_async(self.manifestQueue, ^{
+        [self.lock lock];
+        self.needsWriteManifest = NO;
+        NSMutableArray *chunkInfos = [NSMutableArray arrayWithCapacity:[self.chunks count]];
+        for (AFURLSessionUploadChunk *chunk in self.chunks) {
+            [chunkInfos addObject:@{@"length": @(chunk.length), @"sha256": chunk.digest, @"uploaded": @(chunk.uploaded)}];
+        }
+        [self.lock unlock];
+
+        NSDictionary *manifest = @{@"version": @(kAFURLSessionUploadManifestVersion),
+                                   @"URL": self.request.URL.absoluteString ?: @"",
+                                   @"length": @(self.fileSize),
+                                   @"modificationDate": self.fileModificationDate ?: [NSDate distantPast],
+                                   @"deduplicatesChunks": @(self.deduplicatesChunks),
+                                   @"chunks": chunkInfos};
+        NSData *manifestData = [NSPropertyListSerialization dataWithPropertyList:manifest format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+        [manifestData writeToURL:self.manifestURL atomically:YES];
+    });
+}
+
+#pragma mark -
+
+//以下方法都需要在持有lock时调用
+
+- (void)startChunks {
+    if (self.deduplicatesChunks && !self.didQueryServerChunks) {
+        [self queryServerChunks];
+        return;
+    }
+
+    for (AFURLSessionUploadChunk *chunk in self.chunks) {
+        if (self.activeChunkCount >= MAX(self.maximumConcurrentChunkCount, (NSUInteger)1)) {
+            return;
+        }
+        if (!chunk.uploaded && !chunk.task) {
+            [self startChunk:chunk];
+            if (self.finished) {
+                return;
+            }
+        }
+    }
+
+    if (self.activeChunkCount == 0 && !self.commitTask) {
+        [self commit];
+    }
+}
+
+//查询服务器已有的块、查询完成后再开始上传
+- (void)queryServerChunks {
+    AFURLSessionManager *manager = self.manager;
+    if (!manager) {
+        [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+        return;
+    }
+
+    NSMutableOrderedSet *digests = [NSMutableOrderedSet orderedSet];
+    for (AFURLSessionUploadChunk *chunk in self.chunks) {
+        if (!chunk.uploaded) {
+            [digests addObject:AFURLSessionHexStringFromData(chunk.digest)];
+        }
+    }
+    if ([digests count] == 0) {
+        self.didQueryServerChunks = YES;
+        [self startChunks];
+        return;
+    }
+
+    NSMutableURLRequest *mutableRequest = [self.request mutableCopy];
+    mutableRequest.HTTPMethod = @"POST";
+    mutableRequest.HTTPBodyStream = nil;
+    mutableRequest.HTTPBody = [NSJSONSerialization dataWithJSONObject:@{@"sha256": [digests array]} options:0 error:nil];
+    [mutableRequest setValue:@"?1" forHTTPHeaderField:@"Upload-Chunk-Query"];
+    [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+
+    //直接收集原始数据、不依赖manager的responseSerializer
+    NSMutableData *responseData = [NSMutableData data];
+    self.queryTask = [manager dataTaskWithRequest:mutableRequest uploadProgress:nil downloadProgress:nil completionHandler:^(NSURLResponse *response, __unused id responseObject, __unused NSError *error) {
+        NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 0;
+        NSDictionary *JSONObject = statusCode >= 200 && statusCode < 300 ? [NSJSONSerialization JSONObjectWithData:responseData options:0 error:nil] : nil;
+        [self didReceiveServerChunks:JSONObject];
+    }];
+    [manager setDataTaskBuffersResponseData:NO forTask:self.queryTask];
+    [manager setDataTaskDidReceiveDataBlock:^(__unused NSURLSession *session, __unused NSURLSessionDataTask *dataTask, NSData *data) {
+        [responseData appendData:data];
+    } forTask:self.queryTask];
+    [self.queryTask resume];
+}
+
+- (void)didReceiveServerChunks:(NSDictionary *)JSONObject {
+    [self.lock lock];
+    if (self.finished) {
+        [self.lock unlock];
+        return;
+    }
+    self.queryTask = nil;
+    self.didQueryServerChunks = YES;
+
+    //查询失败时上传所有的块
+    NSArray *missingDigests = [JSONObject isKindOfClass:[NSDictionary class]] ? JSONObject[@"missing"] : nil;
+    if ([missingDigests isKindOfClass:[NSArray class]]) {
+        NSSet *missingDigestSet = [NSSet setWithArray:missingDigests];
+        NSMutableSet *pendingDigests = [NSMutableSet set];
+        int64_t deduplicatedLength = 0;
+        for (AFURLSessionUploadChunk *chunk in self.chunks) {
+            if (chunk.uploaded) {
+                continue;
+            }
+            NSString *digest = AFURLSessionHexStringFromData(chunk.digest);
+            //服务器已有、或者同样内容的块已经在前面排队
+            if (![missingDigestSet containsObject:digest] || [pendingDigests containsObject:digest]) {
+                chunk.uploaded = YES;
+                deduplicatedLength += chunk.length;
+            } else {
+                [pendingDigests addObject:digest];
+            }
+        }
+        self.deduplicatedByteCount += deduplicatedLength;
+        self.progress.completedUnitCount += deduplicatedLength;
+        [self setNeedsWriteManifest];
+    }
+
+    [self startChunks];
+    [self.lock unlock];
+
+    if (self.uploadProgressBlock) {
+        self.uploadProgressBlock(self.progress);
+    }
+}
+
+- (void)startChunk:(AFURLSessionUploadChunk *)chunk {
+    AFURLSessionManager *manager = self.manager;
+    if (!manager) {
+        [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+        return;
+    }
+
+    NSMutableURLRequest *mutableRequest = [self.request mutableCopy];
+    if ([mutableRequest.HTTPMethod isEqualToString:@"GET"]) {
+        mutableRequest.HTTPMethod = @"PUT";
+    }
+    mutableRequest.HTTPBody = nil;
+    mutableRequest.HTTPBodyStream = nil;
+    [mutableRequest setValue:[NSString stringWithFormat:@"bytes %lld-%lld/%lld", chunk.offset, chunk.offset + chunk.length - 1, self.fileSize] forHTTPHeaderField:@"Content-Range"];
+    [mutableRequest setValue:[NSString stringWithFormat:@"%lu", (unsigned long)chunk.index] forHTTPHeaderField:@"Upload-Chunk-Index"];
+    [mutableRequest setValue:[@"sha-256=" stringByAppendingString:[chunk.digest base64EncodedStringWithOptions:0]] forHTTPHeaderField:@"Digest"];
+    [mutableRequest setValue:@"application/octet-stream" forHTTPHeaderField:@"Content-Type"];
+
+    NSData *chunkData = [self.fileData subdataWithRange:NSMakeRange((NSUInteger)chunk.offset, (NSUInteger)chunk.length)];
+    NSURLSessionUploadTask *uploadTask = [manager uploadTaskWithRequest:mutableRequest fromData:chunkData progress:^(NSProgress *uploadProgress) {
+        [self chunk:chunk didSendLength:uploadProgress.completedUnitCount];
+    } completionHandler:^(NSURLResponse *response, __unused id responseObject, NSError *error) {
+        [self chunk:chunk didCompleteWithResponse:response error:error];
+    }];
+
+    chunk.task = uploadTask;
+    self.activeChunkCount++;
+    [uploadTask resume];
+}
+
+- (void)chunk:(AFURLSessionUploadChunk *)chunk didSendLength:(int64_t)sentLength {
+    [self.lock lock];
+    if (self.finished || chunk.uploaded) {
+        [self.lock unlock];
+        return;
+    }
+
+    sentLength = MIN(sentLength, chunk.length);
+    self.progress.completedUnitCount += sentLength - chunk.sentLength;
+    chunk.sentLength = sentLength;
+    [self.lock unlock];
+
+    if (self.uploadProgressBlock) {
+        self.uploadProgressBlock(self.progress);
+    }
+}
+
+- (void)chunk:(AFURLSessionUploadChunk *)chunk didCompleteWithResponse:(NSURLResponse *)response error:(NSError *)error {
+    [self.lock lock];
+    if (self.finished) {
+        [self.lock unlock];
+        return;
+    }
+
+    chunk.task = nil;
+    self.activeChunkCount--;
+
+    //状态码由这里判断、块的响应内容不需要解析、序列化器的解码错误可以忽略
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 0;
+    if (statusCode >= 200 && statusCode < 300) {
+        chunk.uploaded = YES;
+        self.progress.completedUnitCount += chunk.length - chunk.sentLength;
+        chunk.sentLength = 0;
+        [self setNeedsWriteManifest];
+        [self startChunks];
+        [self.lock unlock];
+        return;
+    }
+
+    self.progress.completedUnitCount -= chunk.sentLength;
+    chunk.sentLength = 0;
+
+    //网络错误和5xx重试、其他错误直接失败
+    BOOL retryable = statusCode >= 500 || (statusCode == 0 && [error.domain isEqualToString:NSURLErrorDomain] && error.code != NSURLErrorCancelled);
+    if (retryable && ++chunk.retryCount <= kAFURLSessionUploadChunkMaximumRetryCount) {
+        [self startChunk:chunk];
+    } else {
+        [self failWithError:error ?: [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSURLErrorFailingURLErrorKey: self.request.URL ?: [NSNull null]}]];
+    }
+    [self.lock unlock];
+}
+
+//所有块都已上传、发送提交请求
+- (void)commit {
+    AFURLSessionManager *manager = self.manager;
+    if (!manager) {
+        [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+        return;
+    }
+
+    NSMutableArray *chunkInfos = [NSMutableArray arrayWithCapacity:[self.chunks count]];
+    for (AFURLSessionUploadChunk *chunk in self.chunks) {
+        [chunkInfos addObject:@{@"index": @(chunk.index), @"offset": @(chunk.offset), @"length": @(chunk.length), @"sha256": AFURLSessionHexStringFromData(chunk.digest)}];
+    }
+
+    NSMutableURLRequest *mutableRequest = [self.request mutableCopy];
+    mutableRequest.HTTPMethod = @"POST";
+    mutableRequest.HTTPBodyStream = nil;
+    mutableRequest.HTTPBody = [NSJSONSerialization dataWithJSONObject:@{@"length": @(self.fileSize), @"chunks": chunkInfos} options:0 error:nil];
+    [mutableRequest setValue:@"?1" forHTTPHeaderField:@"Upload-Complete"];
+    [mutableRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+
+    self.commitTask = [manager dataTaskWithRequest:mutableRequest uploadProgress:nil downloadProgress:nil completionHandler:^(NSURLResponse *response, id responseObject, NSError *error) {
+        [self.lock lock];
+        if (self.finished) {
+            [self.lock unlock];
+            return;
+        }
+        self.finished = YES;
+        self.fileData = nil;
+        if (!error) {
+            //排在已经安排的写入之后
+            NSURL *manifestURL = self.manifestURL;
+            dispatch_async(self.manifestQueue, ^{
+                [[NSFileManager defaultManager] removeItemAtURL:manifestURL error:nil];
+            });
+        }
+        void (^completionHandler)(NSURLResponse *response, id responseObject, NSError *error) = self.completionHandler;
+        self.completionHandler = nil;
+        [self.lock unlock];
+
+        //已经在completionQueue上
+        if (completionHandler) {
+            completionHandler(response, responseObject, error);
+        }
+    }];
+    [self.commitTask resume];
+}
+
+//清单文件保留、下次可以继续
+- (void)failWithError:(NSError *)error {
+    if (self.finished) {
+        return;
+    }
+    self.finished = YES;
+
+    for (AFURLSessionUploadChunk *chunk in self.chunks) {
+        [chunk.task cancel];
+        chunk.task = nil;
+    }
+    [self.queryTask cancel];
+    [self.commitTask cancel];
+    self.fileData = nil;
+
+    void (^completionHandler)(NSURLResponse *response, id responseObject, NSError *error) = self.completionHandler;
+    self.completionHandler = nil;
+    if (!completionHandler) {
+        return;
+    }
+
+    AFURLSessionManager *manager = self.manager;
+    [manager deliverCompletionBlock:^{
+        completionHandler(nil, nil, error);
+    }];
+}
+
+@end
+
+#pragma mark -
+
+typedef void (^AFURLSessionDataStreamReadHandler)(NSData *data, NSError *error);
+
+@interface AFURLSessionDataStream ()
+@property (readwrite, nonatomic, weak) AFURLSessionManager *manager;
+@property (readwrite, nonatomic, strong) NSURLSessionDataTask *task;
+@property (readwrite, nonatomic, assign) NSUInteger maximumBufferedLength;
+@property (readwrite, nonatomic, assign) NSUInteger bufferedLength;
+@property (readwrite, nonatomic, strong) NSCondition *condition;
+@property (readwrite, nonatomic, strong) NSMutableArray <NSData *> *bufferedData;
+@property (readwrite, nonatomic, strong) NSMutableArray <AFURLSessionDataStreamReadHandler> *pendingReadHandlers;
+@property (readwrite, nonatomic, assign) BOOL suspendedByStream;//因为队列满了而暂停
+@property (readwrite, nonatomic, assign) BOOL finished;
+@property (readwrite, nonatomic, strong) NSError *error;
+@end
+
+@implementation AFURLSessionDataStream
+
+- (instancetype)initWithManager:(AFURLSessionManager *)manager
+                        request:(NSURLRequest *)request
+          maximumBufferedLength:(NSUInteger)maximumBufferedLength
+{
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.manager = manager;
+    self.maximumBufferedLength = MAX(maximumBufferedLength, (NSUInteger)1);
+    self.condition = [[NSCondition alloc] init];
+    self.bufferedData = [NSMutableArray array];
+    self.pendingReadHandlers = [NSMutableArray array];
+
+    //任务结束之前由任务的回调持有、使用者只需要持有到不再读取为止
+    self.task = [manager dataTaskWithRequest:request uploadProgress:nil downloadProgress:nil completionHandler:^(__unused NSURLResponse *response, __unused id responseObject, NSError *error) {
+        [self didCompleteWithError:error];
+    }];
+    [manager setDataTaskBuffersResponseData:NO forTask:self.task];
+    [manager setDataTaskDidReceiveDataBlock:^(__unused NSURLSession *session, __unused NSURLSessionDataTask *dataTask, NSData *data) {
+        [self didReceiveData:data];
+    } forTask:self.task];
+
+    return self;
+}
+
+- (NSURLResponse *)response {
+    return self.task.response;
+}
+
+- (void)resume {
+    [self.task resume];
+}
+
+- (void)cancel {
+    [self.condition lock];
+    [self.bufferedData removeAllObjects];
+    self.bufferedLength = 0;
+    [self.condition unlock];
+
+    [self.task cancel];
+}
+
+#pragma mark -
+
+- (void)didReceiveData:(NSData *)data {
+    [self.condition lock];
+    if (self.finished) {
+        [self.condition unlock];
+        return;
+    }
+
+    //已经有使用者在等待、直接交出去不进入队列
+    if ([self.pendingReadHandlers count] > 0) {
+        AFURLSessionDataStreamReadHandler handler = [self.pendingReadHandlers firstObject];
+        [self.pendingReadHandlers removeObjectAtIndex:0];
+        [self.condition unlock];
+
+        [self callReadHandler:handler data:data error:nil];
+        return;
+    }
+
+    [self.bufferedData addObject:data];
+    self.bufferedLength += [data length];
+    //暂停后不再从socket读取、已经在路上的数据仍然会送达、所以队列会略微超过上限
+    if (self.bufferedLength >= self.maximumBufferedLength && !self.suspendedByStream) {
+        self.suspendedByStream = YES;
+        [self.task suspend];
+    }
+    [self.condition signal];
+    [self.condition unlock];
+}
+
+- (void)didCompleteWithError:(NSError *)error {
+    //数据没有交给序列化器、解码失败的错误不代表请求失败
+    if ([error.domain isEqualToString:AFURLResponseSerializationErrorDomain] && error.code == NSURLErrorCannotDecodeContentData) {
+        error = nil;
+    }
+
+    [self.condition lock];
+    self.finished = YES;
+    self.error = error;
+    NSArray *pendingReadHandlers = [self.pendingReadHandlers copy];
+    [self.pendingReadHandlers removeAllObjects];
+    [self.condition broadcast];
+    [self.condition unlock];
+
+    for (AFURLSessionDataStreamReadHandler handler in pendingReadHandlers) {
+        [self callReadHandler:handler data:nil error:error];
+    }
+}
+
+//需要在持有condition时调用
+- (NSData *)dequeueData {
+    NSData *data = [self.bufferedData firstObject];
+    [self.bufferedData removeObjectAtIndex:0];
+    self.bufferedLength -= [data length];
+
+    //降到上限的一半以下才恢复、避免在上限附近频繁暂停和恢复
+    if (self.suspendedByStream && self.bufferedLength <= self.maximumBufferedLength / 2) {
+        self.suspendedByStream = NO;
+        [self.task resume];
+    }
+
+    return data;
+}
+
+- (void)readDataWithCompletionHandler:(void (^)(NSData *data, NSError *error))completionHandler {
+    NSParameterAssert(completionHandler);
+
+    [self.condition lock];
+    if ([self.bufferedData count] > 0) {
+        NSData *data = [self dequeueData];
+        [self.condition unlock];
+        [self callReadHandler:completionHandler data:data error:nil];
+    } else if (self.finished) {
+        NSError *error = self.error;
+        [self.condition unlock];
+        [self callReadHandler:completionHandler data:nil error:error];
+    } else {
+        [self.pendingReadHandlers addObject:[completionHandler copy]];
+        [self.condition unlock];
+    }
+}
+
+- (NSData *)readData:(NSError * __autoreleasing *)error {
+    [self.condition lock];
+    while ([self.bufferedData count] == 0 && !self.finished) {
+        [self.condition wait];
+    }
+
+    NSData *data = nil;
+    if ([self.bufferedData count] > 0) {
+        data = [self dequeueData];
+    } else if (error) {
+        *error = self.error;
+    }
+    [self.condition unlock];
+
+    return data;
+}
+
+- (void)callReadHandler:(AFURLSessionDataStreamReadHandler)handler data:(NSData *)data error:(NSError *)error {
+    AFURLSessionManager *manager = self.manager;
+    [manager deliverCompletionBlock:^{
+        handler(data, error);
+    }];
+}
+
+@end
+
+#pragma mark -
+
+static NSString * AFConcurrencyLimiterHostKeyForURL(NSURL *URL) {
+    NSString *host = [URL.host lowercaseString] ?: @"";
+    return URL.port ? [NSString stringWithFormat:@"%@:%@", host, URL.port] : host;
+}
+
+//一个主机的限制状态
+@interface AFURLSessionHostConcurrency : NSObject
+@property (nonatomic, assign) double limit;
+@property (nonatomic, assign) NSUInteger inFlightCount;
+@property (nonatomic, strong) NSMutableArray <NSURLSessionTask *> *queuedTasks;
+@property (nonatomic, assign) double minimumRTT;//基线、0为还没有样本
+@property (nonatomic, assign) double smoothedRTT;
+@property (nonatomic, assign) NSUInteger sampleCount;
+@property (nonatomic, assign) double lastDecreaseTime;
+@end
+
+@implementation AFURLSessionHostConcurrency
+@end
+
+typedef NS_ENUM(NSUInteger, AFURLSessionTaskAdmissionState) {
+    AFURLSessionTaskAdmissionStateRegistered,//还没有调用resume
+    AFURLSessionTaskAdmissionStateQueued,
+    AFURLSessionTaskAdmissionStateAdmitted,
+};
+
+//限制器记录的一个任务
+@interface AFURLSessionTaskAdmission : NSObject
+@property (nonatomic, strong) AFURLSessionHostConcurrency *host;
+@property (nonatomic, weak) NSURLSession *session;
+@property (nonatomic, assign) AFURLSessionTaskAdmissionState state;
+@property (nonatomic, assign) uint64_t startTime;//AFURLSessionTaskTimingTimestamp()
+@end
+
+@implementation AFURLSessionTaskAdmission
+@end
+
+@interface AFURLSessionConcurrencyLimiter ()
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, strong) NSMutableDictionary <NSString *, AFURLSessionHostConcurrency *> *hosts;
+@property (readwrite, nonatomic, strong) NSMapTable <NSURLSessionTask *, AFURLSessionTaskAdmission *> *admissions;//弱引用任务、创建后没有resume就被丢弃的任务不会一直留在这里
+@end
+
+@implementation AFURLSessionConcurrencyLimiter
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.initialLimit = 4;
+    self.minimumLimit = 1;
+    self.maximumLimit = 64;
+    self.latencyTolerance = 2.0;
+    self.backoffRatio = 0.9;
+    self.lock = [[NSLock alloc] init];
+    self.hosts = [NSMutableDictionary dictionary];
+    self.admissions = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+
+    return self;
+}
+
+- (NSUInteger)limitForURL:(NSURL *)URL {
+    NSString *hostKey = AFConcurrencyLimiterHostKeyForURL(URL);
+
+    [self.lock lock];
+    AFURLSessionHostConcurrency *hostConcurrency = self.hosts[hostKey];
+    NSUInteger limit = hostConcurrency ? (NSUInteger)hostConcurrency.limit : self.initialLimit;
+    [self.lock unlock];
+
+    return limit;
+}
+
+#pragma mark -
+
+- (void)registerTask:(NSURLSessionTask *)task session:(NSURLSession *)session {
+    NSString *hostKey = AFConcurrencyLimiterHostKeyForURL(task.originalRequest.URL ?: task.currentRequest.URL);
+
+    [self.lock lock];
+    AFURLSessionHostConcurrency *hostConcurrency = self.hosts[hostKey];
+    if (!hostConcurrency) {
+        hostConcurrency = [[AFURLSessionHostConcurrency alloc] init];
+        hostConcurrency.limit = MAX(self.initialLimit, (NSUInteger)1);
+        hostConcurrency.queuedTasks = [NSMutableArray array];
+        self.hosts[hostKey] = hostConcurrency;
+    }
+
+    AFURLSessionTaskAdmission *admission = [[AFURLSessionTaskAdmission alloc] init];
+    admission.host = hostConcurrency;
+    admission.session = session;
+    [self.admissions setObject:admission forKey:task];
+    [self.lock unlock];
+
+    objc_setAssociatedObject(task, &AFURLSessionTaskConcurrencyLimiterKey, self, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+}
+
+//已经放行的任务(比如暂停后恢复)不再排队
+- (BOOL)shouldDeferResumeOfTask:(NSURLSessionTask *)task {
+    [self.lock lock];
+    AFURLSessionTaskAdmission *admission = [self.admissions objectForKey:task];
+    if (!admission || admission.state == AFURLSessionTaskAdmissionStateAdmitted) {
+        [self.lock unlock];
+        return NO;
+    }
+
+    if (admission.state == AFURLSessionTaskAdmissionStateRegistered) {
+        admission.state = AFURLSessionTaskAdmissionStateQueued;
+        [admission.host.queuedTasks addObject:task];
+    }
+    NSArray *admittedTasks = [self admitTasksForHost:admission.host];
+    [self.lock unlock];
+
+    [self resumeAdmittedTasks:admittedTasks];
+
+    //本任务如果立即被放行、已经在resumeAdmittedTasks中开始了
+    return YES;
+}
+
+- (void)taskDidComplete:(NSURLSessionTask *)task error:(NSError *)error {
+    [self.lock lock];
+    AFURLSessionTaskAdmission *admission = [self.admissions objectForKey:task];
+    if (!admission) {
+        [self.lock unlock];
+        return;
+    }
+    [self.admissions removeObjectForKey:task];
+
+    AFURLSessionHostConcurrency *hostConcurrency = admission.host;
+    if (admission.state == AFURLSessionTaskAdmissionStateQueued) {
+        //排队中被取消
+        [hostConcurrency.queuedTasks removeObjectIdenticalTo:task];
+    } else if (admission.state == AFURLSessionTaskAdmissionStateAdmitted) {
+        [self host:hostConcurrency didCompleteTask:task startTime:admission.startTime error:error];
+        hostConcurrency.inFlightCount--;
+    }
+
+    NSArray *admittedTasks = [self admitTasksForHost:hostConcurrency];
+    [self.lock unlock];
+
+    [self resumeAdmittedTasks:admittedTasks];
+}
+
+- (void)sessionDidBecomeInvalid:(NSURLSession *)session {
+    [self.lock lock];
+    NSMutableArray *invalidatedTasks = [NSMutableArray array];
+    NSMutableSet *affectedHosts = [NSMutableSet set];
+    for (NSURLSessionTask *task in self.admissions) {
+        AFURLSessionTaskAdmission *admission = [self.admissions objectForKey:task];
+        //session已经释放的也一起清理
+        if (admission.session && admission.session != session) {
+            continue;
+        }
+        [invalidatedTasks addObject:task];
+        [affectedHosts addObject:admission.host];
+        if (admission.state == AFURLSessionTaskAdmissionStateQueued) {
+            [admission.host.queuedTasks removeObjectIdenticalTo:task];
+        } else if (admission.state == AFURLSessionTaskAdmissionStateAdmitted) {
+            admission.host.inFlightCount--;
+        }
+    }
+    for (NSURLSessionTask *task in invalidatedTasks) {
+        [self.admissions removeObjectForKey:task];
+    }
+
+    //共用限制器的其他session的任务可以继续
+    NSMutableArray *admittedTasks = [NSMutableArray array];
+    for (AFURLSessionHostConcurrency *hostConcurrency in affectedHosts) {
+        [admittedTasks addObjectsFromArray:[self admitTasksForHost:hostConcurrency] ?: @[]];
+    }
+    [self.lock unlock];
+
+    [self resumeAdmittedTasks:admittedTasks];
+}
+
+//以下两个方法需要在持有lock时调用
+
+- (void)host:(AFURLSessionHostConcurrency *)hostConcurrency
+didCompleteTask:(NSURLSessionTask *)task
+   startTime:(uint64_t)startTime
+       error:(NSError *)error
+{
+    if ([error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled) {
+        return;
+    }
+
+    //限制的计算以秒为单位
+    uint64_t timestamp = AFURLSessionTaskTimingTimestamp();
+    double now = (double)timestamp / NSEC_PER_SEC;
+    double RTT = (double)(timestamp - startTime) / NSEC_PER_SEC;
+    NSInteger statusCode = [task.response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)task.response statusCode] : 0;
+    BOOL overloaded = statusCode == 429 || statusCode == 503 || ([error.domain isEqualToString:NSURLErrorDomain] && (error.code == NSURLErrorTimedOut || error.code == NSURLErrorCannotConnectToHost || error.code == NSURLErrorNetworkConnectionLost));
+    //每轮最多降低一次、同一批变慢的请求只算一次
+    BOOL canDecrease = now - hostConcurrency.lastDecreaseTime > MAX(hostConcurrency.smoothedRTT, RTT);
+    double minimumLimit = MAX(self.minimumLimit, (NSUInteger)1);
+    double maximumLimit = MAX(self.maximumLimit, (NSUInteger)minimumLimit);
+
+    if (overloaded) {
+        if (canDecrease) {
+            hostConcurrency.limit = MAX(minimumLimit, hostConcurrency.limit * 0.5);
+            hostConcurrency.lastDecreaseTime = now;
+        }
+        return;
+    }
+    if (error) {
+        return;
+    }
+
+    hostConcurrency.smoothedRTT = hostConcurrency.smoothedRTT > 0 ? hostConcurrency.smoothedRTT * 0.8 + RTT * 0.2 : RTT;
+    hostConcurrency.minimumRTT = hostConcurrency.minimumRTT > 0 ? MIN(hostConcurrency.minimumRTT, RTT) : RTT;
+    //基线只会变小、定期用当前的平滑耗时重新开始
+    if (++hostConcurrency.sampleCount % 256 == 0) {
+        hostConcurrency.minimumRTT = hostConcurrency.smoothedRTT;
+    }
+
+    if (RTT > hostConcurrency.minimumRTT * self.latencyTolerance) {
+        if (canDecrease) {
+            hostConcurrency.limit = MAX(minimumLimit, hostConcurrency.limit * self.backoffRatio);
+            hostConcurrency.lastDecreaseTime = now;
+        }
+    } else if (hostConcurrency.inFlightCount * 2 >= hostConcurrency.limit) {
+        //并发没有用满时不增加、避免限制无限增长
+        hostConcurrency.limit = MIN(maximumLimit, hostConcurrency.limit + 1.0 / hostConcurrency.limit);
+    }
+}
+
+- (NSArray <NSURLSessionTask *> *)admitTasksForHost:(AFURLSessionHostConcurrency *)hostConcurrency {
+    NSMutableArray *admittedTasks = nil;
+    while ([hostConcurrency.queuedTasks count] > 0 && hostConcurrency.inFlightCount < MAX((NSUInteger)hostConcurrency.limit, (NSUInteger)1)) {
+        NSURLSessionTask *task = [hostConcurrency.queuedTasks firstObject];
+        [hostConcurrency.queuedTasks removeObjectAtIndex:0];
+
+        AFURLSessionTaskAdmission *admission = [self.admissions objectForKey:task];
+        admission.state = AFURLSessionTaskAdmissionStateAdmitted;
+        admission.startTime = AFURLSessionTaskTimingTimestamp();
+        hostConcurrency.inFlightCount++;
+
+        if (!admittedTasks) {
+            admittedTasks = [NSMutableArray array];
+        }
+        [admittedTasks addObject:task];
+    }
+
+    return admittedTasks;
+}
+
+- (void)resumeAdmittedTasks:(NSArray <NSURLSessionTask *> *)tasks {
+    for (NSURLSessionTask *task in tasks) {
+        [task resume];
+    }
+}
+
+@end
+
+#pragma mark -
+
+//一次排空最多追加执行的轮数、超过后重新提交、避免持续有block进入时一直占用目标队列
+static NSUInteger const AFURLSessionDeliveryQueueMaximumDrainPasses = 4;
+
+@interface AFURLSessionDeliveryQueue ()
+@property (readwrite, nonatomic, strong) dispatch_queue_t queue;
+@property (readwrite, nonatomic, assign) NSTimeInterval coalescingInterval;
+@property (readwrite, nonatomic, strong) NSLock *lock;
+@property (readwrite, nonatomic, strong) NSMutableArray <dispatch_block_t> *pendingBlocks;
+@property (readwrite, nonatomic, assign, getter=isDrainScheduled) BOOL drainScheduled;
+@property (readwrite, nonatomic, assign) NSUInteger drainCount;
+@property (readwrite, nonatomic, assign) NSUInteger deliveredBlockCount;
+@end
+
+@implementation AFURLSessionDeliveryQueue
+
++ (instancetype)mainDeliveryQueue {
+    static AFURLSessionDeliveryQueue *_mainDeliveryQueue = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _mainDeliveryQueue = [[self alloc] initWithQueue:dispatch_get_main_queue()];
+    });
+
+    return _mainDeliveryQueue;
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue {
+    return [self initWithQueue:queue coalescingInterval:0];
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue coalescingInterval:(NSTimeInterval)coalescingInterval {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.queue = queue;
+    self.coalescingInterval = MAX(coalescingInterval, 0);
+    self.lock = [[NSLock alloc] init];
+    self.pendingBlocks = [NSMutableArray array];
+
+    return self;
+}
+
+- (void)enqueueBlock:(dispatch_block_t)block {
+    [self enqueueBlock:block group:nil];
+}
+
+- (void)enqueueBlock:(dispatch_block_t)block group:(dispatch_group_t)group {
+    if (group) {
+        dispatch_group_enter(group);
+        dispatch_block_t groupBlock = block;
+        block = ^{
+            groupBlock();
+            dispatch_group_leave(group);
+        };
+    }
+
+    [self.lock lock];
+    [self.pendingBlocks addObject:[block copy]];
+    BOOL needsDrain = !self.drainScheduled;
+    self.drainScheduled = YES;
+    [self.lock unlock];
+
+    if (needsDrain) {
+        [self scheduleDrainAfterInterval:self.coalescingInterval];
+    }
+}
+
+- (void)scheduleDrainAfterInterval:(NSTimeInterval)interval {
+    if (interval > 0) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)), self.queue, ^{
+            [self drain];
+        });
+    } else {
+        dispatch_async(self.queue, ^{
+            [self drain];
+        });
+    }
+}
+
+- (void)drain {
+    for (NSUInteger pass = 0; ; pass++) {
+        [self.lock lock];
+        NSArray <dispatch_block_t> *blocks = self.pendingBlocks;
+        if ([blocks count] == 0) {
+            self.drainScheduled = NO;
+            [self.lock unlock];
+            return;
+        }
+        if (pass == AFURLSessionDeliveryQueueMaximumDrainPasses) {
+            //剩下的留给下一次排空、drainScheduled保持为YES以维持顺序
+            [self.lock unlock];
+            [self scheduleDrainAfterInterval:0];
+            return;
+        }
+        self.pendingBlocks = [NSMutableArray array];
+        if (pass == 0) {
+            self.drainCount++;
+        }
+        self.deliveredBlockCount += [blocks count];
+        [self.lock unlock];
+
+        for (dispatch_block_t block in blocks) {
+            //每个block单独的自动释放池、和逐个提交到队列时的内存峰值一致
+            @autoreleasepool {
+                block();
+            }
+        }
+    }
+}
+
+@end
+
+#pragma mark -
+
+//环形缓冲区中的一格、sequence等于写入位置时可写、等于写入位置+1时可读
+typedef struct {
+    _Atomic(uint64_t) sequence;
+    AFURLSessionTaskTimingRecord record;
+} AFURLSessionTaskTimingSlot;
+
+//有界的多生产者多消费者队列、写入和取出各自用CAS推进位置、不需要锁
+typedef struct {
+    AFURLSessionTaskTimingSlot *slots;
+    uint64_t mask;
+    _Atomic(uint64_t) enqueuePosition __attribute__((aligned(64)));
+    _Atomic(uint64_t) dequeuePosition __attribute__((aligned(64)));
+    _Atomic(uint64_t) droppedCount;
+} AFURLSessionTaskTimingRing;
+
+static BOOL AFURLSessionTaskTimingRingPush(AFURLSessionTaskTimingRing *ring, const AFURLSessionTaskTimingRecord *record) {
+    uint64_t position = atomic_load_explicit(&ring->enqueuePosition, memory_order_relaxed);
+    for (;;) {
+        AFURLSessionTaskTimingSlot *slot = &ring->slots[position & ring->mask];
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int64_t difference = (int64_t)(sequence - position);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueuePosition, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                slot->record = *record;
+                atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+                return YES;
+            }
+        } else if (difference < 0) {
+            //已满
+            atomic_fetch_add_explicit(&ring->droppedCount, 1, memory_order_relaxed);
+            return NO;
+        } else {
+            position = atomic_load_explicit(&ring->enqueuePosition, memory_order_relaxed);
+        }
+    }
+}
+
+static BOOL AFURLSessionTaskTimingRingPop(AFURLSessionTaskTimingRing *ring, AFURLSessionTaskTimingRecord *record) {
+    uint64_t position = atomic_load_explicit(&ring->dequeuePosition, memory_order_relaxed);
+    for (;;) {
+        AFURLSessionTaskTimingSlot *slot = &ring->slots[position & ring->mask];
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int64_t difference = (int64_t)(sequence - (position + 1));
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeuePosition, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *record = slot->record;
+                atomic_store_explicit(&slot->sequence, position + ring->mask + 1, memory_order_release);
+                return YES;
+            }
+        } else if (difference < 0) {
+            //已空
+            return NO;
+        } else {
+            position = atomic_load_explicit(&ring->dequeuePosition, memory_order_relaxed);
+        }
+    }
+}
+
+static NSUInteger const AFURLSessionTaskTimingRecorderDefaultCapacity = 1024;
+
+@interface AFURLSessionTaskTimingRecorder ()
+@property (readwrite, nonatomic, assign) NSUInteger capacity;
+@property (readwrite, nonatomic, assign) AFURLSessionTaskTimingRing *ring;
+@end
+
+@implementation AFURLSessionTaskTimingRecorder
+
+- (instancetype)init {
+    return [self initWithCapacity:AFURLSessionTaskTimingRecorderDefaultCapacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    NSUInteger roundedCapacity = 2;
+    while (roundedCapacity < capacity) {
+        roundedCapacity <<= 1;
+    }
+    self.capacity = roundedCapacity;
+
+    AFURLSessionTaskTimingRing *ring = calloc(1, sizeof(AFURLSessionTaskTimingRing));
+    ring->slots = calloc(roundedCapacity, sizeof(AFURLSessionTaskTimingSlot));
+    ring->mask = roundedCapacity - 1;
+    for (uint64_t index = 0; index < roundedCapacity; index++) {
+        atomic_init(&ring->slots[index].sequence, index);
+    }
+    atomic_init(&ring->enqueuePosition, 0);
+    atomic_init(&ring->dequeuePosition, 0);
+    atomic_init(&ring->droppedCount, 0);
+    self.ring = ring;
+
+    return self;
+}
+
+- (void)dealloc {
+    free(_ring->slots);
+    free(_ring);
+}
+
+- (NSUInteger)droppedRecordCount {
+    return (NSUInteger)atomic_load_explicit(&self.ring->droppedCount, memory_order_relaxed);
+}
+
+- (BOOL)appendRecord:(const AFURLSessionTaskTimingRecord *)record {
+    NSParameterAssert(record);
+
+    return AFURLSessionTaskTimingRingPush(self.ring, record);
+}
+
+- (NSUInteger)drainRecordsUsingBlock:(void (^)(const AFURLSessionTaskTimingRecord *record))block {
+    NSParameterAssert(block);
+
+    //只取出开始时已有的记录、避免和写入方一直竞争
+    NSUInteger count = 0;
+    AFURLSessionTaskTimingRecord record;
+    while (count < self.capacity && AFURLSessionTaskTimingRingPop(self.ring, &record)) {
+        block(&record);
+        count++;
+    }
+
+    return count;
+}
+
+@end
+
+#pragma mark -
+
+//Chrome trace中的一段、两个时间点都有记录时才输出
+typedef struct {
+    const char *name;
+    AFURLSessionTaskTimingPhase start;
+    AFURLSessionTaskTimingPhase end;
+    BOOL fromMetrics;
+} AFURLSessionTaskTimingSpan;
+
+static const AFURLSessionTaskTimingSpan AFURLSessionTaskTimingSpans[] = {
+    {"request serialization", AFURLSessionTaskTimingPhaseRequestSerializationStart, AFURLSessionTaskTimingPhaseRequestSerializationEnd, NO},
+    {"queued", AFURLSessionTaskTimingPhaseTaskCreation, AFURLSessionTaskTimingPhaseResume, NO},
+    {"waiting", AFURLSessionTaskTimingPhaseResume, AFURLSessionTaskTimingPhaseFirstByte, NO},
+    {"receiving", AFURLSessionTaskTimingPhaseFirstByte, AFURLSessionTaskTimingPhaseLastByte, NO},
+    {"serializer queue wait", AFURLSessionTaskTimingPhaseSerializerEnqueue, AFURLSessionTaskTimingPhaseSerializerStart, NO},
+    {"response serialization", AFURLSessionTaskTimingPhaseSerializerStart, AFURLSessionTaskTimingPhaseSerializerEnd, NO},
+    {"callback dispatch", AFURLSessionTaskTimingPhaseCallbackDispatch, AFURLSessionTaskTimingPhaseCallbackStart, NO},
+    {"callback", AFURLSessionTaskTimingPhaseCallbackStart, AFURLSessionTaskTimingPhaseCallbackEnd, NO},
+    {"dns", AFURLSessionTaskTimingPhaseDomainLookupStart, AFURLSessionTaskTimingPhaseDomainLookupEnd, YES},
+    {"connect", AFURLSessionTaskTimingPhaseConnectStart, AFURLSessionTaskTimingPhaseConnectEnd, YES},
+    {"tls", AFURLSessionTaskTimingPhaseSecureConnectionStart, AFURLSessionTaskTimingPhaseSecureConnectionEnd, YES},
+    {"request", AFURLSessionTaskTimingPhaseRequestStart, AFURLSessionTaskTimingPhaseResponseStart, YES},
+    {"response", AFURLSessionTaskTimingPhaseResponseStart, AFURLSessionTaskTimingPhaseResponseEnd, YES},
+};
+
+//AF内部的阶段和NSURLSessionTaskMetrics的阶段会交叉、分成两个进程显示
+static NSInteger const AFURLSessionTaskTimingTraceProcessIdentifier = 1;
+static NSInteger const AFURLSessionTaskTimingTraceMetricsProcessIdentifier = 2;
+
+@interface AFURLSessionTaskTimingTraceExporter ()
+@property (readwrite, nonatomic, strong) NSMutableArray <NSDictionary *> *traceEvents;
+@property (readwrite, nonatomic, assign) NSUInteger recordCount;
+@end
+
+@implementation AFURLSessionTaskTimingTraceExporter
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    self.traceEvents = [NSMutableArray arrayWithObjects:
+                        @{@"name": @"process_name", @"ph": @"M", @"pid": @(AFURLSessionTaskTimingTraceProcessIdentifier), @"args": @{@"name": @"AFNetworking"}},
+                        @{@"name": @"process_name", @"ph": @"M", @"pid": @(AFURLSessionTaskTimingTraceMetricsProcessIdentifier), @"args": @{@"name": @"NSURLSessionTaskMetrics"}},
+                        nil];
+
+    return self;
+}
+
+- (void)appendRecord:(const AFURLSessionTaskTimingRecord *)record {
+    NSParameterAssert(record);
+
+    const uint64_t *timestamps = record->timestamps;
+    NSString *name = [NSString stringWithUTF8String:record->name] ?: @"";
+    NSNumber *threadIdentifier = @(record->taskIdentifier);
+    NSDictionary *arguments = @{@"task": name, @"status": @(record->statusCode), @"failed": @(record->failed)};
+
+    //整个任务从最早的时间点到最晚的时间点
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+    for (NSUInteger phase = 0; phase < AFURLSessionTaskTimingPhaseCount; phase++) {
+        if (timestamps[phase] == 0) {
+            continue;
+        }
+        start = MIN(start, timestamps[phase]);
+        end = MAX(end, timestamps[phase]);
+    }
+    if (end == 0) {
+        return;
+    }
+
+    for (NSNumber *processIdentifier in @[@(AFURLSessionTaskTimingTraceProcessIdentifier), @(AFURLSessionTaskTimingTraceMetricsProcessIdentifier)]) {
+        [self.traceEvents addObject:@{@"name": @"thread_name", @"ph": @"M", @"pid": processIdentifier, @"tid": threadIdentifier, @"args": @{@"name": name}}];
+    }
+    [self.traceEvents addObject:[self traceEventWithName:name start:start end:end processIdentifier:AFURLSessionTaskTimingTraceProcessIdentifier threadIdentifier:threadIdentifier arguments:arguments]];
+
+    for (NSUInteger index = 0; index < sizeof(AFURLSessionTaskTimingSpans) / sizeof(AFURLSessionTaskTimingSpans[0]); index++) {
+        AFURLSessionTaskTimingSpan span = AFURLSessionTaskTimingSpans[index];
+        uint64_t spanStart = timestamps[span.start];
+        uint64_t spanEnd = timestamps[span.end];
+        if (spanStart == 0 || spanEnd < spanStart) {
+            continue;
+        }
+
+        NSInteger processIdentifier = span.fromMetrics ? AFURLSessionTaskTimingTraceMetricsProcessIdentifier : AFURLSessionTaskTimingTraceProcessIdentifier;
+        [self.traceEvents addObject:[self traceEventWithName:@(span.name) start:spanStart end:spanEnd processIdentifier:processIdentifier threadIdentifier:threadIdentifier arguments:arguments]];
+    }
+
+    self.recordCount++;
+}
+
+- (NSDictionary *)traceEventWithName:(NSString *)name
+                               start:(uint64_t)start
+                                 end:(uint64_t)end
+                   processIdentifier:(NSInteger)processIdentifier
+                    threadIdentifier:(NSNumber *)threadIdentifier
+                           arguments:(NSDictionary *)arguments
+{
+    //Chrome trace的时间单位为微秒
+    return @{@"name": name,
+             @"cat": @"AFNetworking",
+             @"ph": @"X",
+             @"ts": @((double)start / NSEC_PER_USEC),
+             @"dur": @((double)(end - start) / NSEC_PER_USEC),
+             @"pid": @(processIdentifier),
+             @"tid": threadIdentifier,
+             @"args": arguments};
+}
+
+- (NSUInteger)appendRecordsFromRecorder:(AFURLSessionTaskTimingRecorder *)recorder {
+    return [recorder drainRecordsUsingBlock:^(const AFURLSessionTaskTimingRecord *record) {
+        [self appendRecord:record];
+    }];
+}
+
+- (NSData *)traceData {
+    return [NSJSONSerialization dataWithJSONObject:@{@"traceEvents": self.traceEvents, @"displayTimeUnit": @"ms"} options:0 error:nil];
+}
+
+- (BOOL)writeToURL:(NSURL *)URL error:(NSError * __autoreleasing *)error {
+    return [[self traceData] writeToURL:URL options:NSDataWritingAtomic error:error];
+}
+
+@end
@@ -69,6 +69,18 @@ typedef NS_ENUM(NSInteger, AFImageDownloadPrioritization) {
  */
 @property (nonatomic, assign) AFImageDownloadPrioritization downloadPrioritizaton;
 
+/**
+ Whether image data should be decoded incrementally as it arrives, so that handlers registered with a `partialImage` block can display the image before the download finishes. `NO` by default.
+
+ When enabled, every download keeps an incremental image source and a single bitmap buffer which is redrawn for each partial image. The response data is collected once by the decoder instead of by the session manager, and the final, full quality image is produced from it by the session manager's response serializer and delivered to the `success` block.
+ */
+@property (nonatomic, assign, getter=isProgressiveDecodingEnabled) BOOL progressiveDecodingEnabled;
+
+/**
+ The minimum interval, in seconds, between two partial images delivered for the same download. `0.25` by default.
+ */
+@property (nonatomic, assign) NSTimeInterval progressiveDecodingInterval;
+
 /**
  The shared default instance of `AFImageDownloader` initialized with default values.
  */
@@ -141,6 +153,25 @@ typedef NS_ENUM(NSInteger, AFImageDownloadPrioritization) {
                                                         success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
                                                         failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure;
 
+/**
+ Creates a data task using the `sessionManager` instance for the specified URL request, delivering partial images while the image data is being downloaded.
+
+ Partial images are only produced when `progressiveDecodingEnabled` is `YES`. They are delivered on the main queue, at most once per `progressiveDecodingInterval`, and never after the `success` or `failure` block has been scheduled.
+
+ @param request The URL request.
+ @param receiptID The identifier to use for the download receipt that will be created for this request. This must be a unique identifier that does not represent any other request.
+ @param partialImage A block to be executed each time a partial image has been decoded from the data received so far. This block has no return value and takes two arguments: the request sent from the client and the partially decoded image.
+ @param success A block to be executed when the image data task finishes successfully. This block has no return value and takes three arguments: the request sent from the client, the response received from the server, and the image created from the response data of request. If the image was returned from cache, the response parameter will be `nil`.
+ @param failure A block object to be executed when the image data task finishes unsuccessfully, or that finishes successfully. This block has no return value and takes three arguments: the request sent from the client, the response received from the server, and the error object describing the network or parsing error that occurred.
+
+ @return The image download receipt for the data task if available. `nil` if the image is stored in the cache.
+ */
+- (nullable AFImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                 withReceiptID:(NSUUID *)receiptID
+                                                  partialImage:(nullable void (^)(NSURLRequest *request, UIImage *partialImage))partialImage
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure;
+
 /**
  Cancels the data task in the receipt by removing the corresponding success and failure blocks and cancelling the data task if necessary.
 
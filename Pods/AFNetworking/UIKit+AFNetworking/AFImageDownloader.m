@@ -26,10 +26,23 @@
 #import "AFImageDownloader.h"
 #import "AFHTTPSessionManager.h"
 
+#import <ImageIO/ImageIO.h>
+
+@interface AFImageResponseSerializer (AFImageDownloader)
+- (nullable UIImage *)imageForResponse:(NSHTTPURLResponse *)response data:(NSData *)data;
+@end
+
+@interface AFURLSessionManager (AFImageDownloader)
+//合并投递时进入manager使用的主队列投递队列、否则直接提交到主队列
+- (void)deliverMainQueueBlock:(dispatch_block_t)block;
+@end
+
 @interface AFImageDownloaderResponseHandler : NSObject
 @property (nonatomic, strong) NSUUID *uuid;
 @property (nonatomic, copy) void (^successBlock)(NSURLRequest*, NSHTTPURLResponse*, UIImage*);
 @property (nonatomic, copy) void (^failureBlock)(NSURLRequest*, NSHTTPURLResponse*, NSError*);
+@property (nonatomic, copy) void (^partialImageBlock)(NSURLRequest*, UIImage*);
+@property (atomic, assign, getter=isCancelled) BOOL cancelled;
 @end
 
 @implementation AFImageDownloaderResponseHandler
@@ -37,8 +50,16 @@
 - (instancetype)initWithUUID:(NSUUID *)uuid
                      success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, UIImage *responseObject))success
                      failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
+    return [self initWithUUID:uuid partialImage:nil success:success failure:failure];
+}
+
+- (instancetype)initWithUUID:(NSUUID *)uuid
+                partialImage:(nullable void (^)(NSURLRequest *request, UIImage *partialImage))partialImage
+                     success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, UIImage *responseObject))success
+                     failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
     if (self = [self init]) {
         self.uuid = uuid;
+        self.partialImageBlock = partialImage;
         self.successBlock = success;
         self.failureBlock = failure;
     }
@@ -51,11 +72,168 @@
 
 @end
 
+/**
+ Incrementally decodes the image data of a single download. The decoder owns the only copy of the response data, the session manager does not buffer it for the task. All methods except `finished` must be called from the same serial queue.
+ */
+@interface AFImageDownloaderProgressiveDecoder : NSObject
+@property (atomic, assign, getter=isFinished) BOOL finished;
+
+- (instancetype)initWithScale:(CGFloat)scale minimumInterval:(NSTimeInterval)minimumInterval;
+- (void)appendData:(NSData *)data expectedLength:(long long)expectedLength;
+- (BOOL)shouldDecode;
+- (nullable UIImage *)decodePartialImage;
+- (void)stopPartialDecoding;
+- (nullable NSData *)finishDecoding;
+@end
+
+@implementation AFImageDownloaderProgressiveDecoder {
+    CGImageSourceRef _imageSource;
+    CGContextRef _bitmapContext;
+    NSMutableData *_storage;
+    NSUInteger _length;
+    NSUInteger _decodedLength;
+    CGFloat _scale;
+    NSTimeInterval _minimumInterval;
+    CFAbsoluteTime _lastDecodeTime;
+}
+
+- (instancetype)initWithScale:(CGFloat)scale minimumInterval:(NSTimeInterval)minimumInterval {
+    if (self = [self init]) {
+        _imageSource = CGImageSourceCreateIncremental(NULL);
+        _scale = scale;
+        _minimumInterval = minimumInterval;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self releaseDecodingResources];
+}
+
+- (void)releaseDecodingResources {
+    if (_imageSource) {
+        CFRelease(_imageSource);
+        _imageSource = NULL;
+    }
+    CGContextRelease(_bitmapContext);
+    _bitmapContext = NULL;
+}
+
+- (void)appendData:(NSData *)data expectedLength:(long long)expectedLength {
+    if (self.isFinished || data.length == 0) {
+        return;
+    }
+
+    // Bytes below _length are never written again. When the storage is too small a new one is allocated, the old one stays alive as long as a snapshot refers to it.
+    NSUInteger requiredLength = _length + data.length;
+    if (requiredLength > _storage.length) {
+        NSUInteger capacity = MAX(requiredLength, MAX(_storage.length * 2, (NSUInteger)MAX(expectedLength, 0LL)));
+        NSMutableData *storage = [NSMutableData dataWithLength:capacity];
+        if (_length > 0) {
+            memcpy(storage.mutableBytes, _storage.bytes, _length);
+        }
+        _storage = storage;
+    }
+    [data getBytes:(uint8_t *)_storage.mutableBytes + _length length:data.length];
+    _length = requiredLength;
+}
+
+// An immutable view of the bytes received so far. It is not copied and does not change when more data is appended.
+- (NSData *)receivedDataSnapshot {
+    if (_length == 0) {
+        return [NSData data];
+    }
+
+    NSMutableData *storage = _storage;
+    return [[NSData alloc] initWithBytesNoCopy:storage.mutableBytes length:_length deallocator:^(__unused void *bytes, __unused NSUInteger length) {
+        (void)storage;
+    }];
+}
+
+- (BOOL)shouldDecode {
+    return _imageSource && !self.isFinished && _length > _decodedLength && CFAbsoluteTimeGetCurrent() - _lastDecodeTime >= _minimumInterval;
+}
+
+- (void)stopPartialDecoding {
+    // The data is still collected for the final image, only the partial decoding work is torn down
+    [self releaseDecodingResources];
+}
+
+- (NSData *)finishDecoding {
+    self.finished = YES;
+    [self releaseDecodingResources];
+
+    NSData *data = [self receivedDataSnapshot];
+    _storage = nil;
+    _length = 0;
+
+    return data;
+}
+
+- (UIImage *)decodePartialImage {
+    if (!_imageSource || self.isFinished) {
+        return nil;
+    }
+
+    _lastDecodeTime = CFAbsoluteTimeGetCurrent();
+    _decodedLength = _length;
+
+    // ImageIO may keep the data it is given, so it gets a snapshot that later appends never touch.
+    CGImageSourceUpdateData(_imageSource, (__bridge CFDataRef)[self receivedDataSnapshot], false);
+    if (CGImageSourceGetStatus(_imageSource) == kCGImageStatusUnknownType || CGImageSourceGetCount(_imageSource) == 0) {
+        return nil;
+    }
+
+    CGImageRef partialImageRef = CGImageSourceCreateImageAtIndex(_imageSource, 0, NULL);
+    if (!partialImageRef) {
+        return nil;
+    }
+
+    size_t width = CGImageGetWidth(partialImageRef);
+    size_t height = CGImageGetHeight(partialImageRef);
+    if (width == 0 || height == 0) {
+        CGImageRelease(partialImageRef);
+        return nil;
+    }
+
+    // Every partial image is rendered into the same bitmap buffer, it is only recreated if the image dimensions change.
+    if (!_bitmapContext || CGBitmapContextGetWidth(_bitmapContext) != width || CGBitmapContextGetHeight(_bitmapContext) != height) {
+        CGContextRelease(_bitmapContext);
+
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+        _bitmapContext = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGBitmapByteOrder32Host | (CGBitmapInfo)kCGImageAlphaPremultipliedFirst);
+        CGColorSpaceRelease(colorSpace);
+
+        if (!_bitmapContext) {
+            CGImageRelease(partialImageRef);
+            return nil;
+        }
+    }
+
+    CGRect rect = CGRectMake(0.0f, 0.0f, width, height);
+    CGContextClearRect(_bitmapContext, rect);
+    CGContextDrawImage(_bitmapContext, rect, partialImageRef);
+    CGImageRelease(partialImageRef);
+
+    CGImageRef renderedImageRef = CGBitmapContextCreateImage(_bitmapContext);
+    if (!renderedImageRef) {
+        return nil;
+    }
+
+    UIImage *partialImage = [[UIImage alloc] initWithCGImage:renderedImageRef scale:_scale orientation:UIImageOrientationUp];
+    CGImageRelease(renderedImageRef);
+
+    return partialImage;
+}
+
+@end
+
 @interface AFImageDownloaderMergedTask : NSObject
 @property (nonatomic, strong) NSString *URLIdentifier;
 @property (nonatomic, strong) NSUUID *identifier;
 @property (nonatomic, strong) NSURLSessionDataTask *task;
 @property (nonatomic, strong) NSMutableArray <AFImageDownloaderResponseHandler*> *responseHandlers;
+@property (nonatomic, strong) AFImageDownloaderProgressiveDecoder *progressiveDecoder;
 
 @end
 
@@ -97,6 +275,7 @@
 
 @property (nonatomic, strong) dispatch_queue_t synchronizationQueue;
 @property (nonatomic, strong) dispatch_queue_t responseQueue;
+@property (nonatomic, strong) dispatch_queue_t progressiveDecodingQueue;
 
 @property (nonatomic, assign) NSInteger maximumActiveDownloads;
 @property (nonatomic, assign) NSInteger activeRequestCount;
@@ -156,12 +335,16 @@
         self.queuedMergedTasks = [[NSMutableArray alloc] init];
         self.mergedTasks = [[NSMutableDictionary alloc] init];
         self.activeRequestCount = 0;
+        self.progressiveDecodingInterval = 0.25;
 
         NSString *name = [NSString stringWithFormat:@"com.alamofire.imagedownloader.synchronizationqueue-%@", [[NSUUID UUID] UUIDString]];
         self.synchronizationQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
 
         name = [NSString stringWithFormat:@"com.alamofire.imagedownloader.responsequeue-%@", [[NSUUID UUID] UUIDString]];
         self.responseQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_CONCURRENT);
+
+        name = [NSString stringWithFormat:@"com.alamofire.imagedownloader.progressivedecodingqueue-%@", [[NSUUID UUID] UUIDString]];
+        self.progressiveDecodingQueue = dispatch_queue_create([name cStringUsingEncoding:NSASCIIStringEncoding], DISPATCH_QUEUE_SERIAL);
     }
 
     return self;
@@ -186,15 +369,23 @@
                                                   withReceiptID:(nonnull NSUUID *)receiptID
                                                         success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
                                                         failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
+    return [self downloadImageForURLRequest:request withReceiptID:receiptID partialImage:nil success:success failure:failure];
+}
+
+- (nullable AFImageDownloadReceipt *)downloadImageForURLRequest:(NSURLRequest *)request
+                                                  withReceiptID:(nonnull NSUUID *)receiptID
+                                                   partialImage:(nullable void (^)(NSURLRequest *request, UIImage *partialImage))partialImage
+                                                        success:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse  * _Nullable response, UIImage *responseObject))success
+                                                        failure:(nullable void (^)(NSURLRequest *request, NSHTTPURLResponse * _Nullable response, NSError *error))failure {
     __block NSURLSessionDataTask *task = nil;
     dispatch_sync(self.synchronizationQueue, ^{
         NSString *URLIdentifier = request.URL.absoluteString;
         if (URLIdentifier == nil) {
             if (failure) {
                 NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadURL userInfo:nil];
-                dispatch_async(dispatch_get_main_queue(), ^{
+                [self deliverToMainQueue:^{
                     failure(request, nil, error);
-                });
+                }];
             }
             return;
         }
@@ -202,7 +393,7 @@
         // 1) Append the success and failure blocks to a pre-existing request if it already exists
         AFImageDownloaderMergedTask *existingMergedTask = self.mergedTasks[URLIdentifier];
         if (existingMergedTask != nil) {
-            AFImageDownloaderResponseHandler *handler = [[AFImageDownloaderResponseHandler alloc] initWithUUID:receiptID success:success failure:failure];
+            AFImageDownloaderResponseHandler *handler = [[AFImageDownloaderResponseHandler alloc] initWithUUID:receiptID partialImage:partialImage success:success failure:failure];
             [existingMergedTask addResponseHandler:handler];
             task = existingMergedTask.task;
             return;
@@ -216,9 +407,9 @@
                 UIImage *cachedImage = [self.imageCache imageforRequest:request withAdditionalIdentifier:nil];
                 if (cachedImage != nil) {
                     if (success) {
-                        dispatch_async(dispatch_get_main_queue(), ^{
+                        [self deliverToMainQueue:^{
                             success(request, nil, cachedImage);
-                        });
+                        }];
                     }
                     return;
                 }
@@ -241,22 +432,36 @@
                                AFImageDownloaderMergedTask *mergedTask = self.mergedTasks[URLIdentifier];
                                if ([mergedTask.identifier isEqual:mergedTaskIdentifier]) {
                                    mergedTask = [strongSelf safelyRemoveMergedTaskWithURLIdentifier:URLIdentifier];
-                                   if (error) {
+                                   // No partial image may be delivered once the final result has been scheduled.
+                                   // The decoder holds the only copy of the data, so the final image is decoded from it here.
+                                   id finalResponseObject = responseObject;
+                                   NSError *finalError = error;
+                                   AFImageDownloaderProgressiveDecoder *decoder = mergedTask.progressiveDecoder;
+                                   if (decoder) {
+                                       __block NSData *imageData = nil;
+                                       dispatch_sync(strongSelf.progressiveDecodingQueue, ^{
+                                           imageData = [decoder finishDecoding];
+                                       });
+                                       if (!finalError) {
+                                           finalResponseObject = [strongSelf finalImageForResponse:response data:imageData error:&finalError];
+                                       }
+                                   }
+                                   if (finalError) {
                                        for (AFImageDownloaderResponseHandler *handler in mergedTask.responseHandlers) {
                                            if (handler.failureBlock) {
-                                               dispatch_async(dispatch_get_main_queue(), ^{
-                                                   handler.failureBlock(request, (NSHTTPURLResponse*)response, error);
-                                               });
+                                               [self deliverToMainQueue:^{
+                                                   handler.failureBlock(request, (NSHTTPURLResponse*)response, finalError);
+                                               }];
                                            }
                                        }
                                    } else {
-                                       [strongSelf.imageCache addImage:responseObject forRequest:request withAdditionalIdentifier:nil];
+                                       [strongSelf.imageCache addImage:finalResponseObject forRequest:request withAdditionalIdentifier:nil];
 
                                        for (AFImageDownloaderResponseHandler *handler in mergedTask.responseHandlers) {
                                            if (handler.successBlock) {
-                                               dispatch_async(dispatch_get_main_queue(), ^{
-                                                   handler.successBlock(request, (NSHTTPURLResponse*)response, responseObject);
-                                               });
+                                               [self deliverToMainQueue:^{
+                                                   handler.successBlock(request, (NSHTTPURLResponse*)response, finalResponseObject);
+                                               }];
                                            }
                                        }
                                        
@@ -269,6 +474,7 @@
 
         // 4) Store the response handler for use when the request completes
         AFImageDownloaderResponseHandler *handler = [[AFImageDownloaderResponseHandler alloc] initWithUUID:receiptID
+                                                                                              partialImage:partialImage
                                                                                                    success:success
                                                                                                    failure:failure];
         AFImageDownloaderMergedTask *mergedTask = [[AFImageDownloaderMergedTask alloc]
@@ -278,6 +484,11 @@
         [mergedTask addResponseHandler:handler];
         self.mergedTasks[URLIdentifier] = mergedTask;
 
+        // 4.1) Feed every chunk of the response into an incremental decoder if progressive decoding is enabled
+        if (self.isProgressiveDecodingEnabled) {
+            [self setupProgressiveDecodingForMergedTask:mergedTask request:request];
+        }
+
         // 5) Either start the request or enqueue it depending on the current active request count
         if ([self isActiveRequestCountBelowMaximumLimit]) {
             [self startMergedTask:mergedTask];
@@ -294,6 +505,78 @@
     }
 }
 
+- (CGFloat)progressiveDecodingImageScale {
+    id <AFURLResponseSerialization> responseSerializer = self.sessionManager.responseSerializer;
+    if ([responseSerializer isKindOfClass:[AFImageResponseSerializer class]]) {
+        return [(AFImageResponseSerializer *)responseSerializer imageScale];
+    }
+
+    return [[UIScreen mainScreen] scale];
+}
+
+//This method should only be called from safely within the synchronizationQueue
+- (void)setupProgressiveDecodingForMergedTask:(AFImageDownloaderMergedTask *)mergedTask request:(NSURLRequest *)request {
+    AFImageDownloaderProgressiveDecoder *decoder = [[AFImageDownloaderProgressiveDecoder alloc] initWithScale:[self progressiveDecodingImageScale]
+                                                                                               minimumInterval:self.progressiveDecodingInterval];
+    mergedTask.progressiveDecoder = decoder;
+    // The decoder collects the data itself, buffering it in the session manager as well would double the memory of every download
+    [self.sessionManager setDataTaskBuffersResponseData:NO forTask:mergedTask.task];
+
+    __weak __typeof__(self) weakSelf = self;
+    __weak __typeof__(mergedTask) weakMergedTask = mergedTask;
+    [self.sessionManager setDataTaskDidReceiveDataBlock:^(NSURLSession * _Nonnull __unused session, NSURLSessionDataTask * _Nonnull dataTask, NSData * _Nonnull data) {
+        __strong __typeof__(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf || decoder.isFinished) {
+            return;
+        }
+
+        long long expectedLength = dataTask.response.expectedContentLength;
+        dispatch_async(strongSelf.progressiveDecodingQueue, ^{
+            [decoder appendData:data expectedLength:expectedLength];
+            if (![decoder shouldDecode]) {
+                return;
+            }
+
+            __block NSArray <AFImageDownloaderResponseHandler *> *handlers = nil;
+            dispatch_sync(strongSelf.synchronizationQueue, ^{
+                handlers = [weakMergedTask.responseHandlers filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(AFImageDownloaderResponseHandler * _Nullable handler, __unused NSDictionary<NSString *,id> * _Nullable bindings) {
+                    return handler.partialImageBlock != nil;
+                }]];
+            });
+            if (handlers.count == 0) {
+                return;
+            }
+
+            UIImage *image = [decoder decodePartialImage];
+            if (!image) {
+                return;
+            }
+
+            [strongSelf deliverToMainQueue:^{
+                if (decoder.isFinished) {
+                    return;
+                }
+                for (AFImageDownloaderResponseHandler *handler in handlers) {
+                    if (!handler.isCancelled) {
+                        handler.partialImageBlock(request, image);
+                    }
+                }
+            }];
+        });
+    } forTask:mergedTask.task];
+}
+
+// The session manager has already run its serializer on the response, without data because the decoder kept it.
+// Its validation stands, an AFImageResponseSerializer only has to decode the image. Other serializers get the data in a second pass.
+- (id)finalImageForResponse:(NSURLResponse *)response data:(NSData *)data error:(NSError * __autoreleasing *)error {
+    id <AFURLResponseSerialization> responseSerializer = self.sessionManager.responseSerializer;
+    if ([responseSerializer isKindOfClass:[AFImageResponseSerializer class]]) {
+        return [(AFImageResponseSerializer *)responseSerializer imageForResponse:(NSHTTPURLResponse *)response data:data];
+    }
+
+    return [responseSerializer responseObjectForResponse:response data:data error:error];
+}
+
 - (void)cancelTaskForImageDownloadReceipt:(AFImageDownloadReceipt *)imageDownloadReceipt {
     dispatch_sync(self.synchronizationQueue, ^{
         NSString *URLIdentifier = imageDownloadReceipt.task.originalRequest.URL.absoluteString;
@@ -304,13 +587,25 @@
 
         if (index != NSNotFound) {
             AFImageDownloaderResponseHandler *handler = mergedTask.responseHandlers[index];
+            // Partial images that were already scheduled for this handler must not be delivered after the cancellation
+            handler.cancelled = YES;
             [mergedTask removeResponseHandler:handler];
             NSString *failureReason = [NSString stringWithFormat:@"ImageDownloader cancelled URL request: %@",imageDownloadReceipt.task.originalRequest.URL.absoluteString];
             NSDictionary *userInfo = @{NSLocalizedFailureReasonErrorKey:failureReason};
             NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:userInfo];
             if (handler.failureBlock) {
-                dispatch_async(dispatch_get_main_queue(), ^{
+                [self deliverToMainQueue:^{
                     handler.failureBlock(imageDownloadReceipt.task.originalRequest, nil, error);
+                }];
+            }
+        }
+
+        if (mergedTask.responseHandlers.count == 0) {
+            // Nobody is left to receive partial images, stop decoding them
+            AFImageDownloaderProgressiveDecoder *decoder = mergedTask.progressiveDecoder;
+            if (decoder) {
+                dispatch_async(self.progressiveDecodingQueue, ^{
+                    [decoder stopPartialDecoding];
                 });
             }
         }
@@ -337,6 +632,11 @@
     return mergedTask;
 }
 
+//回调到主队列、sessionManager合并投递时和它的完成回调共用同一个排空
+- (void)deliverToMainQueue:(dispatch_block_t)block {
+    [self.sessionManager deliverMainQueueBlock:block];
+}
+
 - (void)safelyDecrementActiveTaskCount {
     dispatch_sync(self.synchronizationQueue, ^{
         if (self.activeRequestCount > 0) {